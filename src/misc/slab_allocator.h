@@ -0,0 +1,125 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Slab allocator for objects of a single type. Objects are carved out of
+// large slabs instead of being allocated individually on the heap, and the
+// slots of deleted objects are reused by later allocations. Objects never
+// move, so pointers to them remain valid until they are deleted.
+
+#ifndef FIRMAMENT_MISC_SLAB_ALLOCATOR_H
+#define FIRMAMENT_MISC_SLAB_ALLOCATOR_H
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+
+namespace firmament {
+
+template <typename T>
+class SlabAllocator {
+ public:
+  explicit SlabAllocator(size_t objects_per_slab = 4096)
+    : objects_per_slab_(objects_per_slab), free_list_(NULL),
+      next_unused_slot_(objects_per_slab), num_allocated_(0) {
+    CHECK_GT(objects_per_slab_, 0);
+  }
+
+  /**
+   * Releases the slabs. Objects that are still allocated are not destroyed;
+   * their owner must Delete() them first if their destructors have to run.
+   */
+  ~SlabAllocator() {
+    for (auto& slab : slabs_) {
+      delete[] slab;
+    }
+  }
+
+  /**
+   * Returns uninitialized storage for one object, e.g. for a class-specific
+   * operator new. The storage must be released with Deallocate().
+   */
+  void* Allocate() {
+    Slot* slot;
+    if (free_list_ != NULL) {
+      slot = free_list_;
+      free_list_ = slot->next_free_;
+    } else {
+      if (next_unused_slot_ == objects_per_slab_) {
+        slabs_.push_back(new Slot[objects_per_slab_]);
+        next_unused_slot_ = 0;
+      }
+      slot = &slabs_.back()[next_unused_slot_++];
+    }
+    num_allocated_++;
+    return &slot->storage_;
+  }
+
+  /**
+   * Makes the storage returned by Allocate() available for reuse. The object
+   * in it must already have been destroyed.
+   */
+  void Deallocate(void* storage) {
+    Slot* slot = reinterpret_cast<Slot*>(storage);
+    slot->next_free_ = free_list_;
+    free_list_ = slot;
+    num_allocated_--;
+  }
+
+  /**
+   * Constructs a new object with the given constructor arguments.
+   */
+  template <typename... Args>
+  T* New(Args&&... args) {
+    return new (Allocate()) T(std::forward<Args>(args)...);
+  }
+
+  /**
+   * Destroys the object and makes its slot available for reuse.
+   */
+  void Delete(T* object) {
+    object->~T();
+    Deallocate(object);
+  }
+
+  size_t NumAllocated() const {
+    return num_allocated_;
+  }
+
+ private:
+  union Slot {
+    Slot* next_free_;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_;
+  };
+
+  const size_t objects_per_slab_;
+  vector<Slot*> slabs_;
+  // Slots of deleted objects.
+  Slot* free_list_;
+  // Index of the next never-used slot in the last slab.
+  size_t next_unused_slot_;
+  size_t num_allocated_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_MISC_SLAB_ALLOCATOR_H
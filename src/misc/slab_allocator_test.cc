@@ -0,0 +1,105 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Slab allocator unit tests.
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "misc/slab_allocator.h"
+
+namespace firmament {
+
+// The fixture for testing class SlabAllocator.
+class SlabAllocatorTest : public ::testing::Test {
+ protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  SlabAllocatorTest() {
+    // You can do set-up work for each test here.
+  }
+
+  virtual ~SlabAllocatorTest() {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  virtual void SetUp() {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+  }
+
+  virtual void TearDown() {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Objects declared here can be used by all tests in the test case for
+  // SlabAllocator.
+};
+
+struct TestObject {
+  TestObject(uint64_t id, const string& name) : id_(id), name_(name) {}
+  uint64_t id_;
+  string name_;
+};
+
+// Allocates objects across several slabs, deletes some of them and checks
+// that their slots are reused and that the other objects are intact.
+TEST_F(SlabAllocatorTest, AllocateAndReuse) {
+  SlabAllocator<TestObject> allocator(4);
+  vector<TestObject*> objects;
+  for (uint64_t i = 0; i < 10; ++i) {
+    objects.push_back(allocator.New(i, to_string(i)));
+  }
+  EXPECT_EQ(allocator.NumAllocated(), 10);
+  set<TestObject*> deleted;
+  for (uint64_t i = 0; i < 10; i += 3) {
+    deleted.insert(objects[i]);
+    allocator.Delete(objects[i]);
+  }
+  EXPECT_EQ(allocator.NumAllocated(), 6);
+  for (uint64_t i = 0; i < 10; ++i) {
+    if (i % 3 != 0) {
+      EXPECT_EQ(objects[i]->id_, i);
+      EXPECT_EQ(objects[i]->name_, to_string(i));
+    }
+  }
+  for (uint64_t i = 0; i < deleted.size(); ++i) {
+    TestObject* object = allocator.New(100 + i, "reused");
+    EXPECT_EQ(deleted.count(object), 1);
+    EXPECT_EQ(object->id_, 100 + i);
+  }
+  EXPECT_EQ(allocator.NumAllocated(), 10);
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
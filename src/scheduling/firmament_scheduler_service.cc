@@ -744,6 +744,8 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
   Status NodeUpdated(ServerContext* context,
                      const ResourceTopologyNodeDescriptor* updated_rtnd_ptr,
                      NodeUpdatedResponse* reply) override {
+    boost::lock_guard<boost::recursive_mutex> lock(
+        scheduler_->scheduling_lock_);
     ResourceID_t res_id =
         ResourceIDFromString(updated_rtnd_ptr->resource_desc().uuid());
     ResourceStatus* rs_ptr = FindPtrOrNull(*resource_map_, res_id);
@@ -759,6 +761,10 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
         rs_ptr->mutable_topology_node(), *updated_rtnd_ptr,
         boost::bind(&FirmamentSchedulerServiceImpl::UpdateNodeTaints, this, _1,
                     _2));
+    DFSTraverseResourceProtobufTreeReturnRTND(
+        rs_ptr->mutable_topology_node(),
+        boost::bind(&FirmamentSchedulerServiceImpl::UpdateLabelIndex, this,
+                    _1));
     // TODO(ionel): Support other types of node updates.
     reply->set_type(NodeReplyType::NODE_UPDATED_OK);
     return Status::OK;
@@ -775,6 +781,19 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
     }
   }
 
+  // Re-indexes the labels and taints of a machine that has been updated, and
+  // moves its pods to the topology domains of its new labels.
+  void UpdateLabelIndex(ResourceTopologyNodeDescriptor* rtnd_ptr) {
+    ResourceID_t res_id =
+        ResourceIDFromString(rtnd_ptr->resource_desc().uuid());
+    LabelIndex* label_index = knowledge_base_->mutable_label_index();
+    if (label_index->HasMachine(res_id)) {
+      label_index->AddOrUpdateMachine(res_id, rtnd_ptr->resource_desc());
+      knowledge_base_->mutable_topology_domain_counts()->AddOrUpdateMachine(
+          res_id, rtnd_ptr->resource_desc());
+    }
+  }
+
   void UpdateNodeTaints(ResourceTopologyNodeDescriptor* old_rtnd_ptr,
                         const ResourceTopologyNodeDescriptor& new_rtnd_ptr) {
     ResourceDescriptor* old_rd_ptr = old_rtnd_ptr->mutable_resource_desc();
@@ -172,16 +172,25 @@ class CostModelInterface {
   virtual void RemoveTaskFromTaskSymmetryMap(TaskDescriptor* td_ptr) {}
 
   /**
-   * Update namespaces entry in resource namespaces map.
+   * Counts a task placed on a resource in the topology domains of the
+   * resource, or stops counting it if add is false.
    */
-  virtual void UpdateResourceToNamespacesMap(ResourceID_t res_id,
-                                             string task_namespace, bool add) {}
+  virtual void UpdateTopologyDomainCounts(ResourceID_t res_id,
+                                          const TaskDescriptor& td,
+                                          bool add) {}
 
   /**
    * Removes EC from EC to pod symmetry map.
    */
   virtual void RemoveECFromPodSymmetryMap(EquivClass_t ec) {}
 
+  /**
+   * Called by the flow_graph when the node of an equivalence class is removed.
+   * Cost models can drop the state they keep for the equivalence class here.
+   * @param ec the equivalence class whose node has been removed
+   */
+  virtual void RemoveEquivClass(EquivClass_t ec) {}
+
   /**
    * Get equivalence classes to which the outgoing arcs of an equivalence class
    * are pointing to.
@@ -268,6 +277,26 @@ class CostModelInterface {
   virtual void GetUnscheduledTasks(vector<uint64_t>* unscheduled_tasks_ptr) {
   }
 
+  /**
+   * Returns true if TaskToEquivClassAggregator, EquivClassToResourceNode and
+   * EquivClassToEquivClass only read the cost model's state, and hence may
+   * be called concurrently from several threads while the flow graph is
+   * updated.
+   */
+  virtual bool IsThreadSafe() const {
+    return false;
+  }
+
+  /**
+   * Returns true if the costs of the arcs from tasks and equivalence classes
+   * to equivalence classes and resources only change when one of the arc's
+   * nodes is updated, and hence may be cached across scheduling rounds
+   * (see --cache_equiv_class_arc_costs).
+   */
+  virtual bool SupportsArcCostCache() const {
+    return false;
+  }
+
  protected:
   shared_ptr<FlowGraphManager> flow_graph_manager_;
 };
@@ -0,0 +1,579 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Implementation of Goldberg's cost scaling push-relabel min-cost flow
+// algorithm on top of the in-memory FlowGraph.
+
+#include "scheduling/flow/cost_scaling_solver.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "misc/map-util.h"
+#include "scheduling/flow/dimacs_add_node.h"
+#include "scheduling/flow/dimacs_change_arc.h"
+#include "scheduling/flow/dimacs_new_arc.h"
+#include "scheduling/flow/dimacs_remove_node.h"
+
+DEFINE_int64(inproc_solver_alpha_factor, 9, "Factor by which the in-process "
+             "solver divides epsilon in every cost scaling iteration.");
+DEFINE_int64(inproc_solver_warm_start_max_relabels, 4, "Maximum number of "
+             "relabels per node after which the warm-started in-process "
+             "solver gives up and solves from scratch.");
+
+namespace firmament {
+
+// Potentials only ever decrease. The warm-started solver starts from scratch
+// before they get close to overflowing.
+const int64_t kMinPotential = -(1LL << 61);
+// Number of nodes discharged between two checks of the deadline.
+const uint64_t kDeadlineCheckInterval = 1024;
+
+CostScalingSolver::CostScalingSolver()
+  : num_nodes_(0), solved_once_(false), cost_scaling_factor_(1), epsilon_(1),
+    refine_phase_(0), max_potential_drop_(0), num_relabels_(0),
+    max_relabels_(0), deadline_(0), deadline_reached_(false),
+    optimal_(false) {
+}
+
+CostScalingSolver::~CostScalingSolver() {
+}
+
+void CostScalingSolver::AddArcPair(const FlowGraphArc& arc) {
+  CHECK_LE(arc.cap_lower_bound_, arc.cap_upper_bound_);
+  uint64_t arc_index;
+  if (free_arcs_.empty()) {
+    arc_index = arcs_.size();
+    arcs_.resize(arc_index + 2);
+    arc_lower_bounds_.push_back(0);
+  } else {
+    arc_index = free_arcs_.back();
+    free_arcs_.pop_back();
+  }
+  ResidualArc& forward_arc = arcs_[arc_index];
+  ResidualArc& reverse_arc = arcs_[arc_index + 1];
+  forward_arc.dst_ = arc.dst_;
+  forward_arc.residual_cap_ =
+    static_cast<int64_t>(arc.cap_upper_bound_ - arc.cap_lower_bound_);
+  forward_arc.cost_ = arc.cost_ * cost_scaling_factor_;
+  forward_arc.position_ = nodes_[arc.src_].arcs_.size();
+  nodes_[arc.src_].arcs_.push_back(arc_index);
+  reverse_arc.dst_ = arc.src_;
+  reverse_arc.residual_cap_ = 0;
+  reverse_arc.cost_ = -forward_arc.cost_;
+  reverse_arc.position_ = nodes_[arc.dst_].arcs_.size();
+  nodes_[arc.dst_].arcs_.push_back(arc_index + 1);
+  arc_lower_bounds_[arc_index / 2] = arc.cap_lower_bound_;
+  CHECK(InsertIfNotPresent(&arc_indices_, make_pair(arc.src_, arc.dst_),
+                           arc_index));
+  // The lower bound flow is always sent.
+  int64_t lower_bound = static_cast<int64_t>(arc.cap_lower_bound_);
+  AddExcess(arc.src_, -lower_bound);
+  AddExcess(arc.dst_, lower_bound);
+  Touch(arc.src_);
+  Touch(arc.dst_);
+}
+
+void CostScalingSolver::AddExcess(uint64_t node_id, int64_t excess) {
+  ResidualNode& node = nodes_[node_id];
+  bool active = node.excess_ > 0;
+  node.excess_ += excess;
+  if (!active && node.excess_ > 0) {
+    active_nodes_.push(node_id);
+  }
+}
+
+void CostScalingSolver::AddNode(const FlowGraphNode& node) {
+  if (IsAlive(node.id_)) {
+    RemoveNode(node.id_);
+  }
+  if (node.id_ >= nodes_.size()) {
+    nodes_.resize(node.id_ + 1);
+  }
+  ResidualNode& residual_node = nodes_[node.id_];
+  residual_node.alive_ = true;
+  residual_node.supply_ = node.excess_;
+  residual_node.potential_ = 0;
+  num_nodes_++;
+  AddExcess(node.id_, node.excess_);
+  Touch(node.id_);
+}
+
+void CostScalingSolver::ApplyArcChange(const FlowGraph& graph, uint64_t src,
+                                       uint64_t dst) {
+  if (!IsAlive(src) || !IsAlive(dst)) {
+    // The arc is added once the missing node is added.
+    return;
+  }
+  FlowGraphArc* arc = NULL;
+  FlowGraphNode* src_node = graph.FindNode(src);
+  if (src_node != NULL) {
+    arc = FindPtrOrNull(src_node->outgoing_arc_map_, dst);
+  }
+  uint64_t* arc_index = FindOrNull(arc_indices_, make_pair(src, dst));
+  if (arc == NULL) {
+    if (arc_index != NULL) {
+      RemoveArcPair(*arc_index);
+    }
+  } else if (arc_index == NULL) {
+    AddArcPair(*arc);
+  } else {
+    UpdateArcPair(*arc_index, *arc);
+  }
+}
+
+void CostScalingSolver::ApplyChange(const FlowGraph& graph,
+                                    DIMACSChange* change) {
+  // We only use the changes to find the nodes and arcs that changed. Their
+  // current state is read from the graph.
+  switch (change->kind()) {
+    case DIMACSChange::CHANGE_ARC: {
+      DIMACSChangeArc* chg_arc = static_cast<DIMACSChangeArc*>(change);
+      ApplyArcChange(graph, chg_arc->src_, chg_arc->dst_);
+      break;
+    }
+    case DIMACSChange::NEW_ARC: {
+      DIMACSNewArc* new_arc = static_cast<DIMACSNewArc*>(change);
+      ApplyArcChange(graph, new_arc->src_, new_arc->dst_);
+      break;
+    }
+    case DIMACSChange::ADD_NODE: {
+      DIMACSAddNode* add_node = static_cast<DIMACSAddNode*>(change);
+      FlowGraphNode* node = graph.FindNode(add_node->id_);
+      if (node == NULL) {
+        // The node has already been removed again.
+        return;
+      }
+      AddNode(*node);
+      new_nodes_.push_back(node->id_);
+      for (auto& dst_arc : node->outgoing_arc_map_) {
+        ApplyArcChange(graph, node->id_, dst_arc.first);
+      }
+      for (auto& src_arc : node->incoming_arc_map_) {
+        ApplyArcChange(graph, src_arc.first, node->id_);
+      }
+      break;
+    }
+    case DIMACSChange::REMOVE_NODE: {
+      DIMACSRemoveNode* remove_node = static_cast<DIMACSRemoveNode*>(change);
+      if (IsAlive(remove_node->node_id_)) {
+        RemoveNode(remove_node->node_id_);
+      }
+      break;
+    }
+    default:
+      LOG(FATAL) << "Unexpected graph change: " << change->GenerateChange();
+  }
+}
+
+void CostScalingSolver::ClearTouchedNodes() {
+  for (auto& node_id : touched_nodes_) {
+    nodes_[node_id].touched_ = false;
+  }
+  touched_nodes_.clear();
+  new_nodes_.clear();
+}
+
+void CostScalingSolver::DetachArc(uint64_t node_id, uint64_t arc_index) {
+  vector<uint64_t>& node_arcs = nodes_[node_id].arcs_;
+  uint64_t position = arcs_[arc_index].position_;
+  node_arcs[position] = node_arcs.back();
+  arcs_[node_arcs[position]].position_ = position;
+  node_arcs.pop_back();
+}
+
+void CostScalingSolver::Discharge(uint64_t node_id) {
+  ResidualNode& node = nodes_[node_id];
+  while (node.excess_ > 0) {
+    if (node.current_arc_ == node.arcs_.size()) {
+      if (!Relabel(node_id)) {
+        return;
+      }
+      node.current_arc_ = 0;
+      continue;
+    }
+    uint64_t arc_index = node.arcs_[node.current_arc_];
+    const ResidualArc& arc = arcs_[arc_index];
+    if (arc.residual_cap_ > 0 && ReducedCost(node_id, arc) < 0) {
+      Push(arc_index, min(node.excess_, arc.residual_cap_));
+      if (arc.residual_cap_ == 0) {
+        node.current_arc_++;
+      }
+    } else {
+      node.current_arc_++;
+    }
+  }
+}
+
+void CostScalingSolver::EnsureCostScalingFactor() {
+  int64_t growth = 1;
+  while (cost_scaling_factor_ <= static_cast<int64_t>(num_nodes_)) {
+    cost_scaling_factor_ *= 2;
+    growth *= 2;
+  }
+  if (growth > 1) {
+    // Scaling the costs and the potentials by the same factor keeps the
+    // flow growth-optimal for the new costs. All the arcs must be revisited.
+    for (auto& arc : arcs_) {
+      arc.cost_ *= growth;
+    }
+    for (uint64_t node_id = 0; node_id < nodes_.size(); ++node_id) {
+      if (nodes_[node_id].alive_) {
+        nodes_[node_id].potential_ *= growth;
+        Touch(node_id);
+      }
+    }
+  }
+}
+
+void CostScalingSolver::ExtractFlow(ExtractedFlow* extracted_flow,
+                                    uint64_t num_node_ids) const {
+  CHECK_NOTNULL(extracted_flow);
+  extracted_flow->Reset(num_node_ids);
+  for (uint64_t arc_index = 0; arc_index < arcs_.size(); arc_index += 2) {
+    // The residual capacity of the reverse arc is the flow sent on top of the
+    // lower bound. Removed arcs do not carry flow.
+    uint64_t flow = arc_lower_bounds_[arc_index / 2] +
+      static_cast<uint64_t>(arcs_[arc_index + 1].residual_cap_);
+    if (flow > 0) {
+      uint64_t src = arcs_[arc_index + 1].dst_;
+      uint64_t dst = arcs_[arc_index].dst_;
+      extracted_flow->AddArcFlow(src, dst, flow);
+    }
+  }
+  CHECK(extracted_flow->Finalize());
+}
+
+void CostScalingSolver::Push(uint64_t arc_index, int64_t flow) {
+  ResidualArc& arc = arcs_[arc_index];
+  ResidualArc& reverse_arc = arcs_[arc_index ^ 1];
+  arc.residual_cap_ -= flow;
+  reverse_arc.residual_cap_ += flow;
+  AddExcess(reverse_arc.dst_, -flow);
+  AddExcess(arc.dst_, flow);
+}
+
+bool CostScalingSolver::Refine(bool scan_all_nodes) {
+  refine_phase_++;
+  if (scan_all_nodes) {
+    // In a phase a node's potential decreases by at most O(n * epsilon)
+    // unless the problem is infeasible. The bound does not hold for warm
+    // starts, which instead limit the number of relabels.
+    max_potential_drop_ = 2 * (FLAGS_inproc_solver_alpha_factor + 2) *
+      static_cast<int64_t>(num_nodes_ + 1) * epsilon_;
+  } else {
+    max_potential_drop_ = numeric_limits<int64_t>::max();
+  }
+  // Saturate the arcs that are not epsilon-optimal. When warm-starting, only
+  // the arcs of the touched nodes can violate epsilon-optimality.
+  if (scan_all_nodes) {
+    for (uint64_t node_id = 0; node_id < nodes_.size(); ++node_id) {
+      SaturateViolatingArcs(node_id);
+    }
+  } else {
+    for (uint64_t index = 0; index < touched_nodes_.size(); ++index) {
+      SaturateViolatingArcs(touched_nodes_[index]);
+    }
+  }
+  // Restore feasibility by discharging the nodes that have excess.
+  uint64_t num_discharges = 0;
+  while (!active_nodes_.empty()) {
+    if (deadline_ > 0 && ++num_discharges % kDeadlineCheckInterval == 0 &&
+        wall_time_.GetCurrentTimestamp() >= deadline_) {
+      // The flow is not feasible until the phase completes, so there is no
+      // result to fall back to.
+      LOG(WARNING) << "In-process solver reached its deadline in a refine "
+                   << "phase with epsilon " << epsilon_;
+      deadline_reached_ = true;
+      active_nodes_ = queue<uint64_t>();
+      return false;
+    }
+    uint64_t node_id = active_nodes_.front();
+    active_nodes_.pop();
+    Discharge(node_id);
+    if (nodes_[node_id].excess_ > 0) {
+      // The node could not be relabeled.
+      active_nodes_ = queue<uint64_t>();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CostScalingSolver::Relabel(uint64_t node_id) {
+  ResidualNode& node = nodes_[node_id];
+  int64_t max_potential = numeric_limits<int64_t>::min();
+  for (auto& arc_index : node.arcs_) {
+    const ResidualArc& arc = arcs_[arc_index];
+    if (arc.residual_cap_ > 0) {
+      max_potential =
+        max(max_potential, nodes_[arc.dst_].potential_ - arc.cost_);
+    }
+  }
+  if (max_potential == numeric_limits<int64_t>::min()) {
+    LOG(ERROR) << "Node " << node_id << " has excess, but no residual arcs";
+    return false;
+  }
+  if (max_relabels_ > 0 && ++num_relabels_ > max_relabels_) {
+    VLOG(1) << "Warm start exceeded " << max_relabels_ << " relabels";
+    return false;
+  }
+  if (node.relabel_phase_ != refine_phase_) {
+    node.relabel_phase_ = refine_phase_;
+    node.phase_start_potential_ = node.potential_;
+  }
+  node.potential_ = max_potential - epsilon_;
+  Touch(node_id);
+  if (node.phase_start_potential_ - node.potential_ > max_potential_drop_ ||
+      node.potential_ < kMinPotential) {
+    VLOG(1) << "Potential of node " << node_id << " dropped to "
+            << node.potential_ << " in a single refine phase";
+    return false;
+  }
+  return true;
+}
+
+void CostScalingSolver::RemoveArcPair(uint64_t arc_index) {
+  ResidualArc& forward_arc = arcs_[arc_index];
+  ResidualArc& reverse_arc = arcs_[arc_index + 1];
+  uint64_t src = reverse_arc.dst_;
+  uint64_t dst = forward_arc.dst_;
+  // Return the arc's flow to its endpoints.
+  int64_t flow = static_cast<int64_t>(arc_lower_bounds_[arc_index / 2]) +
+    reverse_arc.residual_cap_;
+  AddExcess(src, flow);
+  AddExcess(dst, -flow);
+  DetachArc(src, arc_index);
+  DetachArc(dst, arc_index + 1);
+  arc_indices_.erase(make_pair(src, dst));
+  forward_arc.residual_cap_ = 0;
+  reverse_arc.residual_cap_ = 0;
+  arc_lower_bounds_[arc_index / 2] = 0;
+  free_arcs_.push_back(arc_index);
+  Touch(src);
+  Touch(dst);
+}
+
+void CostScalingSolver::RemoveNode(uint64_t node_id) {
+  ResidualNode& node = nodes_[node_id];
+  while (!node.arcs_.empty()) {
+    RemoveArcPair(node.arcs_.back() & ~1ULL);
+  }
+  node.alive_ = false;
+  node.supply_ = 0;
+  node.excess_ = 0;
+  node.potential_ = 0;
+  node.current_arc_ = 0;
+  num_nodes_--;
+}
+
+void CostScalingSolver::Reset() {
+  nodes_.clear();
+  num_nodes_ = 0;
+  arcs_.clear();
+  arc_lower_bounds_.clear();
+  arc_indices_.clear();
+  free_arcs_.clear();
+  active_nodes_ = queue<uint64_t>();
+  touched_nodes_.clear();
+  new_nodes_.clear();
+  solved_once_ = false;
+  refine_phase_ = 0;
+}
+
+void CostScalingSolver::SaturateViolatingArcs(uint64_t node_id) {
+  if (!nodes_[node_id].alive_) {
+    return;
+  }
+  for (auto& arc_index : nodes_[node_id].arcs_) {
+    const ResidualArc& arc = arcs_[arc_index];
+    if (arc.residual_cap_ > 0 && ReducedCost(node_id, arc) < -epsilon_) {
+      Push(arc_index, arc.residual_cap_);
+    }
+    const ResidualArc& reverse_arc = arcs_[arc_index ^ 1];
+    if (reverse_arc.residual_cap_ > 0 &&
+        ReducedCost(arc.dst_, reverse_arc) < -epsilon_) {
+      Push(arc_index ^ 1, reverse_arc.residual_cap_);
+    }
+  }
+}
+
+bool CostScalingSolver::Solve(const FlowGraph& graph) {
+  Reset();
+  deadline_reached_ = false;
+  uint64_t max_node_id = 0;
+  for (auto& node : graph.Nodes()) {
+    max_node_id = max(max_node_id, node->id_);
+  }
+  nodes_.resize(max_node_id + 1);
+  arcs_.reserve(2 * graph.NumArcs());
+  arc_lower_bounds_.reserve(graph.NumArcs());
+  // Leave room for the graph to grow before the costs must be rescaled.
+  cost_scaling_factor_ = 1;
+  while (cost_scaling_factor_ <=
+         2 * static_cast<int64_t>(graph.Nodes().size() + 1)) {
+    cost_scaling_factor_ *= 2;
+  }
+  int64_t total_excess = 0;
+  for (auto& node : graph.Nodes()) {
+    AddNode(*node);
+    total_excess += node->excess_;
+  }
+  if (total_excess != 0) {
+    LOG(ERROR) << "Supply and demand of the flow graph do not match: "
+               << total_excess;
+    return false;
+  }
+  int64_t max_cost = 0;
+  for (auto& arc : graph.Arcs()) {
+    AddArcPair(*arc);
+    int64_t cost = arc->cost_ * cost_scaling_factor_;
+    max_cost = max(max_cost, cost < 0 ? -cost : cost);
+  }
+  epsilon_ = max_cost;
+  do {
+    epsilon_ = max(static_cast<int64_t>(1),
+                   epsilon_ / FLAGS_inproc_solver_alpha_factor);
+    VLOG(2) << "Cost scaling refine with epsilon " << epsilon_;
+    if (!Refine(true)) {
+      return false;
+    }
+    if (epsilon_ > 1 && deadline_ > 0 &&
+        wall_time_.GetCurrentTimestamp() >= deadline_) {
+      // Every refine phase ends with a feasible flow, which is epsilon-optimal
+      // rather than optimal. The next run cannot warm start from it.
+      LOG(WARNING) << "In-process solver reached its deadline with epsilon "
+                   << epsilon_;
+      ClearTouchedNodes();
+      optimal_ = false;
+      return true;
+    }
+  } while (epsilon_ > 1);
+  ClearTouchedNodes();
+  solved_once_ = true;
+  optimal_ = true;
+  return true;
+}
+
+bool CostScalingSolver::SolveIncremental(const FlowGraph& graph,
+                                         const vector<DIMACSChange*>& changes,
+                                         const FlowGraphNode& sink) {
+  if (!solved_once_) {
+    return Solve(graph);
+  }
+  deadline_reached_ = false;
+  for (auto& change : changes) {
+    ApplyChange(graph, change);
+  }
+  if (IsAlive(sink.id_)) {
+    AddExcess(sink.id_, sink.excess_ - nodes_[sink.id_].supply_);
+    nodes_[sink.id_].supply_ = sink.excess_;
+  }
+  EnsureCostScalingFactor();
+  // Start new nodes at a potential at which their cheapest outgoing arc has
+  // zero reduced cost.
+  for (auto& node_id : new_nodes_) {
+    if (!nodes_[node_id].alive_) {
+      continue;
+    }
+    int64_t max_potential = numeric_limits<int64_t>::min();
+    for (auto& arc_index : nodes_[node_id].arcs_) {
+      const ResidualArc& arc = arcs_[arc_index];
+      if (arc.residual_cap_ > 0) {
+        max_potential =
+          max(max_potential, nodes_[arc.dst_].potential_ - arc.cost_);
+      }
+    }
+    if (max_potential != numeric_limits<int64_t>::min()) {
+      nodes_[node_id].potential_ = max_potential;
+    }
+  }
+  // The flow of the previous run was 1-optimal and only the arcs of the
+  // touched nodes can violate 1-optimality now. A single refine phase with
+  // epsilon 1 restores optimality. Scaling epsilon down from the largest
+  // violation would instead revisit most of the graph, because cost changes
+  // cause violations of the order of the scaled costs.
+  epsilon_ = 1;
+  VLOG(2) << "Warm start with " << changes.size() << " changes and "
+          << touched_nodes_.size() << " touched nodes";
+  num_relabels_ = 0;
+  max_relabels_ = static_cast<uint64_t>(
+      FLAGS_inproc_solver_warm_start_max_relabels) * (num_nodes_ + 1);
+  bool refined = Refine(false);
+  max_relabels_ = 0;
+  if (!refined && deadline_reached_) {
+    // Solving from scratch would not finish by the deadline either. The
+    // next run starts from scratch, since the flow is not feasible.
+    solved_once_ = false;
+    return false;
+  }
+  if (!refined) {
+    LOG(WARNING) << "Warm start of the in-process solver failed; solving "
+                 << "from scratch";
+    return Solve(graph);
+  }
+  ClearTouchedNodes();
+  optimal_ = true;
+  return true;
+}
+
+int64_t CostScalingSolver::TotalCost() const {
+  int64_t total_cost = 0;
+  for (uint64_t arc_index = 0; arc_index < arcs_.size(); arc_index += 2) {
+    int64_t flow = static_cast<int64_t>(arc_lower_bounds_[arc_index / 2]) +
+      arcs_[arc_index + 1].residual_cap_;
+    total_cost += flow * (arcs_[arc_index].cost_ / cost_scaling_factor_);
+  }
+  return total_cost;
+}
+
+void CostScalingSolver::Touch(uint64_t node_id) {
+  ResidualNode& node = nodes_[node_id];
+  if (!node.touched_) {
+    node.touched_ = true;
+    touched_nodes_.push_back(node_id);
+  }
+  // The node's arcs may have been reordered.
+  node.current_arc_ = 0;
+}
+
+void CostScalingSolver::UpdateArcPair(uint64_t arc_index,
+                                      const FlowGraphArc& arc) {
+  CHECK_LE(arc.cap_lower_bound_, arc.cap_upper_bound_);
+  ResidualArc& forward_arc = arcs_[arc_index];
+  ResidualArc& reverse_arc = arcs_[arc_index + 1];
+  int64_t lower_bound = static_cast<int64_t>(arc.cap_lower_bound_);
+  int64_t upper_bound = static_cast<int64_t>(arc.cap_upper_bound_);
+  // Keep as much of the arc's flow as the new bounds allow.
+  int64_t flow = static_cast<int64_t>(arc_lower_bounds_[arc_index / 2]) +
+    reverse_arc.residual_cap_;
+  int64_t new_flow = min(max(flow, lower_bound), upper_bound);
+  forward_arc.residual_cap_ = upper_bound - new_flow;
+  reverse_arc.residual_cap_ = new_flow - lower_bound;
+  forward_arc.cost_ = arc.cost_ * cost_scaling_factor_;
+  reverse_arc.cost_ = -forward_arc.cost_;
+  arc_lower_bounds_[arc_index / 2] = arc.cap_lower_bound_;
+  AddExcess(arc.src_, flow - new_flow);
+  AddExcess(arc.dst_, new_flow - flow);
+  Touch(arc.src_);
+  Touch(arc.dst_);
+}
+
+}  // namespace firmament
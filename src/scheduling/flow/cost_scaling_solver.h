@@ -0,0 +1,197 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// In-process cost scaling min-cost flow solver. Unlike the external solvers,
+// it runs directly on the FlowGraph and thus avoids spawning a solver process
+// and converting the graph and the resulting flow to and from DIMACS text.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_COST_SCALING_SOLVER_H
+#define FIRMAMENT_SCHEDULING_FLOW_COST_SCALING_SOLVER_H
+
+#include <queue>
+#include <utility>
+#include <vector>
+#include <boost/functional/hash.hpp>
+
+#include "base/common.h"
+#include "base/types.h"
+#include "misc/wall_time.h"
+#include "scheduling/flow/dimacs_change.h"
+#include "scheduling/flow/extracted_flow.h"
+#include "scheduling/flow/flow_graph.h"
+
+namespace firmament {
+
+class CostScalingSolver {
+ public:
+  CostScalingSolver();
+  ~CostScalingSolver();
+
+  /**
+   * Sets the extracted flow to the arcs that carry flow, identifying the
+   * nodes by their node ids.
+   * @param extracted_flow the extracted flow; it is reset and finalized
+   * @param num_node_ids the number of node ids the flow can refer to; it must
+   * be larger than every node id in the graph
+   */
+  void ExtractFlow(ExtractedFlow* extracted_flow, uint64_t num_node_ids) const;
+  /**
+   * Returns true if the flow computed by the last run is a min-cost flow,
+   * and false if the run stopped early because it reached the deadline.
+   */
+  inline bool optimal() const {
+    return optimal_;
+  }
+  /**
+   * Returns true if the last run stopped without a result because it
+   * reached the deadline in the middle of a refine phase.
+   */
+  inline bool deadline_reached() const {
+    return deadline_reached_;
+  }
+  /**
+   * Sets the time by which runs should stop. A run that reaches the
+   * deadline between refine phases keeps the feasible, but not necessarily
+   * min-cost, flow computed so far. A run that reaches it within a refine
+   * phase has no feasible flow and fails.
+   * @param deadline the deadline as a wall clock timestamp in microseconds,
+   * or 0 for no deadline
+   */
+  inline void set_deadline(uint64_t deadline) {
+    deadline_ = deadline;
+  }
+  /**
+   * Computes a min-cost flow for the given flow graph from scratch.
+   * @param graph the flow graph to solve
+   * @return true if a feasible flow was found; false if none exists or the
+   * deadline was reached first
+   */
+  bool Solve(const FlowGraph& graph);
+  /**
+   * Re-optimizes the flow of the previous run after the graph has changed.
+   * The flow and the node potentials of the previous run are kept, and only
+   * the nodes and arcs affected by the changes are revisited. Falls back to
+   * solving from scratch if the solver has not run before or if the warm
+   * start fails.
+   * @param graph the flow graph to solve
+   * @param changes the changes applied to the graph since the previous run
+   * @param sink the sink node, whose excess changes without a graph change
+   * @return true if a feasible flow was found; false if none exists or the
+   * deadline was reached first
+   */
+  bool SolveIncremental(const FlowGraph& graph,
+                        const vector<DIMACSChange*>& changes,
+                        const FlowGraphNode& sink);
+  /**
+   * Returns the cost of the flow computed by the last run.
+   */
+  int64_t TotalCost() const;
+
+ private:
+  // An arc of the residual network. Arcs are stored in pairs: the arc at
+  // index 2 * i is the forward arc of the i-th flow graph arc and the arc at
+  // index 2 * i + 1 is its reverse. Hence, the reverse of arc a is a ^ 1.
+  struct ResidualArc {
+    uint64_t dst_;
+    int64_t residual_cap_;
+    int64_t cost_;
+    // Position of the arc in its source node's arc list.
+    uint64_t position_;
+  };
+
+  struct ResidualNode {
+    bool alive_;
+    // Set if the node's arcs or potential changed in the current run.
+    bool touched_;
+    int64_t supply_;
+    int64_t excess_;
+    int64_t potential_;
+    // Refine phase in which the node was last relabeled, and its potential
+    // at the beginning of that phase.
+    uint64_t relabel_phase_;
+    int64_t phase_start_potential_;
+    // Index into arcs_ of the next arc to try when discharging the node.
+    uint64_t current_arc_;
+    vector<uint64_t> arcs_;
+  };
+
+  void AddArcPair(const FlowGraphArc& arc);
+  void AddExcess(uint64_t node_id, int64_t excess);
+  void AddNode(const FlowGraphNode& node);
+  void ApplyArcChange(const FlowGraph& graph, uint64_t src, uint64_t dst);
+  void ApplyChange(const FlowGraph& graph, DIMACSChange* change);
+  void ClearTouchedNodes();
+  void DetachArc(uint64_t node_id, uint64_t arc_index);
+  void Discharge(uint64_t node_id);
+  void EnsureCostScalingFactor();
+  inline bool IsAlive(uint64_t node_id) const {
+    return node_id < nodes_.size() && nodes_[node_id].alive_;
+  }
+  void Push(uint64_t arc_index, int64_t flow);
+  inline int64_t ReducedCost(uint64_t src, const ResidualArc& arc) const {
+    return arc.cost_ + nodes_[src].potential_ - nodes_[arc.dst_].potential_;
+  }
+  bool Refine(bool scan_all_nodes);
+  bool Relabel(uint64_t node_id);
+  void RemoveArcPair(uint64_t arc_index);
+  void RemoveNode(uint64_t node_id);
+  void Reset();
+  void SaturateViolatingArcs(uint64_t node_id);
+  void Touch(uint64_t node_id);
+  void UpdateArcPair(uint64_t arc_index, const FlowGraphArc& arc);
+
+  vector<ResidualNode> nodes_;
+  uint64_t num_nodes_;
+  vector<ResidualArc> arcs_;
+  // Lower bound of every flow graph arc; indexed by the arc pair index.
+  vector<uint64_t> arc_lower_bounds_;
+  // Maps (src, dst) node ids to the index of the arc's forward residual arc.
+  unordered_map<pair<uint64_t, uint64_t>, uint64_t,
+                boost::hash<pair<uint64_t, uint64_t>>> arc_indices_;
+  // Forward arc indices of the removed arc pairs that can be reused.
+  vector<uint64_t> free_arcs_;
+  // Nodes that have positive excess.
+  queue<uint64_t> active_nodes_;
+  // Nodes whose arcs or potential changed since the previous run.
+  vector<uint64_t> touched_nodes_;
+  // Nodes added since the previous run.
+  vector<uint64_t> new_nodes_;
+  bool solved_once_;
+  // Factor by which the costs are multiplied. A flow that is 1-optimal for
+  // the scaled costs is optimal for the original costs as long as the factor
+  // is larger than the number of nodes.
+  int64_t cost_scaling_factor_;
+  int64_t epsilon_;
+  uint64_t refine_phase_;
+  int64_t max_potential_drop_;
+  // Number of relabels in the current warm start, and the limit after which
+  // the solver falls back to solving from scratch (0 if unlimited).
+  uint64_t num_relabels_;
+  uint64_t max_relabels_;
+  // Wall clock timestamp by which runs should stop; 0 if there is none.
+  uint64_t deadline_;
+  bool deadline_reached_;
+  bool optimal_;
+  WallTime wall_time_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_COST_SCALING_SOLVER_H
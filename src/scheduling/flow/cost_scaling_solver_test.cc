@@ -0,0 +1,437 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the in-process cost scaling solver.
+
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <vector>
+
+#include "base/common.h"
+#include "scheduling/flow/cost_scaling_solver.h"
+#include "scheduling/flow/dimacs_change_stats.h"
+#include "scheduling/flow/flow_graph.h"
+#include "scheduling/flow/flow_graph_change_manager.h"
+
+DECLARE_bool(incremental_flow);
+
+namespace firmament {
+
+// The fixture for testing the CostScalingSolver class.
+class CostScalingSolverTest : public ::testing::Test {
+ protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  CostScalingSolverTest() {
+    // You can do set-up work for each test here.
+    FLAGS_v = 2;
+  }
+
+  virtual ~CostScalingSolverTest() {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  virtual void SetUp() {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+  }
+
+  virtual void TearDown() {
+    // Code here will be called immediately after the test (right
+    // before the destructor).
+  }
+
+  FlowGraphArc* AddArc(FlowGraph* graph, FlowGraphNode* src,
+                       FlowGraphNode* dst, uint64_t cap_lower_bound,
+                       uint64_t cap_upper_bound, int64_t cost) {
+    FlowGraphArc* arc = graph->AddArc(src, dst);
+    graph->ChangeArc(arc, cap_lower_bound, cap_upper_bound, cost);
+    return arc;
+  }
+
+  // Computes the min-cost flow cost using successive shortest paths. The
+  // graph must not have arcs with negative costs or lower bounds.
+  int64_t ReferenceMinCost(const FlowGraph& graph) {
+    uint64_t num_nodes = graph.NumNodes() + 1;
+    vector<int64_t> excess(num_nodes, 0);
+    vector<uint64_t> arc_dst;
+    vector<int64_t> arc_cap;
+    vector<int64_t> arc_cost;
+    vector<vector<uint64_t>> adjacency(num_nodes);
+    for (auto& node : graph.Nodes()) {
+      excess[node->id_] = node->excess_;
+    }
+    for (auto& arc : graph.Arcs()) {
+      CHECK_EQ(arc->cap_lower_bound_, 0);
+      adjacency[arc->src_].push_back(arc_dst.size());
+      arc_dst.push_back(arc->dst_);
+      arc_cap.push_back(static_cast<int64_t>(arc->cap_upper_bound_));
+      arc_cost.push_back(arc->cost_);
+      adjacency[arc->dst_].push_back(arc_dst.size());
+      arc_dst.push_back(arc->src_);
+      arc_cap.push_back(0);
+      arc_cost.push_back(-arc->cost_);
+    }
+    int64_t total_cost = 0;
+    const int64_t kInfinity = numeric_limits<int64_t>::max();
+    while (true) {
+      // Bellman-Ford from all the nodes that have excess.
+      vector<int64_t> distance(num_nodes, kInfinity);
+      vector<uint64_t> pred_arc(num_nodes, arc_dst.size());
+      for (uint64_t node_id = 0; node_id < num_nodes; ++node_id) {
+        if (excess[node_id] > 0) {
+          distance[node_id] = 0;
+        }
+      }
+      bool updated = true;
+      while (updated) {
+        updated = false;
+        for (uint64_t node_id = 0; node_id < num_nodes; ++node_id) {
+          if (distance[node_id] == kInfinity) {
+            continue;
+          }
+          for (auto& arc_index : adjacency[node_id]) {
+            uint64_t dst = arc_dst[arc_index];
+            if (arc_cap[arc_index] > 0 &&
+                distance[node_id] + arc_cost[arc_index] < distance[dst]) {
+              distance[dst] = distance[node_id] + arc_cost[arc_index];
+              pred_arc[dst] = arc_index;
+              updated = true;
+            }
+          }
+        }
+      }
+      uint64_t deficit_node = num_nodes;
+      for (uint64_t node_id = 0; node_id < num_nodes; ++node_id) {
+        if (excess[node_id] < 0 && distance[node_id] != kInfinity &&
+            (deficit_node == num_nodes ||
+             distance[node_id] < distance[deficit_node])) {
+          deficit_node = node_id;
+        }
+      }
+      if (deficit_node == num_nodes) {
+        break;
+      }
+      // Find the path's source and its bottleneck capacity.
+      int64_t flow = -excess[deficit_node];
+      uint64_t node_id = deficit_node;
+      while (pred_arc[node_id] != arc_dst.size()) {
+        flow = min(flow, arc_cap[pred_arc[node_id]]);
+        node_id = arc_dst[pred_arc[node_id] ^ 1];
+      }
+      flow = min(flow, excess[node_id]);
+      excess[node_id] -= flow;
+      excess[deficit_node] += flow;
+      for (node_id = deficit_node; pred_arc[node_id] != arc_dst.size();
+           node_id = arc_dst[pred_arc[node_id] ^ 1]) {
+        arc_cap[pred_arc[node_id]] -= flow;
+        arc_cap[pred_arc[node_id] ^ 1] += flow;
+        total_cost += flow * arc_cost[pred_arc[node_id]];
+      }
+    }
+    return total_cost;
+  }
+};
+
+// Two tasks that prefer the same PU. Only one of them can run on it.
+TEST_F(CostScalingSolverTest, SimpleSchedulingGraph) {
+  FlowGraph graph;
+  FlowGraphNode* sink = graph.AddNode();
+  FlowGraphNode* task1 = graph.AddNode();
+  FlowGraphNode* task2 = graph.AddNode();
+  FlowGraphNode* unsched_agg = graph.AddNode();
+  FlowGraphNode* pu1 = graph.AddNode();
+  FlowGraphNode* pu2 = graph.AddNode();
+  task1->excess_ = 1;
+  task2->excess_ = 1;
+  sink->excess_ = -2;
+  AddArc(&graph, task1, pu1, 0, 1, 1);
+  AddArc(&graph, task1, pu2, 0, 1, 5);
+  AddArc(&graph, task1, unsched_agg, 0, 1, 100);
+  AddArc(&graph, task2, pu1, 0, 1, 2);
+  AddArc(&graph, task2, pu2, 0, 1, 3);
+  AddArc(&graph, task2, unsched_agg, 0, 1, 100);
+  AddArc(&graph, unsched_agg, sink, 0, 2, 0);
+  AddArc(&graph, pu1, sink, 0, 1, 0);
+  AddArc(&graph, pu2, sink, 0, 1, 0);
+  CostScalingSolver solver;
+  CHECK(solver.Solve(graph));
+  EXPECT_EQ(solver.TotalCost(), 4);
+  ExtractedFlow extracted_flow;
+  solver.ExtractFlow(&extracted_flow, graph.NumNodes() + 1);
+  EXPECT_EQ(extracted_flow.Flow(task1->id_, pu1->id_), 1);
+  EXPECT_EQ(extracted_flow.Flow(task2->id_, pu2->id_), 1);
+  EXPECT_EQ(extracted_flow.Flow(pu1->id_, sink->id_), 1);
+  EXPECT_EQ(extracted_flow.Flow(pu2->id_, sink->id_), 1);
+  EXPECT_TRUE(extracted_flow.IncomingBegin(unsched_agg->id_) ==
+              extracted_flow.IncomingEnd(unsched_agg->id_));
+}
+
+// A run that reaches its deadline stops early with a feasible flow.
+TEST_F(CostScalingSolverTest, Deadline) {
+  FlowGraph graph;
+  FlowGraphNode* sink = graph.AddNode();
+  FlowGraphNode* task1 = graph.AddNode();
+  FlowGraphNode* task2 = graph.AddNode();
+  FlowGraphNode* unsched_agg = graph.AddNode();
+  FlowGraphNode* pu1 = graph.AddNode();
+  FlowGraphNode* pu2 = graph.AddNode();
+  task1->excess_ = 1;
+  task2->excess_ = 1;
+  sink->excess_ = -2;
+  AddArc(&graph, task1, pu1, 0, 1, 1);
+  AddArc(&graph, task1, pu2, 0, 1, 5);
+  AddArc(&graph, task1, unsched_agg, 0, 1, 100);
+  AddArc(&graph, task2, pu1, 0, 1, 2);
+  AddArc(&graph, task2, pu2, 0, 1, 3);
+  AddArc(&graph, task2, unsched_agg, 0, 1, 100);
+  AddArc(&graph, unsched_agg, sink, 0, 2, 0);
+  AddArc(&graph, pu1, sink, 0, 1, 0);
+  AddArc(&graph, pu2, sink, 0, 1, 0);
+  CostScalingSolver solver;
+  // The deadline has passed before the solver starts.
+  solver.set_deadline(1);
+  CHECK(solver.Solve(graph));
+  EXPECT_FALSE(solver.optimal());
+  ExtractedFlow extracted_flow;
+  solver.ExtractFlow(&extracted_flow, graph.NumNodes() + 1);
+  uint64_t flow_to_sink = 0;
+  for (const ExtractedFlow::ArcFlow* arc =
+         extracted_flow.IncomingBegin(sink->id_);
+       arc != extracted_flow.IncomingEnd(sink->id_); ++arc) {
+    flow_to_sink += arc->flow_;
+  }
+  EXPECT_EQ(flow_to_sink, 2);
+  solver.set_deadline(0);
+  CHECK(solver.Solve(graph));
+  EXPECT_TRUE(solver.optimal());
+  EXPECT_EQ(solver.TotalCost(), 4);
+}
+
+// A run that reaches its deadline within a refine phase has no result.
+TEST_F(CostScalingSolverTest, DeadlineWithinRefine) {
+  FlowGraph graph;
+  FlowGraphNode* sink = graph.AddNode();
+  uint64_t num_tasks = 5000;
+  sink->excess_ = -static_cast<int64_t>(num_tasks);
+  for (uint64_t task_index = 0; task_index < num_tasks; ++task_index) {
+    FlowGraphNode* task = graph.AddNode();
+    FlowGraphNode* pu = graph.AddNode();
+    task->excess_ = 1;
+    AddArc(&graph, task, pu, 0, 1, 1);
+    AddArc(&graph, pu, sink, 0, 1, 0);
+  }
+  CostScalingSolver solver;
+  solver.set_deadline(1);
+  EXPECT_FALSE(solver.Solve(graph));
+  EXPECT_TRUE(solver.deadline_reached());
+  solver.set_deadline(0);
+  CHECK(solver.Solve(graph));
+  EXPECT_FALSE(solver.deadline_reached());
+  EXPECT_TRUE(solver.optimal());
+  EXPECT_EQ(solver.TotalCost(), static_cast<int64_t>(num_tasks));
+}
+
+// Lower bounds must be satisfied even if other arcs are cheaper.
+TEST_F(CostScalingSolverTest, LowerBound) {
+  FlowGraph graph;
+  FlowGraphNode* sink = graph.AddNode();
+  FlowGraphNode* task = graph.AddNode();
+  FlowGraphNode* pu1 = graph.AddNode();
+  FlowGraphNode* pu2 = graph.AddNode();
+  task->excess_ = 1;
+  sink->excess_ = -1;
+  AddArc(&graph, task, pu1, 0, 1, 1);
+  AddArc(&graph, task, pu2, 1, 1, 10);
+  AddArc(&graph, pu1, sink, 0, 1, 0);
+  AddArc(&graph, pu2, sink, 0, 1, 0);
+  CostScalingSolver solver;
+  CHECK(solver.Solve(graph));
+  EXPECT_EQ(solver.TotalCost(), 10);
+  ExtractedFlow extracted_flow;
+  solver.ExtractFlow(&extracted_flow, graph.NumNodes() + 1);
+  EXPECT_EQ(extracted_flow.Flow(task->id_, pu2->id_), 1);
+  EXPECT_TRUE(extracted_flow.IncomingBegin(pu1->id_) ==
+              extracted_flow.IncomingEnd(pu1->id_));
+}
+
+// The solver must detect that the task cannot reach the sink.
+TEST_F(CostScalingSolverTest, Infeasible) {
+  FlowGraph graph;
+  FlowGraphNode* sink = graph.AddNode();
+  FlowGraphNode* task1 = graph.AddNode();
+  FlowGraphNode* task2 = graph.AddNode();
+  FlowGraphNode* pu = graph.AddNode();
+  task1->excess_ = 1;
+  task2->excess_ = 1;
+  sink->excess_ = -2;
+  AddArc(&graph, task1, pu, 0, 1, 1);
+  AddArc(&graph, task2, pu, 0, 1, 1);
+  AddArc(&graph, pu, sink, 0, 1, 0);
+  CostScalingSolver solver;
+  EXPECT_FALSE(solver.Solve(graph));
+}
+
+// Compares the solver against successive shortest paths on random graphs.
+TEST_F(CostScalingSolverTest, RandomGraphs) {
+  uint32_t seed = 42;
+  for (uint64_t round = 0; round < 20; ++round) {
+    FlowGraph graph;
+    FlowGraphNode* sink = graph.AddNode();
+    vector<FlowGraphNode*> tasks;
+    vector<FlowGraphNode*> others;
+    for (uint64_t i = 0; i < 30; ++i) {
+      tasks.push_back(graph.AddNode());
+      tasks.back()->excess_ = 1 + rand_r(&seed) % 3;
+      sink->excess_ -= tasks.back()->excess_;
+    }
+    for (uint64_t i = 0; i < 20; ++i) {
+      others.push_back(graph.AddNode());
+      AddArc(&graph, others.back(), sink, 0, 1 + rand_r(&seed) % 4,
+             rand_r(&seed) % 10);
+    }
+    FlowGraphNode* unsched_agg = graph.AddNode();
+    AddArc(&graph, unsched_agg, sink, 0, 100, 0);
+    for (auto& task : tasks) {
+      AddArc(&graph, task, unsched_agg, 0, 3, 1000);
+      for (uint64_t i = 0; i < 4; ++i) {
+        FlowGraphNode* other = others[rand_r(&seed) % others.size()];
+        if (graph.GetArc(task, other) == NULL) {
+          AddArc(&graph, task, other, 0, 1 + rand_r(&seed) % 2,
+                 rand_r(&seed) % 500);
+        }
+      }
+    }
+    for (uint64_t i = 0; i < 40; ++i) {
+      FlowGraphNode* src = others[rand_r(&seed) % others.size()];
+      FlowGraphNode* dst = others[rand_r(&seed) % others.size()];
+      if (src != dst && graph.GetArc(src, dst) == NULL &&
+          graph.GetArc(dst, src) == NULL) {
+        AddArc(&graph, src, dst, 0, 1 + rand_r(&seed) % 5,
+               rand_r(&seed) % 50);
+      }
+    }
+    CostScalingSolver solver;
+    CHECK(solver.Solve(graph));
+    EXPECT_EQ(solver.TotalCost(), ReferenceMinCost(graph));
+  }
+}
+
+// Applies random changes to a graph and checks that the warm-started solver
+// finds flows as cheap as the ones computed from scratch.
+TEST_F(CostScalingSolverTest, IncrementalChanges) {
+  FLAGS_incremental_flow = true;
+  DIMACSChangeStats dimacs_stats;
+  FlowGraphChangeManager change_manager(&dimacs_stats);
+  FlowGraphNode* sink =
+    change_manager.AddNode(FlowNodeType::SINK, 0, ADD_SINK_NODE, "sink");
+  FlowGraphNode* unsched_agg =
+    change_manager.AddNode(FlowNodeType::JOB_AGGREGATOR, 0,
+                           ADD_UNSCHED_JOB_NODE, "unsched_agg");
+  FlowGraphArc* unsched_arc =
+    change_manager.AddArc(unsched_agg, sink, 0, 0, 0, OTHER,
+                          ADD_ARC_FROM_UNSCHED, "unsched_agg to sink");
+  vector<FlowGraphNode*> pus;
+  for (uint64_t i = 0; i < 20; ++i) {
+    pus.push_back(change_manager.AddNode(FlowNodeType::PU, 0,
+                                         ADD_RESOURCE_NODE, "pu"));
+    change_manager.AddArc(pus.back(), sink, 0, 2, 0, OTHER,
+                          ADD_ARC_RES_TO_SINK, "pu to sink");
+  }
+  uint32_t seed = 42;
+  vector<FlowGraphNode*> tasks;
+  CostScalingSolver solver;
+  for (uint64_t round = 0; round < 30; ++round) {
+    // Add tasks.
+    uint64_t num_new_tasks = rand_r(&seed) % 6;
+    for (uint64_t i = 0; i < num_new_tasks; ++i) {
+      FlowGraphNode* task =
+        change_manager.AddNode(FlowNodeType::UNSCHEDULED_TASK, 1,
+                               ADD_TASK_NODE, "task");
+      sink->excess_--;
+      change_manager.AddArc(task, unsched_agg, 0, 1, 1000, OTHER,
+                            ADD_ARC_TO_UNSCHED, "task to unsched_agg");
+      change_manager.ChangeArcCapacity(
+          unsched_arc, unsched_arc->cap_upper_bound_ + 1, CHG_ARC_FROM_UNSCHED,
+          "grow unsched_agg");
+      for (uint64_t j = 0; j < 3; ++j) {
+        FlowGraphNode* pu = pus[rand_r(&seed) % pus.size()];
+        if (task->outgoing_arc_map_.find(pu->id_) ==
+            task->outgoing_arc_map_.end()) {
+          change_manager.AddArc(task, pu, 0, 1, rand_r(&seed) % 500, OTHER,
+                                ADD_ARC_TASK_TO_RES, "task to pu");
+        }
+      }
+      tasks.push_back(task);
+    }
+    // Remove tasks.
+    uint64_t num_removed_tasks = min(tasks.size(),
+                                     static_cast<size_t>(rand_r(&seed) % 3));
+    for (uint64_t i = 0; i < num_removed_tasks; ++i) {
+      uint64_t index = rand_r(&seed) % tasks.size();
+      FlowGraphNode* task = tasks[index];
+      tasks[index] = tasks.back();
+      tasks.pop_back();
+      task->excess_ = 0;
+      sink->excess_++;
+      change_manager.ChangeArcCapacity(
+          unsched_arc, unsched_arc->cap_upper_bound_ - 1, CHG_ARC_FROM_UNSCHED,
+          "shrink unsched_agg");
+      change_manager.DeleteNode(task, DEL_TASK_NODE, "remove task");
+    }
+    // Change the costs and capacities of some arcs.
+    for (auto& task : tasks) {
+      if (rand_r(&seed) % 4 != 0) {
+        continue;
+      }
+      for (auto& dst_arc : task->outgoing_arc_map_) {
+        if (dst_arc.first != unsched_agg->id_) {
+          change_manager.ChangeArc(dst_arc.second, 0, rand_r(&seed) % 2,
+                                   rand_r(&seed) % 500,
+                                   CHG_ARC_TASK_TO_RES, "change task arc");
+        }
+      }
+    }
+    if (round == 0) {
+      CHECK(solver.Solve(change_manager.flow_graph()));
+    } else {
+      CHECK(solver.SolveIncremental(
+          change_manager.flow_graph(),
+          change_manager.GetOptimizedGraphChanges(), *sink));
+    }
+    change_manager.ResetChanges();
+    CostScalingSolver scratch_solver;
+    CHECK(scratch_solver.Solve(change_manager.flow_graph()));
+    EXPECT_EQ(solver.TotalCost(), scratch_solver.TotalCost());
+  }
+  FLAGS_incremental_flow = false;
+}
+
+}  // namespace firmament
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -31,6 +31,13 @@
 #include "scheduling/label_utils.h"
 
 DEFINE_uint64(max_multi_arcs_for_cpu, 50, "Maximum number of multi-arcs.");
+DEFINE_bool(cpu_cost_model_log_machine_segments, false,
+            "If true, every machine gets one equivalence class per "
+            "log-spaced range of task slots (1, 1, 2, 4, ...), rather than "
+            "one equivalence class per task slot. This is an approximation: "
+            "all the tasks in a range are charged the cost of its middle "
+            "slot, and so a machine can get up to half a range more or fewer "
+            "tasks than with one equivalence class per slot.");
 
 DECLARE_uint64(max_tasks_per_pu);
 DECLARE_bool(gather_unscheduled_tasks);
@@ -38,14 +45,30 @@ DECLARE_bool(pod_affinity_antiaffinity_symmetry);
 
 namespace firmament {
 
+// Sets the least requested and balanced resource allocation costs from the
+// costs the batch computed for the arc.
+static void SetLeastRequestedAndBalancedCosts(const ResourceCostBatch& batch,
+                                              size_t arc,
+                                              CpuMemCostVector_t* cost_vector) {
+  // Expressing Least Requested Priority.
+  int64_t cpu_cost = batch.cpu_costs_[arc];
+  int64_t ram_cost = batch.ram_costs_[arc];
+  int64_t cpu_ram_cost = (cpu_cost + ram_cost) / 2;
+  cost_vector->cpu_mem_cost_ = cpu_ram_cost;
+  // Expressing Balanced Resource Allocation Priority. The variance of the CPU
+  // and RAM fractions is a positive fraction that is higher for nodes with
+  // unbalanced usage, and the batch scales it by omega_(1000).
+  int64_t balanced_resource_cost = batch.balanced_costs_[arc];
+  cost_vector->balanced_res_cost_ = balanced_resource_cost;
+}
+
 CpuCostModel::CpuCostModel(
     shared_ptr<ResourceMap_t> resource_map, shared_ptr<TaskMap_t> task_map,
-    shared_ptr<KnowledgeBase> knowledge_base,
-    unordered_map<string, unordered_map<string, vector<TaskID_t>>>* labels_map)
+    shared_ptr<KnowledgeBase> knowledge_base)
     : resource_map_(resource_map),
       task_map_(task_map),
       knowledge_base_(knowledge_base),
-      labels_map_(labels_map) {
+      scored_task_ec_(0) {
   // Set an initial value for infinity -- this overshoots a bit; would be nice
   // to have a tighter bound based on actual costs observed
   infinity_ = omega_ * CpuMemCostVector_t::dimensions_;
@@ -152,6 +175,17 @@ ArcDescriptor CpuCostModel::TaskToEquivClassAggregator(TaskID_t task_id,
 
 ArcDescriptor CpuCostModel::EquivClassToResourceNode(EquivClass_t ec,
                                                      ResourceID_t res_id) {
+  if (FLAGS_cpu_cost_model_log_machine_segments) {
+    // The arc between a machine segment EC and the machine carries as many
+    // tasks as there are task slots in the segment.
+    uint64_t* index = FindOrNull(ec_to_index_, ec);
+    ResourceStatus* rs = FindPtrOrNull(*resource_map_, res_id);
+    if (index && rs) {
+      uint64_t segment_end = MachineSegmentEnd(
+          *index, rs->topology_node().resource_desc().max_pods());
+      return ArcDescriptor(0LL, segment_end - *index, 0ULL);
+    }
+  }
   // The arcs between ECs an machine can only carry unit flow.
   return ArcDescriptor(0LL, 1ULL, 0ULL);
 }
@@ -168,48 +202,48 @@ ArcDescriptor CpuCostModel::EquivClassToEquivClass(EquivClass_t ec1,
   CHECK_NOTNULL(rs);
   const ResourceDescriptor& rd = rs->topology_node().resource_desc();
   CHECK_EQ(rd.type(), ResourceDescriptor::RESOURCE_MACHINE);
-  CpuMemResVector_t available_resources;
-  available_resources.cpu_cores_ =
-      static_cast<uint64_t>(rd.available_resources().cpu_cores());
-  available_resources.ram_cap_ =
-      static_cast<uint64_t>(rd.available_resources().ram_cap());
-  uint64_t* index = FindOrNull(ec_to_index_, ec2);
-  CHECK_NOTNULL(index);
-  uint64_t ec_index = *index;
-  if ((available_resources.cpu_cores_ <
-       resource_request->cpu_cores_ * ec_index) ||
-      (available_resources.ram_cap_ < resource_request->ram_cap_ * ec_index)) {
-    return ArcDescriptor(0LL, 0ULL, 0ULL);
-  }
-  available_resources.cpu_cores_ = rd.available_resources().cpu_cores() -
-                                   ec_index * resource_request->cpu_cores_;
-  available_resources.ram_cap_ = rd.available_resources().ram_cap() -
-                                 ec_index * resource_request->ram_cap_;
-
-  // Expressing Least Requested Priority.
-  float cpu_fraction =
-      ((rd.resource_capacity().cpu_cores() - available_resources.cpu_cores_) /
-       (float)rd.resource_capacity().cpu_cores());
-  float ram_fraction =
-      ((rd.resource_capacity().ram_cap() - available_resources.ram_cap_) /
-       (float)rd.resource_capacity().ram_cap());
-  int64_t cpu_cost = cpu_fraction * omega_;
-  int64_t ram_cost = ram_fraction * omega_;
-  int64_t cpu_ram_cost = (cpu_cost + ram_cost) / 2;
-  cost_vector.cpu_mem_cost_ = cpu_ram_cost;
-
-  // Expressing Balanced Resource Allocation Priority.
-  // Compute variance for two fractions, cpu and ram.
-  float mean = (cpu_fraction + ram_fraction) / float(2);
-  float variance = (((cpu_fraction - mean) * (cpu_fraction - mean)) +
-                    ((ram_fraction - mean) * (ram_fraction - mean))) /
-                   float(2);
-  // Since the variance is between positive fractions, it will be positive
-  // fraction. Variance lets the cost to be higher for node which has high
-  // variance and multiplying it with omega_(1000) provides the scaling
-  // factor needed.
-  int64_t balanced_resource_cost = variance * omega_;
-  cost_vector.balanced_res_cost_ = balanced_resource_cost;
+  uint64_t capacity = 1;
+  const size_t* arc_position = ec1 == scored_task_ec_ ?
+      FindOrNull(scored_arc_positions_, ec2) : NULL;
+  if (arc_position) {
+    // The arc's resource costs were computed in batch along with all the
+    // other arcs of the task EC.
+    capacity = scored_arc_capacities_[*arc_position];
+    SetLeastRequestedAndBalancedCosts(scored_arcs_, *arc_position,
+                                      &cost_vector);
+  } else {
+    CpuMemResVector_t available_resources;
+    available_resources.cpu_cores_ =
+        static_cast<uint64_t>(rd.available_resources().cpu_cores());
+    available_resources.ram_cap_ =
+        static_cast<uint64_t>(rd.available_resources().ram_cap());
+    uint64_t* index = FindOrNull(ec_to_index_, ec2);
+    CHECK_NOTNULL(index);
+    uint64_t ec_index = *index;
+    if (FLAGS_cpu_cost_model_log_machine_segments) {
+      // The segment admits the tasks from its first slot up to the last slot
+      // that still fits on the machine. All of them are charged the cost of
+      // the slot in the middle of the segment. This intentionally trades the
+      // convex per-slot cost for a step function with O(log max_pods) arcs
+      // per machine; the segment is not split into per-slot arcs, as that
+      // would bring back the arcs the segments save.
+      uint64_t num_fit =
+          NumTasksThatFit(*resource_request, rd, *machine_res_id);
+      if (num_fit <= ec_index) {
+        return ArcDescriptor(0LL, 0ULL, 0ULL);
+      }
+      capacity = min(MachineSegmentEnd(ec_index, rd.max_pods()), num_fit) -
+                 ec_index;
+      ec_index += (capacity - 1) / 2;
+    } else if ((available_resources.cpu_cores_ <
+                resource_request->cpu_cores_ * ec_index) ||
+               (available_resources.ram_cap_ <
+                resource_request->ram_cap_ * ec_index)) {
+      return ArcDescriptor(0LL, 0ULL, 0ULL);
+    }
+    LeastRequestedAndBalancedCosts(*machine_res_id, *resource_request,
+                                   ec_index, &cost_vector);
+  }
 
   // Expressing Node Affinity priority.
   const TaskDescriptor* td_ptr = FindOrNull(ec_to_td_requirements, ec1);
@@ -363,7 +397,7 @@ ArcDescriptor CpuCostModel::EquivClassToEquivClass(EquivClass_t ec1,
       }
     }
   }
-  return ArcDescriptor(final_cost, 1ULL, 0ULL);
+  return ArcDescriptor(final_cost, capacity, 0ULL);
 }
 
 Cost_t CpuCostModel::FlattenCostVector(CpuMemCostVector_t cv) {
@@ -497,6 +531,13 @@ vector<EquivClass_t>* CpuCostModel::GetTaskEquivClasses(TaskID_t task_id) {
   InsertIfNotPresent(&ec_resource_requirement_, resource_request_ec,
                      *task_resource_request);
   InsertIfNotPresent(&ec_to_td_requirements, resource_request_ec, *td_ptr);
+  if (!ContainsKey(ec_to_label_predicates_, resource_request_ec)) {
+    // Compile the node selector, node affinity and tolerations once per EC,
+    // so that they are not re-parsed for every machine.
+    scheduler::CompileLabelPredicates(
+        *td_ptr, knowledge_base_->mutable_label_index()->mutable_strings(),
+        &ec_to_label_predicates_[resource_request_ec]);
+  }
   if (pod_antiaffinity_symmetry) {
     ecs_with_pod_antiaffinity_symmetry_.insert(resource_request_ec);
   }
@@ -554,23 +595,17 @@ void CpuCostModel::CalculatePrioritiesCost(const EquivClass_t ec,
     if (affinity.has_node_affinity()) {
       if (affinity.node_affinity()
               .preferredduringschedulingignoredduringexecution_size()) {
-        // Match PreferredDuringSchedulingIgnoredDuringExecution term by term
-        for (auto& preferredSchedulingTerm :
-             affinity.node_affinity()
-                 .preferredduringschedulingignoredduringexecution()) {
-          // If weight is zero then skip preferredSchedulingTerm.
-          if (!preferredSchedulingTerm.weight()) {
-            continue;
-          }
-          // A null or empty node selector term matches no objects.
-          if (!preferredSchedulingTerm.has_preference()) {
-            continue;
-          }
-          if (scheduler::NodeMatchesNodeSelectorTerm(
-                  rd, preferredSchedulingTerm.preference())) {
-            sum_of_weights += preferredSchedulingTerm.weight();
-          }
-        }
+        // Match PreferredDuringSchedulingIgnoredDuringExecution terms using
+        // the EC's compiled predicates.
+        const scheduler::LabelPredicateProgram* label_predicates =
+            FindOrNull(ec_to_label_predicates_, ec);
+        CHECK_NOTNULL(label_predicates);
+        const LabelIndex& label_index = knowledge_base_->label_index();
+        const scheduler::InternedNodeAttributes* node_attributes =
+            label_index.FindMachine(ResourceIDFromString(rd.uuid()));
+        CHECK_NOTNULL(node_attributes);
+        sum_of_weights = scheduler::PreferredNodeAffinityWeight(
+            *node_attributes, *label_predicates, label_index.strings());
         // Fill the node priority min, max and actual scores which will
         // be used in cost calculation.
         unordered_map<ResourceID_t, PriorityScoresList_t,
@@ -636,56 +671,9 @@ void CpuCostModel::CalculatePrioritiesCost(const EquivClass_t ec,
 }
 
 // Taints and Tolerations
-void CpuCostModel::CalculateIntolerableTaintsCost(const ResourceDescriptor& rd,
-                                                  const TaskDescriptor* td_ptr,
-                                                  const EquivClass_t ec) {
-  bool IsTolerable = false;
-  int64_t intolerable_taint_cost = 0;
-  for (const auto& tolerations : td_ptr->tolerations()) {
-    if (tolerations.effect() == "PreferNoSchedule" ||
-        tolerations.effect() == "") {
-      if (tolerations.operator_() == "Exists") {
-        if (tolerations.key() != "") {
-          InsertIfNotPresent(&tolerationSoftExistsMap, tolerations.key(),
-                             tolerations.value());
-        } else {
-          IsTolerable = true;
-        }
-
-      } else if ((tolerations.operator_() == "Equal") ||
-                 (tolerations.operator_() == "")) {
-        InsertIfNotPresent(&tolerationSoftEqualMap, tolerations.key(),
-                           tolerations.value());
-
-      } else {
-        LOG(FATAL) << "Unsupported operator :" << tolerations.operator_();
-        break;
-      }
-    }
-  }
-
-  if (!IsTolerable) {
-    for (const auto& taint : rd.taints()) {
-      if (taint.effect() == "PreferNoSchedule") {
-        // If the key does not exist in Exists Map, look for Equal Map for any
-        // matching key and value
-
-        if (!ContainsKey(tolerationSoftExistsMap, taint.key())) {
-          const string* value = FindOrNull(tolerationSoftEqualMap, taint.key());
-
-          // If key is found, then value is not NULL
-          if (value != NULL) {
-            // Check if the value matches for the found key
-            if ((*value) != taint.value()) {
-              intolerable_taint_cost = intolerable_taint_cost + 1;
-            }
-          } else {  // If the key is not found, then taint is not tolerable
-            intolerable_taint_cost = intolerable_taint_cost + 1;
-          }
-        }
-      }
-    }
-  }
+void CpuCostModel::CalculateIntolerableTaintsCost(
+    const ResourceDescriptor& rd, int64_t intolerable_taint_cost,
+    const EquivClass_t ec) {
   // Fill the intolerable taints priority min, max and actual scores which will
   // be used in cost calculation.
   unordered_map<ResourceID_t, PriorityScoresList_t,
@@ -746,113 +734,32 @@ void CpuCostModel::CalculateIntolerableTaintsCost(const ResourceDescriptor& rd,
 
 // Pod affinity/anti-affinity
 bool CpuCostModel::MatchExpressionWithPodLabels(
-    const ResourceDescriptor& rd, const LabelSelectorRequirement& expression) {
-  unordered_map<string, vector<TaskID_t>>* label_values =
-      FindOrNull(*labels_map_, expression.key());
-  if (label_values) {
-    for (auto& value : expression.values()) {
-      vector<TaskID_t>* labels_map_tasks = FindOrNull(*label_values, value);
-      if (labels_map_tasks) {
-        for (auto task_id : *labels_map_tasks) {
-          TaskDescriptor* tdp = FindPtrOrNull(*task_map_, task_id);
-          if (tdp) {
-            if (tdp->state() == TaskDescriptor::RUNNING) {
-              ResourceID_t pu_res_id =
-                  ResourceIDFromString(tdp->scheduled_to_resource());
-              ResourceID_t machine_res_id = MachineResIDForResource(pu_res_id);
-              ResourceID_t res_id = ResourceIDFromString(rd.uuid());
-              if (machine_res_id == res_id) {
-                return true;
-              }
-            }
-          }
-        }
-      }
+    const DomainPodCounts& pods, const LabelSelectorRequirement& expression) {
+  for (auto& value : expression.values()) {
+    if (pods.HasLabelValue(expression.key(), value)) {
+      return true;
     }
   }
   return false;
 }
 
 bool CpuCostModel::NotMatchExpressionWithPodLabels(
-    const ResourceDescriptor& rd, const LabelSelectorRequirement& expression) {
-  unordered_map<string, vector<TaskID_t>>* label_values =
-      FindOrNull(*labels_map_, expression.key());
-  if (label_values) {
-    for (auto& value : expression.values()) {
-      vector<TaskID_t>* labels_map_tasks = FindOrNull(*label_values, value);
-      if (labels_map_tasks) {
-        for (auto task_id : *labels_map_tasks) {
-          TaskDescriptor* tdp = FindPtrOrNull(*task_map_, task_id);
-          if (tdp) {
-            if (tdp->state() == TaskDescriptor::RUNNING) {
-              ResourceID_t pu_res_id =
-                  ResourceIDFromString(tdp->scheduled_to_resource());
-              ResourceID_t machine_res_id = MachineResIDForResource(pu_res_id);
-              ResourceID_t res_id = ResourceIDFromString(rd.uuid());
-              if (machine_res_id == res_id) {
-                return false;
-              }
-            }
-          }
-        }
-      }
-    }
-  }
-  return true;
+    const DomainPodCounts& pods, const LabelSelectorRequirement& expression) {
+  return !MatchExpressionWithPodLabels(pods, expression);
 }
 
 bool CpuCostModel::MatchExpressionKeyWithPodLabels(
-    const ResourceDescriptor& rd, const LabelSelectorRequirement& expression) {
-  unordered_map<string, vector<TaskID_t>>* label_values =
-      FindOrNull(*labels_map_, expression.key());
-  if (label_values) {
-    for (auto it = label_values->begin(); it != label_values->end(); it++) {
-      for (auto task_id : it->second) {
-        TaskDescriptor* tdp = FindPtrOrNull(*task_map_, task_id);
-        if (tdp) {
-          if (tdp->state() == TaskDescriptor::RUNNING) {
-            ResourceID_t pu_res_id =
-                ResourceIDFromString(tdp->scheduled_to_resource());
-            ResourceID_t machine_res_id = MachineResIDForResource(pu_res_id);
-            ResourceID_t res_id = ResourceIDFromString(rd.uuid());
-            if (machine_res_id == res_id) {
-              return true;
-            }
-          }
-        }
-      }
-    }
-  }
-  return false;
+    const DomainPodCounts& pods, const LabelSelectorRequirement& expression) {
+  return pods.HasLabelKey(expression.key());
 }
 
 bool CpuCostModel::NotMatchExpressionKeyWithPodLabels(
-    const ResourceDescriptor& rd, const LabelSelectorRequirement& expression) {
-  unordered_map<string, vector<TaskID_t>>* label_values =
-      FindOrNull(*labels_map_, expression.key());
-  if (label_values) {
-    for (auto it = label_values->begin(); it != label_values->end(); it++) {
-      for (auto task_id : it->second) {
-        TaskDescriptor* tdp = FindPtrOrNull(*task_map_, task_id);
-        if (tdp) {
-          if (tdp->state() == TaskDescriptor::RUNNING) {
-            ResourceID_t pu_res_id =
-                ResourceIDFromString(tdp->scheduled_to_resource());
-            ResourceID_t machine_res_id = MachineResIDForResource(pu_res_id);
-            ResourceID_t res_id = ResourceIDFromString(rd.uuid());
-            if (machine_res_id == res_id) {
-              return false;
-            }
-          }
-        }
-      }
-    }
-  }
-  return true;
+    const DomainPodCounts& pods, const LabelSelectorRequirement& expression) {
+  return !MatchExpressionKeyWithPodLabels(pods, expression);
 }
 
 bool CpuCostModel::SatisfiesPodAntiAffinityMatchExpression(
-    const ResourceDescriptor& rd,
+    const DomainPodCounts& pods,
     const LabelSelectorRequirementAntiAff& expression) {
   LabelSelectorRequirement expression_selector;
   expression_selector.set_key(expression.key());
@@ -861,13 +768,15 @@ bool CpuCostModel::SatisfiesPodAntiAffinityMatchExpression(
     expression_selector.add_values(value);
   }
   if (expression.operator_() == std::string("In")) {
-    if (!MatchExpressionWithPodLabels(rd, expression_selector)) return true;
+    if (!MatchExpressionWithPodLabels(pods, expression_selector)) return true;
   } else if (expression.operator_() == std::string("NotIn")) {
-    if (!NotMatchExpressionWithPodLabels(rd, expression_selector)) return true;
+    if (!NotMatchExpressionWithPodLabels(pods, expression_selector))
+      return true;
   } else if (expression.operator_() == std::string("Exists")) {
-    if (!MatchExpressionKeyWithPodLabels(rd, expression_selector)) return true;
+    if (!MatchExpressionKeyWithPodLabels(pods, expression_selector))
+      return true;
   } else if (expression.operator_() == std::string("DoesNotExist")) {
-    if (!NotMatchExpressionKeyWithPodLabels(rd, expression_selector))
+    if (!NotMatchExpressionKeyWithPodLabels(pods, expression_selector))
       return true;
   } else {
     LOG(FATAL) << "Unsupported selector type: " << expression.operator_();
@@ -877,15 +786,15 @@ bool CpuCostModel::SatisfiesPodAntiAffinityMatchExpression(
 }
 
 bool CpuCostModel::SatisfiesPodAffinityMatchExpression(
-    const ResourceDescriptor& rd, const LabelSelectorRequirement& expression) {
+    const DomainPodCounts& pods, const LabelSelectorRequirement& expression) {
   if (expression.operator_() == std::string("In")) {
-    if (MatchExpressionWithPodLabels(rd, expression)) return true;
+    if (MatchExpressionWithPodLabels(pods, expression)) return true;
   } else if (expression.operator_() == std::string("NotIn")) {
-    if (NotMatchExpressionWithPodLabels(rd, expression)) return true;
+    if (NotMatchExpressionWithPodLabels(pods, expression)) return true;
   } else if (expression.operator_() == std::string("Exists")) {
-    if (MatchExpressionKeyWithPodLabels(rd, expression)) return true;
+    if (MatchExpressionKeyWithPodLabels(pods, expression)) return true;
   } else if (expression.operator_() == std::string("DoesNotExist")) {
-    if (NotMatchExpressionKeyWithPodLabels(rd, expression)) return true;
+    if (NotMatchExpressionKeyWithPodLabels(pods, expression)) return true;
   } else {
     LOG(FATAL) << "Unsupported selector type: " << expression.operator_();
     return false;
@@ -894,10 +803,10 @@ bool CpuCostModel::SatisfiesPodAffinityMatchExpression(
 }
 
 bool CpuCostModel::SatisfiesPodAntiAffinityMatchExpressions(
-    const ResourceDescriptor& rd,
+    const DomainPodCounts& pods,
     const RepeatedPtrField<LabelSelectorRequirementAntiAff>& matchexpressions) {
   for (auto& expression : matchexpressions) {
-    if (SatisfiesPodAntiAffinityMatchExpression(rd, expression)) {
+    if (SatisfiesPodAntiAffinityMatchExpression(pods, expression)) {
       continue;
     } else {
       return false;
@@ -907,10 +816,10 @@ bool CpuCostModel::SatisfiesPodAntiAffinityMatchExpressions(
 }
 
 bool CpuCostModel::SatisfiesPodAffinityMatchExpressions(
-    const ResourceDescriptor& rd,
+    const DomainPodCounts& pods,
     const RepeatedPtrField<LabelSelectorRequirement>& matchexpressions) {
   for (auto& expression : matchexpressions) {
-    if (SatisfiesPodAffinityMatchExpression(rd, expression)) {
+    if (SatisfiesPodAffinityMatchExpression(pods, expression)) {
       continue;
     } else {
       return false;
@@ -919,57 +828,50 @@ bool CpuCostModel::SatisfiesPodAffinityMatchExpressions(
   return true;
 }
 
-void CpuCostModel::UpdateResourceToNamespacesMap(ResourceID_t res_id,
-                                                 string task_namespace,
-                                                 bool add) {
-  ResourceID_t machine_res_id = MachineResIDForResource(res_id);
-  vector<string>* task_namespaces =
-                  FindOrNull(resource_to_namespaces_, machine_res_id);
+void CpuCostModel::UpdateTopologyDomainCounts(ResourceID_t res_id,
+                                              const TaskDescriptor& td,
+                                              bool add) {
+  TopologyDomainCounts* topology_domain_counts =
+      knowledge_base_->mutable_topology_domain_counts();
   if (add) {
-    if (task_namespaces) {
-      task_namespaces->push_back(task_namespace);
-    } else {
-      vector<string> t_namespaces;
-      t_namespaces.push_back(task_namespace);
-      InsertIfNotPresent(&resource_to_namespaces_, machine_res_id,
-                                                   t_namespaces);
-    }
+    topology_domain_counts->AddPod(MachineResIDForResource(res_id), td);
   } else {
-    if (task_namespaces) {
-      vector<string>::iterator it = find(task_namespaces->begin(),
-                                        task_namespaces->end(), task_namespace);
-      if (it != task_namespaces->end()) {
-        task_namespaces->erase(it);
-      }
-    }
+    topology_domain_counts->RemovePod(td.uid());
   }
 }
 
+const DomainPodCounts* CpuCostModel::TopologyDomainPods(
+    const ResourceDescriptor& rd, const string& topology_key) {
+  ResourceID_t machine_res_id = ResourceIDFromString(rd.uuid());
+  const DomainPodCounts* pods =
+      knowledge_base_->topology_domain_counts().DomainCounts(machine_res_id,
+                                                             topology_key);
+  // Every machine known to the cost model is its own domain.
+  CHECK(pods || !topology_key.empty());
+  return pods;
+}
+
 bool CpuCostModel::SatisfiesPodAntiAffinityTerm(
     const ResourceDescriptor& rd, const TaskDescriptor& td,
     const PodAffinityTermAntiAff& term) {
-  ResourceID_t machine_res_id =
-               MachineResIDForResource(ResourceIDFromString(rd.uuid()));
-  vector<string>* res_namespaces =
-                  FindOrNull(resource_to_namespaces_, machine_res_id);
-  if (res_namespaces) {
-    if (!term.namespaces_size()) {
-      auto it = find(res_namespaces->begin(), res_namespaces->end(),
-                                              td.task_namespace());
-      if (it != res_namespaces->end()) {
-        return false;
-      }
-    } else {
-      for (auto name : term.namespaces()) {
-        auto it = find(res_namespaces->begin(), res_namespaces->end(), name);
-        if (it != res_namespaces->end()) return false;
-      }
+  const DomainPodCounts* pods = TopologyDomainPods(rd, term.topologykey());
+  if (!pods) {
+    // A machine without the topology key shares no domain with other pods.
+    return true;
+  }
+  if (!term.namespaces_size()) {
+    if (pods->HasNamespace(td.task_namespace())) {
+      return false;
+    }
+  } else {
+    for (auto name : term.namespaces()) {
+      if (pods->HasNamespace(name)) return false;
     }
   }
   if (term.has_labelselector()) {
     if (term.labelselector().matchexpressions_size()) {
       if (!SatisfiesPodAntiAffinityMatchExpressions(
-              rd, term.labelselector().matchexpressions()))
+              *pods, term.labelselector().matchexpressions()))
         return false;
     }
   }
@@ -979,36 +881,28 @@ bool CpuCostModel::SatisfiesPodAntiAffinityTerm(
 bool CpuCostModel::SatisfiesPodAffinityTerm(const ResourceDescriptor& rd,
                                             const TaskDescriptor& td,
                                             const PodAffinityTerm& term) {
-  ResourceID_t machine_res_id =
-               MachineResIDForResource(ResourceIDFromString(rd.uuid()));
-  vector<string>* res_namespaces =
-                  FindOrNull(resource_to_namespaces_, machine_res_id);
-  if (res_namespaces) {
-    vector<string> namespaces;
-    if (!term.namespaces_size()) {
-      auto it = find(res_namespaces->begin(), res_namespaces->end(),
-                                              td.task_namespace());
-      if (it == res_namespaces->end()) {
-        return false;
-      }
-    } else {
-      bool namespace_found = false;
-      for (auto name : term.namespaces()) {
-        auto it = find(res_namespaces->begin(), res_namespaces->end(), name);
-        if (it != res_namespaces->end()) {
-          namespace_found = true;
-          break;
-        }
-      }
-      if (!namespace_found) return false;
+  const DomainPodCounts* pods = TopologyDomainPods(rd, term.topologykey());
+  if (!pods) {
+    return false;
+  }
+  if (!term.namespaces_size()) {
+    if (!pods->HasNamespace(td.task_namespace())) {
+      return false;
     }
   } else {
-    return false;
+    bool namespace_found = false;
+    for (auto name : term.namespaces()) {
+      if (pods->HasNamespace(name)) {
+        namespace_found = true;
+        break;
+      }
+    }
+    if (!namespace_found) return false;
   }
   if (term.has_labelselector()) {
     if (term.labelselector().matchexpressions_size()) {
       if (!SatisfiesPodAffinityMatchExpressions(
-              rd, term.labelselector().matchexpressions()))
+              *pods, term.labelselector().matchexpressions()))
         return false;
     }
   }
@@ -1510,17 +1404,36 @@ vector<EquivClass_t>* CpuCostModel::GetEquivClassToEquivClassesArcs(
     // scores. But we are not clearing it just after scheduling round completed,
     // we are clearing in the subsequent scheduling round, need to improve this.
     ec_to_node_priority_scores.clear();
-    // Added to clear the map before filling the values for each node
-    tolerationSoftEqualMap.clear();
-    tolerationSoftExistsMap.clear();
+    // The resource costs of all the arcs returned are computed in one batch.
+    scored_task_ec_ = ec;
+    scored_arcs_.Clear();
+    scored_arc_positions_.clear();
+    scored_arc_capacities_.clear();
+    const TaskDescriptor* td_ptr = FindOrNull(ec_to_td_requirements, ec);
+    const scheduler::LabelPredicateProgram* label_predicates =
+        FindOrNull(ec_to_label_predicates_, ec);
+    // Filter the machines by node selector and node affinity once for all
+    // machines using the label index.
+    const LabelIndex& label_index = knowledge_base_->label_index();
+    MachineSet_t selected_machines;
+    if (td_ptr) {
+      CHECK_NOTNULL(label_predicates);
+      label_index.MachinesSatisfyingNodeSelectorAndNodeAffinity(
+          *label_predicates, &selected_machines);
+      // Evaluate the tolerations once per group of machines with the same
+      // taints.
+      TolerationMasks* toleration_masks = &ec_to_toleration_masks_[ec];
+      label_index.UpdateTolerationMasks(*label_predicates, toleration_masks);
+      label_index.IntolerableTaintCounts(*toleration_masks,
+                                         &taint_group_intolerable_counts_);
+    }
     for (auto& ec_machines : ecs_for_machines_) {
       ResourceStatus* rs = FindPtrOrNull(*resource_map_, ec_machines.first);
       CHECK_NOTNULL(rs);
       const ResourceDescriptor& rd = rs->topology_node().resource_desc();
-      const TaskDescriptor* td_ptr = FindOrNull(ec_to_td_requirements, ec);
       if (td_ptr) {
         // Checking whether machine satisfies node selector and node affinity.
-        if (scheduler::SatisfiesNodeSelectorAndNodeAffinity(rd, *td_ptr)) {
+        if (label_index.Contains(selected_machines, ec_machines.first)) {
           // Calculate costs for all priorities.
           CalculatePrioritiesCost(ec, rd);
         } else
@@ -1532,8 +1445,10 @@ vector<EquivClass_t>* CpuCostModel::GetEquivClassToEquivClassesArcs(
           continue;
         }
         // Check whether taints in the machine has matching tolerations
-        if (scheduler::HasMatchingTolerationforNodeTaints(rd, *td_ptr)) {
-          CalculateIntolerableTaintsCost(rd, td_ptr, ec);
+        int64_t intolerable_taint_cost = taint_group_intolerable_counts_[
+            label_index.TaintGroup(ec_machines.first)];
+        if (intolerable_taint_cost >= 0) {
+          CalculateIntolerableTaintsCost(rd, intolerable_taint_cost, ec);
         } else {
           continue;
         }
@@ -1558,35 +1473,39 @@ vector<EquivClass_t>* CpuCostModel::GetEquivClassToEquivClassesArcs(
           CalculateNodePreferAvoidPodsPriority(rd, *td_ptr, ec);
         }
       }
-      CpuMemResVector_t available_resources;
-      available_resources.cpu_cores_ =
-          static_cast<uint64_t>(rd.available_resources().cpu_cores());
-      available_resources.ram_cap_ =
-          static_cast<uint64_t>(rd.available_resources().ram_cap());
-      available_resources.ephemeral_storage_ =
-          static_cast<uint64_t>(rd.available_resources().ephemeral_storage());
       ResourceID_t res_id = ResourceIDFromString(rd.uuid());
       vector<EquivClass_t>* ecs_for_machine =
           FindOrNull(ecs_for_machines_, res_id);
       CHECK_NOTNULL(ecs_for_machine);
-      uint64_t index = 0;
-      CpuMemResVector_t cur_resource;
-      uint64_t task_count = rd.num_running_tasks_below() +
-          knowledge_base_->GetResourceNonFirmamentTaskCount(res_id);
-      //TODO(Pratik) : FLAGS_max_tasks_per_pu is treated as equivalent to max-pods,
-      // as max-pods functionality is not yet merged at this point.
-      for (cur_resource = *task_resource_request;
-           cur_resource.cpu_cores_ < available_resources.cpu_cores_ &&
-           cur_resource.ram_cap_ < available_resources.ram_cap_ &&
-           cur_resource.ephemeral_storage_ < available_resources.ephemeral_storage_ &&
-           index < ecs_for_machine->size() && task_count < rd.max_pods();
-           cur_resource.cpu_cores_ += task_resource_request->cpu_cores_,
-          cur_resource.ram_cap_ += task_resource_request->ram_cap_,
-          cur_resource.ephemeral_storage_ += task_resource_request->ephemeral_storage_,
-          index++, task_count++) {
-        pref_ecs->push_back(ec_machines.second[index]);
+      uint64_t num_fit = NumTasksThatFit(*task_resource_request, rd, res_id);
+      int64_t row = machine_resource_table_.FindRow(res_id);
+      CHECK_GE(row, 0);
+      // The machine ECs are ordered by the first task slot they admit.
+      for (uint64_t index = 0; index < ecs_for_machine->size(); ++index) {
+        EquivClass_t machine_ec = (*ecs_for_machine)[index];
+        uint64_t* ec_index_ptr = FindOrNull(ec_to_index_, machine_ec);
+        CHECK_NOTNULL(ec_index_ptr);
+        uint64_t ec_index = *ec_index_ptr;
+        if (ec_index >= num_fit) {
+          break;
+        }
+        pref_ecs->push_back(machine_ec);
+        // Mirrors the capacity and cost index of EquivClassToEquivClass.
+        uint64_t capacity = 1;
+        if (FLAGS_cpu_cost_model_log_machine_segments) {
+          capacity = min(MachineSegmentEnd(ec_index, rd.max_pods()), num_fit) -
+                     ec_index;
+          ec_index += (capacity - 1) / 2;
+        }
+        InsertOrUpdate(&scored_arc_positions_, machine_ec,
+                       scored_arcs_.AddArc(machine_resource_table_, row,
+                                           task_resource_request->cpu_cores_,
+                                           task_resource_request->ram_cap_,
+                                           ec_index));
+        scored_arc_capacities_.push_back(capacity);
       }
     }
+    scored_arcs_.Compute(omega_);
     if (FLAGS_gather_unscheduled_tasks) {
       if (pref_ecs->size() == 0) {
         // So tasks connected to this task EC will never be scheduled, so populate
@@ -1611,13 +1530,21 @@ void CpuCostModel::AddMachine(ResourceTopologyNodeDescriptor* rtnd_ptr) {
   CHECK(rd.type() == ResourceDescriptor::RESOURCE_MACHINE);
   ResourceID_t res_id = ResourceIDFromString(rd.uuid());
   vector<EquivClass_t> machine_ecs;
-  for (uint64_t index = 0; index < rd.max_pods(); ++index) {
+  for (uint64_t index = 0; index < rd.max_pods();
+       index = FLAGS_cpu_cost_model_log_machine_segments
+                   ? MachineSegmentEnd(index, rd.max_pods())
+                   : index + 1) {
     EquivClass_t multi_machine_ec = GetMachineEC(rd.friendly_name(), index);
     machine_ecs.push_back(multi_machine_ec);
     CHECK(InsertIfNotPresent(&ec_to_index_, multi_machine_ec, index));
     CHECK(InsertIfNotPresent(&ec_to_machine_, multi_machine_ec, res_id));
   }
   CHECK(InsertIfNotPresent(&ecs_for_machines_, res_id, machine_ecs));
+  knowledge_base_->mutable_label_index()->AddOrUpdateMachine(res_id, rd);
+  knowledge_base_->mutable_topology_domain_counts()->AddOrUpdateMachine(res_id,
+                                                                        rd);
+  machine_resource_table_.AddOrUpdateMachine(res_id, rd);
+  scored_arc_positions_.clear();
 }
 
 void CpuCostModel::AddTask(TaskID_t task_id) {
@@ -1642,6 +1569,10 @@ void CpuCostModel::RemoveMachine(ResourceID_t res_id) {
     CHECK_EQ(ec_to_index_.erase(ec), 1);
   }
   CHECK_EQ(ecs_for_machines_.erase(res_id), 1);
+  knowledge_base_->mutable_label_index()->RemoveMachine(res_id);
+  knowledge_base_->mutable_topology_domain_counts()->RemoveMachine(res_id);
+  machine_resource_table_.RemoveMachine(res_id);
+  scored_arc_positions_.clear();
 }
 
 void CpuCostModel::RemoveTask(TaskID_t task_id) {
@@ -1649,6 +1580,49 @@ void CpuCostModel::RemoveTask(TaskID_t task_id) {
   task_resource_requirement_.erase(task_id);
 }
 
+void CpuCostModel::RemoveEquivClass(EquivClass_t ec) {
+  // GetTaskEquivClasses recreates the EC's state if a task is in the EC
+  // again.
+  ec_resource_requirement_.erase(ec);
+  ec_to_td_requirements.erase(ec);
+  ec_to_label_predicates_.erase(ec);
+  ec_to_toleration_masks_.erase(ec);
+}
+
+uint64_t CpuCostModel::MachineSegmentEnd(uint64_t segment_start,
+                                         uint64_t max_pods) {
+  return min(max(2 * segment_start, segment_start + 1), max_pods);
+}
+
+uint64_t CpuCostModel::NumTasksThatFit(const CpuMemResVector_t& request,
+                                       const ResourceDescriptor& rd,
+                                       ResourceID_t res_id) {
+  CpuMemResVector_t available_resources;
+  available_resources.cpu_cores_ =
+      static_cast<uint64_t>(rd.available_resources().cpu_cores());
+  available_resources.ram_cap_ =
+      static_cast<uint64_t>(rd.available_resources().ram_cap());
+  available_resources.ephemeral_storage_ =
+      static_cast<uint64_t>(rd.available_resources().ephemeral_storage());
+  uint64_t num_fit = 0;
+  CpuMemResVector_t cur_resource;
+  uint64_t task_count = rd.num_running_tasks_below() +
+      knowledge_base_->GetResourceNonFirmamentTaskCount(res_id);
+  //TODO(Pratik) : FLAGS_max_tasks_per_pu is treated as equivalent to max-pods,
+  // as max-pods functionality is not yet merged at this point.
+  for (cur_resource = request;
+       cur_resource.cpu_cores_ < available_resources.cpu_cores_ &&
+       cur_resource.ram_cap_ < available_resources.ram_cap_ &&
+       cur_resource.ephemeral_storage_ < available_resources.ephemeral_storage_ &&
+       num_fit < rd.max_pods() && task_count < rd.max_pods();
+       cur_resource.cpu_cores_ += request.cpu_cores_,
+      cur_resource.ram_cap_ += request.ram_cap_,
+      cur_resource.ephemeral_storage_ += request.ephemeral_storage_,
+      num_fit++, task_count++) {
+  }
+  return num_fit;
+}
+
 EquivClass_t CpuCostModel::GetMachineEC(const string& machine_name,
                                         uint64_t ec_index) {
   uint64_t hash = HashString(machine_name);
@@ -1656,6 +1630,18 @@ EquivClass_t CpuCostModel::GetMachineEC(const string& machine_name,
   return static_cast<EquivClass_t>(hash);
 }
 
+void CpuCostModel::LeastRequestedAndBalancedCosts(
+    ResourceID_t res_id, const CpuMemResVector_t& request, uint64_t num_tasks,
+    CpuMemCostVector_t* cost_vector) {
+  int64_t row = machine_resource_table_.FindRow(res_id);
+  CHECK_GE(row, 0);
+  single_arc_.Clear();
+  single_arc_.AddArc(machine_resource_table_, row, request.cpu_cores_,
+                     request.ram_cap_, num_tasks);
+  single_arc_.Compute(omega_);
+  SetLeastRequestedAndBalancedCosts(single_arc_, 0, cost_vector);
+}
+
 FlowGraphNode* CpuCostModel::GatherStats(FlowGraphNode* accumulator,
                                          FlowGraphNode* other) {
   if (!accumulator->IsResourceNode()) {
@@ -1713,6 +1699,8 @@ FlowGraphNode* CpuCostModel::GatherStats(FlowGraphNode* accumulator,
     if (accumulator->rd_ptr_ && other->rd_ptr_) {
       AccumulateResourceStats(accumulator->rd_ptr_, other->rd_ptr_);
     }
+    machine_resource_table_.UpdateMachine(accumulator->resource_id_, *rd_ptr);
+    scored_arc_positions_.clear();
   }
   return accumulator;
 }
@@ -1725,6 +1713,11 @@ void CpuCostModel::PrepareStats(FlowGraphNode* accumulator) {
   accumulator->rd_ptr_->clear_num_running_tasks_below();
   accumulator->rd_ptr_->clear_num_slots_below();
   accumulator->rd_ptr_->clear_available_resources();
+  if (accumulator->type_ == FlowNodeType::MACHINE) {
+    machine_resource_table_.UpdateMachine(accumulator->resource_id_,
+                                          *accumulator->rd_ptr_);
+    scored_arc_positions_.clear();
+  }
   // Clear maps related to priority scores.
   ec_to_node_priority_scores.clear();
   ec_to_min_cost_.clear();
@@ -31,7 +31,9 @@
 #include "misc/map-util.h"
 #include "scheduling/common.h"
 #include "scheduling/flow/cost_model_interface.h"
+#include "scheduling/flow/machine_resource_table.h"
 #include "scheduling/knowledge_base.h"
+#include "scheduling/label_utils.h"
 
 namespace firmament {
 
@@ -90,9 +92,7 @@ class CpuCostModel : public CostModelInterface {
  public:
   CpuCostModel(shared_ptr<ResourceMap_t> resource_map,
                shared_ptr<TaskMap_t> task_map,
-               shared_ptr<KnowledgeBase> knowledge_base,
-               unordered_map<string, unordered_map<string, vector<TaskID_t>>>*
-                   labels_map);
+               shared_ptr<KnowledgeBase> knowledge_base);
   // Costs pertaining to leaving tasks unscheduled
   ArcDescriptor TaskToUnscheduledAgg(TaskID_t task_id);
   ArcDescriptor UnscheduledAggToSink(JobID_t job_id);
@@ -118,26 +118,30 @@ class CpuCostModel : public CostModelInterface {
   vector<ResourceID_t>* GetOutgoingEquivClassPrefArcs(EquivClass_t tec);
   vector<ResourceID_t>* GetTaskPreferenceArcs(TaskID_t task_id);
   // Pod anti-affinity
-  bool MatchExpressionWithPodLabels(const ResourceDescriptor& rd,
+  bool MatchExpressionWithPodLabels(const DomainPodCounts& pods,
                                     const LabelSelectorRequirement& expression);
   bool NotMatchExpressionWithPodLabels(
-      const ResourceDescriptor& rd, const LabelSelectorRequirement& expression);
+      const DomainPodCounts& pods, const LabelSelectorRequirement& expression);
   bool MatchExpressionKeyWithPodLabels(
-      const ResourceDescriptor& rd, const LabelSelectorRequirement& expression);
+      const DomainPodCounts& pods, const LabelSelectorRequirement& expression);
   bool NotMatchExpressionKeyWithPodLabels(
-      const ResourceDescriptor& rd, const LabelSelectorRequirement& expression);
+      const DomainPodCounts& pods, const LabelSelectorRequirement& expression);
   bool SatisfiesPodAntiAffinityMatchExpression(
-      const ResourceDescriptor& rd,
+      const DomainPodCounts& pods,
       const LabelSelectorRequirementAntiAff& expression);
   bool SatisfiesPodAffinityMatchExpression(
-      const ResourceDescriptor& rd, const LabelSelectorRequirement& expression);
+      const DomainPodCounts& pods, const LabelSelectorRequirement& expression);
   bool SatisfiesPodAntiAffinityMatchExpressions(
-      const ResourceDescriptor& rd,
+      const DomainPodCounts& pods,
       const RepeatedPtrField<LabelSelectorRequirementAntiAff>&
           matchexpressions);
   bool SatisfiesPodAffinityMatchExpressions(
-      const ResourceDescriptor& rd,
+      const DomainPodCounts& pods,
       const RepeatedPtrField<LabelSelectorRequirement>& matchexpressions);
+  // Returns the counts of the pods in the machine's domain for the topology
+  // key, or NULL if the machine does not carry the key.
+  const DomainPodCounts* TopologyDomainPods(const ResourceDescriptor& rd,
+                                            const string& topology_key);
   bool SatisfiesPodAntiAffinityTerm(const ResourceDescriptor& rd,
                                     const TaskDescriptor& td,
                                     const PodAffinityTermAntiAff& term);
@@ -158,8 +162,8 @@ class CpuCostModel : public CostModelInterface {
                                                   const EquivClass_t ec);
   //Intolerable Taints
   void CalculateIntolerableTaintsCost(const ResourceDescriptor& rd,
-                                                  const TaskDescriptor* td,
-                                                  const EquivClass_t ec);
+                                      int64_t intolerable_taint_cost,
+                                      const EquivClass_t ec);
   void CalculateNodePreferAvoidPodsPriority(const ResourceDescriptor rd,
                                             const TaskDescriptor td,
                                             const EquivClass_t ec);
@@ -167,8 +171,8 @@ class CpuCostModel : public CostModelInterface {
   bool CheckPodAffinityAntiAffinitySymmetryConflict(TaskDescriptor* td_ptr);
   void UpdateResourceToTaskSymmetryMap(ResourceID_t res_id, TaskID_t td);
   void RemoveTaskFromTaskSymmetryMap(TaskDescriptor* td_ptr);
-  void UpdateResourceToNamespacesMap(ResourceID_t res_id,
-                                     string task_namespace, bool add);
+  void UpdateTopologyDomainCounts(ResourceID_t res_id,
+                                  const TaskDescriptor& td, bool add);
   void RemoveECFromPodSymmetryMap(EquivClass_t ec);
   bool SatisfiesSymmetryMatchExpression(
       unordered_multimap<string, string> task_labels,
@@ -207,6 +211,7 @@ class CpuCostModel : public CostModelInterface {
   void AddTask(TaskID_t task_id);
   void RemoveMachine(ResourceID_t res_id);
   void RemoveTask(TaskID_t task_id);
+  void RemoveEquivClass(EquivClass_t ec);
   FlowGraphNode* GatherStats(FlowGraphNode* accumulator, FlowGraphNode* other);
   void PrepareStats(FlowGraphNode* accumulator);
   FlowGraphNode* UpdateStats(FlowGraphNode* accumulator, FlowGraphNode* other);
@@ -228,15 +233,33 @@ class CpuCostModel : public CostModelInterface {
   FRIEND_TEST(CpuCostModelTest, AddTask);
   FRIEND_TEST(CpuCostModelTest, EquivClassToEquivClass);
   FRIEND_TEST(CpuCostModelTest, GetEquivClassToEquivClassesArcs);
+  FRIEND_TEST(CpuCostModelTest, LogMachineSegments);
+  FRIEND_TEST(CpuCostModelTest, LogMachineSegmentsPlacements);
   FRIEND_TEST(CpuCostModelTest, GatherStats);
   FRIEND_TEST(CpuCostModelTest, GetOutgoingEquivClassPrefArcs);
   FRIEND_TEST(CpuCostModelTest, GetTaskEquivClasses);
   FRIEND_TEST(CpuCostModelTest, MachineResIDForResource);
+  FRIEND_TEST(CpuCostModelTest, PodAffinityTopologyDomains);
+  FRIEND_TEST(CpuCostModelTest, PodAffinityTopologyDomainsMigration);
+  FRIEND_TEST(CpuCostModelTest, RemoveEquivClass);
+  FRIEND_TEST(CpuCostModelTest, ScoredArcCosts);
   // Load statistics accumulator helper
   void AccumulateResourceStats(ResourceDescriptor* accumulator,
                                ResourceDescriptor* other);
   Cost_t FlattenCostVector(CpuMemCostVector_t cv);
   EquivClass_t GetMachineEC(const string& machine_name, uint64_t ec_index);
+  // Sets the least requested and balanced resource allocation costs of the
+  // arc that places num_tasks tasks of the request on the machine.
+  void LeastRequestedAndBalancedCosts(ResourceID_t res_id,
+                                      const CpuMemResVector_t& request,
+                                      uint64_t num_tasks,
+                                      CpuMemCostVector_t* cost_vector);
+  // Returns the end of the range of task slots that starts at segment_start
+  // when the slots are split into log-spaced segments.
+  uint64_t MachineSegmentEnd(uint64_t segment_start, uint64_t max_pods);
+  // Returns how many more tasks with the given request fit on the machine.
+  uint64_t NumTasksThatFit(const CpuMemResVector_t& request,
+                           const ResourceDescriptor& rd, ResourceID_t res_id);
   ResourceID_t MachineResIDForResource(ResourceID_t res_id);
   inline const TaskDescriptor& GetTask(TaskID_t task_id) {
     TaskDescriptor* td = FindPtrOrNull(*task_map_, task_id);
@@ -266,18 +289,35 @@ class CpuCostModel : public CostModelInterface {
                                             boost::hash<boost::uuids::uuid>>>
       ec_to_node_priority_scores;
   unordered_map<EquivClass_t, MinMaxScores_t> ec_to_max_min_priority_scores;
-  // Pod affinity/anti-affinity
-  unordered_map<string, unordered_map<string, vector<TaskID_t>>>* labels_map_;
-  unordered_map<ResourceID_t, vector<string>, boost::hash<ResourceID_t>>
-                                                      resource_to_namespaces_;
   // Pod affinity/anti-affinity symmetry
   unordered_map<ResourceID_t, vector<TaskID_t>, boost::hash<ResourceID_t>> 
                                                 resource_to_task_symmetry_map_;
   unordered_set<EquivClass_t> ecs_with_pod_antiaffinity_symmetry_;
   unordered_map<EquivClass_t, ResourceID_t> ec_to_best_fit_resource_;
   unordered_map<EquivClass_t, Cost_t> ec_to_min_cost_;
-  unordered_map<string, string> tolerationSoftEqualMap;
-  unordered_map<string, string> tolerationSoftExistsMap;
+  // The node selector, node affinity and tolerations of every task EC,
+  // compiled for evaluation against the machines in the label index.
+  unordered_map<EquivClass_t, scheduler::LabelPredicateProgram>
+      ec_to_label_predicates_;
+  // The taints every task EC does not tolerate.
+  unordered_map<EquivClass_t, TolerationMasks> ec_to_toleration_masks_;
+  // Scratch space of GetEquivClassToEquivClassesArcs: the number of soft
+  // taints the current EC does not tolerate, per taint group, or -1 if it
+  // does not tolerate a hard taint of the group.
+  vector<int64_t> taint_group_intolerable_counts_;
+  // The capacity and available resources of every machine, kept as arrays
+  // so that the resource costs of many arcs are computed in one batch.
+  MachineResourceTable machine_resource_table_;
+  // The resource costs of the arcs from scored_task_ec_ to the machine ECs
+  // returned by the last GetEquivClassToEquivClassesArcs call for it,
+  // together with the arcs' positions in the batch and their capacities.
+  // Cleared whenever the machines' available resources change.
+  EquivClass_t scored_task_ec_;
+  ResourceCostBatch scored_arcs_;
+  unordered_map<EquivClass_t, size_t> scored_arc_positions_;
+  vector<uint64_t> scored_arc_capacities_;
+  // Scratch space for the costs of arcs that have not been scored in batch.
+  ResourceCostBatch single_arc_;
   unordered_set<EquivClass_t> task_ec_with_no_pref_arcs_set_;
   vector<EquivClass_t> task_ec_with_no_pref_arcs_;
   unordered_map<EquivClass_t, vector<uint64_t>> task_ec_to_connected_tasks_;
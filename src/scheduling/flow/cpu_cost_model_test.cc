@@ -33,6 +33,7 @@
 #include "scheduling/knowledge_base.h"
 #include "scheduling/label_utils.h"
 
+DECLARE_bool(cpu_cost_model_log_machine_segments);
 DECLARE_uint64(max_multi_arcs_for_cpu);
 DECLARE_uint64(max_tasks_per_pu);
 
@@ -49,8 +50,7 @@ class CpuCostModelTest : public ::testing::Test {
     resource_map_.reset(new ResourceMap_t);
     task_map_.reset(new TaskMap_t);
     knowledge_base_.reset(new KnowledgeBase);
-    cost_model =
-        new CpuCostModel(resource_map_, task_map_, knowledge_base_, NULL);
+    cost_model = new CpuCostModel(resource_map_, task_map_, knowledge_base_);
   }
 
   virtual ~CpuCostModelTest() {
@@ -245,6 +245,384 @@ TEST_F(CpuCostModelTest, GetEquivClassToEquivClassesArcs) {
   delete equiv_to_equiv_arcs;
 }
 
+TEST_F(CpuCostModelTest, LogMachineSegments) {
+  FLAGS_cpu_cost_model_log_machine_segments = true;
+  // Create Task.
+  JobDescriptor test_job;
+  TaskDescriptor* td_ptr = CreateTask(&test_job, 45);
+  InsertIfNotPresent(cost_model->task_map_.get(), td_ptr->uid(), td_ptr);
+  TaskID_t task_id = td_ptr->uid();
+  td_ptr->mutable_resource_request()->set_cpu_cores(20.0);
+  td_ptr->mutable_resource_request()->set_ram_cap(1000);
+  cost_model->AddTask(task_id);
+  vector<EquivClass_t>* equiv_classes =
+      cost_model->GetTaskEquivClasses(task_id);
+  // Create a machine that has 110 task slots, of which 15 fit the task.
+  ResourceID_t res_id = GenerateResourceID("Machine1");
+  ResourceTopologyNodeDescriptor rtnd;
+  ResourceDescriptor* rd_ptr = rtnd.mutable_resource_desc();
+  rd_ptr->set_friendly_name("Machine1");
+  rd_ptr->set_uuid(to_string(res_id));
+  rd_ptr->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+  rd_ptr->set_max_pods(110);
+  ResourceVector* resource_capacity = rd_ptr->mutable_resource_capacity();
+  ResourceVector* available_resources = rd_ptr->mutable_available_resources();
+  resource_capacity->set_cpu_cores(1000.0);
+  resource_capacity->set_ram_cap(32000);
+  resource_capacity->set_ephemeral_storage(1000);
+  available_resources->set_cpu_cores(500.0);
+  available_resources->set_ram_cap(16000);
+  available_resources->set_ephemeral_storage(1000);
+  ResourceStatus resource_status =
+      ResourceStatus(rd_ptr, &rtnd, rd_ptr->friendly_name(), 0);
+  CHECK(InsertIfNotPresent(resource_map_.get(), res_id, &resource_status));
+  cost_model->AddMachine(&rtnd);
+  // The slots are split into the segments starting at 0, 1, 2, 4, 8, 16, 32
+  // and 64.
+  vector<EquivClass_t>& machine_ecs = cost_model->ecs_for_machines_[res_id];
+  EXPECT_EQ(8U, machine_ecs.size());
+  EXPECT_EQ(64U, cost_model->ec_to_index_[machine_ecs[7]]);
+  EXPECT_EQ(46U, cost_model->EquivClassToResourceNode(machine_ecs[7],
+                                                      res_id).capacity_);
+  // Only the segments starting below 15 admit the task.
+  vector<EquivClass_t>* equiv_to_equiv_arcs =
+      cost_model->GetEquivClassToEquivClassesArcs((*equiv_classes)[0]);
+  EXPECT_EQ(5U, equiv_to_equiv_arcs->size());
+  ArcDescriptor arc_first = cost_model->EquivClassToEquivClass(
+      (*equiv_classes)[0], machine_ecs[0]);
+  ArcDescriptor arc_last = cost_model->EquivClassToEquivClass(
+      (*equiv_classes)[0], machine_ecs[4]);
+  EXPECT_EQ(1U, arc_first.capacity_);
+  // The last segment is cut short at the 15th slot.
+  EXPECT_EQ(7U, arc_last.capacity_);
+  EXPECT_LT(arc_first.cost_, arc_last.cost_);
+  EXPECT_EQ(0U, cost_model->EquivClassToEquivClass(
+      (*equiv_classes)[0], machine_ecs[5]).capacity_);
+  // Clean up.
+  cost_model->RemoveTask(task_id);
+  delete equiv_classes;
+  delete equiv_to_equiv_arcs;
+  cost_model->RemoveMachine(res_id);
+  cost_model->resource_map_.get()->erase(res_id);
+  FLAGS_cpu_cost_model_log_machine_segments = false;
+}
+
+// The log-spaced segments charge all the tasks in a segment the same cost,
+// but still spread the tasks over a small cluster much like one EC per slot.
+TEST_F(CpuCostModelTest, LogMachineSegmentsPlacements) {
+  JobDescriptor test_job;
+  TaskDescriptor* td_ptr = CreateTask(&test_job, 46);
+  InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr);
+  td_ptr->mutable_resource_request()->set_cpu_cores(20.0);
+  td_ptr->mutable_resource_request()->set_ram_cap(1000);
+  // Machine1 has more resources available than Machine2.
+  ResourceTopologyNodeDescriptor rtnds[2];
+  vector<ResourceID_t> res_ids;
+  vector<ResourceStatus*> resource_statuses;
+  for (uint64_t index = 0; index < 2; ++index) {
+    string machine_name = "Machine" + to_string(index + 1);
+    ResourceID_t res_id = GenerateResourceID(machine_name);
+    ResourceDescriptor* rd_ptr = rtnds[index].mutable_resource_desc();
+    rd_ptr->set_friendly_name(machine_name);
+    rd_ptr->set_uuid(to_string(res_id));
+    rd_ptr->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    rd_ptr->set_max_pods(32);
+    ResourceVector* resource_capacity = rd_ptr->mutable_resource_capacity();
+    ResourceVector* available_resources =
+        rd_ptr->mutable_available_resources();
+    resource_capacity->set_cpu_cores(1000.0);
+    resource_capacity->set_ram_cap(32000);
+    resource_capacity->set_ephemeral_storage(1000);
+    available_resources->set_cpu_cores(index == 0 ? 500.0 : 400.0);
+    available_resources->set_ram_cap(index == 0 ? 20000 : 16000);
+    available_resources->set_ephemeral_storage(1000);
+    resource_statuses.push_back(
+        new ResourceStatus(rd_ptr, &rtnds[index], machine_name, 0));
+    CHECK(InsertIfNotPresent(resource_map_.get(), res_id,
+                             resource_statuses.back()));
+    res_ids.push_back(res_id);
+  }
+  // Places the tasks like the solver would: a min-cost flow through the task
+  // EC to the machine ECs takes the cheapest arcs first.
+  map<ResourceID_t, uint64_t> placements[2];
+  for (uint64_t mode = 0; mode < 2; ++mode) {
+    FLAGS_cpu_cost_model_log_machine_segments = mode == 1;
+    CpuCostModel cpu_cost_model(resource_map_, task_map_, knowledge_base_);
+    for (auto& rtnd : rtnds) {
+      cpu_cost_model.AddMachine(&rtnd);
+    }
+    cpu_cost_model.AddTask(td_ptr->uid());
+    vector<EquivClass_t>* equiv_classes =
+        cpu_cost_model.GetTaskEquivClasses(td_ptr->uid());
+    EquivClass_t task_ec = (*equiv_classes)[0];
+    vector<EquivClass_t>* machine_ecs =
+        cpu_cost_model.GetEquivClassToEquivClassesArcs(task_ec);
+    vector<pair<int64_t, EquivClass_t>> slots;
+    for (auto& machine_ec : *machine_ecs) {
+      ArcDescriptor arc =
+          cpu_cost_model.EquivClassToEquivClass(task_ec, machine_ec);
+      slots.insert(slots.end(), arc.capacity_,
+                   make_pair(arc.cost_, machine_ec));
+    }
+    stable_sort(slots.begin(), slots.end(),
+                [](const pair<int64_t, EquivClass_t>& slot1,
+                   const pair<int64_t, EquivClass_t>& slot2) {
+                  return slot1.first < slot2.first;
+                });
+    for (uint64_t index = 0; index < min<size_t>(16, slots.size()); ++index) {
+      placements[mode][cpu_cost_model.ec_to_machine_[slots[index].second]]++;
+    }
+    delete machine_ecs;
+    delete equiv_classes;
+    cpu_cost_model.RemoveTask(td_ptr->uid());
+    for (auto& res_id : res_ids) {
+      cpu_cost_model.RemoveMachine(res_id);
+    }
+  }
+  FLAGS_cpu_cost_model_log_machine_segments = false;
+  // One EC per slot places 10 tasks on Machine1 and 6 on Machine2. Both
+  // modes place all the tasks, use both machines, and prefer Machine1.
+  for (uint64_t mode = 0; mode < 2; ++mode) {
+    EXPECT_EQ(16U, placements[mode][res_ids[0]] + placements[mode][res_ids[1]]);
+    EXPECT_GT(placements[mode][res_ids[1]], 0U);
+    EXPECT_GE(placements[mode][res_ids[0]], placements[mode][res_ids[1]]);
+  }
+  // Every segment costs as much as its middle slot, and so a machine gets
+  // at most half a segment (here, the slots 8 to 15) more or fewer tasks.
+  for (auto& res_id : res_ids) {
+    EXPECT_NEAR(placements[0][res_id], placements[1][res_id], 4);
+  }
+  // Clean up.
+  for (uint64_t index = 0; index < 2; ++index) {
+    resource_map_->erase(res_ids[index]);
+    delete resource_statuses[index];
+  }
+}
+
+TEST_F(CpuCostModelTest, PodAffinityTopologyDomains) {
+  // Create machines 1 and 2 in zone a, and machine 3 in zone b.
+  ResourceTopologyNodeDescriptor rtnds[3];
+  vector<ResourceID_t> res_ids;
+  vector<ResourceStatus*> resource_statuses;
+  for (uint64_t index = 0; index < 3; ++index) {
+    string machine_name = "Machine" + to_string(index + 1);
+    ResourceID_t res_id = GenerateResourceID(machine_name);
+    ResourceDescriptor* rd_ptr = rtnds[index].mutable_resource_desc();
+    rd_ptr->set_friendly_name(machine_name);
+    rd_ptr->set_uuid(to_string(res_id));
+    rd_ptr->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    Label* zone_label = rd_ptr->add_labels();
+    zone_label->set_key("zone");
+    zone_label->set_value(index < 2 ? "a" : "b");
+    resource_statuses.push_back(
+        new ResourceStatus(rd_ptr, &rtnds[index], machine_name, 0));
+    CHECK(InsertIfNotPresent(resource_map_.get(), res_id,
+                             resource_statuses.back()));
+    cost_model->AddMachine(&rtnds[index]);
+    res_ids.push_back(res_id);
+  }
+  // Place a database pod on machine 1.
+  JobDescriptor db_job;
+  TaskDescriptor* db_td_ptr = CreateTask(&db_job, 42);
+  db_td_ptr->set_task_namespace("default");
+  Label* app_label = db_td_ptr->add_labels();
+  app_label->set_key("app");
+  app_label->set_value("db");
+  cost_model->UpdateTopologyDomainCounts(res_ids[0], *db_td_ptr, true);
+  // A pod that wants to run next to the database.
+  TaskDescriptor td;
+  td.set_task_namespace("default");
+  PodAffinityTerm affinity_term;
+  LabelSelectorRequirement* expression =
+      affinity_term.mutable_labelselector()->add_matchexpressions();
+  expression->set_key("app");
+  expression->set_operator_("In");
+  expression->add_values("db");
+  PodAffinityTermAntiAff anti_affinity_term;
+  LabelSelectorRequirementAntiAff* anti_expression =
+      anti_affinity_term.mutable_labelselector()->add_matchexpressions();
+  anti_expression->set_key("app");
+  anti_expression->set_operator_("In");
+  anti_expression->add_values("db");
+  const ResourceDescriptor& rd2 = rtnds[1].resource_desc();
+  const ResourceDescriptor& rd3 = rtnds[2].resource_desc();
+  // Without a topology key, every machine is its own domain.
+  EXPECT_TRUE(cost_model->SatisfiesPodAffinityTerm(rtnds[0].resource_desc(),
+                                                   td, affinity_term));
+  EXPECT_FALSE(cost_model->SatisfiesPodAffinityTerm(rd2, td, affinity_term));
+  EXPECT_TRUE(cost_model->SatisfiesPodAntiAffinityTerm(rd2, td,
+                                                       anti_affinity_term));
+  // With the zone as topology key, machine 2 shares the database's domain.
+  affinity_term.set_topologykey("zone");
+  anti_affinity_term.set_topologykey("zone");
+  EXPECT_TRUE(cost_model->SatisfiesPodAffinityTerm(rd2, td, affinity_term));
+  EXPECT_FALSE(cost_model->SatisfiesPodAffinityTerm(rd3, td, affinity_term));
+  EXPECT_FALSE(cost_model->SatisfiesPodAntiAffinityTerm(rd2, td,
+                                                        anti_affinity_term));
+  EXPECT_TRUE(cost_model->SatisfiesPodAntiAffinityTerm(rd3, td,
+                                                       anti_affinity_term));
+  // Once the database pod completes, no machine is next to it.
+  cost_model->UpdateTopologyDomainCounts(res_ids[0], *db_td_ptr, false);
+  EXPECT_FALSE(cost_model->SatisfiesPodAffinityTerm(rd2, td, affinity_term));
+  EXPECT_TRUE(cost_model->SatisfiesPodAntiAffinityTerm(rd2, td,
+                                                       anti_affinity_term));
+  // Clean up.
+  for (uint64_t index = 0; index < 3; ++index) {
+    cost_model->RemoveMachine(res_ids[index]);
+    cost_model->resource_map_.get()->erase(res_ids[index]);
+    delete resource_statuses[index];
+  }
+}
+
+// A migrated pod counts towards the topology domain of its new machine only.
+TEST_F(CpuCostModelTest, PodAffinityTopologyDomainsMigration) {
+  // Create machines 1 and 2 in zone a, and machine 3 in zone b.
+  ResourceTopologyNodeDescriptor rtnds[3];
+  vector<ResourceID_t> res_ids;
+  vector<ResourceStatus*> resource_statuses;
+  for (uint64_t index = 0; index < 3; ++index) {
+    string machine_name = "Machine" + to_string(index + 1);
+    ResourceID_t res_id = GenerateResourceID(machine_name);
+    ResourceDescriptor* rd_ptr = rtnds[index].mutable_resource_desc();
+    rd_ptr->set_friendly_name(machine_name);
+    rd_ptr->set_uuid(to_string(res_id));
+    rd_ptr->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    Label* zone_label = rd_ptr->add_labels();
+    zone_label->set_key("zone");
+    zone_label->set_value(index < 2 ? "a" : "b");
+    resource_statuses.push_back(
+        new ResourceStatus(rd_ptr, &rtnds[index], machine_name, 0));
+    CHECK(InsertIfNotPresent(resource_map_.get(), res_id,
+                             resource_statuses.back()));
+    cost_model->AddMachine(&rtnds[index]);
+    res_ids.push_back(res_id);
+  }
+  // Place a database pod on machine 1.
+  JobDescriptor db_job;
+  TaskDescriptor* db_td_ptr = CreateTask(&db_job, 43);
+  db_td_ptr->set_task_namespace("default");
+  Label* app_label = db_td_ptr->add_labels();
+  app_label->set_key("app");
+  app_label->set_value("db");
+  cost_model->UpdateTopologyDomainCounts(res_ids[0], *db_td_ptr, true);
+  // A pod that wants to run in the same zone as the database.
+  TaskDescriptor td;
+  td.set_task_namespace("default");
+  PodAffinityTerm affinity_term;
+  affinity_term.set_topologykey("zone");
+  LabelSelectorRequirement* expression =
+      affinity_term.mutable_labelselector()->add_matchexpressions();
+  expression->set_key("app");
+  expression->set_operator_("In");
+  expression->add_values("db");
+  const ResourceDescriptor& rd2 = rtnds[1].resource_desc();
+  const ResourceDescriptor& rd3 = rtnds[2].resource_desc();
+  EXPECT_TRUE(cost_model->SatisfiesPodAffinityTerm(rd2, td, affinity_term));
+  EXPECT_FALSE(cost_model->SatisfiesPodAffinityTerm(rd3, td, affinity_term));
+  // Migrate the database pod to machine 3, as FlowScheduler does.
+  cost_model->UpdateTopologyDomainCounts(res_ids[0], *db_td_ptr, false);
+  cost_model->UpdateTopologyDomainCounts(res_ids[2], *db_td_ptr, true);
+  EXPECT_FALSE(cost_model->SatisfiesPodAffinityTerm(rd2, td, affinity_term));
+  EXPECT_TRUE(cost_model->SatisfiesPodAffinityTerm(rd3, td, affinity_term));
+  // Clean up.
+  cost_model->UpdateTopologyDomainCounts(res_ids[2], *db_td_ptr, false);
+  for (uint64_t index = 0; index < 3; ++index) {
+    cost_model->RemoveMachine(res_ids[index]);
+    cost_model->resource_map_.get()->erase(res_ids[index]);
+    delete resource_statuses[index];
+  }
+}
+
+TEST_F(CpuCostModelTest, RemoveEquivClass) {
+  JobDescriptor test_job;
+  TaskDescriptor* td_ptr = CreateTask(&test_job, 46);
+  InsertIfNotPresent(cost_model->task_map_.get(), td_ptr->uid(), td_ptr);
+  TaskID_t task_id = td_ptr->uid();
+  td_ptr->mutable_resource_request()->set_cpu_cores(20.0);
+  td_ptr->mutable_resource_request()->set_ram_cap(1000);
+  cost_model->AddTask(task_id);
+  vector<EquivClass_t>* equiv_classes =
+      cost_model->GetTaskEquivClasses(task_id);
+  CHECK_EQ(equiv_classes->size(), 1U);
+  EquivClass_t ec = (*equiv_classes)[0];
+  delete equiv_classes;
+  cost_model->ec_to_toleration_masks_[ec];
+  EXPECT_TRUE(ContainsKey(cost_model->ec_resource_requirement_, ec));
+  EXPECT_TRUE(ContainsKey(cost_model->ec_to_td_requirements, ec));
+  EXPECT_TRUE(ContainsKey(cost_model->ec_to_label_predicates_, ec));
+  // Removing the EC drops all the state kept for it.
+  cost_model->RemoveEquivClass(ec);
+  EXPECT_FALSE(ContainsKey(cost_model->ec_resource_requirement_, ec));
+  EXPECT_FALSE(ContainsKey(cost_model->ec_to_td_requirements, ec));
+  EXPECT_FALSE(ContainsKey(cost_model->ec_to_label_predicates_, ec));
+  EXPECT_FALSE(ContainsKey(cost_model->ec_to_toleration_masks_, ec));
+  // The state is recreated when a task is in the EC again.
+  delete cost_model->GetTaskEquivClasses(task_id);
+  EXPECT_TRUE(ContainsKey(cost_model->ec_resource_requirement_, ec));
+  EXPECT_TRUE(ContainsKey(cost_model->ec_to_td_requirements, ec));
+  EXPECT_TRUE(ContainsKey(cost_model->ec_to_label_predicates_, ec));
+  cost_model->RemoveTask(task_id);
+}
+
+TEST_F(CpuCostModelTest, ScoredArcCosts) {
+  JobDescriptor test_job;
+  TaskDescriptor* td_ptr = CreateTask(&test_job, 42);
+  CHECK(InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr));
+  TaskID_t task_id = td_ptr->uid();
+  td_ptr->mutable_resource_request()->set_cpu_cores(20.0);
+  td_ptr->mutable_resource_request()->set_ram_cap(1000);
+  cost_model->AddTask(task_id);
+  vector<EquivClass_t>* equiv_classes =
+      cost_model->GetTaskEquivClasses(task_id);
+  // Create a machine whose CPU and RAM are unevenly used, on which 9 tasks
+  // fit.
+  ResourceID_t res_id = GenerateResourceID("Machine1");
+  ResourceTopologyNodeDescriptor rtnd;
+  ResourceDescriptor* rd_ptr = rtnd.mutable_resource_desc();
+  rd_ptr->set_friendly_name("Machine1");
+  rd_ptr->set_uuid(to_string(res_id));
+  rd_ptr->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+  rd_ptr->set_max_pods(110);
+  ResourceVector* resource_capacity = rd_ptr->mutable_resource_capacity();
+  ResourceVector* available_resources = rd_ptr->mutable_available_resources();
+  resource_capacity->set_cpu_cores(1000.0);
+  resource_capacity->set_ram_cap(32000);
+  resource_capacity->set_ephemeral_storage(1000);
+  available_resources->set_cpu_cores(700.0);
+  available_resources->set_ram_cap(10000);
+  available_resources->set_ephemeral_storage(1000);
+  ResourceStatus resource_status =
+      ResourceStatus(rd_ptr, &rtnd, rd_ptr->friendly_name(), 0);
+  CHECK(InsertIfNotPresent(resource_map_.get(), res_id, &resource_status));
+  cost_model->AddMachine(&rtnd);
+  vector<EquivClass_t>& machine_ecs = cost_model->ecs_for_machines_[res_id];
+  vector<EquivClass_t>* equiv_to_equiv_arcs =
+      cost_model->GetEquivClassToEquivClassesArcs((*equiv_classes)[0]);
+  EXPECT_EQ(9U, equiv_to_equiv_arcs->size());
+  EXPECT_EQ(9U, cost_model->scored_arc_positions_.size());
+  vector<Cost_t> scored_arc_costs;
+  for (uint64_t index = 0; index < 9; ++index) {
+    ArcDescriptor arc = cost_model->EquivClassToEquivClass(
+        (*equiv_classes)[0], machine_ecs[index]);
+    scored_arc_costs.push_back(arc.cost_);
+    EXPECT_EQ(1U, arc.capacity_);
+  }
+  EXPECT_LT(scored_arc_costs[0], scored_arc_costs[8]);
+  // The arcs cost the same when they are costed one at a time.
+  cost_model->scored_arc_positions_.clear();
+  for (uint64_t index = 0; index < 9; ++index) {
+    EXPECT_EQ(scored_arc_costs[index], cost_model->EquivClassToEquivClass(
+        (*equiv_classes)[0], machine_ecs[index]).cost_);
+  }
+  // Clean up.
+  cost_model->RemoveTask(task_id);
+  delete equiv_classes;
+  delete equiv_to_equiv_arcs;
+  cost_model->RemoveMachine(res_id);
+  cost_model->resource_map_.get()->erase(res_id);
+  EXPECT_TRUE(cost_model->scored_arc_positions_.empty());
+}
+
 TEST_F(CpuCostModelTest, GatherStats) {
   // Create machine Machine1.
   ResourceID_t res_id1 = GenerateResourceID("Machine1");
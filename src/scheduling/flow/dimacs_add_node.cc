@@ -23,6 +23,8 @@
 
 #include "scheduling/flow/dimacs_add_node.h"
 
+#include "scheduling/flow/dimacs_binary_format.h"
+
 namespace firmament {
 
 // Node type is used to construct the mapping of tasks to PUs in the solver.
@@ -40,7 +42,8 @@ enum NodeType {
 
 DIMACSAddNode::DIMACSAddNode(const FlowGraphNode& node,
                              const vector<FlowGraphArc*>& arcs) :
-     DIMACSChange(), id_(node.id_), excess_(node.excess_), type_(node.type_) {
+     PooledDIMACSChange(ADD_NODE), id_(node.id_), excess_(node.excess_),
+     type_(node.type_) {
   for (FlowGraphArc* arc : arcs) {
     // NOTE: The DIMACS stats for these new arcs have already been updated when
     // the arcs were created.
@@ -58,6 +61,16 @@ const string DIMACSAddNode::GenerateChange() const {
   return ss.str();
 }
 
+void DIMACSAddNode::GenerateBinaryChange(string* buffer) const {
+  AppendBinaryRecordType(BINARY_RECORD_NODE, buffer);
+  AppendBinaryUInt64(id_, buffer);
+  AppendBinaryInt64(excess_, buffer);
+  AppendBinaryUInt32(GetNodeType(), buffer);
+  for (const DIMACSNewArc &new_arc : arc_additions_) {
+    new_arc.GenerateBinaryChange(buffer);
+  }
+}
+
 uint32_t DIMACSAddNode::GetNodeType() const {
   if (type_ == FlowNodeType::PU) {
     return DIMACS_NODE_PU;
@@ -33,11 +33,12 @@
 
 namespace firmament {
 
-class DIMACSAddNode : public DIMACSChange {
+class DIMACSAddNode : public PooledDIMACSChange<DIMACSAddNode> {
  public:
   DIMACSAddNode(const FlowGraphNode& node, const vector<FlowGraphArc*>& arcs);
   ~DIMACSAddNode() {}
   const string GenerateChange() const;
+  void GenerateBinaryChange(string* buffer) const;
   uint32_t GetNodeType() const;
   const uint64_t id_;
   const int64_t excess_;
@@ -0,0 +1,139 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Compact binary alternative to the DIMACS text format used to communicate
+// with the solvers. Every record starts with a one byte record type, which
+// matches the line prefix of the equivalent DIMACS line, followed by the
+// record's fixed-width little-endian fields:
+//
+//   'p' problem:          num_nodes u64, num_arcs u64
+//   'n' node:             id u64, excess i64, type u32
+//   'a' new arc:          src u64, dst u64, cap_lb u64, cap_ub u64, cost i64,
+//                         type u32
+//   'x' changed arc:      the fields of a new arc, followed by old_cost i64
+//   'r' removed node:     id u64
+//   'e' end of iteration: no fields
+//   'q' end of stream:    no fields
+//
+// The solver replies with:
+//
+//   'f' flow:             src u64, dst u64, flow u64
+//   'm' assignment:       task node id u64, PU node id u64
+//   's' solution cost:    cost i64
+//   't' algorithm time:   runtime u64
+//   'e' end of iteration: no fields
+//
+// The format is only used if -flowlessly_binary_protocol is set, and it is
+// off by default. It relies on the solver: Flowlessly must accept the
+// --binary_protocol=true flag and read and write the records above. The
+// Flowlessly builds in cmake/ExternalDependencies.cmake are not known to do
+// so, so the solver binary must be provided separately (see
+// -flowlessly_binary) when the flag is set. The SolverDispatcher refuses to
+// start if the binary does not accept --binary_protocol=true.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_DIMACS_BINARY_FORMAT_H
+#define FIRMAMENT_SCHEDULING_FLOW_DIMACS_BINARY_FORMAT_H
+
+#include <endian.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "base/types.h"
+
+namespace firmament {
+
+enum DIMACSBinaryRecordType {
+  BINARY_RECORD_PROBLEM = 'p',
+  BINARY_RECORD_NODE = 'n',
+  BINARY_RECORD_NEW_ARC = 'a',
+  BINARY_RECORD_CHANGE_ARC = 'x',
+  BINARY_RECORD_REMOVE_NODE = 'r',
+  BINARY_RECORD_END_OF_ITERATION = 'e',
+  BINARY_RECORD_END_OF_STREAM = 'q',
+  BINARY_RECORD_FLOW = 'f',
+  BINARY_RECORD_ASSIGNMENT = 'm',
+  BINARY_RECORD_COST = 's',
+  BINARY_RECORD_ALGORITHM_TIME = 't',
+};
+
+// Sizes (in bytes) of the records' fields, excluding the record type.
+const size_t kBinaryProblemSize = 16;
+const size_t kBinaryNodeSize = 20;
+const size_t kBinaryNewArcSize = 44;
+const size_t kBinaryChangeArcSize = 52;
+const size_t kBinaryRemoveNodeSize = 8;
+const size_t kBinaryFlowSize = 24;
+const size_t kBinaryAssignmentSize = 16;
+const size_t kBinaryCostSize = 8;
+const size_t kBinaryAlgorithmTimeSize = 8;
+
+inline void AppendBinaryRecordType(DIMACSBinaryRecordType type,
+                                   string* buffer) {
+  buffer->push_back(static_cast<char>(type));
+}
+
+inline void AppendBinaryUInt32(uint32_t value, string* buffer) {
+  uint32_t le_value = htole32(value);
+  buffer->append(reinterpret_cast<const char*>(&le_value), sizeof(le_value));
+}
+
+inline void AppendBinaryUInt64(uint64_t value, string* buffer) {
+  uint64_t le_value = htole64(value);
+  buffer->append(reinterpret_cast<const char*>(&le_value), sizeof(le_value));
+}
+
+inline void AppendBinaryInt64(int64_t value, string* buffer) {
+  AppendBinaryUInt64(static_cast<uint64_t>(value), buffer);
+}
+
+inline uint64_t ParseBinaryUInt64(const char* data) {
+  uint64_t le_value;
+  memcpy(&le_value, data, sizeof(le_value));
+  return le64toh(le_value);
+}
+
+inline int64_t ParseBinaryInt64(const char* data) {
+  return static_cast<int64_t>(ParseBinaryUInt64(data));
+}
+
+// Returns the size of the fields of a record the solver sends, or -1 if the
+// record type is unknown.
+inline int64_t BinaryResultRecordSize(char type) {
+  switch (type) {
+    case BINARY_RECORD_FLOW:
+      return kBinaryFlowSize;
+    case BINARY_RECORD_ASSIGNMENT:
+      return kBinaryAssignmentSize;
+    case BINARY_RECORD_COST:
+      return kBinaryCostSize;
+    case BINARY_RECORD_ALGORITHM_TIME:
+      return kBinaryAlgorithmTimeSize;
+    case BINARY_RECORD_END_OF_ITERATION:
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+} // namespace firmament
+
+#endif // FIRMAMENT_SCHEDULING_FLOW_DIMACS_BINARY_FORMAT_H
@@ -23,12 +23,24 @@
 
 #include <string>
 
+#include <boost/thread/mutex.hpp>
+
 #include "base/types.h"
+#include "misc/slab_allocator.h"
 
 namespace firmament {
 
 class DIMACSChange {
  public:
+  enum Kind {
+    ADD_NODE = 0,
+    REMOVE_NODE = 1,
+    NEW_ARC = 2,
+    CHANGE_ARC = 3,
+  };
+
+  explicit DIMACSChange(Kind kind) : kind_(kind) {
+  }
   virtual ~DIMACSChange() {
   }
   virtual const string& comment() const {
@@ -39,6 +51,13 @@ class DIMACSChange {
       comment_ = comment;
     }
   }
+  /**
+   * Returns the type of the change, which callers can switch on instead of
+   * trying dynamic_casts to all the change classes.
+   */
+  inline Kind kind() const {
+    return kind_;
+  }
 
   const string GenerateChangeDescription() const {
     if (!comment_.empty()) {
@@ -51,11 +70,65 @@ class DIMACSChange {
   }
 
   virtual const std::string GenerateChange() const = 0;
+  /**
+   * Appends the change in the binary format (see dimacs_binary_format.h) to
+   * the buffer. Comments are not part of the binary format.
+   */
+  virtual void GenerateBinaryChange(string* buffer) const = 0;
 
  protected:
+  const Kind kind_;
   string comment_;
 };
 
+// Base class of the change types T. A change is logged for every graph
+// mutation between two solver runs, so the changes are carved out of a slab
+// allocator per type instead of being allocated individually on the heap.
+// The slots of the changes deleted after a solver run are reused by the
+// changes of the next one.
+template <typename T>
+class PooledDIMACSChange : public DIMACSChange {
+ public:
+  static void* operator new(size_t size) {
+    if (size != sizeof(T)) {
+      // A subclass of T.
+      return ::operator new(size);
+    }
+    ChangePool* pool = Pool();
+    boost::lock_guard<boost::mutex> lock(pool->lock_);
+    return pool->allocator_.Allocate();
+  }
+  static void operator delete(void* ptr, size_t size) {
+    if (ptr == NULL) {
+      return;
+    }
+    if (size != sizeof(T)) {
+      ::operator delete(ptr);
+      return;
+    }
+    ChangePool* pool = Pool();
+    boost::lock_guard<boost::mutex> lock(pool->lock_);
+    pool->allocator_.Deallocate(ptr);
+  }
+
+ protected:
+  explicit PooledDIMACSChange(Kind kind) : DIMACSChange(kind) {
+  }
+
+ private:
+  struct ChangePool {
+    boost::mutex lock_;
+    SlabAllocator<T> allocator_;
+  };
+
+  static ChangePool* Pool() {
+    // The pool is never destroyed, since changes may still be deleted
+    // during static destruction.
+    static ChangePool* pool = new ChangePool();
+    return pool;
+  }
+};
+
 } // namespace firmament
 
 #endif // FIRMAMENT_SCHEDULING_FLOW_DIMACS_CHANGE_H
@@ -22,11 +22,13 @@
 
 #include "scheduling/flow/dimacs_change_arc.h"
 
+#include "scheduling/flow/dimacs_binary_format.h"
+
 namespace firmament {
 
 DIMACSChangeArc::DIMACSChangeArc(const FlowGraphArc& arc,
                                  const int64_t old_cost)
-  : DIMACSChange(), src_(arc.src_), dst_(arc.dst_),
+  : PooledDIMACSChange(CHANGE_ARC), src_(arc.src_), dst_(arc.dst_),
     cap_lower_bound_(arc.cap_lower_bound_),
     cap_upper_bound_(arc.cap_upper_bound_), cost_(arc.cost_), type_(arc.type_),
     old_cost_(old_cost) {
@@ -41,4 +43,15 @@ const string DIMACSChangeArc::GenerateChange() const {
   return ss.str();
 }
 
+void DIMACSChangeArc::GenerateBinaryChange(string* buffer) const {
+  AppendBinaryRecordType(BINARY_RECORD_CHANGE_ARC, buffer);
+  AppendBinaryUInt64(src_, buffer);
+  AppendBinaryUInt64(dst_, buffer);
+  AppendBinaryUInt64(cap_lower_bound_, buffer);
+  AppendBinaryUInt64(cap_upper_bound_, buffer);
+  AppendBinaryInt64(cost_, buffer);
+  AppendBinaryUInt32(type_, buffer);
+  AppendBinaryInt64(old_cost_, buffer);
+}
+
 } // namespace firmament
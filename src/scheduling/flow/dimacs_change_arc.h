@@ -30,10 +30,11 @@
 
 namespace firmament {
 
-class DIMACSChangeArc : public DIMACSChange {
+class DIMACSChangeArc : public PooledDIMACSChange<DIMACSChangeArc> {
  public:
   explicit DIMACSChangeArc(const FlowGraphArc& arc, int64_t old_cost);
   const string GenerateChange() const;
+  void GenerateBinaryChange(string* buffer) const;
 
   uint64_t src_;
   uint64_t dst_;
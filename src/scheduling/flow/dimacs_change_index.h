@@ -0,0 +1,113 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Open-addressing hash index over the changes in the change log, used to
+// find earlier changes to the same arc or node when the changes are
+// optimized. The changes are keyed by integer ids rather than by their
+// textual representation. Clearing the index keeps its slots, so that
+// optimizing the changes of every solver run does not allocate once the
+// index has grown to the size of the change log.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_DIMACS_CHANGE_INDEX_H
+#define FIRMAMENT_SCHEDULING_FLOW_DIMACS_CHANGE_INDEX_H
+
+#include <vector>
+
+#include "base/common.h"
+#include "base/types.h"
+#include "scheduling/flow/dimacs_change.h"
+
+namespace firmament {
+
+class DIMACSChangeIndex {
+ public:
+  struct Entry {
+    uint64_t hash_;
+    // NULL if the entry is empty.
+    DIMACSChange* change_;
+    // State the caller keeps for the change, e.g. its position in the log.
+    uint64_t value_;
+  };
+
+  DIMACSChangeIndex() : mask_(0), num_entries_(0), max_entries_(0) {
+  }
+
+  /**
+   * Removes all entries and makes room for up to max_entries entries.
+   */
+  void Clear(size_t max_entries) {
+    size_t num_slots = kMinSlots;
+    // Keeping the load factor at most 1/2 keeps the probe sequences short.
+    while (num_slots < 2 * max_entries) {
+      num_slots *= 2;
+    }
+    Entry empty_entry = {0, NULL, 0};
+    slots_.assign(num_slots, empty_entry);
+    mask_ = num_slots - 1;
+    num_entries_ = 0;
+    max_entries_ = max_entries;
+  }
+  /**
+   * Returns the entry with the given hash whose change matches, or the empty
+   * entry at which such a change is to be inserted.
+   * @param matches called with the change of every entry with the hash
+   */
+  template <typename Matches>
+  Entry* Find(uint64_t hash, Matches matches) {
+    for (uint64_t index = hash & mask_; ; index = (index + 1) & mask_) {
+      Entry* entry = &slots_[index];
+      if (entry->change_ == NULL ||
+          (entry->hash_ == hash && matches(*entry->change_))) {
+        return entry;
+      }
+    }
+  }
+  /**
+   * Fills in an entry returned by Find(). The entry may already hold a
+   * change, which is then replaced.
+   */
+  void Set(Entry* entry, uint64_t hash, DIMACSChange* change,
+           uint64_t value) {
+    if (entry->change_ == NULL) {
+      CHECK_LT(num_entries_, max_entries_);
+      num_entries_++;
+    }
+    entry->hash_ = hash;
+    entry->change_ = change;
+    entry->value_ = value;
+  }
+
+  static inline uint64_t Hash(uint64_t hash, uint64_t value) {
+    hash = (hash ^ value) * 0x9e3779b97f4a7c15ULL;
+    return hash ^ (hash >> 32);
+  }
+
+ private:
+  static const size_t kMinSlots = 16;
+
+  vector<Entry> slots_;
+  uint64_t mask_;
+  size_t num_entries_;
+  size_t max_entries_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_DIMACS_CHANGE_INDEX_H
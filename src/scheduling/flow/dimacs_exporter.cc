@@ -26,67 +26,295 @@
 #include <string>
 #include <cstdio>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 #include "misc/pb_utils.h"
+#include "scheduling/flow/dimacs_binary_format.h"
+
+DEFINE_int32(dimacs_export_threads, 0, "Number of threads that format full "
+             "flow graph exports. 0 uses one thread per core; 1 formats the "
+             "graph on the exporting thread.");
 
 namespace firmament {
 
-DIMACSExporter::DIMACSExporter() {
+// Size up to which the exporters buffer output before writing it.
+const size_t kExportBufferSize = 1 << 20;
+// Minimum number of nodes and arcs per shard of a parallel export. Smaller
+// graphs are not worth the cost of starting the threads.
+const uint64_t kMinElementsPerExportShard = 16384;
+
+// Appends the decimal representation of value to the buffer.
+inline void AppendUInt64(uint64_t value, string* buffer) {
+  char digits[20];
+  uint32_t num_digits = 0;
+  do {
+    digits[num_digits++] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value > 0);
+  while (num_digits > 0) {
+    buffer->push_back(digits[--num_digits]);
+  }
+}
+
+inline void AppendInt64(int64_t value, string* buffer) {
+  if (value < 0) {
+    buffer->push_back('-');
+    AppendUInt64(0 - static_cast<uint64_t>(value), buffer);
+  } else {
+    AppendUInt64(static_cast<uint64_t>(value), buffer);
+  }
+}
+
+DIMACSExporter::DIMACSExporter() : dense_node_ids_(false) {
 }
 
 void DIMACSExporter::Export(const FlowGraph& graph, FILE* stream) {
-  fprintf(stream, "c ===========================\n");
-  fflush(stream);
-  fprintf(stream, "p min %" PRIu64 " %" PRIu64 "\n",
-          graph.NumNodes(), graph.NumArcs());
-  fflush(stream);
-  fprintf(stream, "c ===========================\n");
-  fflush(stream);
-  fprintf(stream, "c === ALL NODES FOLLOW ===\n");
-  fflush(stream);
-  for (auto& id_node : graph.Nodes()) {
-    GenerateNode(*id_node.second, stream);
+  if (NumExportShards(graph) > 1) {
+    ExportParallel(graph, false, stream);
+    return;
   }
-  fprintf(stream, "c === ALL ARCS FOLLOW ===\n");
-  fflush(stream);
+  buffer_.clear();
+  buffer_.append("c ===========================\n");
+  buffer_.append("p min ");
+  AppendUInt64(ExportedNumNodes(graph), &buffer_);
+  buffer_.push_back(' ');
+  AppendUInt64(graph.NumArcs(), &buffer_);
+  buffer_.push_back('\n');
+  buffer_.append("c ===========================\n");
+  buffer_.append("c === ALL NODES FOLLOW ===\n");
+  for (auto& node : graph.Nodes()) {
+    GenerateNode(graph, *node, &buffer_);
+    if (buffer_.size() >= kExportBufferSize) {
+      WriteBuffer(&buffer_, stream);
+    }
+  }
+  buffer_.append("c === ALL ARCS FOLLOW ===\n");
   for (const auto& arc : graph.Arcs()) {
-    GenerateArc(*arc, stream);
+    GenerateArc(graph, *arc, &buffer_);
+    if (buffer_.size() >= kExportBufferSize) {
+      WriteBuffer(&buffer_, stream);
+    }
   }
   // Add end of iteration comment.
-  fprintf(stream, "c EOI\n");
+  buffer_.append("c EOI\n");
+  WriteBuffer(&buffer_, stream);
+  fflush(stream);
+}
+
+void DIMACSExporter::ExportBinary(const FlowGraph& graph, FILE* stream) {
+  if (NumExportShards(graph) > 1) {
+    ExportParallel(graph, true, stream);
+    return;
+  }
+  buffer_.clear();
+  AppendBinaryRecordType(BINARY_RECORD_PROBLEM, &buffer_);
+  AppendBinaryUInt64(ExportedNumNodes(graph), &buffer_);
+  AppendBinaryUInt64(graph.NumArcs(), &buffer_);
+  for (auto& node : graph.Nodes()) {
+    GenerateBinaryNode(graph, *node, &buffer_);
+    if (buffer_.size() >= kExportBufferSize) {
+      WriteBuffer(&buffer_, stream);
+    }
+  }
+  for (const auto& arc : graph.Arcs()) {
+    GenerateBinaryArc(graph, *arc, &buffer_);
+    if (buffer_.size() >= kExportBufferSize) {
+      WriteBuffer(&buffer_, stream);
+    }
+  }
+  AppendBinaryRecordType(BINARY_RECORD_END_OF_ITERATION, &buffer_);
+  WriteBuffer(&buffer_, stream);
+  fflush(stream);
+}
+
+uint64_t DIMACSExporter::ExportedNumNodes(const FlowGraph& graph) const {
+  return dense_node_ids_ ? graph.Nodes().size() : graph.NumNodes();
+}
+
+void DIMACSExporter::ExportParallel(const FlowGraph& graph, bool binary,
+                                    FILE* stream) {
+  // The node and arc lists are split into shards of consecutive elements.
+  // Each shard is formatted into its own buffer, and the buffers are written
+  // in order once all the shards are formatted.
+  uint64_t num_shards = NumExportShards(graph);
+  node_shard_buffers_.resize(num_shards);
+  arc_shard_buffers_.resize(num_shards);
+  uint64_t num_nodes = graph.Nodes().size();
+  uint64_t num_arcs = graph.NumArcs();
+  for (uint64_t shard = 0; shard < num_shards; ++shard) {
+    export_tasks_.push_back(
+        boost::bind(&DIMACSExporter::FormatNodeShard, this, boost::cref(graph),
+                    num_nodes * shard / num_shards,
+                    num_nodes * (shard + 1) / num_shards, binary,
+                    &node_shard_buffers_[shard]));
+    export_tasks_.push_back(
+        boost::bind(&DIMACSExporter::FormatArcShard, this, boost::cref(graph),
+                    num_arcs * shard / num_shards,
+                    num_arcs * (shard + 1) / num_shards, binary,
+                    &arc_shard_buffers_[shard]));
+  }
+  export_pool_.Start(&export_tasks_, 2 * num_shards);
+  // Format the header while the shards are being formatted.
+  buffer_.clear();
+  if (binary) {
+    AppendBinaryRecordType(BINARY_RECORD_PROBLEM, &buffer_);
+    AppendBinaryUInt64(ExportedNumNodes(graph), &buffer_);
+    AppendBinaryUInt64(graph.NumArcs(), &buffer_);
+  } else {
+    buffer_.append("c ===========================\n");
+    buffer_.append("p min ");
+    AppendUInt64(ExportedNumNodes(graph), &buffer_);
+    buffer_.push_back(' ');
+    AppendUInt64(graph.NumArcs(), &buffer_);
+    buffer_.push_back('\n');
+    buffer_.append("c ===========================\n");
+    buffer_.append("c === ALL NODES FOLLOW ===\n");
+  }
+  export_pool_.Wait();
+  WriteBuffer(&buffer_, stream);
+  for (auto& shard_buffer : node_shard_buffers_) {
+    WriteBuffer(&shard_buffer, stream);
+  }
+  if (!binary) {
+    buffer_.append("c === ALL ARCS FOLLOW ===\n");
+    WriteBuffer(&buffer_, stream);
+  }
+  for (auto& shard_buffer : arc_shard_buffers_) {
+    WriteBuffer(&shard_buffer, stream);
+  }
+  if (binary) {
+    AppendBinaryRecordType(BINARY_RECORD_END_OF_ITERATION, &buffer_);
+  } else {
+    // Add end of iteration comment.
+    buffer_.append("c EOI\n");
+  }
+  WriteBuffer(&buffer_, stream);
   fflush(stream);
 }
 
 void DIMACSExporter::ExportIncremental(const vector<DIMACSChange*>& changes,
                                        FILE* stream) {
+  buffer_.clear();
   for (const auto& change : changes) {
-    fprintf(stream, "%s", change->GenerateChange().c_str());
-    fflush(stream);
+    buffer_.append(change->GenerateChange());
+    if (buffer_.size() >= kExportBufferSize) {
+      WriteBuffer(&buffer_, stream);
+    }
   }
   // Add end of iteration comment.
-  fprintf(stream, "c EOI\n");
+  buffer_.append("c EOI\n");
+  WriteBuffer(&buffer_, stream);
   fflush(stream);
 }
 
-inline void DIMACSExporter::GenerateArc(const FlowGraphArc& arc, FILE* stream) {
-  fprintf(stream,
-          "a %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64 "\n",
-          arc.src_, arc.dst_, arc.cap_lower_bound_, arc.cap_upper_bound_,
-          arc.cost_);
+void DIMACSExporter::ExportIncrementalBinary(
+    const vector<DIMACSChange*>& changes, FILE* stream) {
+  buffer_.clear();
+  for (const auto& change : changes) {
+    change->GenerateBinaryChange(&buffer_);
+    if (buffer_.size() >= kExportBufferSize) {
+      WriteBuffer(&buffer_, stream);
+    }
+  }
+  AppendBinaryRecordType(BINARY_RECORD_END_OF_ITERATION, &buffer_);
+  WriteBuffer(&buffer_, stream);
   fflush(stream);
 }
 
-inline void DIMACSExporter::GenerateNode(const FlowGraphNode& node,
-                                         FILE* stream) {
+void DIMACSExporter::FormatArcShard(const FlowGraph& graph,
+                                    uint64_t first_index, uint64_t end_index,
+                                    bool binary, string* buffer) {
+  const vector<FlowGraphArc*>& arcs = graph.Arcs();
+  buffer->clear();
+  for (uint64_t index = first_index; index < end_index; ++index) {
+    if (binary) {
+      GenerateBinaryArc(graph, *arcs[index], buffer);
+    } else {
+      GenerateArc(graph, *arcs[index], buffer);
+    }
+  }
+}
+
+void DIMACSExporter::FormatNodeShard(const FlowGraph& graph,
+                                     uint64_t first_index, uint64_t end_index,
+                                     bool binary, string* buffer) {
+  const vector<FlowGraphNode*>& nodes = graph.Nodes();
+  buffer->clear();
+  for (uint64_t index = first_index; index < end_index; ++index) {
+    if (binary) {
+      GenerateBinaryNode(graph, *nodes[index], buffer);
+    } else {
+      GenerateNode(graph, *nodes[index], buffer);
+    }
+  }
+}
+
+inline void DIMACSExporter::GenerateArc(const FlowGraph& graph,
+                                        const FlowGraphArc& arc,
+                                        string* buffer) {
+  buffer->append("a ");
+  AppendUInt64(ExportedNodeId(graph, *arc.src_node_), buffer);
+  buffer->push_back(' ');
+  AppendUInt64(ExportedNodeId(graph, *arc.dst_node_), buffer);
+  buffer->push_back(' ');
+  AppendUInt64(arc.cap_lower_bound_, buffer);
+  buffer->push_back(' ');
+  AppendUInt64(arc.cap_upper_bound_, buffer);
+  buffer->push_back(' ');
+  AppendInt64(arc.cost_, buffer);
+  buffer->push_back('\n');
+}
+
+inline void DIMACSExporter::GenerateBinaryArc(const FlowGraph& graph,
+                                              const FlowGraphArc& arc,
+                                              string* buffer) {
+  AppendBinaryRecordType(BINARY_RECORD_NEW_ARC, buffer);
+  AppendBinaryUInt64(ExportedNodeId(graph, *arc.src_node_), buffer);
+  AppendBinaryUInt64(ExportedNodeId(graph, *arc.dst_node_), buffer);
+  AppendBinaryUInt64(arc.cap_lower_bound_, buffer);
+  AppendBinaryUInt64(arc.cap_upper_bound_, buffer);
+  AppendBinaryInt64(arc.cost_, buffer);
+  AppendBinaryUInt32(arc.type_, buffer);
+}
+
+inline void DIMACSExporter::GenerateBinaryNode(const FlowGraph& graph,
+                                               const FlowGraphNode& node,
+                                               string* buffer) {
+  AppendBinaryRecordType(BINARY_RECORD_NODE, buffer);
+  AppendBinaryUInt64(ExportedNodeId(graph, node), buffer);
+  AppendBinaryInt64(node.excess_, buffer);
+  AppendBinaryUInt32(GetNodeType(node), buffer);
+}
+
+inline void DIMACSExporter::GenerateNode(const FlowGraph& graph,
+                                         const FlowGraphNode& node,
+                                         string* buffer) {
   if (node.rd_ptr_) {
-    fprintf(stream, "c nd Res_%s\n", node.rd_ptr_->uuid().c_str());
+    buffer->append("c nd Res_");
+    buffer->append(node.rd_ptr_->uuid());
+    buffer->push_back('\n');
   } else if (node.td_ptr_) {
-    fprintf(stream, "c nd Task_%" PRIu64 "\n", node.td_ptr_->uid());
+    buffer->append("c nd Task_");
+    AppendUInt64(node.td_ptr_->uid(), buffer);
+    buffer->push_back('\n');
   } else if (node.ec_id_) {
-    fprintf(stream, "c nd EC_%" PRIu64 "\n", node.ec_id_);
+    buffer->append("c nd EC_");
+    AppendUInt64(node.ec_id_, buffer);
+    buffer->push_back('\n');
   } else if (node.comment_ != "") {
-    fprintf(stream, "c nd %s\n", node.comment_.c_str());
+    buffer->append("c nd ");
+    buffer->append(node.comment_);
+    buffer->push_back('\n');
   }
+  buffer->append("n ");
+  AppendUInt64(ExportedNodeId(graph, node), buffer);
+  buffer->push_back(' ');
+  AppendInt64(node.excess_, buffer);
+  buffer->push_back(' ');
+  AppendUInt64(GetNodeType(node), buffer);
+  buffer->push_back('\n');
+}
+inline uint32_t DIMACSExporter::GetNodeType(const FlowGraphNode& node) {
   uint32_t node_type = 0;
   if (node.type_ == FlowNodeType::PU) {
     node_type = 2;
@@ -106,9 +334,26 @@ inline void DIMACSExporter::GenerateNode(const FlowGraphNode& node,
   } else {
     node_type = 0;
   }
-  fprintf(stream, "n %" PRIu64 " %" PRId64 " %d\n",
-          node.id_, node.excess_, node_type);
-  fflush(stream);
+  return node_type;
+}
+
+uint64_t DIMACSExporter::NumExportShards(const FlowGraph& graph) {
+  uint64_t num_threads = FLAGS_dimacs_export_threads > 0 ?
+    static_cast<uint64_t>(FLAGS_dimacs_export_threads) :
+    max(boost::thread::hardware_concurrency(), 1U);
+  // Every shard formats a range of nodes and a range of arcs.
+  uint64_t num_shards = max(num_threads / 2, static_cast<uint64_t>(1));
+  uint64_t num_elements = graph.Nodes().size() + graph.NumArcs();
+  return min(num_shards,
+             max(num_elements / kMinElementsPerExportShard,
+                 static_cast<uint64_t>(1)));
+}
+
+void DIMACSExporter::WriteBuffer(string* buffer, FILE* stream) {
+  if (fwrite(buffer->data(), 1, buffer->size(), stream) != buffer->size()) {
+    PLOG(ERROR) << "Failed to write flow graph";
+  }
+  buffer->clear();
 }
 
 }  // namespace firmament
@@ -35,6 +35,7 @@
 #include "scheduling/flow/flow_graph.h"
 #include "scheduling/flow/flow_graph_arc.h"
 #include "scheduling/flow/flow_graph_node.h"
+#include "scheduling/flow/worker_pool.h"
 
 namespace firmament {
 
@@ -42,11 +43,61 @@ class DIMACSExporter {
  public:
   DIMACSExporter();
   void Export(const FlowGraph& graph, FILE* stream);
+  /**
+   * Exports the graph in the binary format (see dimacs_binary_format.h).
+   */
+  void ExportBinary(const FlowGraph& graph, FILE* stream);
   void ExportIncremental(const vector<DIMACSChange*>& changes, FILE* stream);
+  /**
+   * Exports the changes in the binary format (see dimacs_binary_format.h).
+   */
+  void ExportIncrementalBinary(const vector<DIMACSChange*>& changes,
+                               FILE* stream);
+  /**
+   * Sets whether full exports identify the nodes by their dense node ids
+   * (see FlowGraph::DenseNodeId) instead of their node ids. Solvers then see
+   * a problem whose size is the number of live nodes rather than the highest
+   * node id. Incremental exports always use the node ids.
+   */
+  void set_dense_node_ids(bool dense_node_ids) {
+    dense_node_ids_ = dense_node_ids;
+  }
 
  private:
-  inline void GenerateArc(const FlowGraphArc& arc, FILE* stream);
-  inline void GenerateNode(const FlowGraphNode& node, FILE* stream);
+  inline uint64_t ExportedNodeId(const FlowGraph& graph,
+                                 const FlowGraphNode& node) const {
+    return dense_node_ids_ ? graph.DenseNodeId(node) : node.id_;
+  }
+  uint64_t ExportedNumNodes(const FlowGraph& graph) const;
+  void ExportParallel(const FlowGraph& graph, bool binary, FILE* stream);
+  void FormatArcShard(const FlowGraph& graph, uint64_t first_index,
+                      uint64_t end_index, bool binary, string* buffer);
+  void FormatNodeShard(const FlowGraph& graph, uint64_t first_index,
+                       uint64_t end_index, bool binary, string* buffer);
+  inline void GenerateArc(const FlowGraph& graph, const FlowGraphArc& arc,
+                          string* buffer);
+  inline void GenerateBinaryArc(const FlowGraph& graph,
+                                const FlowGraphArc& arc, string* buffer);
+  inline void GenerateBinaryNode(const FlowGraph& graph,
+                                 const FlowGraphNode& node, string* buffer);
+  inline void GenerateNode(const FlowGraph& graph, const FlowGraphNode& node,
+                           string* buffer);
+  inline uint32_t GetNodeType(const FlowGraphNode& node);
+  uint64_t NumExportShards(const FlowGraph& graph);
+  void WriteBuffer(string* buffer, FILE* stream);
+
+  // Reused across exports to avoid reallocating the output buffer. The
+  // output is written to the stream in large chunks, and the stream is only
+  // flushed at the end of the export.
+  string buffer_;
+  // Per-shard buffers of parallel exports.
+  vector<string> node_shard_buffers_;
+  vector<string> arc_shard_buffers_;
+  // Threads that format the shards, kept across exports.
+  WorkerPool export_pool_;
+  vector<boost::function<void()>> export_tasks_;
+  // Whether full exports use dense node ids.
+  bool dense_node_ids_;
 };
 
 }  // namespace firmament
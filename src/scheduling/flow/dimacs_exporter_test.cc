@@ -37,11 +37,15 @@
 #include "misc/wall_time.h"
 #include "misc/string_utils.h"
 #include "misc/utils.h"
+#include "scheduling/flow/dimacs_binary_format.h"
 #include "scheduling/flow/dimacs_change_stats.h"
 #include "scheduling/flow/dimacs_exporter.h"
+#include "scheduling/flow/flow_graph_change_manager.h"
 #include "scheduling/flow/flow_graph_manager.h"
 #include "scheduling/flow/trivial_cost_model.h"
 
+DECLARE_int32(dimacs_export_threads);
+
 namespace firmament {
 
 // The fixture for testing the DIMACSExporter container class.
@@ -65,11 +69,13 @@ class DIMACSExporterTest : public ::testing::Test {
   virtual void SetUp() {
     // Code here will be called immediately after the constructor (right
     // before each test).
+    saved_dimacs_export_threads_ = FLAGS_dimacs_export_threads;
   }
 
   virtual void TearDown() {
     // Code here will be called immediately after each test (right
     // before the destructor).
+    FLAGS_dimacs_export_threads = saved_dimacs_export_threads_;
   }
 
   void reset_uuid(ResourceTopologyNodeDescriptor* rtnd) {
@@ -83,8 +89,93 @@ class DIMACSExporterTest : public ::testing::Test {
                    new_uuid);
     rtnd->mutable_resource_desc()->set_uuid(new_uuid);
   }
+  // Exports the graph like the exporter used to: with one fprintf and one
+  // fflush per line. Used as the baseline for the export benchmark.
+  void ExportUnbuffered(const FlowGraph& graph, FILE* stream) {
+    fprintf(stream, "c ===========================\n");
+    fflush(stream);
+    fprintf(stream, "p min %" PRIu64 " %" PRIu64 "\n",
+            graph.NumNodes(), graph.NumArcs());
+    fflush(stream);
+    fprintf(stream, "c ===========================\n");
+    fflush(stream);
+    fprintf(stream, "c === ALL NODES FOLLOW ===\n");
+    fflush(stream);
+    for (auto& node_ptr : graph.Nodes()) {
+      const FlowGraphNode& node = *node_ptr;
+      if (node.comment_ != "") {
+        fprintf(stream, "c nd %s\n", node.comment_.c_str());
+      }
+      uint32_t node_type = 0;
+      if (node.type_ == FlowNodeType::PU) {
+        node_type = 2;
+      } else if (node.type_ == FlowNodeType::MACHINE) {
+        node_type = 4;
+      } else if (node.type_ == FlowNodeType::SINK) {
+        node_type = 3;
+      } else if (node.type_ == FlowNodeType::UNSCHEDULED_TASK) {
+        node_type = 1;
+      }
+      fprintf(stream, "n %" PRIu64 " %" PRId64 " %d\n",
+              node.id_, node.excess_, node_type);
+      fflush(stream);
+    }
+    fprintf(stream, "c === ALL ARCS FOLLOW ===\n");
+    fflush(stream);
+    for (const auto& arc : graph.Arcs()) {
+      fprintf(stream,
+              "a %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64
+              "\n", arc->src_, arc->dst_, arc->cap_lower_bound_,
+              arc->cap_upper_bound_, arc->cost_);
+      fflush(stream);
+    }
+    fprintf(stream, "c EOI\n");
+    fflush(stream);
+  }
+
+  // Adds machines with PUs, and tasks with preference arcs to random PUs, to
+  // the graph.
+  void BuildSchedulingGraph(FlowGraphChangeManager* change_manager,
+                            uint64_t num_machines, uint64_t num_tasks,
+                            uint64_t num_preferences) {
+    uint32_t seed = 42;
+    FlowGraphNode* sink =
+      change_manager->AddNode(FlowNodeType::SINK, 0, ADD_SINK_NODE, "sink");
+    vector<FlowGraphNode*> pus;
+    for (uint64_t i = 0; i < num_machines; ++i) {
+      FlowGraphNode* machine =
+        change_manager->AddNode(FlowNodeType::MACHINE, 0, ADD_RESOURCE_NODE,
+                                "machine");
+      for (uint64_t j = 0; j < 8; ++j) {
+        FlowGraphNode* pu =
+          change_manager->AddNode(FlowNodeType::PU, 0, ADD_RESOURCE_NODE, "pu");
+        change_manager->AddArc(machine, pu, 0, 1, 0, OTHER,
+                               ADD_ARC_BETWEEN_RES, "machine to pu");
+        change_manager->AddArc(pu, sink, 0, 1, 0, OTHER, ADD_ARC_RES_TO_SINK,
+                               "pu to sink");
+        pus.push_back(pu);
+      }
+    }
+    for (uint64_t i = 0; i < num_tasks; ++i) {
+      FlowGraphNode* task =
+        change_manager->AddNode(FlowNodeType::UNSCHEDULED_TASK, 1,
+                                ADD_TASK_NODE, "task");
+      sink->excess_--;
+      for (uint64_t j = 0; j < num_preferences; ++j) {
+        FlowGraphNode* pu = pus[rand_r(&seed) % pus.size()];
+        if (task->outgoing_arc_map_.find(pu->id_) ==
+            task->outgoing_arc_map_.end()) {
+          change_manager->AddArc(task, pu, 0, 1, rand_r(&seed) % 1000, OTHER,
+                                 ADD_ARC_TASK_TO_RES, "preference");
+        }
+      }
+    }
+  }
+
   // Objects declared here can be used by all tests.
   map<string, string> uuid_conversion_map_;
+  // Restored after every test, as some tests change the number of threads.
+  int32_t saved_dimacs_export_threads_;
   // Enable access from tests
   FRIEND_TEST(DIMACSExporterTest, LargeGraph);
   FRIEND_TEST(DIMACSExporterTest, ScalabilityTestGraphs);
@@ -152,6 +243,171 @@ TEST_F(DIMACSExporterTest, SimpleGraphOutput) {
   delete leaf_res_ids;
 }
 
+// Exports a graph with two nodes and one arc in the binary format and checks
+// the records.
+TEST_F(DIMACSExporterTest, BinaryGraphOutput) {
+  DIMACSChangeStats dimacs_stats;
+  FlowGraphChangeManager change_manager(&dimacs_stats);
+  FlowGraphNode* task =
+    change_manager.AddNode(FlowNodeType::UNSCHEDULED_TASK, 1, ADD_TASK_NODE,
+                           "task");
+  FlowGraphNode* sink =
+    change_manager.AddNode(FlowNodeType::SINK, -1, ADD_SINK_NODE, "sink");
+  change_manager.AddArc(task, sink, 0, 1, -42, OTHER, ADD_ARC_TO_UNSCHED,
+                        "task to sink");
+  DIMACSExporter exp;
+  FILE* out_file = tmpfile();
+  CHECK_NOTNULL(out_file);
+  exp.ExportBinary(change_manager.flow_graph(), out_file);
+  EXPECT_EQ(ftell(out_file),
+            static_cast<long>(1 + kBinaryProblemSize +
+                              2 * (1 + kBinaryNodeSize) +
+                              1 + kBinaryNewArcSize + 1));
+  rewind(out_file);
+  char data[256];
+  size_t size = fread(data, 1, sizeof(data), out_file);
+  fclose(out_file);
+  // Problem line.
+  EXPECT_EQ(data[0], BINARY_RECORD_PROBLEM);
+  EXPECT_EQ(ParseBinaryUInt64(data + 1),
+            change_manager.flow_graph().NumNodes());
+  EXPECT_EQ(ParseBinaryUInt64(data + 9), 1ULL);
+  // The nodes can be exported in any order.
+  const char* node = data + 1 + kBinaryProblemSize;
+  for (uint32_t i = 0; i < 2; ++i) {
+    EXPECT_EQ(node[0], BINARY_RECORD_NODE);
+    if (ParseBinaryUInt64(node + 1) == task->id_) {
+      EXPECT_EQ(ParseBinaryInt64(node + 9), 1);
+    } else {
+      EXPECT_EQ(ParseBinaryUInt64(node + 1), sink->id_);
+      EXPECT_EQ(ParseBinaryInt64(node + 9), -1);
+    }
+    node += 1 + kBinaryNodeSize;
+  }
+  const char* arc = node;
+  EXPECT_EQ(arc[0], BINARY_RECORD_NEW_ARC);
+  EXPECT_EQ(ParseBinaryUInt64(arc + 1), task->id_);
+  EXPECT_EQ(ParseBinaryUInt64(arc + 9), sink->id_);
+  EXPECT_EQ(ParseBinaryUInt64(arc + 17), 0ULL);
+  EXPECT_EQ(ParseBinaryUInt64(arc + 25), 1ULL);
+  EXPECT_EQ(ParseBinaryInt64(arc + 33), -42);
+  EXPECT_EQ(data[size - 1], BINARY_RECORD_END_OF_ITERATION);
+}
+
+// Checks that exports with dense node ids number the live nodes from 1 and
+// that the arcs refer to the same nodes as in the flow graph.
+TEST_F(DIMACSExporterTest, DenseNodeIds) {
+  DIMACSChangeStats dimacs_stats;
+  FlowGraphChangeManager change_manager(&dimacs_stats);
+  vector<FlowGraphNode*> tasks;
+  for (uint32_t i = 0; i < 4; ++i) {
+    tasks.push_back(
+        change_manager.AddNode(FlowNodeType::UNSCHEDULED_TASK, 1,
+                               ADD_TASK_NODE, "task"));
+  }
+  FlowGraphNode* sink =
+    change_manager.AddNode(FlowNodeType::SINK, -2, ADD_SINK_NODE, "sink");
+  for (auto& task : tasks) {
+    change_manager.AddArc(task, sink, 0, 1, 7, OTHER, ADD_ARC_TO_UNSCHED,
+                          "task to sink");
+  }
+  // Removing the first tasks leaves gaps in the node ids.
+  change_manager.DeleteNode(tasks[0], DEL_TASK_NODE, "remove task");
+  change_manager.DeleteNode(tasks[1], DEL_TASK_NODE, "remove task");
+  const FlowGraph& graph = change_manager.flow_graph();
+  CHECK_EQ(graph.Nodes().size(), 3);
+  CHECK_GT(graph.NumNodes(), 3);
+  DIMACSExporter exp;
+  exp.set_dense_node_ids(true);
+  FILE* out_file = tmpfile();
+  CHECK_NOTNULL(out_file);
+  exp.Export(graph, out_file);
+  rewind(out_file);
+  char line[256];
+  set<uint64_t> node_ids;
+  set<pair<uint64_t, uint64_t>> arcs;
+  while (fgets(line, sizeof(line), out_file) != NULL) {
+    uint64_t num_nodes;
+    uint64_t num_arcs;
+    uint64_t src;
+    uint64_t dst;
+    if (sscanf(line, "p min %ju %ju", &num_nodes, &num_arcs) == 2) {
+      EXPECT_EQ(num_nodes, 3);
+      EXPECT_EQ(num_arcs, 2);
+    } else if (sscanf(line, "n %ju", &src) == 1) {
+      node_ids.insert(src);
+    } else if (sscanf(line, "a %ju %ju", &src, &dst) == 2) {
+      arcs.insert(make_pair(src, dst));
+    }
+  }
+  fclose(out_file);
+  EXPECT_EQ(node_ids, set<uint64_t>({1, 2, 3}));
+  EXPECT_EQ(arcs.size(), 2);
+  for (uint32_t i = 2; i < tasks.size(); ++i) {
+    EXPECT_EQ(graph.NodeForDenseId(graph.DenseNodeId(*tasks[i])), tasks[i]);
+    EXPECT_EQ(arcs.count(make_pair(graph.DenseNodeId(*tasks[i]),
+                                   graph.DenseNodeId(*sink))), 1);
+  }
+}
+
+// Compares the buffered exporter with the former line-by-line exporter on a
+// graph of the size of the largest ScalabilityTestGraphs graph (120 machines,
+// 64 jobs of 100 tasks each, 20 preference arcs per task).
+TEST_F(DIMACSExporterTest, ExportBenchmark) {
+  DIMACSChangeStats dimacs_stats;
+  FlowGraphChangeManager change_manager(&dimacs_stats);
+  BuildSchedulingGraph(&change_manager, 120, 6400, 20);
+  const FlowGraph& graph = change_manager.flow_graph();
+  DIMACSExporter exp;
+  // Both exporters must produce the same output.
+  FLAGS_dimacs_export_threads = 1;
+  FILE* unbuffered_file = tmpfile();
+  FILE* buffered_file = tmpfile();
+  CHECK_NOTNULL(unbuffered_file);
+  CHECK_NOTNULL(buffered_file);
+  ExportUnbuffered(graph, unbuffered_file);
+  exp.Export(graph, buffered_file);
+  size_t size = static_cast<size_t>(ftell(unbuffered_file));
+  ASSERT_EQ(size, static_cast<size_t>(ftell(buffered_file)));
+  string unbuffered_output(size, '\0');
+  string buffered_output(size, '\0');
+  rewind(unbuffered_file);
+  rewind(buffered_file);
+  CHECK_EQ(fread(&unbuffered_output[0], 1, size, unbuffered_file), size);
+  CHECK_EQ(fread(&buffered_output[0], 1, size, buffered_file), size);
+  fclose(unbuffered_file);
+  fclose(buffered_file);
+  EXPECT_EQ(unbuffered_output, buffered_output);
+  // Time both exporters writing to /dev/null.
+  FILE* null_file;
+  CHECK((null_file = fopen("/dev/null", "w")) != NULL);
+  WallTime wall_time;
+  uint64_t start_time = wall_time.GetCurrentTimestamp();
+  ExportUnbuffered(graph, null_file);
+  uint64_t unbuffered_time = wall_time.GetCurrentTimestamp() - start_time;
+  start_time = wall_time.GetCurrentTimestamp();
+  exp.Export(graph, null_file);
+  uint64_t buffered_time = wall_time.GetCurrentTimestamp() - start_time;
+  // Sharded export on four threads.
+  FLAGS_dimacs_export_threads = 4;
+  start_time = wall_time.GetCurrentTimestamp();
+  exp.Export(graph, null_file);
+  uint64_t parallel_time = wall_time.GetCurrentTimestamp() - start_time;
+  fclose(null_file);
+  LOG(INFO) << "Exported " << graph.NumArcs() << " arcs in "
+            << unbuffered_time << "us line-by-line, " << buffered_time
+            << "us buffered and " << parallel_time << "us on 4 threads";
+  FILE* parallel_file = tmpfile();
+  CHECK_NOTNULL(parallel_file);
+  exp.Export(graph, parallel_file);
+  ASSERT_EQ(size, static_cast<size_t>(ftell(parallel_file)));
+  string parallel_output(size, '\0');
+  rewind(parallel_file);
+  CHECK_EQ(fread(&parallel_output[0], 1, size, parallel_file), size);
+  fclose(parallel_file);
+  EXPECT_EQ(buffered_output, parallel_output);
+}
+
 // Runs the graph export for a single simulated graph (somewhat simplified),
 // with the following parameters:
 //  - 2500 machines
@@ -22,10 +22,12 @@
 
 #include "scheduling/flow/dimacs_new_arc.h"
 
+#include "scheduling/flow/dimacs_binary_format.h"
+
 namespace firmament {
 
 DIMACSNewArc::DIMACSNewArc(const FlowGraphArc& arc)
-  : DIMACSChange(), src_(arc.src_), dst_(arc.dst_),
+  : PooledDIMACSChange(NEW_ARC), src_(arc.src_), dst_(arc.dst_),
     cap_lower_bound_(arc.cap_lower_bound_),
     cap_upper_bound_(arc.cap_upper_bound_), cost_(arc.cost_),
     type_(arc.type_) {
@@ -39,4 +41,14 @@ const string DIMACSNewArc::GenerateChange() const {
   return ss.str();
 }
 
+void DIMACSNewArc::GenerateBinaryChange(string* buffer) const {
+  AppendBinaryRecordType(BINARY_RECORD_NEW_ARC, buffer);
+  AppendBinaryUInt64(src_, buffer);
+  AppendBinaryUInt64(dst_, buffer);
+  AppendBinaryUInt64(cap_lower_bound_, buffer);
+  AppendBinaryUInt64(cap_upper_bound_, buffer);
+  AppendBinaryInt64(cost_, buffer);
+  AppendBinaryUInt32(type_, buffer);
+}
+
 } // namespace firmament
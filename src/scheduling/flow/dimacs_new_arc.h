@@ -29,10 +29,11 @@
 
 namespace firmament {
 
-class DIMACSNewArc : public DIMACSChange {
+class DIMACSNewArc : public PooledDIMACSChange<DIMACSNewArc> {
  public:
   explicit DIMACSNewArc(const FlowGraphArc& arc);
   const string GenerateChange() const;
+  void GenerateBinaryChange(string* buffer) const;
 
   uint64_t src_;
   uint64_t dst_;
@@ -20,10 +20,12 @@
 
 #include "scheduling/flow/dimacs_remove_node.h"
 
+#include "scheduling/flow/dimacs_binary_format.h"
+
 namespace firmament {
 
 DIMACSRemoveNode::DIMACSRemoveNode(const FlowGraphNode& node)
-  : DIMACSChange(), node_id_(node.id_) {
+  : PooledDIMACSChange(REMOVE_NODE), node_id_(node.id_) {
 }
 
 const string DIMACSRemoveNode::GenerateChange() const {
@@ -33,4 +35,9 @@ const string DIMACSRemoveNode::GenerateChange() const {
   return ss.str();
 }
 
+void DIMACSRemoveNode::GenerateBinaryChange(string* buffer) const {
+  AppendBinaryRecordType(BINARY_RECORD_REMOVE_NODE, buffer);
+  AppendBinaryUInt64(node_id_, buffer);
+}
+
 } // namespace firmament
@@ -31,10 +31,11 @@
 
 namespace firmament {
 
-class DIMACSRemoveNode : public DIMACSChange {
+class DIMACSRemoveNode : public PooledDIMACSChange<DIMACSRemoveNode> {
  public:
   explicit DIMACSRemoveNode(const FlowGraphNode& node);
   const string GenerateChange() const;
+  void GenerateBinaryChange(string* buffer) const;
 
   const uint64_t node_id_;
 };
@@ -0,0 +1,181 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/flow/extracted_flow.h"
+
+#include <algorithm>
+
+namespace firmament {
+
+ExtractedFlow::ExtractedFlow() : num_node_ids_(0) {
+  offsets_.push_back(0);
+}
+
+bool ExtractedFlow::Finalize() {
+  // Counting sort of the arcs by destination. offsets_[n] first counts the
+  // arcs into n, then holds the end of n's arcs, and finally their start.
+  offsets_.assign(num_node_ids_ + 1, 0);
+  for (auto& arc : arcs_) {
+    if (arc.src_ >= num_node_ids_ || arc.dst_ >= num_node_ids_) {
+      // The node ids come from the solver's output.
+      LOG(ERROR) << "Flow on arc from " << arc.src_ << " to " << arc.dst_
+                 << " refers to an unknown node; there are " << num_node_ids_
+                 << " node ids";
+      Reset(num_node_ids_);
+      return false;
+    }
+    offsets_[arc.dst_]++;
+  }
+  for (uint64_t node_id = 1; node_id < num_node_ids_; ++node_id) {
+    offsets_[node_id] += offsets_[node_id - 1];
+  }
+  incoming_.resize(arcs_.size());
+  // Placing the arcs in reverse order keeps the arcs into every node in the
+  // order in which they were added.
+  for (vector<ArcFlow>::reverse_iterator it = arcs_.rbegin();
+       it != arcs_.rend(); ++it) {
+    incoming_[--offsets_[it->dst_]] = *it;
+  }
+  offsets_[num_node_ids_] = arcs_.size();
+  return true;
+}
+
+uint64_t ExtractedFlow::Flow(uint64_t src, uint64_t dst) const {
+  for (const ArcFlow* arc = IncomingBegin(dst); arc != IncomingEnd(dst);
+       ++arc) {
+    if (arc->src_ == src) {
+      return arc->flow_;
+    }
+  }
+  return 0;
+}
+
+bool ExtractedFlow::MapTasksToLeaves(
+    const vector<uint8_t>& node_kinds, uint64_t sink,
+    vector<pair<uint64_t, uint64_t>>* task_leaf_pairs) {
+  CHECK_NOTNULL(task_leaf_pairs);
+  CHECK_EQ(node_kinds.size(), num_node_ids_);
+  CHECK_EQ(incoming_.size(), arcs_.size()) << "Flow has not been finalized";
+  CHECK_LT(sink, num_node_ids_);
+  task_leaf_pairs->clear();
+  // Every node is assigned one leaf per unit of flow that leaves it, so the
+  // leaves of all nodes fit into a single array. The flow comes from the
+  // solver's output, and so it is checked before the array is sized by it:
+  // every unit of flow is supplied by a task, and thus the flow out of a
+  // node cannot exceed the number of tasks.
+  uint64_t num_tasks = static_cast<uint64_t>(
+      count(node_kinds.begin(), node_kinds.end(), TASK_NODE));
+  leaf_offsets_.assign(num_node_ids_ + 1, 0);
+  num_pending_arcs_.assign(num_node_ids_, 0);
+  for (auto& arc : incoming_) {
+    if (arc.flow_ > num_tasks - leaf_offsets_[arc.src_ + 1]) {
+      LOG(ERROR) << "Flow out of node " << arc.src_ << " exceeds the supply "
+                 << "of the " << num_tasks << " tasks";
+      return false;
+    }
+    leaf_offsets_[arc.src_ + 1] += arc.flow_;
+    if (arc.dst_ != sink) {
+      num_pending_arcs_[arc.src_]++;
+    }
+  }
+  for (uint64_t node_id = 0; node_id < num_node_ids_; ++node_id) {
+    if (leaf_offsets_[node_id + 1] > UINT64_MAX - leaf_offsets_[node_id]) {
+      LOG(ERROR) << "Total flow out of the nodes overflows";
+      return false;
+    }
+    leaf_offsets_[node_id + 1] += leaf_offsets_[node_id];
+  }
+  leaf_ids_.resize(leaf_offsets_[num_node_ids_]);
+  num_leaves_.assign(num_node_ids_, 0);
+  ready_nodes_.clear();
+  // The flow that reaches the sink from a leaf is assigned to the leaf. The
+  // flow of the tasks that stay unscheduled is assigned to the sink.
+  for (const ArcFlow* arc = IncomingBegin(sink); arc != IncomingEnd(sink);
+       ++arc) {
+    uint64_t leaf_id;
+    if (node_kinds[arc->src_] == LEAF_NODE) {
+      leaf_id = arc->src_;
+    } else if (node_kinds[arc->src_] == UNSCHEDULED_NODE) {
+      leaf_id = sink;
+    } else {
+      continue;
+    }
+    uint64_t* leaves = leaf_ids_.data() + leaf_offsets_[arc->src_];
+    fill(leaves + num_leaves_[arc->src_],
+         leaves + num_leaves_[arc->src_] + arc->flow_, leaf_id);
+    num_leaves_[arc->src_] += arc->flow_;
+    if (num_pending_arcs_[arc->src_] == 0) {
+      ready_nodes_.push_back(arc->src_);
+    }
+  }
+  // A node is ready once all the nodes its flow goes to have handed their
+  // leaves on to it.
+  while (!ready_nodes_.empty()) {
+    uint64_t node_id = ready_nodes_.back();
+    ready_nodes_.pop_back();
+    const uint64_t* leaves = leaf_ids_.data() + leaf_offsets_[node_id];
+    uint64_t num_leaves = num_leaves_[node_id];
+    if (node_kinds[node_id] == TASK_NODE) {
+      for (uint64_t index = 0; index < num_leaves; ++index) {
+        if (leaves[index] != sink) {
+          task_leaf_pairs->push_back(make_pair(node_id, leaves[index]));
+        }
+      }
+      continue;
+    }
+    // Hand the leaves on to the nodes the flow comes from, one leaf per unit
+    // of flow.
+    uint64_t next_leaf = 0;
+    for (const ArcFlow* arc = IncomingBegin(node_id);
+         arc != IncomingEnd(node_id); ++arc) {
+      uint64_t num_handed_on = min(arc->flow_, num_leaves - next_leaf);
+      copy(leaves + next_leaf, leaves + next_leaf + num_handed_on,
+           leaf_ids_.data() + leaf_offsets_[arc->src_] +
+           num_leaves_[arc->src_]);
+      num_leaves_[arc->src_] += num_handed_on;
+      next_leaf += num_handed_on;
+      if (--num_pending_arcs_[arc->src_] == 0) {
+        ready_nodes_.push_back(arc->src_);
+      }
+    }
+  }
+  // All the flow out of a task must have been traced back to it. Flow that
+  // ends in a node other than a leaf or an unscheduled aggregator, or that
+  // goes around a cycle, never hands leaves on to the task.
+  for (uint64_t node_id = 0; node_id < num_node_ids_; ++node_id) {
+    if (node_kinds[node_id] == TASK_NODE &&
+        num_leaves_[node_id] !=
+        leaf_offsets_[node_id + 1] - leaf_offsets_[node_id]) {
+      LOG(ERROR) << "Flow out of task node " << node_id << " does not reach "
+                 << "a leaf or an unscheduled aggregator";
+      return false;
+    }
+  }
+  return true;
+}
+
+void ExtractedFlow::Reset(uint64_t num_node_ids) {
+  num_node_ids_ = num_node_ids;
+  arcs_.clear();
+  incoming_.clear();
+  offsets_.assign(num_node_ids_ + 1, 0);
+}
+
+}  // namespace firmament
@@ -0,0 +1,136 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Flow computed by a solver, restricted to the arcs that carry flow. The arcs
+// are stored in flat arrays grouped by their destination node (i.e., in
+// compressed sparse row format), which is the order in which the flow is
+// traced back from the leaves to the tasks.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_EXTRACTED_FLOW_H
+#define FIRMAMENT_SCHEDULING_FLOW_EXTRACTED_FLOW_H
+
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+#include "base/types.h"
+
+namespace firmament {
+
+class ExtractedFlow {
+ public:
+  enum NodeKind {
+    OTHER_NODE = 0,
+    TASK_NODE = 1,
+    LEAF_NODE = 2,
+    // A node whose flow to the sink leaves tasks unscheduled.
+    UNSCHEDULED_NODE = 3,
+  };
+
+  struct ArcFlow {
+    uint64_t src_;
+    uint64_t dst_;
+    uint64_t flow_;
+  };
+
+  ExtractedFlow();
+
+  /**
+   * Adds an arc that carries flow. Arcs can only be added between Reset()
+   * and Finalize().
+   */
+  inline void AddArcFlow(uint64_t src, uint64_t dst, uint64_t flow) {
+    ArcFlow arc_flow = {src, dst, flow};
+    arcs_.push_back(arc_flow);
+  }
+  /**
+   * Groups the arcs by their destination node. Must be called once all the
+   * arcs have been added.
+   * @return false if an arc refers to a node id outside [0, NumNodeIds());
+   * all the arcs are then removed
+   */
+  bool Finalize();
+  /**
+   * Returns the flow on the arc from src to dst, or 0 if the arc carries no
+   * flow.
+   */
+  uint64_t Flow(uint64_t src, uint64_t dst) const;
+  /**
+   * Returns the arcs that carry flow into the node.
+   */
+  inline const ArcFlow* IncomingBegin(uint64_t node_id) const {
+    return incoming_.data() + offsets_[node_id];
+  }
+  inline const ArcFlow* IncomingEnd(uint64_t node_id) const {
+    return incoming_.data() + offsets_[node_id + 1];
+  }
+  /**
+   * Traces the flow back from the leaves to the tasks and returns which leaf
+   * every task that is scheduled is mapped to. Every unit of flow that
+   * reaches the sink from a leaf is followed back to exactly one task, and
+   * every node is visited once after all the nodes its flow goes to have
+   * been visited.
+   * @param node_kinds the kind of every node, indexed by node id
+   * @param sink the id of the sink node
+   * @param task_leaf_pairs set to the (task node id, leaf node id) pairs
+   * @return false if the flow out of a node exceeds the number of tasks, or
+   * if some of the flow out of a task cannot be traced to a leaf or an
+   * unscheduled aggregator, i.e., it ends in another node or goes around a
+   * cycle; task_leaf_pairs is then incomplete
+   */
+  bool MapTasksToLeaves(const vector<uint8_t>& node_kinds, uint64_t sink,
+                        vector<pair<uint64_t, uint64_t>>* task_leaf_pairs);
+  /**
+   * Returns the number of node ids the flow can refer to; the node ids are
+   * in [0, NumNodeIds()).
+   */
+  inline uint64_t NumNodeIds() const {
+    return num_node_ids_;
+  }
+  /**
+   * Removes all arcs and prepares the flow for a graph whose node ids are in
+   * [0, num_node_ids). The arrays keep their capacity, so that reusing the
+   * object across solver runs does not reallocate them.
+   */
+  void Reset(uint64_t num_node_ids);
+
+ private:
+  uint64_t num_node_ids_;
+  // The arcs in the order in which they were added.
+  vector<ArcFlow> arcs_;
+  // The arcs grouped by destination node. The arcs into node n are at
+  // positions [offsets_[n], offsets_[n + 1]).
+  vector<ArcFlow> incoming_;
+  vector<uint64_t> offsets_;
+  // Scratch space of MapTasksToLeaves. The leaves assigned to node n are at
+  // positions [leaf_offsets_[n], leaf_offsets_[n] + num_leaves_[n]) of
+  // leaf_ids_.
+  vector<uint64_t> leaf_offsets_;
+  vector<uint64_t> num_leaves_;
+  vector<uint64_t> leaf_ids_;
+  // Number of arcs carrying flow out of every node whose destination has
+  // not been visited yet.
+  vector<uint64_t> num_pending_arcs_;
+  vector<uint64_t> ready_nodes_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_EXTRACTED_FLOW_H
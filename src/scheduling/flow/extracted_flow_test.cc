@@ -0,0 +1,289 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the flat representation of the flow computed by a solver.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+#include "misc/wall_time.h"
+#include "scheduling/flow/extracted_flow.h"
+
+namespace firmament {
+
+// The fixture for testing class ExtractedFlow.
+class ExtractedFlowTest : public ::testing::Test {
+ protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  ExtractedFlowTest() {
+    // You can do set-up work for each test here.
+  }
+
+  virtual ~ExtractedFlowTest() {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  virtual void SetUp() {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+  }
+
+  virtual void TearDown() {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Maps the tasks to leaves the way SolverDispatcher::GetMappings did before
+  // the flow was stored in flat arrays: per-node hash maps of the incoming
+  // flow, traversed breadth-first from the leaves.
+  void MapTasksToLeavesWithHashMaps(
+      vector<unordered_map<uint64_t, uint64_t>>* incoming_flow,
+      const vector<uint8_t>& node_kinds, uint64_t sink,
+      multimap<uint64_t, uint64_t>* task_to_pu) {
+    vector<unordered_map<uint64_t, uint64_t>>& flow = *incoming_flow;
+    vector<vector<uint64_t>> pu_ids(flow.size());
+    vector<bool> visited(flow.size(), false);
+    queue<uint64_t> to_visit;
+    for (uint64_t node_id = 0; node_id < node_kinds.size(); ++node_id) {
+      if (node_kinds[node_id] != ExtractedFlow::LEAF_NODE) {
+        continue;
+      }
+      visited[node_id] = true;
+      unordered_map<uint64_t, uint64_t>::iterator it =
+        flow[sink].find(node_id);
+      if (it != flow[sink].end()) {
+        pu_ids[node_id].assign(it->second, node_id);
+        to_visit.push(node_id);
+      }
+    }
+    while (!to_visit.empty()) {
+      uint64_t node_id = to_visit.front();
+      to_visit.pop();
+      if (node_kinds[node_id] == ExtractedFlow::TASK_NODE) {
+        for (auto& pu_id : pu_ids[node_id]) {
+          task_to_pu->insert(pair<uint64_t, uint64_t>(node_id, pu_id));
+        }
+        continue;
+      }
+      vector<uint64_t>::iterator pu_it = pu_ids[node_id].begin();
+      for (auto& src_flow : flow[node_id]) {
+        while (src_flow.second > 0 && pu_it != pu_ids[node_id].end()) {
+          pu_ids[src_flow.first].push_back(*pu_it);
+          ++pu_it;
+          src_flow.second--;
+        }
+        if (!visited[src_flow.first]) {
+          to_visit.push(src_flow.first);
+          visited[src_flow.first] = true;
+        }
+      }
+    }
+  }
+
+  // Objects declared here can be used by all tests in the test case for
+  // ExtractedFlow.
+};
+
+// Traces the flow of three tasks through an equivalence class, a machine and
+// an unscheduled aggregator to the sink.
+TEST_F(ExtractedFlowTest, MapTasksToLeaves) {
+  // Node ids: 1 sink, 2-4 tasks, 5 equivalence class, 6 machine, 7-8 PUs,
+  // 9 unscheduled aggregator.
+  ExtractedFlow flow;
+  flow.Reset(10);
+  flow.AddArcFlow(7, 1, 1);
+  flow.AddArcFlow(8, 1, 1);
+  flow.AddArcFlow(9, 1, 1);
+  flow.AddArcFlow(6, 7, 1);
+  flow.AddArcFlow(6, 8, 1);
+  flow.AddArcFlow(5, 6, 1);
+  flow.AddArcFlow(3, 6, 1);
+  flow.AddArcFlow(2, 5, 1);
+  flow.AddArcFlow(4, 9, 1);
+  flow.Finalize();
+  EXPECT_EQ(flow.Flow(6, 7), 1);
+  EXPECT_EQ(flow.Flow(7, 6), 0);
+  EXPECT_EQ(flow.IncomingEnd(6) - flow.IncomingBegin(6), 2);
+  vector<uint8_t> node_kinds(10, ExtractedFlow::OTHER_NODE);
+  node_kinds[2] = node_kinds[3] = node_kinds[4] = ExtractedFlow::TASK_NODE;
+  node_kinds[7] = node_kinds[8] = ExtractedFlow::LEAF_NODE;
+  node_kinds[9] = ExtractedFlow::UNSCHEDULED_NODE;
+  vector<pair<uint64_t, uint64_t>> task_leaf_pairs;
+  EXPECT_TRUE(flow.MapTasksToLeaves(node_kinds, 1, &task_leaf_pairs));
+  // Task 4 is unscheduled, and tasks 2 and 3 each get one of the PUs.
+  ASSERT_EQ(task_leaf_pairs.size(), 2);
+  sort(task_leaf_pairs.begin(), task_leaf_pairs.end());
+  EXPECT_EQ(task_leaf_pairs[0].first, 2);
+  EXPECT_EQ(task_leaf_pairs[1].first, 3);
+  EXPECT_NE(task_leaf_pairs[0].second, task_leaf_pairs[1].second);
+  EXPECT_GE(task_leaf_pairs[0].second, 7);
+  EXPECT_LE(task_leaf_pairs[0].second, 8);
+  EXPECT_GE(task_leaf_pairs[1].second, 7);
+  EXPECT_LE(task_leaf_pairs[1].second, 8);
+}
+
+// Flow on an arc to or from a node id the graph does not have is rejected.
+TEST_F(ExtractedFlowTest, FinalizeUnknownNode) {
+  ExtractedFlow flow;
+  flow.Reset(4);
+  flow.AddArcFlow(2, 1, 1);
+  flow.AddArcFlow(3, 4, 1);
+  EXPECT_FALSE(flow.Finalize());
+  EXPECT_EQ(flow.IncomingEnd(1) - flow.IncomingBegin(1), 0);
+  flow.Reset(4);
+  flow.AddArcFlow(2, 1, 1);
+  EXPECT_TRUE(flow.Finalize());
+  EXPECT_EQ(flow.Flow(2, 1), 1);
+}
+
+// A task's flow that ends in a node other than a leaf or an unscheduled
+// aggregator cannot be mapped.
+TEST_F(ExtractedFlowTest, MapTasksToLeavesDeadEnd) {
+  // Node ids: 1 sink, 2-3 tasks, 4 equivalence class, 5 PU.
+  ExtractedFlow flow;
+  flow.Reset(6);
+  flow.AddArcFlow(5, 1, 1);
+  flow.AddArcFlow(4, 1, 1);
+  flow.AddArcFlow(2, 5, 1);
+  flow.AddArcFlow(3, 4, 1);
+  flow.Finalize();
+  vector<uint8_t> node_kinds(6, ExtractedFlow::OTHER_NODE);
+  node_kinds[2] = node_kinds[3] = ExtractedFlow::TASK_NODE;
+  node_kinds[5] = ExtractedFlow::LEAF_NODE;
+  vector<pair<uint64_t, uint64_t>> task_leaf_pairs;
+  EXPECT_FALSE(flow.MapTasksToLeaves(node_kinds, 1, &task_leaf_pairs));
+}
+
+// A task's flow that goes around a cycle before it reaches a leaf cannot be
+// mapped.
+TEST_F(ExtractedFlowTest, MapTasksToLeavesCycle) {
+  // Node ids: 1 sink, 2 task, 3-4 equivalence classes, 5 PU.
+  ExtractedFlow flow;
+  flow.Reset(6);
+  flow.AddArcFlow(5, 1, 1);
+  flow.AddArcFlow(2, 3, 1);
+  flow.AddArcFlow(3, 4, 2);
+  flow.AddArcFlow(4, 3, 1);
+  flow.AddArcFlow(4, 5, 1);
+  flow.Finalize();
+  vector<uint8_t> node_kinds(6, ExtractedFlow::OTHER_NODE);
+  node_kinds[2] = ExtractedFlow::TASK_NODE;
+  node_kinds[5] = ExtractedFlow::LEAF_NODE;
+  vector<pair<uint64_t, uint64_t>> task_leaf_pairs;
+  EXPECT_FALSE(flow.MapTasksToLeaves(node_kinds, 1, &task_leaf_pairs));
+}
+
+// Flow out of a node that exceeds the tasks' supply is rejected before the
+// leaves are allocated, also when the flows would overflow the leaf offsets.
+TEST_F(ExtractedFlowTest, MapTasksToLeavesExcessFlow) {
+  // Node ids: 1 sink, 2 task, 3 equivalence class, 4 PU.
+  ExtractedFlow flow;
+  flow.Reset(5);
+  flow.AddArcFlow(4, 1, 1);
+  flow.AddArcFlow(2, 3, 1);
+  flow.AddArcFlow(3, 4, 2);
+  flow.Finalize();
+  vector<uint8_t> node_kinds(5, ExtractedFlow::OTHER_NODE);
+  node_kinds[2] = ExtractedFlow::TASK_NODE;
+  node_kinds[4] = ExtractedFlow::LEAF_NODE;
+  vector<pair<uint64_t, uint64_t>> task_leaf_pairs;
+  EXPECT_FALSE(flow.MapTasksToLeaves(node_kinds, 1, &task_leaf_pairs));
+  flow.Reset(5);
+  flow.AddArcFlow(4, 1, UINT64_MAX);
+  flow.AddArcFlow(3, 1, UINT64_MAX);
+  flow.AddArcFlow(3, 4, 2);
+  flow.AddArcFlow(2, 3, 1);
+  flow.Finalize();
+  EXPECT_FALSE(flow.MapTasksToLeaves(node_kinds, 1, &task_leaf_pairs));
+  EXPECT_TRUE(task_leaf_pairs.empty());
+}
+
+// Maps 200k running tasks, spread over 1000 machines with 8 PUs each, to
+// their PUs, and compares the time it takes to doing so with hash maps.
+TEST_F(ExtractedFlowTest, MapTasksToLeavesBenchmark) {
+  const uint64_t kNumMachines = 1000;
+  const uint64_t kNumPUsPerMachine = 8;
+  const uint64_t kNumTasks = 200000;
+  const uint64_t kNumPUs = kNumMachines * kNumPUsPerMachine;
+  // Node ids: 0 sink, then the machines, the PUs and the tasks.
+  uint64_t num_node_ids = 1 + kNumMachines + kNumPUs + kNumTasks;
+  vector<uint8_t> node_kinds(num_node_ids, ExtractedFlow::OTHER_NODE);
+  ExtractedFlow flow;
+  flow.Reset(num_node_ids);
+  vector<unordered_map<uint64_t, uint64_t>> incoming_flow(num_node_ids);
+  for (uint64_t pu = 0; pu < kNumPUs; ++pu) {
+    uint64_t pu_id = 1 + kNumMachines + pu;
+    uint64_t machine_id = 1 + pu / kNumPUsPerMachine;
+    node_kinds[pu_id] = ExtractedFlow::LEAF_NODE;
+    flow.AddArcFlow(pu_id, 0, kNumTasks / kNumPUs);
+    incoming_flow[0][pu_id] = kNumTasks / kNumPUs;
+    flow.AddArcFlow(machine_id, pu_id, kNumTasks / kNumPUs);
+    incoming_flow[pu_id][machine_id] = kNumTasks / kNumPUs;
+  }
+  for (uint64_t task = 0; task < kNumTasks; ++task) {
+    uint64_t task_id = 1 + kNumMachines + kNumPUs + task;
+    uint64_t machine_id = 1 + task % kNumMachines;
+    node_kinds[task_id] = ExtractedFlow::TASK_NODE;
+    flow.AddArcFlow(task_id, machine_id, 1);
+    incoming_flow[machine_id][task_id] = 1;
+  }
+  WallTime wall_time;
+  uint64_t start_time = wall_time.GetCurrentTimestamp();
+  multimap<uint64_t, uint64_t> task_to_pu;
+  MapTasksToLeavesWithHashMaps(&incoming_flow, node_kinds, 0, &task_to_pu);
+  uint64_t hash_map_time = wall_time.GetCurrentTimestamp() - start_time;
+  EXPECT_EQ(task_to_pu.size(), kNumTasks);
+  start_time = wall_time.GetCurrentTimestamp();
+  flow.Finalize();
+  vector<pair<uint64_t, uint64_t>> task_leaf_pairs;
+  EXPECT_TRUE(flow.MapTasksToLeaves(node_kinds, 0, &task_leaf_pairs));
+  uint64_t flat_time = wall_time.GetCurrentTimestamp() - start_time;
+  LOG(INFO) << "Mapped " << kNumTasks << " tasks in " << hash_map_time
+            << " us with hash maps and in " << flat_time
+            << " us with flat arrays";
+  ASSERT_EQ(task_leaf_pairs.size(), kNumTasks);
+  vector<uint64_t> tasks_per_pu(num_node_ids, 0);
+  for (auto& task_leaf : task_leaf_pairs) {
+    EXPECT_EQ((task_leaf.first - 1 - kNumMachines - kNumPUs) % kNumMachines,
+              (task_leaf.second - 1 - kNumMachines) / kNumPUsPerMachine);
+    tasks_per_pu[task_leaf.second]++;
+  }
+  for (uint64_t pu = 0; pu < kNumPUs; ++pu) {
+    EXPECT_EQ(tasks_per_pu[1 + kNumMachines + pu], kNumTasks / kNumPUs);
+  }
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
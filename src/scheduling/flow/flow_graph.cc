@@ -34,38 +34,38 @@ FlowGraph::FlowGraph() : current_id_(1) {
 }
 
 FlowGraph::~FlowGraph() {
-  for (unordered_map<uint64_t, FlowGraphNode*>::iterator it = node_map_.begin();
-       it != node_map_.end(); ) {
-    unordered_map<uint64_t, FlowGraphNode*>::iterator it_tmp = it;
-    ++it;
-    DeleteNode(it_tmp->second);
+  while (!nodes_.empty()) {
+    DeleteNode(nodes_.back());
   }
 }
 
 FlowGraphArc* FlowGraph::AddArc(FlowGraphNode* src,
                                 FlowGraphNode* dst) {
-  FlowGraphArc* arc = new FlowGraphArc(src->id_, dst->id_, src, dst);
-  CHECK(arc_set_.insert(arc).second);
+  FlowGraphArc* arc = arc_allocator_.New(src->id_, dst->id_, src, dst);
+  arc->graph_index_ = arcs_.size();
+  arcs_.push_back(arc);
   src->AddArc(arc);
   return arc;
 }
 
 FlowGraphArc* FlowGraph::AddArc(uint64_t src, uint64_t dst) {
-  FlowGraphNode* src_node = FindPtrOrNull(node_map_, src);
+  FlowGraphNode* src_node = FindNode(src);
   CHECK_NOTNULL(src_node);
-  FlowGraphNode* dst_node = FindPtrOrNull(node_map_, dst);
+  FlowGraphNode* dst_node = FindNode(dst);
   CHECK_NOTNULL(dst_node);
-  FlowGraphArc* arc = new FlowGraphArc(src, dst, src_node, dst_node);
-  arc_set_.insert(arc);
-  src_node->AddArc(arc);
-  return arc;
+  return AddArc(src_node, dst_node);
 }
 
 FlowGraphNode* FlowGraph::AddNode() {
   uint64_t id = NextId();
-  FlowGraphNode* node = new FlowGraphNode(id);
-  CHECK_NOTNULL(node);
-  CHECK(InsertIfNotPresent(&node_map_, id, node));
+  if (id >= node_index_.size()) {
+    node_index_.resize(id + 1, NULL);
+  }
+  CHECK(node_index_[id] == NULL);
+  FlowGraphNode* node = node_allocator_.New(id);
+  node->graph_index_ = nodes_.size();
+  nodes_.push_back(node);
+  node_index_[id] = node;
   return node;
 }
 
@@ -84,49 +84,45 @@ void FlowGraph::DeleteArc(FlowGraphArc* arc) {
   // Remove the arc from the incoming and outgoing collections.
   arc->src_node_->outgoing_arc_map_.erase(arc->dst_node_->id_);
   arc->dst_node_->incoming_arc_map_.erase(arc->src_node_->id_);
-  // First remove various meta-data relating to this arc
-  arc_set_.erase(arc);
+  // First remove the arc from the arc list by moving the last arc into its
+  // position
+  FlowGraphArc* last_arc = arcs_.back();
+  last_arc->graph_index_ = arc->graph_index_;
+  arcs_[arc->graph_index_] = last_arc;
+  arcs_.pop_back();
   // Then delete the arc itself
-  delete arc;
+  arc_allocator_.Delete(arc);
 }
 
 void FlowGraph::DeleteNode(FlowGraphNode* node) {
   unused_ids_.push(node->id_);
-  // First remove all outgoing arcs
-  for (unordered_map<uint64_t, FlowGraphArc*>::iterator it =
-         node->outgoing_arc_map_.begin();
-       it != node->outgoing_arc_map_.end();) {
-    CHECK_EQ(it->first, it->second->dst_);
-    CHECK_EQ(node->id_, it->second->src_);
-    CHECK_EQ(it->second->dst_node_->incoming_arc_map_.erase(it->second->src_),
-             1);
-    unordered_map<uint64_t, FlowGraphArc*>::iterator it_tmp = it;
-    ++it;
-    DeleteArc(it_tmp->second);
+  // First remove all outgoing arcs. DeleteArc removes each arc from the
+  // adjacency lists, which invalidates their iterators.
+  while (!node->outgoing_arc_map_.empty()) {
+    FlowGraphArc* arc = node->outgoing_arc_map_.begin()->second;
+    CHECK_EQ(node->outgoing_arc_map_.begin()->first, arc->dst_);
+    CHECK_EQ(node->id_, arc->src_);
+    DeleteArc(arc);
   }
-  node->outgoing_arc_map_.clear();
   // Remove all incoming arcs.
-  for (unordered_map<uint64_t, FlowGraphArc*>::iterator it =
-         node->incoming_arc_map_.begin();
-       it != node->incoming_arc_map_.end();) {
-    CHECK_EQ(node->id_, it->second->dst_);
-    CHECK_EQ(it->first, it->second->src_);
-    CHECK_EQ(it->second->src_node_->outgoing_arc_map_.erase(it->second->dst_),
-             1);
-    unordered_map<uint64_t, FlowGraphArc*>::iterator it_tmp = it;
-    ++it;
-    DeleteArc(it_tmp->second);
+  while (!node->incoming_arc_map_.empty()) {
+    FlowGraphArc* arc = node->incoming_arc_map_.begin()->second;
+    CHECK_EQ(node->id_, arc->dst_);
+    CHECK_EQ(node->incoming_arc_map_.begin()->first, arc->src_);
+    DeleteArc(arc);
   }
-  node->incoming_arc_map_.clear();
-  node_map_.erase(node->id_);
-  delete node;
+  FlowGraphNode* last_node = nodes_.back();
+  last_node->graph_index_ = node->graph_index_;
+  nodes_[node->graph_index_] = last_node;
+  nodes_.pop_back();
+  node_index_[node->id_] = NULL;
+  node_allocator_.Delete(node);
 }
 
 FlowGraphArc* FlowGraph::GetArc(FlowGraphNode* src, FlowGraphNode* dst) {
   CHECK_NOTNULL(src);
   CHECK_NOTNULL(dst);
-  unordered_map<uint64_t, FlowGraphArc*>::iterator arc_it =
-    src->outgoing_arc_map_.find(dst->id_);
+  FlowGraphArcMap::iterator arc_it = src->outgoing_arc_map_.find(dst->id_);
   if (arc_it == src->outgoing_arc_map_.end()) {
     return NULL;
   }
@@ -165,4 +161,13 @@ void FlowGraph::PopulateUnusedIds(uint64_t new_current_id) {
   current_id_ = new_current_id;
 }
 
+void FlowGraph::Reserve(uint64_t num_new_nodes, uint64_t num_new_arcs) {
+  nodes_.reserve(nodes_.size() + num_new_nodes);
+  arcs_.reserve(arcs_.size() + num_new_arcs);
+  // New nodes reuse the ids of removed nodes before they get new ids.
+  if (num_new_nodes > unused_ids_.size()) {
+    node_index_.reserve(current_id_ + num_new_nodes - unused_ids_.size());
+  }
+}
+
 }  // namespace firmament
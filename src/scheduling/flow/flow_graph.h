@@ -25,6 +25,7 @@
 #include <vector>
 
 #include "misc/map-util.h"
+#include "misc/slab_allocator.h"
 #include "scheduling/flow/flow_graph_arc.h"
 #include "scheduling/flow/flow_graph_node.h"
 
@@ -45,19 +46,37 @@ class FlowGraph {
   void DeleteArc(FlowGraphArc* arc);
   void DeleteNode(FlowGraphNode* node);
   FlowGraphArc* GetArc(FlowGraphNode* src, FlowGraphNode* dst);
-  inline const unordered_set<FlowGraphArc*>& Arcs() const { return arc_set_; }
-  inline const unordered_map<uint64_t, FlowGraphNode*>& Nodes() const {
-    return node_map_;
+  inline const vector<FlowGraphArc*>& Arcs() const { return arcs_; }
+  inline const vector<FlowGraphNode*>& Nodes() const { return nodes_; }
+  // Returns the node with the given id, or NULL if there is no such node.
+  inline FlowGraphNode* FindNode(uint64_t id) const {
+    return id < node_index_.size() ? node_index_[id] : NULL;
   }
   inline const FlowGraphNode& Node(uint64_t id) const {
-    FlowGraphNode* node = FindPtrOrNull(node_map_, id);
+    FlowGraphNode* node = FindNode(id);
     CHECK_NOTNULL(node);
     return *node;
   }
-  inline uint64_t NumArcs() const { return arc_set_.size(); }
+  // Dense node ids number the live nodes from 1 to Nodes().size() in the
+  // order of the node list. Unlike node ids, they change when nodes are
+  // removed, so they are only valid until the graph changes.
+  inline uint64_t DenseNodeId(const FlowGraphNode& node) const {
+    return node.graph_index_ + 1;
+  }
+  inline FlowGraphNode* NodeForDenseId(uint64_t dense_id) const {
+    CHECK_GT(dense_id, 0);
+    CHECK_LE(dense_id, nodes_.size());
+    return nodes_[dense_id - 1];
+  }
+  inline uint64_t NumArcs() const { return arcs_.size(); }
+  /**
+   * Reserves space for the given number of additional nodes and arcs, so
+   * that adding them does not repeatedly grow the node and arc lists.
+   */
+  void Reserve(uint64_t num_new_nodes, uint64_t num_new_arcs);
   inline uint64_t NumNodes() const {
     if (!FLAGS_flow_scheduling_solver.compare("flowlessly")) {
-      return node_map_.size();
+      return nodes_.size();
     } else {
       // TODO(malte): This is a work-around as cs2 and Relax IV do not allow
       // sparse node IDs, and will get tripped up
@@ -78,10 +97,18 @@ class FlowGraph {
   uint64_t NextId();
   void PopulateUnusedIds(uint64_t new_current_id);
 
-  unordered_set<FlowGraphArc*> arc_set_;
+  // Nodes and arcs are allocated from slabs, so that they are laid out
+  // densely in memory and the pointers the managers hold remain stable.
+  SlabAllocator<FlowGraphArc> arc_allocator_;
+  SlabAllocator<FlowGraphNode> node_allocator_;
+  // Dense lists of the arcs and the nodes. An arc's or node's graph_index_
+  // is its position in the list.
+  vector<FlowGraphArc*> arcs_;
+  vector<FlowGraphNode*> nodes_;
   // Graph structure containers and helper fields
   uint64_t current_id_;
-  unordered_map<uint64_t, FlowGraphNode*> node_map_;
+  // Nodes indexed by node id; NULL if no node has the id.
+  vector<FlowGraphNode*> node_index_;
   // Queue storing the ids of the nodes we've previously removed.
   queue<uint64_t> unused_ids_;
 };
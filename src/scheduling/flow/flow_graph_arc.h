@@ -52,6 +52,11 @@ struct FlowGraphArc {
   FlowGraphNode* src_node_;
   FlowGraphNode* dst_node_;
   FlowGraphArcType type_;
+  // Position of the arc in the flow graph's arc list.
+  uint64_t graph_index_;
+  // Cost version at which the cost model last computed the arc's cost and
+  // capacity (see FlowGraphManager::ArcCostIsCurrent).
+  uint64_t cost_version_;
 };
 
 } // namespace firmament
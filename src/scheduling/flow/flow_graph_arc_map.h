@@ -0,0 +1,164 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Compact adjacency list of a flow graph node, mapping the ids of the
+// node's neighbours to the arcs connecting them. Most nodes (e.g., task and
+// PU nodes) only have a handful of arcs, so the arcs are kept in a flat
+// vector that is searched linearly. A hash index over the vector is only
+// built for nodes with many arcs (e.g., the sink or aggregator nodes).
+//
+// The interface mirrors the subset of unordered_map's interface that the
+// flow graph code uses. Unlike with unordered_map, erasing an arc
+// invalidates all iterators, since the last arc is moved into the erased
+// arc's position.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_ARC_MAP_H
+#define FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_ARC_MAP_H
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+#include "base/types.h"
+
+namespace firmament {
+
+struct FlowGraphArc;
+
+class FlowGraphArcMap {
+ public:
+  typedef uint64_t key_type;
+  typedef FlowGraphArc* mapped_type;
+  typedef pair<uint64_t, FlowGraphArc*> value_type;
+  typedef vector<value_type>::iterator iterator;
+  typedef vector<value_type>::const_iterator const_iterator;
+
+  FlowGraphArcMap() {}
+
+  iterator begin() {
+    return arcs_.begin();
+  }
+  const_iterator begin() const {
+    return arcs_.begin();
+  }
+  void clear() {
+    arcs_.clear();
+    index_.reset();
+  }
+  bool empty() const {
+    return arcs_.empty();
+  }
+  iterator end() {
+    return arcs_.end();
+  }
+  const_iterator end() const {
+    return arcs_.end();
+  }
+  /**
+   * Removes the arc to/from the given node.
+   * @return the number of arcs removed (0 or 1)
+   */
+  size_t erase(uint64_t node_id) {
+    uint64_t position = Position(node_id);
+    if (position == arcs_.size()) {
+      return 0;
+    }
+    if (index_) {
+      index_->erase(node_id);
+    }
+    if (position != arcs_.size() - 1) {
+      arcs_[position] = arcs_.back();
+      if (index_) {
+        (*index_)[arcs_[position].first] = position;
+      }
+    }
+    arcs_.pop_back();
+    if (index_ && arcs_.size() < kIndexThreshold / 2) {
+      // Avoid paying for the index once the node has few arcs again.
+      index_.reset();
+    }
+    return 1;
+  }
+  iterator find(uint64_t node_id) {
+    return arcs_.begin() + Position(node_id);
+  }
+  const_iterator find(uint64_t node_id) const {
+    return arcs_.begin() + Position(node_id);
+  }
+  /**
+   * Adds an arc unless there already is an arc to/from the same node.
+   * @return the arc's position and true if the arc was added
+   */
+  pair<iterator, bool> insert(const value_type& value) {
+    uint64_t position = Position(value.first);
+    if (position != arcs_.size()) {
+      return make_pair(arcs_.begin() + position, false);
+    }
+    arcs_.push_back(value);
+    if (index_) {
+      (*index_)[value.first] = position;
+    } else if (arcs_.size() > kIndexThreshold) {
+      BuildIndex();
+    }
+    return make_pair(arcs_.begin() + position, true);
+  }
+  size_t size() const {
+    return arcs_.size();
+  }
+
+ private:
+  // Number of arcs above which lookups go through the hash index rather
+  // than scanning the arcs.
+  static const size_t kIndexThreshold = 16;
+
+  void BuildIndex() {
+    index_.reset(new unordered_map<uint64_t, uint64_t>());
+    index_->rehash(arcs_.size() * 2);
+    for (uint64_t position = 0; position < arcs_.size(); ++position) {
+      (*index_)[arcs_[position].first] = position;
+    }
+  }
+
+  // Returns the position of the arc to/from the given node, or the number
+  // of arcs if there is no such arc.
+  uint64_t Position(uint64_t node_id) const {
+    if (index_) {
+      unordered_map<uint64_t, uint64_t>::const_iterator it =
+        index_->find(node_id);
+      return it == index_->end() ? arcs_.size() : it->second;
+    }
+    uint64_t position = 0;
+    for (; position < arcs_.size(); ++position) {
+      if (arcs_[position].first == node_id) {
+        break;
+      }
+    }
+    return position;
+  }
+
+  vector<value_type> arcs_;
+  // Maps node ids to positions in arcs_; only set for nodes with many arcs.
+  unique_ptr<unordered_map<uint64_t, uint64_t>> index_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_ARC_MAP_H
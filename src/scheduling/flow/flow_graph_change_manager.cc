@@ -37,6 +37,68 @@ DECLARE_bool(incremental_flow);
 
 namespace firmament {
 
+namespace {
+
+// The fields that the arc changes have in common.
+struct ArcState {
+  uint64_t src_;
+  uint64_t dst_;
+  uint64_t cap_lower_bound_;
+  uint64_t cap_upper_bound_;
+  int64_t cost_;
+  FlowGraphArcType type_;
+};
+
+template <typename T>
+inline ArcState GetArcState(const T& change) {
+  ArcState arc = {change.src_, change.dst_, change.cap_lower_bound_,
+                  change.cap_upper_bound_, change.cost_, change.type_};
+  return arc;
+}
+
+inline ArcState GetArcState(const DIMACSChange& change) {
+  if (change.kind() == DIMACSChange::NEW_ARC) {
+    return GetArcState(static_cast<const DIMACSNewArc&>(change));
+  }
+  CHECK_EQ(change.kind(), DIMACSChange::CHANGE_ARC);
+  return GetArcState(static_cast<const DIMACSChangeArc&>(change));
+}
+
+template <typename T>
+inline void SetArcState(const ArcState& arc, T* change) {
+  change->cap_lower_bound_ = arc.cap_lower_bound_;
+  change->cap_upper_bound_ = arc.cap_upper_bound_;
+  change->cost_ = arc.cost_;
+  change->type_ = arc.type_;
+}
+
+inline void SetArcState(const ArcState& arc, DIMACSChange* change) {
+  if (change->kind() == DIMACSChange::NEW_ARC) {
+    SetArcState(arc, static_cast<DIMACSNewArc*>(change));
+  } else {
+    CHECK_EQ(change->kind(), DIMACSChange::CHANGE_ARC);
+    SetArcState(arc, static_cast<DIMACSChangeArc*>(change));
+  }
+}
+
+// Returns the old cost of an arc change, or 0 for new arcs.
+inline int64_t ChangeOldCost(const DIMACSChange& change) {
+  if (change.kind() == DIMACSChange::CHANGE_ARC) {
+    return static_cast<const DIMACSChangeArc&>(change).old_cost_;
+  }
+  return 0;
+}
+
+inline uint64_t ChangeNodeId(const DIMACSChange& change) {
+  if (change.kind() == DIMACSChange::ADD_NODE) {
+    return static_cast<const DIMACSAddNode&>(change).id_;
+  }
+  CHECK_EQ(change.kind(), DIMACSChange::REMOVE_NODE);
+  return static_cast<const DIMACSRemoveNode&>(change).node_id_;
+}
+
+}  // namespace
+
 FlowGraphChangeManager::FlowGraphChangeManager(
     DIMACSChangeStats* dimacs_stats)
   : flow_graph_(new FlowGraph), dimacs_stats_(dimacs_stats) {
@@ -165,6 +227,71 @@ void FlowGraphChangeManager::ChangeArcCost(FlowGraphArc* arc,
   }
 }
 
+void FlowGraphChangeManager::CoalesceArcAdditions(size_t first_change) {
+  // node_index_ holds the position + 1 of the last addition of every node
+  // since first_change, or 0 if the node has been removed since. arc_index_
+  // holds the arcs that have been changed since first_change. A later
+  // addition of such an arc is kept in place, as otherwise it would be sent
+  // before the change (e.g., its deletion).
+  CHECK_LE(first_change, graph_changes_.size());
+  size_t num_changes = graph_changes_.size() - first_change;
+  node_index_.Clear(num_changes);
+  arc_index_.Clear(num_changes);
+  size_t num_kept = first_change;
+  for (size_t index = first_change; index < graph_changes_.size(); ++index) {
+    DIMACSChange* change = graph_changes_[index];
+    switch (change->kind()) {
+      case DIMACSChange::ADD_NODE:
+      case DIMACSChange::REMOVE_NODE: {
+        uint64_t node_id = ChangeNodeId(*change);
+        uint64_t hash = DIMACSChangeIndex::Hash(0, node_id);
+        node_index_.Set(FindNode(hash, node_id), hash, change,
+                        change->kind() == DIMACSChange::ADD_NODE ?
+                        num_kept + 1 : 0);
+        break;
+      }
+      case DIMACSChange::NEW_ARC:
+      case DIMACSChange::CHANGE_ARC: {
+        ArcState arc = GetArcState(*change);
+        uint64_t hash = DIMACSChangeIndex::Hash(
+            DIMACSChangeIndex::Hash(0, arc.src_), arc.dst_);
+        DIMACSChangeIndex::Entry* entry =
+          arc_index_.Find(hash, [&arc](const DIMACSChange& other) {
+              ArcState other_arc = GetArcState(other);
+              return other_arc.src_ == arc.src_ && other_arc.dst_ == arc.dst_;
+            });
+        if (change->kind() == DIMACSChange::CHANGE_ARC) {
+          arc_index_.Set(entry, hash, change, 0);
+          break;
+        }
+        if (entry->change_ != NULL) {
+          break;
+        }
+        DIMACSChangeIndex::Entry* src_entry =
+          FindNode(DIMACSChangeIndex::Hash(0, arc.src_), arc.src_);
+        DIMACSChangeIndex::Entry* dst_entry =
+          FindNode(DIMACSChangeIndex::Hash(0, arc.dst_), arc.dst_);
+        uint64_t add_seq_num =
+          max(src_entry->change_ != NULL ? src_entry->value_ : 0,
+              dst_entry->change_ != NULL ? dst_entry->value_ : 0);
+        if (add_seq_num > 0) {
+          DIMACSAddNode* add_node =
+            static_cast<DIMACSAddNode*>(graph_changes_[add_seq_num - 1]);
+          add_node->arc_additions_.push_back(
+              *static_cast<DIMACSNewArc*>(change));
+          delete change;
+          continue;
+        }
+        break;
+      }
+      default:
+        LOG(FATAL) << "Unexpected type of change";
+    }
+    graph_changes_[num_kept++] = change;
+  }
+  graph_changes_.resize(num_kept);
+}
+
 void FlowGraphChangeManager::DeleteArc(FlowGraphArc* arc,
                                        DIMACSChangeType change_type,
                                        const char* comment) {
@@ -191,120 +318,87 @@ void FlowGraphChangeManager::DeleteNode(FlowGraphNode* node,
   flow_graph_->DeleteNode(node);
 }
 
-void FlowGraphChangeManager::MergeChangesToSameArcHelper(
-    uint64_t src_id, uint64_t dst_id, uint64_t cap_lower_bound,
-    uint64_t cap_upper_bound, int64_t cost, FlowGraphArcType type,
-    DIMACSChange* change, vector<DIMACSChange*>* new_graph_changes,
-    unordered_map<uint64_t, unordered_map<uint64_t, DIMACSChange*>>*
-    arcs_src_changes,
-    unordered_map<uint64_t, unordered_map<uint64_t, DIMACSChange*>>*
-    arcs_dst_changes) {
-  CHECK_NOTNULL(change);
-  unordered_map<uint64_t, DIMACSChange*>* dst_to_change =
-    FindOrNull(*arcs_src_changes, src_id);
-  if (dst_to_change) {
-    // We already have at least one arc starting at src.
-    DIMACSChange* chg = FindPtrOrNull(*dst_to_change, dst_id);
-    if (chg) {
-      // Update the existing entry.
-      if (DIMACSChangeArc* chg_arc = dynamic_cast<DIMACSChangeArc*>(chg)) {
-        chg_arc->cap_lower_bound_ = cap_lower_bound;
-        chg_arc->cap_upper_bound_ = cap_upper_bound;
-        chg_arc->cost_ = cost;
-        chg_arc->type_ = type;
-        // We don't update the old_cost on a merge because we want to keep the
-        // first recorded old cost value which is the value that the solver
-        // currently has for the arc.
-      } else if (DIMACSNewArc* new_arc = dynamic_cast<DIMACSNewArc*>(chg)) {
-        new_arc->cap_lower_bound_ = cap_lower_bound;
-        new_arc->cap_upper_bound_ = cap_upper_bound;
-        new_arc->cost_ = cost;
-        new_arc->type_ = type;
-      } else {
-        LOG(FATAL) << "Unexpected type of change";
-      }
-    } else {
-      // We don't have an entry for the arc.
-      CHECK(InsertIfNotPresent(dst_to_change, dst_id, change));
-      new_graph_changes->push_back(change);
-    }
-  } else {
-    // No arc starting at source has been changed.
-    unordered_map<uint64_t, DIMACSChange*> new_dst_to_change;
-    InsertIfNotPresent(&new_dst_to_change, dst_id, change);
-    InsertIfNotPresent(arcs_src_changes, src_id, new_dst_to_change);
-    // Append the change to the change list because it's the first time we
-    // update this arc.
-    new_graph_changes->push_back(change);
-  }
-  unordered_map<uint64_t, DIMACSChange*>* src_to_change =
-    FindOrNull(*arcs_dst_changes, dst_id);
-  if (src_to_change) {
-    // Only insert the change if we don't already have one for the arc.
-    InsertIfNotPresent(src_to_change, src_id, change);
-  } else {
-    unordered_map<uint64_t, DIMACSChange*> new_src_to_change;
-    InsertIfNotPresent(&new_src_to_change, src_id, change);
-    InsertIfNotPresent(arcs_dst_changes, dst_id, new_src_to_change);
-  }
+DIMACSChangeIndex::Entry* FlowGraphChangeManager::FindNode(uint64_t hash,
+                                                           uint64_t node_id) {
+  return node_index_.Find(hash, [node_id](const DIMACSChange& change) {
+      return ChangeNodeId(change) == node_id;
+    });
+}
+
+bool FlowGraphChangeManager::IsNodeRemoved(uint64_t node_id) {
+  DIMACSChangeIndex::Entry* entry =
+    FindNode(DIMACSChangeIndex::Hash(0, node_id), node_id);
+  return entry->change_ != NULL && entry->value_;
+}
+
+bool FlowGraphChangeManager::IsStale(const DIMACSChangeIndex::Entry& entry,
+                                     uint64_t src_id, uint64_t dst_id) {
+  DIMACSChangeIndex::Entry* src_entry =
+    FindNode(DIMACSChangeIndex::Hash(0, src_id), src_id);
+  DIMACSChangeIndex::Entry* dst_entry =
+    FindNode(DIMACSChangeIndex::Hash(0, dst_id), dst_id);
+  return (src_entry->change_ != NULL && src_entry->value_ > entry.value_) ||
+    (dst_entry->change_ != NULL && dst_entry->value_ > entry.value_);
 }
 
 void FlowGraphChangeManager::MergeChangesToSameArc() {
-  vector<DIMACSChange*> new_graph_changes;
-  // For each arc change we have an entry in arcs_src_changes and one in
-  // arcs_dst_changes. arcs_src_changes is indexed by src_id and then by
-  // dst_id. arcs_dst_changes is indexed by dst_id and then by src_id.
-  // These two maps allow us to get all the arcs that have a particular
-  // node as a source or destination.
-  unordered_map<uint64_t, unordered_map<uint64_t, DIMACSChange*>>
-    arcs_src_changes;
-  unordered_map<uint64_t, unordered_map<uint64_t, DIMACSChange*>>
-    arcs_dst_changes;
-  for (auto& change : graph_changes_) {
-    if (DIMACSChangeArc* chg_arc = dynamic_cast<DIMACSChangeArc*>(change)) {
-      // Check if we can merge the arc change.
-      MergeChangesToSameArcHelper(
-          chg_arc->src_, chg_arc->dst_, chg_arc->cap_lower_bound_,
-          chg_arc->cap_upper_bound_, chg_arc->cost_, chg_arc->type_, change,
-          &new_graph_changes, &arcs_src_changes, &arcs_dst_changes);
-    } else if (DIMACSNewArc* new_arc = dynamic_cast<DIMACSNewArc*>(change)) {
-      // Check if we can merge the arc change.
-      MergeChangesToSameArcHelper(
-          new_arc->src_, new_arc->dst_, new_arc->cap_lower_bound_,
-          new_arc->cap_upper_bound_, new_arc->cost_, new_arc->type_, change,
-          &new_graph_changes, &arcs_src_changes, &arcs_dst_changes);
-    } else if (DIMACSAddNode* new_node = dynamic_cast<DIMACSAddNode*>(change)) {
-      // Remove all the arcs that have new_node->id_ as source or destination.
-      unordered_map<uint64_t, DIMACSChange*>* dst_to_change =
-        FindOrNull(arcs_src_changes, new_node->id_);
-      if (dst_to_change) {
-        for (auto& dst_change : *dst_to_change) {
-          unordered_map<uint64_t, DIMACSChange*>* src_to_change =
-            FindOrNull(arcs_dst_changes, dst_change.first);
-          CHECK_NOTNULL(src_to_change);
-          src_to_change->erase(new_node->id_);
+  // For every arc, arc_index_ holds the first change to the arc that is
+  // kept, and the sequence number (i.e., position + 1) of the change.
+  // node_index_ holds the sequence number of the last addition of every node.
+  // An arc change is only merged into an earlier change to the arc if neither
+  // of the arc's nodes has been (re-)added since, as otherwise the earlier
+  // change refers to an arc of a node that previously used the same id.
+  arc_index_.Clear(graph_changes_.size());
+  node_index_.Clear(graph_changes_.size());
+  size_t num_kept = 0;
+  for (size_t index = 0; index < graph_changes_.size(); ++index) {
+    DIMACSChange* change = graph_changes_[index];
+    uint64_t seq_num = index + 1;
+    switch (change->kind()) {
+      case DIMACSChange::ADD_NODE: {
+        uint64_t node_id = ChangeNodeId(*change);
+        uint64_t hash = DIMACSChangeIndex::Hash(0, node_id);
+        node_index_.Set(FindNode(hash, node_id), hash, change, seq_num);
+        break;
+      }
+      case DIMACSChange::REMOVE_NODE:
+        break;
+      case DIMACSChange::NEW_ARC:
+      case DIMACSChange::CHANGE_ARC: {
+        ArcState arc = GetArcState(*change);
+        uint64_t hash = DIMACSChangeIndex::Hash(
+            DIMACSChangeIndex::Hash(0, arc.src_), arc.dst_);
+        DIMACSChangeIndex::Entry* entry =
+          arc_index_.Find(hash, [&arc](const DIMACSChange& other) {
+              ArcState other_arc = GetArcState(other);
+              return other_arc.src_ == arc.src_ && other_arc.dst_ == arc.dst_;
+            });
+        if (entry->change_ != NULL && !IsStale(*entry, arc.src_, arc.dst_)) {
+          // Update the existing change. We don't update the old_cost of a
+          // DIMACSChangeArc on a merge because we want to keep the first
+          // recorded old cost value which is the value that the solver
+          // currently has for the arc.
+          SetArcState(arc, entry->change_);
+          delete change;
+          continue;
         }
+        arc_index_.Set(entry, hash, change, seq_num);
+        break;
       }
-      arcs_src_changes.erase(new_node->id_);
-      arcs_dst_changes.erase(new_node->id_);
-      new_graph_changes.push_back(change);
-    } else if (dynamic_cast<DIMACSRemoveNode*>(change)) {
-      new_graph_changes.push_back(change);
-    } else {
-      LOG(FATAL) << "Unexpected type of change";
+      default:
+        LOG(FATAL) << "Unexpected type of change";
     }
+    graph_changes_[num_kept++] = change;
   }
-  graph_changes_.clear();
-  graph_changes_.insert(graph_changes_.begin(), new_graph_changes.begin(),
-                        new_graph_changes.end());
+  graph_changes_.resize(num_kept);
 }
 
 void FlowGraphChangeManager::OptimizeChanges() {
-  if (FLAGS_remove_duplicate_changes) {
-    RemoveDuplicateChanges();
-  }
   if (FLAGS_merge_changes_to_same_arc) {
+    // Merging the changes to an arc also removes the duplicate changes to it.
     MergeChangesToSameArc();
+  } else if (FLAGS_remove_duplicate_changes) {
+    RemoveDuplicateChanges();
   }
   if (FLAGS_purge_changes_before_node_removal) {
     PurgeChangesBeforeNodeRemoval();
@@ -312,153 +406,116 @@ void FlowGraphChangeManager::OptimizeChanges() {
 }
 
 void FlowGraphChangeManager::PurgeChangesBeforeNodeRemoval() {
-  // Set in which we store the ids of the nodes that are removed. We process
-  // the changes from the last to the first one. Whenever we encounter a
-  // remove node change we put its node id to the set. Similarly, whenever
-  // we encounter an add node change we remove its node id from the set.
-  // In this way we make sure we handle the case when ids are re-used upon
-  // node addition.
-  unordered_set<uint64_t> nodes_removed;
-  list<DIMACSChange*> new_graph_changes;
-  for (vector<DIMACSChange*>::reverse_iterator rev_it = graph_changes_.rbegin();
-       rev_it != graph_changes_.rend(); ++rev_it) {
-    if (DIMACSRemoveNode* rem_node =
-        dynamic_cast<DIMACSRemoveNode*>(*rev_it)) {
-      if (nodes_removed.insert(rem_node->node_id_).second) {
-        // Only add the change if the node has not been previosly inserted into
-        // nodes_removed. It if has been inserted then there's no point to add
-        // the change because the node is going to be removed in a future
-        // change.
-        new_graph_changes.push_front(rem_node);
-      }
-    } else if (DIMACSAddNode* new_node =
-               dynamic_cast<DIMACSAddNode*>(*rev_it)) {
-      nodes_removed.erase(new_node->id_);
-      new_graph_changes.push_front(new_node);
-    } else if (DIMACSNewArc* new_arc =
-               dynamic_cast<DIMACSNewArc*>(*rev_it)) {
-      if (nodes_removed.find(new_arc->src_) == nodes_removed.end() &&
-          nodes_removed.find(new_arc->dst_) == nodes_removed.end()) {
-        // Only add the change if neither of its arc source or destination
-        // nodes are going to be removed.
-        new_graph_changes.push_front(new_arc);
+  // We process the changes from the last to the first one, and node_index_
+  // records whether every node is removed by a later change. Whenever we
+  // encounter a remove node change we mark its node id as removed.
+  // Similarly, whenever we encounter an add node change we unmark it. In this
+  // way we make sure we handle the case when ids are re-used upon node
+  // addition. The kept changes are compacted towards the end of the vector.
+  node_index_.Clear(graph_changes_.size());
+  size_t first_kept = graph_changes_.size();
+  for (size_t index = graph_changes_.size(); index-- > 0; ) {
+    DIMACSChange* change = graph_changes_[index];
+    bool keep = true;
+    switch (change->kind()) {
+      case DIMACSChange::ADD_NODE:
+      case DIMACSChange::REMOVE_NODE: {
+        uint64_t node_id = ChangeNodeId(*change);
+        uint64_t hash = DIMACSChangeIndex::Hash(0, node_id);
+        DIMACSChangeIndex::Entry* entry = FindNode(hash, node_id);
+        bool removed = change->kind() == DIMACSChange::REMOVE_NODE;
+        // Only keep a node removal if the node is not removed by a later
+        // change anyway.
+        keep = !(removed && entry->change_ != NULL && entry->value_);
+        node_index_.Set(entry, hash, change, removed);
+        break;
       }
-    } else if (DIMACSChangeArc* chg_arc =
-               dynamic_cast<DIMACSChangeArc*>(*rev_it)) {
-      if (nodes_removed.find(chg_arc->src_) == nodes_removed.end() &&
-          nodes_removed.find(chg_arc->dst_) == nodes_removed.end()) {
-        // Only add the change if neither of its arc source or destination
+      case DIMACSChange::NEW_ARC:
+      case DIMACSChange::CHANGE_ARC: {
+        // Only keep the change if neither of its arc source or destination
         // nodes are going to be removed.
-        new_graph_changes.push_front(chg_arc);
+        ArcState arc = GetArcState(*change);
+        keep = !IsNodeRemoved(arc.src_) && !IsNodeRemoved(arc.dst_);
+        break;
       }
+      default:
+        LOG(FATAL) << "Unexpected type of change";
+    }
+    if (keep) {
+      graph_changes_[--first_kept] = change;
     } else {
-      LOG(FATAL) << "Unexpected type of change";
+      delete change;
     }
   }
-  graph_changes_.clear();
-  graph_changes_.insert(graph_changes_.begin(), new_graph_changes.begin(),
-                        new_graph_changes.end());
+  graph_changes_.erase(graph_changes_.begin(),
+                       graph_changes_.begin() + first_kept);
 }
 
 void FlowGraphChangeManager::RemoveDuplicateChanges() {
-  vector<DIMACSChange*> new_graph_changes;
-  // For each arc change we have two entries in node_to_change. One entry
-  // which is indexed by src_id and another one with is indexed by dst_id.
-  // Thus, whenever we re-use a node id we can make sure to remove from the
-  // state all the arcs that connect the previously removed node that was
-  // using the same id.
-  unordered_map<uint64_t, unordered_map<string, DIMACSChange*>> node_to_change;
-  for (auto& change : graph_changes_) {
-    if (DIMACSChangeArc* chg_arc = dynamic_cast<DIMACSChangeArc*>(change)) {
-      RemoveDuplicateChangesHelper(chg_arc->src_, chg_arc->dst_, change,
-                                   &new_graph_changes, &node_to_change);
-    } else if (DIMACSNewArc* new_arc = dynamic_cast<DIMACSNewArc*>(change)) {
-      RemoveDuplicateChangesHelper(new_arc->src_, new_arc->dst_, change,
-                                   &new_graph_changes, &node_to_change);
-    } else if (DIMACSAddNode* new_node = dynamic_cast<DIMACSAddNode*>(change)) {
-      // Remove from the state the arc changes that connect a node with the
-      // same id as the node we're adding.
-      unordered_map<string, DIMACSChange*>* desc_to_change =
-        FindOrNull(node_to_change, new_node->id_);
-      if (desc_to_change) {
-        for (auto& desc_change : *desc_to_change) {
-          if (DIMACSNewArc* new_arc =
-              dynamic_cast<DIMACSNewArc*>(desc_change.second)) {
-            RemoveDuplicateCleanState(new_node->id_, new_arc->src_,
-                                      new_arc->dst_, desc_change.first,
-                                      &node_to_change);
-          } else if (DIMACSChangeArc* chg_arc =
-                     dynamic_cast<DIMACSChangeArc*>(desc_change.second)) {
-            RemoveDuplicateCleanState(new_node->id_, chg_arc->src_,
-                                      chg_arc->dst_, desc_change.first,
-                                      &node_to_change);
-          } else {
-            LOG(FATAL) << "Unexpected change type";
-          }
+  // arc_index_ holds the kept changes to every arc, keyed by all of their
+  // fields, and node_index_ the sequence number of the last addition of every
+  // node. As when merging, a change is only a duplicate if neither of the
+  // arc's nodes has been (re-)added since the identical change.
+  arc_index_.Clear(graph_changes_.size());
+  node_index_.Clear(graph_changes_.size());
+  size_t num_kept = 0;
+  for (size_t index = 0; index < graph_changes_.size(); ++index) {
+    DIMACSChange* change = graph_changes_[index];
+    uint64_t seq_num = index + 1;
+    switch (change->kind()) {
+      case DIMACSChange::ADD_NODE: {
+        uint64_t node_id = ChangeNodeId(*change);
+        uint64_t hash = DIMACSChangeIndex::Hash(0, node_id);
+        node_index_.Set(FindNode(hash, node_id), hash, change, seq_num);
+        break;
+      }
+      case DIMACSChange::REMOVE_NODE:
+        break;
+      case DIMACSChange::NEW_ARC:
+      case DIMACSChange::CHANGE_ARC: {
+        ArcState arc = GetArcState(*change);
+        int64_t old_cost = ChangeOldCost(*change);
+        uint64_t hash = DIMACSChangeIndex::Hash(0, change->kind());
+        hash = DIMACSChangeIndex::Hash(hash, arc.src_);
+        hash = DIMACSChangeIndex::Hash(hash, arc.dst_);
+        hash = DIMACSChangeIndex::Hash(hash, arc.cap_lower_bound_);
+        hash = DIMACSChangeIndex::Hash(hash, arc.cap_upper_bound_);
+        hash = DIMACSChangeIndex::Hash(hash, static_cast<uint64_t>(arc.cost_));
+        hash = DIMACSChangeIndex::Hash(hash, arc.type_);
+        hash = DIMACSChangeIndex::Hash(hash, static_cast<uint64_t>(old_cost));
+        DIMACSChangeIndex::Entry* entry =
+          arc_index_.Find(hash, [&](const DIMACSChange& other) {
+              ArcState other_arc = GetArcState(other);
+              return other.kind() == change->kind() &&
+                other_arc.src_ == arc.src_ && other_arc.dst_ == arc.dst_ &&
+                other_arc.cap_lower_bound_ == arc.cap_lower_bound_ &&
+                other_arc.cap_upper_bound_ == arc.cap_upper_bound_ &&
+                other_arc.cost_ == arc.cost_ &&
+                other_arc.type_ == arc.type_ &&
+                ChangeOldCost(other) == old_cost &&
+                other.comment() == change->comment();
+            });
+        if (entry->change_ != NULL && !IsStale(*entry, arc.src_, arc.dst_)) {
+          delete change;
+          continue;
         }
+        arc_index_.Set(entry, hash, change, seq_num);
+        break;
       }
-      node_to_change.erase(new_node->id_);
-      new_graph_changes.push_back(change);
-    } else if (dynamic_cast<DIMACSRemoveNode*>(change)) {
-      new_graph_changes.push_back(change);
-    }
-  }
-  graph_changes_.clear();
-  graph_changes_.insert(graph_changes_.begin(), new_graph_changes.begin(),
-                        new_graph_changes.end());
-}
-
-void FlowGraphChangeManager::RemoveDuplicateChangesHelper(
-    uint64_t src_id, uint64_t dst_id, DIMACSChange* change,
-    vector<DIMACSChange*>* new_graph_changes,
-    unordered_map<uint64_t, unordered_map<string, DIMACSChange*>>*
-    node_to_change) {
-  if (RemoveDuplicateChangesUpdateState(src_id, change, node_to_change) &&
-      RemoveDuplicateChangesUpdateState(dst_id, change, node_to_change)) {
-    new_graph_changes->push_back(change);
-  }
-}
-
-bool FlowGraphChangeManager::RemoveDuplicateChangesUpdateState(
-    uint64_t node_id, DIMACSChange* change,
-    unordered_map<uint64_t, unordered_map<string, DIMACSChange*>>*
-    node_to_change) {
-  string change_desc = change->GenerateChange();
-  unordered_map<string, DIMACSChange*>* changes =
-    FindOrNull(*node_to_change, node_id);
-  if (changes) {
-    if (!InsertIfNotPresent(changes, change_desc, change)) {
-      // The change is already in the map.
-      return false;
+      default:
+        LOG(FATAL) << "Unexpected type of change";
     }
-  } else {
-    unordered_map<string, DIMACSChange*> new_changes;
-    InsertIfNotPresent(&new_changes, change_desc, change);
-    InsertIfNotPresent(node_to_change, node_id, new_changes);
+    graph_changes_[num_kept++] = change;
   }
-  return true;
+  graph_changes_.resize(num_kept);
 }
 
-void FlowGraphChangeManager::RemoveDuplicateCleanState(
-    uint64_t new_node_id, uint64_t src, uint64_t dst, const string& change_desc,
-    unordered_map<uint64_t, unordered_map<string, DIMACSChange*>>*
-    node_to_change) {
-  if (new_node_id == src) {
-    auto dst_change_map = FindOrNull(*node_to_change, dst);
-    CHECK_NOTNULL(dst_change_map);
-    dst_change_map->erase(change_desc);
-    if (dst_change_map->size() == 0) {
-      node_to_change->erase(dst);
-    }
-  } else if (new_node_id == dst) {
-    auto src_change_map = FindOrNull(*node_to_change, src);
-    CHECK_NOTNULL(src_change_map);
-    src_change_map->erase(change_desc);
-    if (src_change_map->size() == 0) {
-      node_to_change->erase(src);
-    }
-  } else {
-    LOG(FATAL) << "New node id is not equal to the source or destination ids";
+void FlowGraphChangeManager::Reserve(uint64_t num_new_nodes,
+                                     uint64_t num_new_arcs) {
+  flow_graph_->Reserve(num_new_nodes, num_new_arcs);
+  if (FLAGS_incremental_flow) {
+    graph_changes_.reserve(graph_changes_.size() + num_new_nodes +
+                           num_new_arcs);
   }
 }
 
@@ -30,6 +30,7 @@
 #define FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_CHANGE_MANAGER_H
 
 #include "base/types.h"
+#include "scheduling/flow/dimacs_change_index.h"
 #include "scheduling/flow/dimacs_change_stats.h"
 #include "scheduling/flow/flow_graph.h"
 
@@ -66,6 +67,14 @@ class FlowGraphChangeManager {
                          DIMACSChangeType change_type, const char* comment);
   void ChangeArcCost(FlowGraphArc* arc, int64_t cost,
                      DIMACSChangeType change_type, const char* comment);
+  /**
+   * Moves the arc additions recorded since the first_change-th change into
+   * the change that adds the arc's source or destination node, whichever is
+   * added last, if that node is added since the first_change-th change too.
+   * The nodes added in a batch are thus sent to the solver as one change per
+   * node together with their arcs, rather than as one change per arc.
+   */
+  void CoalesceArcAdditions(size_t first_change);
   void DeleteArc(FlowGraphArc* arc, DIMACSChangeType change_type,
                  const char* comment);
   void DeleteNode(FlowGraphNode* node, DIMACSChangeType change_type,
@@ -77,6 +86,11 @@ class FlowGraphChangeManager {
     OptimizeChanges();
     return graph_changes_;
   }
+  /**
+   * Reserves space for the given number of additional nodes and arcs, and
+   * for the changes that record their addition.
+   */
+  void Reserve(uint64_t num_new_nodes, uint64_t num_new_arcs);
   void ResetChanges();
   inline bool CheckNodeType(uint64_t node_id, FlowNodeType type) {
     return flow_graph_->Node(node_id).type_ == type;
@@ -93,6 +107,8 @@ class FlowGraphChangeManager {
 
  private:
   FRIEND_TEST(FlowGraphChangeManagerTest, AddGraphChange);
+  FRIEND_TEST(FlowGraphChangeManagerTest, CoalesceArcAdditions);
+  FRIEND_TEST(FlowGraphChangeManagerTest, GetOptimizedGraphChanges);
   FRIEND_TEST(FlowGraphChangeManagerTest, MergeChangesToSameArc);
   FRIEND_TEST(FlowGraphChangeManagerTest, PurgeChangesBeforeNodeRemoval);
   FRIEND_TEST(FlowGraphChangeManagerTest, RemoveDuplicateChanges);
@@ -100,50 +116,44 @@ class FlowGraphChangeManager {
 
   void AddGraphChange(DIMACSChange* change);
   void OptimizeChanges();
-  void MergeChangesToSameArc();
   /**
-   * Checks if there's already a change for the (src_id, dst_id) arc.
-   * If there's no change then it adds one to the state, otherwise
-   * it updates the existing change.
+   * Returns the node_index_ entry of the node, or the empty entry at which
+   * the node is to be inserted.
    */
-  void MergeChangesToSameArcHelper(
-      uint64_t src_id, uint64_t dst_id, uint64_t cap_lower_bound,
-      uint64_t cap_upper_bound, int64_t cost, FlowGraphArcType type,
-      DIMACSChange* change, vector<DIMACSChange*>* new_graph_changes,
-      unordered_map<uint64_t, unordered_map<uint64_t, DIMACSChange*>>*
-      arcs_src_changes,
-      unordered_map<uint64_t, unordered_map<uint64_t, DIMACSChange*>>*
-      arcs_dst_changes);
-  void PurgeChangesBeforeNodeRemoval();
-  void RemoveDuplicateChanges();
+  DIMACSChangeIndex::Entry* FindNode(uint64_t hash, uint64_t node_id);
+  /**
+   * Returns true if the node is marked as removed in node_index_.
+   */
+  bool IsNodeRemoved(uint64_t node_id);
+  /**
+   * Returns true if the change to the (src_id, dst_id) arc in the arc_index_
+   * entry precedes the last addition of the src or dst node in node_index_,
+   * i.e. the change is to an arc of a node that previously used the same id.
+   */
+  bool IsStale(const DIMACSChangeIndex::Entry& entry, uint64_t src_id,
+               uint64_t dst_id);
+  /**
+   * Merges the changes to the same arc into the first change to the arc.
+   */
+  void MergeChangesToSameArc();
   /**
-   * Checks if there's already an identical change for the (src_id, dst_id) arc.
-   * If there's no change the it updates the state, otherwise it just ignores
-   * the change we're currently processing because it's duplicate.
+   * Removes the changes to arcs whose source or destination node is removed
+   * by a later change, as well as repeated removals of the same node.
    */
-  void RemoveDuplicateChangesHelper(
-      uint64_t src_id, uint64_t dst_id, DIMACSChange* change,
-      vector<DIMACSChange*>* new_graph_changes,
-      unordered_map<uint64_t, unordered_map<string, DIMACSChange*>>*
-      node_to_change);
-  bool RemoveDuplicateChangesUpdateState(
-      uint64_t node_id, DIMACSChange* change,
-      unordered_map<uint64_t, unordered_map<string, DIMACSChange*>>*
-      node_to_change);
+  void PurgeChangesBeforeNodeRemoval();
   /**
-   * Method to be called upon node addition. This method makes sure that the
-   * state is cleaned when we re-use a node id.
+   * Removes the arc changes that are identical to an earlier change.
    */
-  void RemoveDuplicateCleanState(
-      uint64_t new_node_id, uint64_t src, uint64_t dst,
-      const string& change_desc,
-      unordered_map<uint64_t, unordered_map<string, DIMACSChange*>>*
-      node_to_change);
+  void RemoveDuplicateChanges();
 
   FlowGraph* flow_graph_;
   // Vector storing the graph changes occured since the last scheduling round.
   vector<DIMACSChange*> graph_changes_;
   DIMACSChangeStats* dimacs_stats_;
+  // Scratch indexes used when optimizing the changes. They are kept across
+  // scheduling rounds so that their slots are reused.
+  DIMACSChangeIndex arc_index_;
+  DIMACSChangeIndex node_index_;
 };
 
 }  // namespace firmament
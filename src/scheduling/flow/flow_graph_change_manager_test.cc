@@ -73,6 +73,65 @@ TEST_F(FlowGraphChangeManagerTest, AddGraphChange) {
   EXPECT_EQ(change_manager_->graph_changes_.size(), 3);
 }
 
+TEST_F(FlowGraphChangeManagerTest, CoalesceArcAdditions) {
+  FlowGraphNode node1(1);
+  FlowGraphNode node2(2);
+  FlowGraphNode node3(3);
+  FlowGraphArc arc12(1, 2, 0, 1, 42, &node1, &node2);
+  FlowGraphArc arc13(1, 3, 0, 1, 42, &node1, &node3);
+  FlowGraphArc arc23(2, 3, 0, 1, 42, &node2, &node3);
+  change_manager_->graph_changes_.push_back(
+      new DIMACSAddNode(node1, vector<FlowGraphArc*>()));
+  change_manager_->graph_changes_.push_back(
+      new DIMACSAddNode(node2, vector<FlowGraphArc*>()));
+  change_manager_->graph_changes_.push_back(
+      new DIMACSAddNode(node3, vector<FlowGraphArc*>()));
+  // Node 1 is added before the batch, and so is arc (1,2).
+  change_manager_->graph_changes_.push_back(new DIMACSNewArc(arc12));
+  change_manager_->graph_changes_.push_back(new DIMACSNewArc(arc13));
+  change_manager_->graph_changes_.push_back(new DIMACSNewArc(arc23));
+  // The re-addition of arc (1,3) is kept after the arc's deletion.
+  change_manager_->graph_changes_.push_back(new DIMACSChangeArc(arc13, 42));
+  change_manager_->graph_changes_.push_back(new DIMACSNewArc(arc13));
+  change_manager_->CoalesceArcAdditions(1);
+  const vector<DIMACSChange*>& changes = change_manager_->graph_changes_;
+  ASSERT_EQ(changes.size(), 5);
+  EXPECT_EQ(changes[0]->kind(), DIMACSChange::ADD_NODE);
+  EXPECT_EQ(static_cast<DIMACSAddNode*>(changes[0])->arc_additions_.size(), 0);
+  DIMACSAddNode* add_node2 = static_cast<DIMACSAddNode*>(changes[1]);
+  ASSERT_EQ(add_node2->arc_additions_.size(), 1);
+  EXPECT_EQ(add_node2->arc_additions_[0].src_, 1);
+  DIMACSAddNode* add_node3 = static_cast<DIMACSAddNode*>(changes[2]);
+  ASSERT_EQ(add_node3->arc_additions_.size(), 2);
+  EXPECT_EQ(add_node3->arc_additions_[0].src_, 1);
+  EXPECT_EQ(add_node3->arc_additions_[1].src_, 2);
+  EXPECT_EQ(changes[3]->kind(), DIMACSChange::CHANGE_ARC);
+  EXPECT_EQ(changes[4]->kind(), DIMACSChange::NEW_ARC);
+}
+
+// Merging the changes to an arc also removes the duplicate changes to it,
+// but only up to the re-addition of one of its nodes.
+TEST_F(FlowGraphChangeManagerTest, GetOptimizedGraphChanges) {
+  FlowGraphNode node1(1);
+  FlowGraphNode node2(2);
+  FlowGraphArc arc12(1, 2, 0, 1, 42, &node1, &node2);
+  change_manager_->graph_changes_.push_back(
+      new DIMACSAddNode(node1, vector<FlowGraphArc*>()));
+  change_manager_->graph_changes_.push_back(
+      new DIMACSAddNode(node2, vector<FlowGraphArc*>()));
+  change_manager_->graph_changes_.push_back(new DIMACSChangeArc(arc12, 41));
+  change_manager_->graph_changes_.push_back(new DIMACSChangeArc(arc12, 41));
+  change_manager_->graph_changes_.push_back(
+      new DIMACSAddNode(node2, vector<FlowGraphArc*>()));
+  change_manager_->graph_changes_.push_back(new DIMACSChangeArc(arc12, 41));
+  const vector<DIMACSChange*>& changes =
+    change_manager_->GetOptimizedGraphChanges();
+  ASSERT_EQ(changes.size(), 5);
+  EXPECT_EQ(changes[2]->kind(), DIMACSChange::CHANGE_ARC);
+  EXPECT_EQ(changes[3]->kind(), DIMACSChange::ADD_NODE);
+  EXPECT_EQ(changes[4]->kind(), DIMACSChange::CHANGE_ARC);
+}
+
 TEST_F(FlowGraphChangeManagerTest, MergeChangesToSameArc) {
   FlowGraphNode node1(1);
   FlowGraphNode node2(2);
@@ -27,9 +27,11 @@
 #include <string>
 #include <utility>
 #include <vector>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 #include "base/common.h"
 #include "base/types.h"
@@ -48,12 +50,35 @@ DEFINE_bool(preemption, false, "Enable preemption and migration of tasks");
 DEFINE_bool(update_preferences_running_task, false,
             "True if the preferences of a running task should be updated before"
             " each scheduling round");
+DEFINE_bool(cache_equiv_class_arc_costs, false,
+            "True if the costs of the arcs from tasks and equivalence classes "
+            "to equivalence classes and resources should only be recomputed "
+            "when one of the arc's nodes has been updated. Only valid for cost "
+            "models whose costs for these arcs only depend on the state of "
+            "the arc's nodes and of the resources the equivalence classes "
+            "have arcs to, apart from time-dependent updates. Ignored for "
+            "cost models that do not support it (e.g., the CPU cost model).");
+
+DEFINE_uint64(unsched_agg_cost_update_interval, 0, "If non-zero, the costs "
+              "of the arcs from tasks to their unscheduled aggregators are "
+              "only updated once per interval of this many microseconds, "
+              "rather than before every solver run. The costs are thus "
+              "quantized into buckets of wait time, and only the tasks whose "
+              "wait time crossed into a new bucket get updated.");
+DEFINE_int32(flow_graph_update_threads, 0, "Number of threads that compute "
+             "the costs of the arcs to equivalence classes and resources when "
+             "the cost model is thread-safe. 0 uses one thread per core; 1 "
+             "computes the costs on the updating thread.");
 
 DECLARE_string(flow_scheduling_solver);
 DECLARE_uint64(max_tasks_per_pu);
 
 namespace firmament {
 
+// Minimum number of arc costs computed by every thread. Batches with fewer
+// outdated arcs are not worth handing to the worker pool.
+const uint64_t kMinArcsPerCostShard = 256;
+
 FlowGraphManager::FlowGraphManager(
     CostModelInterface *cost_model,
     unordered_set<ResourceID_t,
@@ -66,7 +91,11 @@ FlowGraphManager::FlowGraphManager(
       leaf_res_ids_(leaf_res_ids),
       trace_generator_(trace_generator),
       dimacs_stats_(dimacs_stats),
-      cur_traversal_counter_(0) {
+      cur_traversal_counter_(0),
+      time_manager_(time_manager),
+      cur_cost_version_(1),
+      min_valid_cost_version_(1),
+      batch_pref_arcs_(false) {
   // Add sink node.
   sink_node_ = graph_change_manager_->AddNode(
       FlowNodeType::SINK, 0, ADD_SINK_NODE, "SINK");
@@ -132,6 +161,106 @@ void FlowGraphManager::AddOrUpdateJobNodes(
   UpdateFlowGraph(&node_queue, &marked_nodes);
 }
 
+void FlowGraphManager::AddOrUpdateJobNodesInBulk(
+    const vector<JobDescriptor*>& jd_ptr_vect) {
+  size_t first_change = graph_change_manager_->GetGraphChanges().size();
+  // Collect the tasks of every job in breadth-first order. The tasks of job
+  // i are at positions [job_task_begin[i], job_task_begin[i + 1]). A job that
+  // is in the batch more than once is only collected once, so that the
+  // capacity of its unscheduled aggregator is changed once.
+  vector<JobDescriptor*> jd_ptrs;
+  vector<TaskDescriptor*> td_ptrs;
+  vector<size_t> job_task_begin;
+  unordered_set<JobID_t, boost::hash<boost::uuids::uuid>> batch_job_ids;
+  for (const auto& jd_ptr : jd_ptr_vect) {
+    if (!batch_job_ids.insert(JobIDFromString(jd_ptr->uuid())).second) {
+      continue;
+    }
+    jd_ptrs.push_back(jd_ptr);
+    job_task_begin.push_back(td_ptrs.size());
+    td_ptrs.push_back(jd_ptr->mutable_root_task());
+    for (size_t index = job_task_begin.back(); index < td_ptrs.size();
+         ++index) {
+      for (RepeatedPtrField<TaskDescriptor>::pointer_iterator
+             task_iter = td_ptrs[index]->mutable_spawned()->pointer_begin();
+           task_iter != td_ptrs[index]->mutable_spawned()->pointer_end();
+           ++task_iter) {
+        td_ptrs.push_back(*task_iter);
+      }
+    }
+  }
+  job_task_begin.push_back(td_ptrs.size());
+  // Only the tasks and jobs that do not have nodes yet add nodes and arcs to
+  // the graph; the rest of the tasks are already in it.
+  uint64_t num_missing_task_nodes = 0;
+  for (const auto& td_ptr : td_ptrs) {
+    if (!NodeForTaskID(td_ptr->uid()) && TaskMustHaveNode(*td_ptr)) {
+      num_missing_task_nodes++;
+    }
+  }
+  uint64_t num_missing_unsched_agg_nodes = 0;
+  for (const auto& jd_ptr : jd_ptrs) {
+    if (!UnschedAggNodeForJobID(JobIDFromString(jd_ptr->uuid()))) {
+      num_missing_unsched_agg_nodes++;
+    }
+  }
+  // Every new task gets a node and an arc to its unscheduled aggregator.
+  graph_change_manager_->Reserve(
+      num_missing_task_nodes + num_missing_unsched_agg_nodes,
+      num_missing_task_nodes);
+  if (num_missing_task_nodes > 0) {
+    // task_to_node_map_ may be a tr1::unordered_map, which has no reserve(),
+    // and rehash() takes a bucket count rather than a number of elements.
+    task_to_node_map_.rehash(static_cast<size_t>(ceil(
+        (task_to_node_map_.size() + num_missing_task_nodes) /
+        task_to_node_map_.max_load_factor())));
+  }
+  vector<FlowGraphNode*> task_nodes;
+  task_nodes.reserve(td_ptrs.size());
+  for (size_t job_index = 0; job_index < jd_ptrs.size(); ++job_index) {
+    JobID_t job_id = JobIDFromString(jd_ptrs[job_index]->uuid());
+    FlowGraphNode* unsched_agg_node = UnschedAggNodeForJobID(job_id);
+    if (!unsched_agg_node) {
+      unsched_agg_node = AddUnscheduledAggNode(job_id);
+    }
+    int64_t num_new_task_nodes = 0;
+    for (size_t index = job_task_begin[job_index];
+         index < job_task_begin[job_index + 1]; ++index) {
+      TaskDescriptor* td_ptr = td_ptrs[index];
+      FlowGraphNode* task_node = NodeForTaskID(td_ptr->uid());
+      if (!task_node && TaskMustHaveNode(*td_ptr)) {
+        task_node = AddTaskNode(job_id, td_ptr);
+        num_new_task_nodes++;
+      }
+      if (task_node) {
+        task_nodes.push_back(task_node);
+      }
+    }
+    if (num_new_task_nodes > 0) {
+      // Increment capacity from unsched agg node to sink.
+      UpdateUnscheduledAggNode(unsched_agg_node, num_new_task_nodes);
+    }
+  }
+  // The task nodes are updated directly rather than through the queue, since
+  // all the tasks' children have already been visited. Only the equivalence
+  // class and resource nodes the tasks have arcs to go through the queue.
+  // The task nodes form the first frontier, and so the costs of their arcs
+  // are computed together. The equivalence classes of all the batch's jobs
+  // are marked when the tasks' arcs to them are added, and thus every
+  // equivalence class node is added and updated once per batch.
+  queue<TDOrNodeWrapper*> node_queue;
+  unordered_set<uint64_t> marked_nodes;
+  batch_pref_arcs_ = cost_model_->IsThreadSafe();
+  for (auto& task_node : task_nodes) {
+    UpdateTaskNode(task_node, &node_queue, &marked_nodes);
+  }
+  UpdatePrefArcs(&node_queue, &marked_nodes);
+  batch_pref_arcs_ = false;
+  UpdateFlowGraph(&node_queue, &marked_nodes);
+  // Send the batch's new nodes to the solver together with their arcs.
+  graph_change_manager_->CoalesceArcAdditions(first_change);
+}
+
 void FlowGraphManager::AddResourceTopologyDFS(
     ResourceTopologyNodeDescriptor* rtnd_ptr) {
   // Steps:
@@ -252,6 +381,12 @@ FlowGraphNode* FlowGraphManager::AddTaskNode(JobID_t job_id,
   task_node->job_id_ = job_id;
   sink_node_->excess_--;
   CHECK(InsertIfNotPresent(&task_to_node_map_, td_ptr->uid(), task_node));
+  if (FLAGS_unsched_agg_cost_update_interval > 0) {
+    uint64_t update_time = time_manager_->GetCurrentTimestamp() +
+      FLAGS_unsched_agg_cost_update_interval;
+    unsched_agg_cost_update_time_[td_ptr->uid()] = update_time;
+    unsched_agg_cost_updates_.push(make_pair(update_time, td_ptr->uid()));
+  }
   return task_node;
 }
 
@@ -263,6 +398,157 @@ FlowGraphNode* FlowGraphManager::AddUnscheduledAggNode(JobID_t job_id) {
   return unsched_agg_node;
 }
 
+void FlowGraphManager::AddPrefArc(FlowGraphNode* src_node,
+                                  FlowGraphNode* dst_node) {
+  FlowGraphArc* arc =
+    graph_change_manager_->mutable_flow_graph()->GetArc(src_node, dst_node);
+  pref_arc_pending_index_.push_back(pending_pref_arcs_.size() - 1);
+  pref_arc_dst_nodes_.push_back(dst_node);
+  pref_arc_outdated_.push_back(!arc || !ArcCostIsCurrent(*arc));
+}
+
+void FlowGraphManager::AddPrefArcs(FlowGraphNode* src_node,
+                                   vector<EquivClass_t>* pref_ecs,
+                                   vector<ResourceID_t>* pref_res,
+                                   queue<TDOrNodeWrapper*>* node_queue,
+                                   unordered_set<uint64_t>* marked_nodes) {
+  pending_pref_arcs_.push_back(PendingPrefArcs{src_node, pref_ecs, pref_res,
+                                               pref_arc_dst_nodes_.size()});
+  if (pref_ecs) {
+    for (auto& pref_ec_id : *pref_ecs) {
+      FlowGraphNode* pref_ec_node = NodeForEquivClass(pref_ec_id);
+      if (!pref_ec_node) {
+        pref_ec_node = AddEquivClassNode(pref_ec_id);
+      }
+      AddPrefArc(src_node, pref_ec_node);
+    }
+  } else {
+    for (auto& pref_res_id : *pref_res) {
+      FlowGraphNode* pref_res_node = NodeForResourceID(pref_res_id);
+      // The resource node should already exist because the cost models cannot
+      // prefer a resource before it is added to the graph.
+      CHECK_NOTNULL(pref_res_node);
+      AddPrefArc(src_node, pref_res_node);
+    }
+  }
+  if (!batch_pref_arcs_) {
+    UpdatePrefArcs(node_queue, marked_nodes);
+  }
+}
+
+bool FlowGraphManager::ArcCostIsCurrent(const FlowGraphArc& arc) {
+  return FLAGS_cache_equiv_class_arc_costs &&
+    cost_model_->SupportsArcCostCache() &&
+    arc.cost_version_ >= min_valid_cost_version_ &&
+    arc.cost_version_ >= arc.src_node_->cost_version_ &&
+    arc.cost_version_ >= arc.dst_node_->cost_version_;
+}
+
+void FlowGraphManager::ComputePrefArcDescriptors() {
+  uint64_t num_arcs = pref_arc_dst_nodes_.size();
+  pref_arc_descriptors_.assign(num_arcs, ArcDescriptor(0LL, 0ULL, 0ULL));
+  uint64_t num_outdated_arcs =
+    count(pref_arc_outdated_.begin(), pref_arc_outdated_.end(), true);
+  uint64_t num_shards = 1;
+  if (num_outdated_arcs >= 2 * kMinArcsPerCostShard &&
+      cost_model_->IsThreadSafe()) {
+    uint64_t num_threads = FLAGS_flow_graph_update_threads > 0 ?
+      static_cast<uint64_t>(FLAGS_flow_graph_update_threads) :
+      max(boost::thread::hardware_concurrency(), 1U);
+    num_shards = min(num_threads, num_outdated_arcs / kMinArcsPerCostShard);
+  }
+  if (num_shards == 1) {
+    ComputePrefArcDescriptorShard(0, num_arcs);
+    return;
+  }
+  // The shards are ranges of consecutive arcs. This thread computes shards
+  // too while it waits for the pool's threads.
+  for (uint64_t shard = 0; shard < num_shards; ++shard) {
+    cost_tasks_.push_back(
+        boost::bind(&FlowGraphManager::ComputePrefArcDescriptorShard, this,
+                    num_arcs * shard / num_shards,
+                    num_arcs * (shard + 1) / num_shards));
+  }
+  cost_pool_.Run(&cost_tasks_, num_shards);
+}
+
+void FlowGraphManager::ComputePrefArcDescriptorShard(uint64_t begin_index,
+                                                     uint64_t end_index) {
+  for (uint64_t index = begin_index; index < end_index; ++index) {
+    if (!pref_arc_outdated_[index]) {
+      continue;
+    }
+    const PendingPrefArcs& pending =
+      pending_pref_arcs_[pref_arc_pending_index_[index]];
+    uint64_t pref_index = index - pending.first_arc_index_;
+    if (pending.pref_res_) {
+      pref_arc_descriptors_[index] = cost_model_->EquivClassToResourceNode(
+          pending.src_node_->ec_id_, (*pending.pref_res_)[pref_index]);
+    } else if (pending.src_node_->IsTaskNode()) {
+      pref_arc_descriptors_[index] = cost_model_->TaskToEquivClassAggregator(
+          pending.src_node_->td_ptr_->uid(), (*pending.pref_ecs_)[pref_index]);
+    } else {
+      pref_arc_descriptors_[index] = cost_model_->EquivClassToEquivClass(
+          pending.src_node_->ec_id_, (*pending.pref_ecs_)[pref_index]);
+    }
+  }
+}
+
+static void HashResourceVector(const ResourceVector& rv, size_t* hash) {
+  boost::hash_combine(*hash, rv.cpu_cores());
+  boost::hash_combine(*hash, rv.ram_bw());
+  boost::hash_combine(*hash, rv.ram_cap());
+  boost::hash_combine(*hash, rv.disk_bw());
+  boost::hash_combine(*hash, rv.disk_cap());
+  boost::hash_combine(*hash, rv.net_tx_bw());
+  boost::hash_combine(*hash, rv.net_rx_bw());
+  boost::hash_combine(*hash, rv.ephemeral_storage());
+}
+
+// Hashes the fields of the resource descriptor that the cost models read.
+// The fields that change without changing costs, such as the last heartbeat
+// and the ids of the running tasks (which are covered by the task
+// placement updates), are left out.
+static uint64_t ResourceCostDigest(const ResourceDescriptor& rd) {
+  size_t hash = 0;
+  boost::hash_combine(hash, static_cast<int>(rd.state()));
+  boost::hash_combine(hash, rd.task_capacity());
+  boost::hash_combine(hash, static_cast<int>(rd.type()));
+  boost::hash_combine(hash, rd.schedulable());
+  boost::hash_combine(hash, rd.current_running_tasks_size());
+  boost::hash_combine(hash, rd.num_running_tasks_below());
+  boost::hash_combine(hash, rd.num_slots_below());
+  HashResourceVector(rd.available_resources(), &hash);
+  HashResourceVector(rd.reserved_resources(), &hash);
+  HashResourceVector(rd.min_available_resources_below(), &hash);
+  HashResourceVector(rd.max_available_resources_below(), &hash);
+  HashResourceVector(rd.min_unreserved_resources_below(), &hash);
+  HashResourceVector(rd.max_unreserved_resources_below(), &hash);
+  HashResourceVector(rd.resource_capacity(), &hash);
+  if (rd.has_whare_map_stats()) {
+    boost::hash_combine(hash, rd.whare_map_stats().SerializeAsString());
+  }
+  if (rd.has_coco_interference_scores()) {
+    boost::hash_combine(hash,
+                        rd.coco_interference_scores().SerializeAsString());
+  }
+  for (const auto& label : rd.labels()) {
+    boost::hash_combine(hash, label.key());
+    boost::hash_combine(hash, label.value());
+  }
+  for (const auto& taint : rd.taints()) {
+    boost::hash_combine(hash, taint.key());
+    boost::hash_combine(hash, taint.value());
+    boost::hash_combine(hash, taint.effect());
+  }
+  for (const auto& avoid : rd.avoids()) {
+    boost::hash_combine(hash, avoid.kind());
+    boost::hash_combine(hash, avoid.uid());
+  }
+  boost::hash_combine(hash, rd.max_pods());
+  return hash;
+}
+
 void FlowGraphManager::ComputeTopologyStatistics(
     FlowGraphNode* node,
     boost::function<void(FlowGraphNode*)> prepare,
@@ -282,9 +568,13 @@ void FlowGraphManager::ComputeTopologyStatistics(
   cur_traversal_counter_++;
   to_visit.push(node);
   node->visited_ = cur_traversal_counter_;
+  vector<FlowGraphNode*> visited_res_nodes;
   while (!to_visit.empty()) {
     FlowGraphNode* cur_node = to_visit.front();
     to_visit.pop();
+    if (FLAGS_cache_equiv_class_arc_costs && cur_node->IsResourceNode()) {
+      visited_res_nodes.push_back(cur_node);
+    }
     for (auto& incoming_arc : cur_node->incoming_arc_map_) {
       if (incoming_arc.second->src_node_->visited_ != cur_traversal_counter_) {
         if (prepare) {
@@ -299,6 +589,23 @@ void FlowGraphManager::ComputeTopologyStatistics(
         update(incoming_arc.second->src_node_, cur_node);
     }
   }
+  // The statistics may change for many reasons (e.g., new machine samples or
+  // node label updates), so we detect changes by comparing the resource
+  // descriptors against their state in the previous traversal.
+  for (auto& res_node : visited_res_nodes) {
+    if (!res_node->rd_ptr_) {
+      continue;
+    }
+    uint64_t rd_digest = ResourceCostDigest(*res_node->rd_ptr_);
+    if (rd_digest != res_node->rd_digest_) {
+      res_node->rd_digest_ = rd_digest;
+      MarkResourceNodeUpdated(res_node);
+    }
+  }
+}
+
+void FlowGraphManager::InvalidateArcCosts() {
+  min_valid_cost_version_ = ++cur_cost_version_;
 }
 
 void FlowGraphManager::JobCompleted(JobID_t job_id) {
@@ -351,6 +658,33 @@ void FlowGraphManager::SchedulingDeltasForPreemptedTasks(
     // It is easier and less expensive to clear it and populate it back again
     // than making sure the preempted tasks are removed.
     rd_ptr->clear_current_running_tasks();
+    FlowGraphNode* res_node = NodeForResourceID(res_id_status.first);
+    if (res_node) {
+      MarkResourceStatsDirty(*res_node);
+    }
+  }
+}
+
+void FlowGraphManager::MarkArcCostCurrent(FlowGraphArc* arc) {
+  arc->cost_version_ = cur_cost_version_;
+}
+
+void FlowGraphManager::MarkNodeUpdated(FlowGraphNode* node) {
+  node->cost_version_ = ++cur_cost_version_;
+}
+
+void FlowGraphManager::MarkResourceStatsDirty(const FlowGraphNode& res_node) {
+  if (res_node.type_ == FlowNodeType::PU) {
+    dirty_res_node_ids_.insert(res_node.id_);
+  }
+}
+
+void FlowGraphManager::MarkResourceNodeUpdated(FlowGraphNode* res_node) {
+  MarkNodeUpdated(res_node);
+  for (auto& src_arc : res_node->incoming_arc_map_) {
+    if (src_arc.second->src_node_->IsEquivalenceClassNode()) {
+      src_arc.second->src_node_->cost_version_ = cur_cost_version_;
+    }
   }
 }
 
@@ -385,6 +719,7 @@ void FlowGraphManager::NodeBindingToSchedulingDeltas(
       // We were already scheduled here. Add back the task_id to the resource's
       // running tasks list.
       res_node.rd_ptr_->add_current_running_tasks(task.uid());
+      MarkResourceStatsDirty(res_node);
     }
   } else {
     // Place the task.
@@ -400,12 +735,14 @@ void FlowGraphManager::NodeBindingToSchedulingDeltas(
 void FlowGraphManager::PinTaskToNode(FlowGraphNode* task_node,
                                      FlowGraphNode* res_node) {
   bool added_running_arc = false;
-  // Remove all arcs apart from the task -> resource mapping.
-  for (unordered_map<uint64_t, FlowGraphArc*>::iterator it =
-         task_node->outgoing_arc_map_.begin();
-       it != task_node->outgoing_arc_map_.end(); ) {
-    FlowGraphArc* arc = it->second;
-    ++it;
+  // Remove all arcs apart from the task -> resource mapping. We iterate over
+  // a copy of the arcs because deleting arcs changes the collection.
+  vector<FlowGraphArc*> arcs;
+  arcs.reserve(task_node->outgoing_arc_map_.size());
+  for (auto& dst_arc : task_node->outgoing_arc_map_) {
+    arcs.push_back(dst_arc.second);
+  }
+  for (auto& arc : arcs) {
     if (arc->dst_node_->id_ == res_node->id_) {
       // This preference arc connects the same nodes as the running arc. Hence,
       // we just transform it into the running arc.
@@ -498,12 +835,29 @@ void FlowGraphManager::PurgeUnconnectedEquivClassNodes() {
   }
 }
 
+uint64_t FlowGraphManager::PUNodeIDForRunningTask(TaskID_t task_id) {
+  FlowGraphArc* running_arc = FindPtrOrNull(task_to_running_arc_, task_id);
+  if (!running_arc) {
+    return 0;
+  }
+  return running_arc->dst_node_->id_;
+}
+
+void FlowGraphManager::QueueNextUnschedAggCostUpdate(TaskID_t task_id,
+                                                     uint64_t* update_time,
+                                                     uint64_t cur_time) {
+  uint64_t interval = FLAGS_unsched_agg_cost_update_interval;
+  *update_time += ((cur_time - *update_time) / interval + 1) * interval;
+  unsched_agg_cost_updates_.push(make_pair(*update_time, task_id));
+}
+
 void FlowGraphManager::RemoveEquivClassNode(FlowGraphNode* ec_node) {
   CHECK_NOTNULL(ec_node);
   tec_to_node_map_.erase(ec_node->ec_id_);
   graph_change_manager_->DeleteNode(ec_node, DEL_EQUIV_CLASS_NODE,
                                     "RemoveEquivClassNode");
   cost_model_->RemoveECFromPodSymmetryMap(ec_node->ec_id_);
+  cost_model_->RemoveEquivClass(ec_node->ec_id_);
 }
 
 void FlowGraphManager::RemoveInvalidECPrefArcs(
@@ -558,13 +912,14 @@ void FlowGraphManager::RemoveResourceTopology(const ResourceDescriptor& rd,
   FlowGraphNode* res_node = NodeForResourceID(res_id);
   CHECK_NOTNULL(res_node);
   int64_t cap_delta = 0;
-  // Delete the children nodes. We use an iterator because we change the
-  // collection while we iterate over it.
-  for (unordered_map<uint64_t, FlowGraphArc*>::iterator
-         it = res_node->outgoing_arc_map_.begin();
-       it != res_node->outgoing_arc_map_.end();) {
-    FlowGraphArc* arc = it->second;
-    ++it;
+  // Delete the children nodes. We iterate over a copy of the arcs because
+  // deleting the children changes the collection.
+  vector<FlowGraphArc*> arcs;
+  arcs.reserve(res_node->outgoing_arc_map_.size());
+  for (auto& dst_arc : res_node->outgoing_arc_map_) {
+    arcs.push_back(dst_arc.second);
+  }
+  for (auto& arc : arcs) {
     cap_delta -=  arc->cap_upper_bound_;
     if (!arc->dst_node_->resource_id_.is_nil()) {
       TraverseAndRemoveTopology(arc->dst_node_, pus_removed);
@@ -592,6 +947,7 @@ void FlowGraphManager::RemoveResourceNode(FlowGraphNode* res_node) {
   // No need to check erase result, as the call may not delete anything if the
   // resource is not a leaf.
   leaf_nodes_.erase(res_node->id_);
+  dirty_res_node_ids_.erase(res_node->id_);
   // When we call erase() on a set we end up deleting the object because the set
   // calls the object's destructor. We copy res_id to avoid using freed memory.
   ResourceID_t res_id_tmp = res_node->resource_id_;
@@ -602,19 +958,25 @@ void FlowGraphManager::RemoveResourceNode(FlowGraphNode* res_node) {
                                     "RemoveResourceNode");
 }
 
-void FlowGraphManager::RemoveTaskHelper(TaskID_t task_id) {
+uint64_t FlowGraphManager::RemoveTaskHelper(TaskID_t task_id) {
   FlowGraphNode* task_node = NodeForTaskID(task_id);
   // task_node may be NULL if the task already completed.
-  if (task_node) {
-    if (FLAGS_preemption) {
-      // We reduce the capacity from the unscheduled aggregator to the sink when
-      // we pin the task. Hence, we only have to reduce the capacity when we
-      // support preemption.
-      UpdateUnscheduledAggNode(UnschedAggNodeForJobID(task_node->job_id_), -1);
-    }
-    task_to_running_arc_.erase(task_id);
-    RemoveTaskNode(task_node);
+  if (!task_node) {
+    return 0;
   }
+  if (FLAGS_preemption) {
+    // We reduce the capacity from the unscheduled aggregator to the sink when
+    // we pin the task. Hence, we only have to reduce the capacity when we
+    // support preemption.
+    UpdateUnscheduledAggNode(UnschedAggNodeForJobID(task_node->job_id_), -1);
+  }
+  FlowGraphArc* running_arc = FindPtrOrNull(task_to_running_arc_, task_id);
+  if (running_arc) {
+    MarkResourceNodeUpdated(running_arc->dst_node_);
+    MarkResourceStatsDirty(*running_arc->dst_node_);
+  }
+  task_to_running_arc_.erase(task_id);
+  return RemoveTaskNode(task_node);
 }
 
 uint64_t FlowGraphManager::RemoveTaskNode(FlowGraphNode* task_node) {
@@ -624,6 +986,8 @@ uint64_t FlowGraphManager::RemoveTaskNode(FlowGraphNode* task_node) {
   task_node->excess_ = 0;
   sink_node_->excess_++;
   CHECK_EQ(task_to_node_map_.erase(task_node->td_ptr_->uid()), 1);
+  // The task's pending cost update becomes stale.
+  unsched_agg_cost_update_time_.erase(task_node->td_ptr_->uid());
   graph_change_manager_->DeleteNode(task_node, DEL_TASK_NODE, "RemoveTaskNode");
   return task_node_id;
 }
@@ -645,6 +1009,11 @@ uint64_t FlowGraphManager::TaskCompleted(TaskID_t task_id) {
     // when we support preemption.
     UpdateUnscheduledAggNode(UnschedAggNodeForJobID(task_node->job_id_), -1);
   }
+  FlowGraphArc* running_arc = FindPtrOrNull(task_to_running_arc_, task_id);
+  if (running_arc) {
+    MarkResourceNodeUpdated(running_arc->dst_node_);
+    MarkResourceStatsDirty(*running_arc->dst_node_);
+  }
   task_to_running_arc_.erase(task_id);
   uint64_t task_node_id = RemoveTaskNode(task_node);
   // NOTE: We do not remove the task from the cost_model because
@@ -652,13 +1021,17 @@ uint64_t FlowGraphManager::TaskCompleted(TaskID_t task_id) {
   return task_node_id;
 }
 
-void FlowGraphManager::TaskEvicted(TaskID_t task_id, ResourceID_t res_id) {
+uint64_t FlowGraphManager::TaskEvicted(TaskID_t task_id,
+                                       ResourceID_t res_id) {
   FlowGraphNode* task_node = NodeForTaskID(task_id);
   CHECK_NOTNULL(task_node);
   task_node->type_ = FlowNodeType::UNSCHEDULED_TASK;
+  MarkNodeUpdated(task_node);
   FlowGraphArc* running_arc =
     FindPtrOrNull(task_to_running_arc_, task_node->td_ptr_->uid());
   CHECK_NOTNULL(running_arc);
+  MarkResourceNodeUpdated(running_arc->dst_node_);
+  MarkResourceStatsDirty(*running_arc->dst_node_);
   task_to_running_arc_.erase(task_id);
   graph_change_manager_->DeleteArc(running_arc, DEL_ARC_EVICTED_TASK,
                                    "TaskEvicted: delete running arc");
@@ -673,46 +1046,54 @@ void FlowGraphManager::TaskEvicted(TaskID_t task_id, ResourceID_t res_id) {
     UpdateUnscheduledAggNode(unsched_agg_node, 1);
   }
   // The task's arcs will be updated just before the next solver run.
+  return task_node->id_;
 }
 
-void FlowGraphManager::TaskFailed(TaskID_t task_id) {
-  RemoveTaskHelper(task_id);
+uint64_t FlowGraphManager::TaskFailed(TaskID_t task_id) {
+  return RemoveTaskHelper(task_id);
 }
 
-void FlowGraphManager::TaskKilled(TaskID_t task_id) {
-  RemoveTaskHelper(task_id);
+uint64_t FlowGraphManager::TaskKilled(TaskID_t task_id) {
+  uint64_t task_node_id = RemoveTaskHelper(task_id);
   cost_model_->RemoveTask(task_id);
+  return task_node_id;
 }
 
-void FlowGraphManager::TaskMigrated(TaskID_t task_id,
-                                    ResourceID_t old_res_id,
-                                    ResourceID_t new_res_id) {
-  TaskEvicted(task_id, old_res_id);
+uint64_t FlowGraphManager::TaskMigrated(TaskID_t task_id,
+                                        ResourceID_t old_res_id,
+                                        ResourceID_t new_res_id) {
+  uint64_t task_node_id = TaskEvicted(task_id, old_res_id);
   TaskScheduled(task_id, new_res_id);
+  return task_node_id;
 }
 
-void FlowGraphManager::TaskRemoved(TaskID_t task_id) {
-  RemoveTaskHelper(task_id);
+uint64_t FlowGraphManager::TaskRemoved(TaskID_t task_id) {
+  uint64_t task_node_id = RemoveTaskHelper(task_id);
   cost_model_->RemoveTask(task_id);
+  return task_node_id;
 }
 
 void FlowGraphManager::TaskScheduled(TaskID_t task_id, ResourceID_t res_id) {
   FlowGraphNode* task_node = NodeForTaskID(task_id);
   CHECK_NOTNULL(task_node);
   task_node->type_ = FlowNodeType::SCHEDULED_TASK;
+  MarkNodeUpdated(task_node);
   FlowGraphNode* res_node = NodeForResourceID(res_id);
   UpdateArcsForScheduledTask(task_node, res_node);
+  MarkResourceNodeUpdated(res_node);
+  MarkResourceStatsDirty(*res_node);
 }
 
 void FlowGraphManager::TraverseAndRemoveTopology(FlowGraphNode* res_node,
                                                  set<uint64_t>* pus_removed) {
-  // We use an iterator because we change the collection while we iterate over
-  // it.
-  for (unordered_map<uint64_t, FlowGraphArc*>::iterator
-         it = res_node->outgoing_arc_map_.begin();
-       it != res_node->outgoing_arc_map_.end();) {
-    FlowGraphArc* arc = it->second;
-    ++it;
+  // We iterate over a copy of the arcs because we change the collection while
+  // we iterate over it.
+  vector<FlowGraphArc*> arcs;
+  arcs.reserve(res_node->outgoing_arc_map_.size());
+  for (auto& dst_arc : res_node->outgoing_arc_map_) {
+    arcs.push_back(dst_arc.second);
+  }
+  for (auto& arc : arcs) {
     if (!arc->dst_node_->resource_id_.is_nil()) {
       // The arc is pointing to a resource node.
       TraverseAndRemoveTopology(arc->dst_node_, pus_removed);
@@ -726,7 +1107,37 @@ void FlowGraphManager::TraverseAndRemoveTopology(FlowGraphNode* res_node,
   RemoveResourceNode(res_node);
 }
 
+bool FlowGraphManager::UnschedAggCostUpdateDue(FlowGraphNode* task_node) {
+  if (FLAGS_unsched_agg_cost_update_interval == 0) {
+    return true;
+  }
+  FlowGraphNode* unsched_agg_node = UnschedAggNodeForJobID(task_node->job_id_);
+  if (!unsched_agg_node ||
+      !graph_change_manager_->mutable_flow_graph()->GetArc(task_node,
+                                                           unsched_agg_node)) {
+    return true;
+  }
+  uint64_t* update_time =
+    FindOrNull(unsched_agg_cost_update_time_, task_node->td_ptr_->uid());
+  if (!update_time) {
+    return true;
+  }
+  uint64_t cur_time = time_manager_->GetCurrentTimestamp();
+  if (*update_time > cur_time) {
+    return false;
+  }
+  // The entry for the due update in unsched_agg_cost_updates_ becomes stale,
+  // and so UpdateDueCostsToUnscheduledAggs does not update the arc again.
+  QueueNextUnschedAggCostUpdate(task_node->td_ptr_->uid(), update_time,
+                                cur_time);
+  return true;
+}
+
 void FlowGraphManager::UpdateAllCostsToUnscheduledAggs() {
+  if (FLAGS_unsched_agg_cost_update_interval > 0) {
+    UpdateDueCostsToUnscheduledAggs();
+    return;
+  }
   for (auto& job_node : job_unsched_to_node_) {
     const FlowGraphNode* unsched_node = job_node.second;
     CHECK_NOTNULL(unsched_node);
@@ -812,6 +1223,83 @@ void FlowGraphManager::UpdateChildrenTasks(
   }
 }
 
+void FlowGraphManager::UpdateDirtyResourceTopology() {
+  for (auto& res_node_id : dirty_res_node_ids_) {
+    FlowGraphNode* cur_node =
+      graph_change_manager_->mutable_flow_graph()->FindNode(res_node_id);
+    CHECK_NOTNULL(cur_node);
+    ResourceDescriptor* rd_ptr = cur_node->rd_ptr_;
+    CHECK_NOTNULL(rd_ptr);
+    // Recompute the PU's counts like UpdateResourceTopologyDFS does, and
+    // propagate the changes to the PU's ancestors.
+    int64_t slots_delta = static_cast<int64_t>(FLAGS_max_tasks_per_pu) -
+      static_cast<int64_t>(rd_ptr->num_slots_below());
+    int64_t running_tasks_delta =
+      static_cast<int64_t>(rd_ptr->current_running_tasks_size()) -
+      static_cast<int64_t>(rd_ptr->num_running_tasks_below());
+    if (slots_delta == 0 && running_tasks_delta == 0) {
+      continue;
+    }
+    while (true) {
+      rd_ptr->set_num_slots_below(
+          static_cast<uint64_t>(
+              static_cast<int64_t>(rd_ptr->num_slots_below()) + slots_delta));
+      rd_ptr->set_num_running_tasks_below(
+          static_cast<uint64_t>(
+              static_cast<int64_t>(rd_ptr->num_running_tasks_below()) +
+              running_tasks_delta));
+      FlowGraphNode* parent_node =
+        FindPtrOrNull(node_to_parent_node_map_, cur_node);
+      if (!parent_node) {
+        // The node is the root of the topology.
+        break;
+      }
+      FlowGraphArc* parent_arc =
+        graph_change_manager_->mutable_flow_graph()->GetArc(parent_node,
+                                                            cur_node);
+      CHECK_NOTNULL(parent_arc);
+      graph_change_manager_->ChangeArcCapacity(
+          parent_arc, CapacityFromResNodeToParent(*rd_ptr),
+          CHG_ARC_BETWEEN_RES, "UpdateDirtyResourceTopology");
+      cur_node = parent_node;
+      rd_ptr = cur_node->rd_ptr_;
+      CHECK_NOTNULL(rd_ptr);
+    }
+  }
+  dirty_res_node_ids_.clear();
+}
+
+void FlowGraphManager::UpdateDueCostsToUnscheduledAggs() {
+  uint64_t cur_time = time_manager_->GetCurrentTimestamp();
+  while (!unsched_agg_cost_updates_.empty() &&
+         unsched_agg_cost_updates_.top().first <= cur_time) {
+    pair<uint64_t, TaskID_t> update = unsched_agg_cost_updates_.top();
+    unsched_agg_cost_updates_.pop();
+    uint64_t* update_time =
+      FindOrNull(unsched_agg_cost_update_time_, update.second);
+    if (!update_time || *update_time != update.first) {
+      // The task's node has been removed since the update was queued.
+      continue;
+    }
+    FlowGraphNode* task_node = NodeForTaskID(update.second);
+    CHECK_NOTNULL(task_node);
+    // Only tasks that have an arc to their unscheduled aggregator are
+    // updated, like UpdateAllCostsToUnscheduledAggs does.
+    FlowGraphNode* unsched_agg_node =
+      UnschedAggNodeForJobID(task_node->job_id_);
+    if (unsched_agg_node &&
+        graph_change_manager_->mutable_flow_graph()->GetArc(
+            task_node, unsched_agg_node)) {
+      if (task_node->IsTaskAssignedOrRunning()) {
+        UpdateRunningTaskNode(task_node, false, NULL, NULL);
+      } else {
+        UpdateTaskToUnscheduledAggArc(task_node);
+      }
+    }
+    QueueNextUnschedAggCostUpdate(update.second, update_time, cur_time);
+  }
+}
+
 void FlowGraphManager::UpdateEquivClassNode(
     FlowGraphNode* ec_node,
     queue<TDOrNodeWrapper*>* node_queue,
@@ -833,36 +1321,7 @@ void FlowGraphManager::UpdateEquivToEquivArcs(
   vector<EquivClass_t>* pref_ec =
     cost_model_->GetEquivClassToEquivClassesArcs(ec_node->ec_id_);
   if (pref_ec) {
-    for (auto& pref_ec_id : *pref_ec) {
-      FlowGraphNode* pref_ec_node = NodeForEquivClass(pref_ec_id);
-      if (!pref_ec_node) {
-        pref_ec_node = AddEquivClassNode(pref_ec_id);
-      }
-      ArcDescriptor arc_descriptor =
-        cost_model_->EquivClassToEquivClass(ec_node->ec_id_, pref_ec_id);
-      FlowGraphArc* pref_ec_arc =
-        graph_change_manager_->mutable_flow_graph()->GetArc(ec_node,
-                                                            pref_ec_node);
-      if (!pref_ec_arc) {
-        graph_change_manager_->AddArc(
-            ec_node, pref_ec_node, arc_descriptor.min_flow_,
-            arc_descriptor.capacity_, arc_descriptor.cost_, OTHER,
-            ADD_ARC_BETWEEN_EQUIV_CLASS, "UpdateEquivClassNode");
-      } else {
-        graph_change_manager_->ChangeArc(
-            pref_ec_arc, arc_descriptor.min_flow_, arc_descriptor.capacity_,
-            arc_descriptor.cost_, CHG_ARC_BETWEEN_EQUIV_CLASS,
-            "UpdateEquivClassNode");
-      }
-      if (marked_nodes->find(pref_ec_node->id_) == marked_nodes->end()) {
-        // Add the EC node to the queue if it hasn't been marked yet.
-        marked_nodes->insert(pref_ec_node->id_);
-        node_queue->push(
-            new TDOrNodeWrapper(pref_ec_node, pref_ec_node->td_ptr_));
-      }
-    }
-    RemoveInvalidECPrefArcs(*ec_node, *pref_ec, DEL_ARC_BETWEEN_EQUIV_CLASS);
-    delete pref_ec;
+    AddPrefArcs(ec_node, pref_ec, NULL, node_queue, marked_nodes);
   } else {
     vector<EquivClass_t> no_pref_ec;
     RemoveInvalidECPrefArcs(*ec_node, no_pref_ec, DEL_ARC_BETWEEN_EQUIV_CLASS);
@@ -879,37 +1338,7 @@ void FlowGraphManager::UpdateEquivToResArcs(
   vector<ResourceID_t>* pref_res =
     cost_model_->GetOutgoingEquivClassPrefArcs(ec_node->ec_id_);
   if (pref_res) {
-    for (auto& pref_res_id : *pref_res) {
-      FlowGraphNode* pref_res_node = NodeForResourceID(pref_res_id);
-      // The resource node should already exist because the cost models cannot
-      // prefer a resource before it is added to the graph.
-      CHECK_NOTNULL(pref_res_node);
-      ArcDescriptor arc_descriptor =
-        cost_model_->EquivClassToResourceNode(ec_node->ec_id_, pref_res_id);
-      FlowGraphArc* pref_res_arc =
-        graph_change_manager_->mutable_flow_graph()->GetArc(ec_node,
-                                                            pref_res_node);
-      if (!pref_res_arc) {
-        graph_change_manager_->AddArc(
-            ec_node, pref_res_node, arc_descriptor.min_flow_,
-            arc_descriptor.capacity_, arc_descriptor.cost_,
-            OTHER, ADD_ARC_EQUIV_CLASS_TO_RES, "UpdateEquivToResArcs");
-
-      } else {
-        graph_change_manager_->ChangeArc(
-            pref_res_arc, arc_descriptor.min_flow_, arc_descriptor.capacity_,
-            arc_descriptor.cost_, CHG_ARC_EQUIV_CLASS_TO_RES,
-            "UpdateEquivToResArcs");
-      }
-      if (marked_nodes->find(pref_res_node->id_) == marked_nodes->end()) {
-        // Add the res node to the queue if it hasn't been marked yet.
-        marked_nodes->insert(pref_res_node->id_);
-        node_queue->push(
-            new TDOrNodeWrapper(pref_res_node, pref_res_node->td_ptr_));
-      }
-    }
-    RemoveInvalidPrefResArcs(*ec_node, *pref_res, DEL_ARC_EQUIV_CLASS_TO_RES);
-    delete pref_res;
+    AddPrefArcs(ec_node, NULL, pref_res, node_queue, marked_nodes);
   } else {
     vector<ResourceID_t> no_pref_res;
     RemoveInvalidPrefResArcs(*ec_node, no_pref_res, DEL_ARC_EQUIV_CLASS_TO_RES);
@@ -921,27 +1350,106 @@ void FlowGraphManager::UpdateFlowGraph(
     unordered_set<uint64_t>* marked_nodes) {
   CHECK_NOTNULL(node_queue);
   CHECK_NOTNULL(marked_nodes);
+  batch_pref_arcs_ = cost_model_->IsThreadSafe();
   while (!node_queue->empty()) {
-    TDOrNodeWrapper* cur_node = node_queue->front();
-    node_queue->pop();
-    if (!cur_node->node_) {
-      // We're handling a task that doesn't have an associated flow graph node.
-      UpdateChildrenTasks(cur_node->td_ptr_, node_queue, marked_nodes);
+    // The nodes added to the queue while the current frontier is updated
+    // form the next frontier.
+    for (size_t num_nodes = node_queue->size(); num_nodes > 0; --num_nodes) {
+      TDOrNodeWrapper* cur_node = node_queue->front();
+      node_queue->pop();
+      if (!cur_node->node_) {
+        // We're handling a task that doesn't have an associated flow graph
+        // node.
+        UpdateChildrenTasks(cur_node->td_ptr_, node_queue, marked_nodes);
+        delete cur_node;
+        continue;
+      }
+      if (cur_node->node_->IsTaskNode()) {
+        UpdateTaskNode(cur_node->node_, node_queue, marked_nodes);
+        UpdateChildrenTasks(cur_node->td_ptr_, node_queue, marked_nodes);
+      } else if (cur_node->node_->IsEquivalenceClassNode()) {
+        UpdateEquivClassNode(cur_node->node_, node_queue, marked_nodes);
+      } else if (cur_node->node_->IsResourceNode()) {
+        UpdateResourceNode(cur_node->node_, node_queue, marked_nodes);
+      } else {
+        LOG(FATAL) << "Unexpected node type: " << cur_node->node_->type_;
+      }
       delete cur_node;
-      continue;
     }
-    if (cur_node->node_->IsTaskNode()) {
-      UpdateTaskNode(cur_node->node_, node_queue, marked_nodes);
-      UpdateChildrenTasks(cur_node->td_ptr_, node_queue, marked_nodes);
-    } else if (cur_node->node_->IsEquivalenceClassNode()) {
-      UpdateEquivClassNode(cur_node->node_, node_queue, marked_nodes);
-    } else if (cur_node->node_->IsResourceNode()) {
-      UpdateResourceNode(cur_node->node_, node_queue, marked_nodes);
+    UpdatePrefArcs(node_queue, marked_nodes);
+  }
+  batch_pref_arcs_ = false;
+}
+
+void FlowGraphManager::UpdatePrefArcs(queue<TDOrNodeWrapper*>* node_queue,
+                                      unordered_set<uint64_t>* marked_nodes) {
+  CHECK_NOTNULL(node_queue);
+  CHECK_NOTNULL(marked_nodes);
+  ComputePrefArcDescriptors();
+  for (auto& pending : pending_pref_arcs_) {
+    FlowGraphNode* src_node = pending.src_node_;
+    DIMACSChangeType add_change_type;
+    DIMACSChangeType chg_change_type;
+    DIMACSChangeType del_change_type;
+    const char* comment;
+    if (pending.pref_res_) {
+      add_change_type = ADD_ARC_EQUIV_CLASS_TO_RES;
+      chg_change_type = CHG_ARC_EQUIV_CLASS_TO_RES;
+      del_change_type = DEL_ARC_EQUIV_CLASS_TO_RES;
+      comment = "UpdateEquivToResArcs";
+    } else if (src_node->IsTaskNode()) {
+      add_change_type = ADD_ARC_TASK_TO_EQUIV_CLASS;
+      chg_change_type = CHG_ARC_TASK_TO_EQUIV_CLASS;
+      del_change_type = DEL_ARC_TASK_TO_EQUIV_CLASS;
+      comment = "UpdateTaskToEquivArcs";
     } else {
-      LOG(FATAL) << "Unexpected node type: " << cur_node->node_->type_;
+      add_change_type = ADD_ARC_BETWEEN_EQUIV_CLASS;
+      chg_change_type = CHG_ARC_BETWEEN_EQUIV_CLASS;
+      del_change_type = DEL_ARC_BETWEEN_EQUIV_CLASS;
+      comment = "UpdateEquivClassNode";
+    }
+    uint64_t end_index = pending.first_arc_index_ +
+      (pending.pref_res_ ? pending.pref_res_->size() :
+       pending.pref_ecs_->size());
+    for (uint64_t index = pending.first_arc_index_; index < end_index;
+         ++index) {
+      FlowGraphNode* pref_node = pref_arc_dst_nodes_[index];
+      if (pref_arc_outdated_[index]) {
+        const ArcDescriptor& arc_descriptor = pref_arc_descriptors_[index];
+        FlowGraphArc* pref_arc =
+          graph_change_manager_->mutable_flow_graph()->GetArc(src_node,
+                                                              pref_node);
+        if (!pref_arc) {
+          pref_arc = graph_change_manager_->AddArc(
+              src_node, pref_node, arc_descriptor.min_flow_,
+              arc_descriptor.capacity_, arc_descriptor.cost_, OTHER,
+              add_change_type, comment);
+        } else {
+          graph_change_manager_->ChangeArc(
+              pref_arc, arc_descriptor.min_flow_, arc_descriptor.capacity_,
+              arc_descriptor.cost_, chg_change_type, comment);
+        }
+        MarkArcCostCurrent(pref_arc);
+      }
+      if (marked_nodes->find(pref_node->id_) == marked_nodes->end()) {
+        // Add the EC or resource node to the queue if it hasn't been marked
+        // yet.
+        marked_nodes->insert(pref_node->id_);
+        node_queue->push(new TDOrNodeWrapper(pref_node, pref_node->td_ptr_));
+      }
+    }
+    if (pending.pref_res_) {
+      RemoveInvalidPrefResArcs(*src_node, *pending.pref_res_, del_change_type);
+      delete pending.pref_res_;
+    } else {
+      RemoveInvalidECPrefArcs(*src_node, *pending.pref_ecs_, del_change_type);
+      delete pending.pref_ecs_;
     }
-    delete cur_node;
   }
+  pending_pref_arcs_.clear();
+  pref_arc_pending_index_.clear();
+  pref_arc_dst_nodes_.clear();
+  pref_arc_outdated_.clear();
 }
 
 void FlowGraphManager::UpdateResourceNode(
@@ -1064,11 +1572,14 @@ void FlowGraphManager::UpdateResOutgoingArcs(
   CHECK_NOTNULL(res_node);
   CHECK_NOTNULL(node_queue);
   CHECK_NOTNULL(marked_nodes);
-  for (unordered_map<uint64_t, FlowGraphArc*>::iterator it =
-         res_node->outgoing_arc_map_.begin();
-       it != res_node->outgoing_arc_map_.end(); ) {
-    FlowGraphArc* arc = it->second;
-    ++it;
+  // UpdateResToSinkArc may add an arc to the collection, so we iterate over
+  // a copy of the arcs.
+  vector<FlowGraphArc*> arcs;
+  arcs.reserve(res_node->outgoing_arc_map_.size());
+  for (auto& dst_arc : res_node->outgoing_arc_map_) {
+    arcs.push_back(dst_arc.second);
+  }
+  for (auto& arc : arcs) {
     if (!arc->dst_node_->resource_id_.is_nil()) {
       ArcDescriptor arc_descriptor =
         cost_model_->ResourceNodeToResourceNode(*res_node->rd_ptr_,
@@ -1164,7 +1675,9 @@ void FlowGraphManager::UpdateTaskNode(FlowGraphNode* task_node,
     UpdateRunningTaskNode(task_node, FLAGS_update_preferences_running_task,
                           node_queue, marked_nodes);
   } else {
-    UpdateTaskToUnscheduledAggArc(task_node);
+    if (UnschedAggCostUpdateDue(task_node)) {
+      UpdateTaskToUnscheduledAggArc(task_node);
+    }
     UpdateTaskToEquivArcs(task_node, node_queue, marked_nodes);
     UpdateTaskToResArcs(task_node, node_queue, marked_nodes);
   }
@@ -1180,38 +1693,7 @@ void FlowGraphManager::UpdateTaskToEquivArcs(
   vector<EquivClass_t>* pref_ec =
     cost_model_->GetTaskEquivClasses(task_node->td_ptr_->uid());
   if (pref_ec) {
-    for (auto& pref_ec_id : *pref_ec) {
-      FlowGraphNode* pref_ec_node = NodeForEquivClass(pref_ec_id);
-      if (!pref_ec_node) {
-        pref_ec_node = AddEquivClassNode(pref_ec_id);
-      }
-      ArcDescriptor arc_descriptor =
-        cost_model_->TaskToEquivClassAggregator(task_node->td_ptr_->uid(),
-                                                pref_ec_id);
-      FlowGraphArc* pref_ec_arc =
-        graph_change_manager_->mutable_flow_graph()->GetArc(task_node,
-                                                            pref_ec_node);
-      if (!pref_ec_arc) {
-        graph_change_manager_->AddArc(
-            task_node, pref_ec_node, arc_descriptor.min_flow_,
-            arc_descriptor.capacity_, arc_descriptor.cost_, OTHER,
-            ADD_ARC_TASK_TO_EQUIV_CLASS, "UpdateTaskToEquivArcs");
-
-      } else {
-        graph_change_manager_->ChangeArc(
-            pref_ec_arc, arc_descriptor.min_flow_, arc_descriptor.capacity_,
-            arc_descriptor.cost_, CHG_ARC_TASK_TO_EQUIV_CLASS,
-            "UpdateTaskToEquivArcs");
-      }
-      if (marked_nodes->find(pref_ec_node->id_) == marked_nodes->end()) {
-        // Add the EC node to the queue if it hasn't been marked yet.
-        marked_nodes->insert(pref_ec_node->id_);
-        node_queue->push(
-            new TDOrNodeWrapper(pref_ec_node, pref_ec_node->td_ptr_));
-      }
-    }
-    RemoveInvalidECPrefArcs(*task_node, *pref_ec, DEL_ARC_TASK_TO_EQUIV_CLASS);
-    delete pref_ec;
+    AddPrefArcs(task_node, pref_ec, NULL, node_queue, marked_nodes);
   } else {
     vector<EquivClass_t> no_pref_ec;
     RemoveInvalidECPrefArcs(*task_node, no_pref_ec,
@@ -1295,6 +1777,7 @@ FlowGraphNode* FlowGraphManager::UpdateTaskToUnscheduledAggArc(
 
 void FlowGraphManager::UpdateTimeDependentCosts(
     const vector<JobDescriptor*>& jd_ptr_vec) {
+  InvalidateArcCosts();
   AddOrUpdateJobNodes(jd_ptr_vec);
 }
 
@@ -21,9 +21,11 @@
 #ifndef FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_MANAGER_H
 #define FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_MANAGER_H
 
+#include <functional>
 #include <queue>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "base/common.h"
@@ -39,6 +41,7 @@
 #include "scheduling/flow/flow_graph_arc.h"
 #include "scheduling/flow/flow_graph_change_manager.h"
 #include "scheduling/flow/flow_graph_node.h"
+#include "scheduling/flow/worker_pool.h"
 
 DECLARE_bool(preemption);
 DECLARE_string(flow_scheduling_solver);
@@ -55,6 +58,17 @@ struct TDOrNodeWrapper {
   TaskDescriptor* td_ptr_;
 };
 
+// The preferences of a node whose arcs are being updated. Exactly one of
+// pref_ecs_ and pref_res_ is set, depending on whether the node prefers
+// equivalence classes or resources.
+struct PendingPrefArcs {
+  FlowGraphNode* src_node_;
+  vector<EquivClass_t>* pref_ecs_;
+  vector<ResourceID_t>* pref_res_;
+  // Index of the node's first arc in the preference arc vectors.
+  uint64_t first_arc_index_;
+};
+
 class FlowGraphManager {
  public:
   explicit FlowGraphManager(CostModelInterface* cost_model,
@@ -65,6 +79,16 @@ class FlowGraphManager {
                             DIMACSChangeStats* dimacs_stats);
   virtual ~FlowGraphManager();
   void AddOrUpdateJobNodes(const vector<JobDescriptor*>& jd_ptr_vect);
+  /**
+   * Adds or updates the nodes of the jobs like AddOrUpdateJobNodes, but is
+   * meant for batches of large jobs. The space for the jobs' task nodes is
+   * reserved up front, all missing task nodes are added before the tasks'
+   * arcs are updated, and the capacity of each job's unscheduled aggregator
+   * arc to the sink is changed once rather than once per task. The arcs of
+   * the nodes added by the batch are recorded as part of the nodes' changes
+   * rather than as one change per arc.
+   */
+  void AddOrUpdateJobNodesInBulk(const vector<JobDescriptor*>& jd_ptr_vect);
 
   /**
    * Adds the entire resource topology tree rooted at rtnd_ptr. The method
@@ -79,6 +103,12 @@ class FlowGraphManager {
       boost::function<void(FlowGraphNode*)> prepare,
       boost::function<FlowGraphNode*(FlowGraphNode*, FlowGraphNode*)> gather,
       boost::function<FlowGraphNode*(FlowGraphNode*, FlowGraphNode*)> update);
+  /**
+   * Returns true if the flow graph already has a node for the task.
+   */
+  inline bool HasNodeForTaskID(TaskID_t task_id) {
+    return NodeForTaskID(task_id) != NULL;
+  }
   void JobCompleted(JobID_t job_id);
   void JobRemoved(JobID_t job_id);
   void NodeBindingToSchedulingDeltas(
@@ -97,6 +127,11 @@ class FlowGraphManager {
    * task or resource nodes.
    */
   void PurgeUnconnectedEquivClassNodes();
+  /**
+   * Returns the id of the PU node the task is running on, or 0 if the task
+   * is not running.
+   */
+  uint64_t PUNodeIDForRunningTask(TaskID_t task_id);
 
   /**
    * Removes the entire resource topology tree rooted at rd. The method also
@@ -112,22 +147,36 @@ class FlowGraphManager {
       shared_ptr<ResourceMap_t> resource_map,
       vector<SchedulingDelta*>* deltas);
   uint64_t TaskCompleted(TaskID_t task_id);
-  void TaskEvicted(TaskID_t task_id, ResourceID_t res_id);
-  void TaskFailed(TaskID_t task_id);
-  void TaskKilled(TaskID_t task_id);
-  void TaskMigrated(TaskID_t task_id,
-                    ResourceID_t old_res_id,
-                    ResourceID_t new_res_id);
-  void TaskRemoved(TaskID_t task_id);
+  uint64_t TaskEvicted(TaskID_t task_id, ResourceID_t res_id);
+  uint64_t TaskFailed(TaskID_t task_id);
+  uint64_t TaskKilled(TaskID_t task_id);
+  uint64_t TaskMigrated(TaskID_t task_id,
+                        ResourceID_t old_res_id,
+                        ResourceID_t new_res_id);
+  uint64_t TaskRemoved(TaskID_t task_id);
   void TaskScheduled(TaskID_t task_id, ResourceID_t res_id);
 
   /**
    * Update each task's arc to its unscheduled aggregator. Moreover, for
-   * running tasks we update their continuation costs.
+   * running tasks we update their continuation costs. If
+   * --unsched_agg_cost_update_interval is set, only the tasks whose wait time
+   * crossed into a new interval since their last update are updated.
    */
   void UpdateAllCostsToUnscheduledAggs();
 
+  /**
+   * Refreshes the slot and running task counts of the resource topology, and
+   * the capacities of the arcs between resources, by traversing the whole
+   * topology rooted at rtnd_ptr.
+   */
   void UpdateResourceTopology(ResourceTopologyNodeDescriptor* rtnd_ptr);
+  /**
+   * Refreshes the resource topology like UpdateResourceTopology, but only
+   * along the paths from the PUs whose running tasks may have changed since
+   * the last refresh (e.g., because tasks were placed on them or completed)
+   * to the roots of the topology.
+   */
+  void UpdateDirtyResourceTopology();
   void UpdateTimeDependentCosts(const vector<JobDescriptor*>& jd_ptr_vec);
 
   // Simple accessor methods
@@ -151,10 +200,16 @@ class FlowGraphManager {
   FRIEND_TEST(DIMACSExporterTest, ScalabilityTestGraphs);
   FRIEND_TEST(DIMACSExporterTest, SimpleGraphOutput);
   FRIEND_TEST(FlowGraphManagerTest, AddEquivClassNode);
+  FRIEND_TEST(FlowGraphManagerTest, AddOrUpdateJobNodesInBulk);
+  FRIEND_TEST(FlowGraphManagerTest, AddOrUpdateJobNodesInBulkChanges);
   FRIEND_TEST(FlowGraphManagerTest, AddResourceNode);
   FRIEND_TEST(FlowGraphManagerTest, AddResourceTopologyDFS);
   FRIEND_TEST(FlowGraphManagerTest, AddTaskNode);
   FRIEND_TEST(FlowGraphManagerTest, AddUnscheduledAggNode);
+  FRIEND_TEST(FlowGraphManagerTest, ArcCostCacheUnsupported);
+  FRIEND_TEST(FlowGraphManagerTest, BatchedArcCostComputation);
+  FRIEND_TEST(FlowGraphManagerTest, CacheEquivClassArcCosts);
+  FRIEND_TEST(FlowGraphManagerTest, ParallelArcCostComputation);
   FRIEND_TEST(FlowGraphManagerTest, PinTaskToNode);
   FRIEND_TEST(FlowGraphManagerTest, PurgeUnconnectedEquivClassNodes);
   FRIEND_TEST(FlowGraphManagerTest, RemoveEquivClassNode);
@@ -162,11 +217,15 @@ class FlowGraphManager {
   FRIEND_TEST(FlowGraphManagerTest, RemoveInvalidPrefResArcs);
   FRIEND_TEST(FlowGraphManagerTest, RemoveResourceNode);
   FRIEND_TEST(FlowGraphManagerTest, RemoveTaskHelper);
+  FRIEND_TEST(FlowGraphManagerTest, ResourceCostDigest);
   FRIEND_TEST(FlowGraphManagerTest, TaskScheduled);
   FRIEND_TEST(FlowGraphManagerTest, TraverseAndRemoveTopology);
   FRIEND_TEST(FlowGraphManagerTest, UpdateAllCostsToUnscheduledAggs);
+  FRIEND_TEST(FlowGraphManagerTest, UpdateBucketedCostsToUnscheduledAggs);
+  FRIEND_TEST(FlowGraphManagerTest, UpdateBucketedCostsInAddOrUpdateJobNodes);
   FRIEND_TEST(FlowGraphManagerTest, UpdateArcsForScheduledTask);
   FRIEND_TEST(FlowGraphManagerTest, UpdateChildrenTasks);
+  FRIEND_TEST(FlowGraphManagerTest, UpdateDirtyResourceTopology);
   FRIEND_TEST(FlowGraphManagerTest, UpdateEquivClassNode);
   FRIEND_TEST(FlowGraphManagerTest, UpdateEquivToEquivArcs);
   FRIEND_TEST(FlowGraphManagerTest, UpdateEquivToResArcs);
@@ -185,6 +244,23 @@ class FlowGraphManager {
   FRIEND_TEST(FlowGraphManagerTest, UpdateUnscheduledAggNode);
 
   FlowGraphNode* AddEquivClassNode(EquivClass_t ec);
+  /**
+   * Appends the arc from src_node to dst_node to the preference arcs that are
+   * being updated. The arc's cost must be computed if the arc does not exist
+   * yet or if its cost is not current.
+   */
+  void AddPrefArc(FlowGraphNode* src_node, FlowGraphNode* dst_node);
+  /**
+   * Appends the arcs from src_node to its preferred equivalence classes or
+   * resources to the preference arcs that are being updated. The arcs are
+   * updated right away unless the updates are being batched, in which case
+   * UpdatePrefArcs updates them together with the other nodes' arcs.
+   * Takes ownership of the preferences vector.
+   */
+  void AddPrefArcs(FlowGraphNode* src_node, vector<EquivClass_t>* pref_ecs,
+                   vector<ResourceID_t>* pref_res,
+                   queue<TDOrNodeWrapper*>* node_queue,
+                   unordered_set<uint64_t>* marked_nodes);
   FlowGraphNode* AddResourceNode(ResourceDescriptor* rd_ptr);
 
   /**
@@ -197,6 +273,48 @@ class FlowGraphManager {
 
   FlowGraphNode* AddTaskNode(JobID_t job_id, TaskDescriptor* td_ptr);
   FlowGraphNode* AddUnscheduledAggNode(JobID_t job_id);
+  /**
+   * Returns true if the arc's cost and capacity were computed after the last
+   * update of its source and destination nodes, and hence the cost model
+   * need not be asked for them again. Always false unless
+   * --cache_equiv_class_arc_costs is set and the cost model supports it.
+   */
+  bool ArcCostIsCurrent(const FlowGraphArc& arc);
+  /**
+   * Computes the descriptors of the preference arcs whose costs must be
+   * computed. The computation is spread across the worker pool if the cost
+   * model is thread-safe and there are enough arcs to make it worthwhile.
+   */
+  void ComputePrefArcDescriptors();
+  void ComputePrefArcDescriptorShard(uint64_t begin_index,
+                                     uint64_t end_index);
+  /**
+   * Marks the costs of all arcs as outdated, e.g. because they depend on
+   * time.
+   */
+  void InvalidateArcCosts();
+  /**
+   * Records that the arc's cost and capacity have just been computed.
+   */
+  void MarkArcCostCurrent(FlowGraphArc* arc);
+  /**
+   * Records that the node changed in a way that may change the costs of its
+   * arcs.
+   */
+  void MarkNodeUpdated(FlowGraphNode* node);
+  /**
+   * Records that the resource changed. The equivalence classes with arcs to
+   * the resource are marked as updated as well, since the costs of their
+   * other arcs may depend on the resource (e.g., an equivalence class
+   * representing a machine).
+   */
+  void MarkResourceNodeUpdated(FlowGraphNode* res_node);
+  /**
+   * Records that the running tasks of the PU may have changed, and hence
+   * that the counts along its path to the root must be refreshed by the next
+   * UpdateDirtyResourceTopology.
+   */
+  void MarkResourceStatsDirty(const FlowGraphNode& res_node);
   void PinTaskToNode(FlowGraphNode* task_node, FlowGraphNode* res_node);
   void RemoveEquivClassNode(FlowGraphNode* ec_node);
 
@@ -222,7 +340,11 @@ class FlowGraphManager {
                                 const vector<ResourceID_t>& pref_resources,
                                 DIMACSChangeType change_type);
   void RemoveResourceNode(FlowGraphNode* res_node);
-  void RemoveTaskHelper(TaskID_t task_id);
+  /**
+   * Removes the task's node if the task still has one.
+   * @return the id of the removed node, or 0 if the task had no node
+   */
+  uint64_t RemoveTaskHelper(TaskID_t task_id);
   uint64_t RemoveTaskNode(FlowGraphNode* task_node);
   void RemoveUnscheduledAggNode(JobID_t job_id);
 
@@ -258,6 +380,26 @@ class FlowGraphManager {
                            queue<TDOrNodeWrapper*>* node_queue,
                            unordered_set<uint64_t>* marked_nodes);
 
+  /**
+   * Queues the next update of the cost of the task's arc to its unscheduled
+   * aggregator, at the end of the bucket that contains the current time.
+   * @param update_time the task's entry in unsched_agg_cost_update_time_
+   */
+  void QueueNextUnschedAggCostUpdate(TaskID_t task_id, uint64_t* update_time,
+                                     uint64_t cur_time);
+  /**
+   * Returns true if the cost of the task's arc to its unscheduled aggregator
+   * must be updated now, in which case the arc's next update is queued.
+   * Always true if --unsched_agg_cost_update_interval is not set or the task
+   * does not have the arc yet.
+   */
+  bool UnschedAggCostUpdateDue(FlowGraphNode* task_node);
+  /**
+   * Updates the costs of the arcs to the unscheduled aggregators of the
+   * tasks whose updates are due, and queues their next updates.
+   */
+  void UpdateDueCostsToUnscheduledAggs();
+
   void UpdateEquivClassNode(FlowGraphNode* ec_node,
                             queue<TDOrNodeWrapper*>* node_queue,
                             unordered_set<uint64_t>* marked_nodes);
@@ -279,9 +421,23 @@ class FlowGraphManager {
                             queue<TDOrNodeWrapper*>* node_queue,
                             unordered_set<uint64_t>* marked_nodes);
 
+  /**
+   * Updates the nodes in the queue and the nodes reachable from them, one
+   * breadth-first frontier at a time. If the cost model is thread-safe, the
+   * costs of the preference arcs of all the nodes in a frontier are computed
+   * together, so that even nodes with few arcs share the worker pool.
+   */
   void UpdateFlowGraph(queue<TDOrNodeWrapper*>* node_queue,
                        unordered_set<uint64_t>* marked_nodes);
 
+  /**
+   * Computes the costs of the pending preference arcs, adds or changes the
+   * arcs, and removes the pending nodes' arcs to the ECs and resources they
+   * no longer prefer.
+   */
+  void UpdatePrefArcs(queue<TDOrNodeWrapper*>* node_queue,
+                      unordered_set<uint64_t>* marked_nodes);
+
   void UpdateResourceNode(FlowGraphNode* res_node,
                           queue<TDOrNodeWrapper*>* node_queue,
                           unordered_set<uint64_t>* marked_nodes);
@@ -413,6 +569,36 @@ class FlowGraphManager {
   // used as a marker in the resource topology traversal. It helps us to avoid
   // having to reset the visited state before each traversal.
   uint32_t cur_traversal_counter_;
+  TimeInterface* time_manager_;
+  // Min-heap of (time, task id) pairs recording when the costs of the tasks'
+  // arcs to their unscheduled aggregators must next be updated. Only used if
+  // --unsched_agg_cost_update_interval is set. A pair is stale if the time
+  // differs from the task's entry in unsched_agg_cost_update_time_.
+  priority_queue<pair<uint64_t, TaskID_t>, vector<pair<uint64_t, TaskID_t>>,
+                 greater<pair<uint64_t, TaskID_t>>> unsched_agg_cost_updates_;
+  unordered_map<TaskID_t, uint64_t> unsched_agg_cost_update_time_;
+  // Counter from which the cost versions of nodes and arcs are assigned.
+  uint64_t cur_cost_version_;
+  // Arcs whose cost version is older than this are outdated.
+  uint64_t min_valid_cost_version_;
+  // The nodes whose preference arcs are being updated, and their arcs: the
+  // index of the arc's node in pending_pref_arcs_, the destination nodes,
+  // whether their costs must be computed, and the computed descriptors. Kept
+  // across calls to avoid reallocating them.
+  vector<PendingPrefArcs> pending_pref_arcs_;
+  vector<uint64_t> pref_arc_pending_index_;
+  vector<FlowGraphNode*> pref_arc_dst_nodes_;
+  vector<bool> pref_arc_outdated_;
+  vector<ArcDescriptor> pref_arc_descriptors_;
+  // True while UpdateFlowGraph batches the preference arcs of all the nodes
+  // of a breadth-first frontier, so that their costs are computed together.
+  bool batch_pref_arcs_;
+  // Threads computing the costs of the preference arcs.
+  WorkerPool cost_pool_;
+  vector<boost::function<void()>> cost_tasks_;
+  // Ids of the PU nodes whose running tasks may have changed since the last
+  // UpdateDirtyResourceTopology.
+  unordered_set<uint64_t> dirty_res_node_ids_;
 };
 
 }  // namespace firmament
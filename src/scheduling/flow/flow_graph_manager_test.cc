@@ -36,10 +36,20 @@
 #include "scheduling/flow/mock_cost_model.h"
 #include "scheduling/flow/trivial_cost_model.h"
 #include "scheduling/flow/void_cost_model.h"
+#include "sim/simulated_wall_time.h"
 
+DECLARE_bool(cache_equiv_class_arc_costs);
+DECLARE_bool(incremental_flow);
+DECLARE_uint64(unsched_agg_cost_update_interval);
+DECLARE_int32(flow_graph_update_threads);
 DECLARE_string(flow_scheduling_solver);
+DECLARE_uint64(max_tasks_per_pu);
 DECLARE_uint64(num_pref_arcs_task_to_res);
 
+// Defined by the simulator's event manager, which the tests do not link.
+DEFINE_uint64(batch_step, 0, "Batch mode: time interval to run scheduler "
+              "at (in microseconds).");
+
 using ::testing::_;
 
 namespace firmament {
@@ -113,6 +123,34 @@ class FlowGraphManagerTest : public ::testing::Test {
     return td_ptr;
   }
 
+  // Returns the cost, capacity and min flow of every arc, keyed by names of
+  // its endpoints that do not depend on node ids. Graphs that are built in
+  // different orders can thus be compared.
+  map<pair<string, string>, tuple<int64_t, uint64_t, uint64_t>>
+      ArcsByEndpoints(const FlowGraph& flow_graph) {
+    map<pair<string, string>, tuple<int64_t, uint64_t, uint64_t>> arcs;
+    for (auto& arc : flow_graph.Arcs()) {
+      CHECK(InsertIfNotPresent(
+          &arcs, make_pair(NodeName(*arc->src_node_), NodeName(*arc->dst_node_)),
+          make_tuple(arc->cost_, arc->cap_upper_bound_,
+                     arc->cap_lower_bound_)));
+    }
+    return arcs;
+  }
+
+  string NodeName(const FlowGraphNode& node) {
+    if (!node.resource_id_.is_nil()) {
+      return "resource " + to_string(node.resource_id_);
+    } else if (node.ec_id_ != 0) {
+      return "EC " + to_string(node.ec_id_);
+    } else if (node.td_ptr_) {
+      return "task " + to_string(node.td_ptr_->uid());
+    } else if (node.type_ == FlowNodeType::JOB_AGGREGATOR) {
+      return "unscheduled " + to_string(node.job_id_);
+    }
+    return "type " + to_string(node.type_);
+  }
+
   shared_ptr<ResourceMap_t> resource_map_;
   shared_ptr<TaskMap_t> task_map_;
   unordered_set<ResourceID_t, boost::hash<boost::uuids::uuid>>* leaf_res_ids_;
@@ -125,6 +163,128 @@ TEST_F(FlowGraphManagerTest, AddOrUpdateJobNodes) {
   // TODO(ionel): Implement!
 }
 
+TEST_F(FlowGraphManagerTest, AddOrUpdateJobNodesInBulk) {
+  // There are no resources the tasks could prefer.
+  uint64_t num_pref_arcs_task_to_res = FLAGS_num_pref_arcs_task_to_res;
+  FLAGS_num_pref_arcs_task_to_res = 0;
+  FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
+  FlowGraphManager* bulk_graph_manager = CreateGraphManagerUsingTrivialCost();
+  JobDescriptor test_job;
+  TaskDescriptor* root_td_ptr = CreateTask(&test_job, 42);
+  root_td_ptr->set_state(TaskDescriptor::RUNNABLE);
+  InsertIfNotPresent(task_map_.get(), root_td_ptr->uid(), root_td_ptr);
+  for (uint32_t task_index = 0; task_index < 100; ++task_index) {
+    TaskDescriptor* td_ptr = root_td_ptr->add_spawned();
+    td_ptr->set_uid(GenerateTaskID(*root_td_ptr));
+    td_ptr->set_job_id(test_job.uuid());
+    // Completed tasks do not get nodes, but their children do.
+    td_ptr->set_state(task_index % 10 == 0 ? TaskDescriptor::COMPLETED :
+                      TaskDescriptor::RUNNABLE);
+    InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr);
+    TaskDescriptor* child_td_ptr = td_ptr->add_spawned();
+    child_td_ptr->set_uid(GenerateTaskID(*td_ptr));
+    child_td_ptr->set_job_id(test_job.uuid());
+    child_td_ptr->set_state(TaskDescriptor::RUNNABLE);
+    InsertIfNotPresent(task_map_.get(), child_td_ptr->uid(), child_td_ptr);
+  }
+  vector<JobDescriptor*> jd_ptr_vect(1, &test_job);
+  graph_manager->AddOrUpdateJobNodes(jd_ptr_vect);
+  bulk_graph_manager->AddOrUpdateJobNodesInBulk(jd_ptr_vect);
+  // Both paths build the same graph.
+  const FlowGraph& flow_graph =
+    graph_manager->graph_change_manager_->flow_graph();
+  const FlowGraph& bulk_flow_graph =
+    bulk_graph_manager->graph_change_manager_->flow_graph();
+  EXPECT_EQ(bulk_flow_graph.NumNodes(), flow_graph.NumNodes());
+  EXPECT_EQ(bulk_flow_graph.NumArcs(), flow_graph.NumArcs());
+  EXPECT_EQ(ArcsByEndpoints(bulk_flow_graph), ArcsByEndpoints(flow_graph));
+  JobID_t job_id = JobIDFromString(test_job.uuid());
+  FlowGraphArc* unsched_agg_arc =
+    bulk_graph_manager->graph_change_manager_->mutable_flow_graph()->GetArc(
+        bulk_graph_manager->UnschedAggNodeForJobID(job_id),
+        bulk_graph_manager->sink_node_);
+  CHECK_NOTNULL(unsched_agg_arc);
+  EXPECT_EQ(unsched_agg_arc->cap_upper_bound_, 191);
+  EXPECT_EQ(bulk_graph_manager->task_to_node_map_.size(), 191);
+  EXPECT_TRUE(bulk_graph_manager->HasNodeForTaskID(root_td_ptr->uid()));
+  // Updating the job again does not add any nodes, nor does it grow the
+  // task to node map.
+  uint64_t num_nodes = bulk_flow_graph.NumNodes();
+  size_t bucket_count = bulk_graph_manager->task_to_node_map_.bucket_count();
+  bulk_graph_manager->AddOrUpdateJobNodesInBulk(jd_ptr_vect);
+  EXPECT_EQ(bulk_flow_graph.NumNodes(), num_nodes);
+  EXPECT_EQ(bulk_graph_manager->task_to_node_map_.bucket_count(),
+            bucket_count);
+  EXPECT_EQ(unsched_agg_arc->cap_upper_bound_, 191);
+  graph_manager->AddOrUpdateJobNodes(jd_ptr_vect);
+  EXPECT_EQ(ArcsByEndpoints(bulk_flow_graph), ArcsByEndpoints(flow_graph));
+  FLAGS_num_pref_arcs_task_to_res = num_pref_arcs_task_to_res;
+  delete graph_manager;
+  delete bulk_graph_manager;
+}
+
+// The bulk path records one change per new node, which carries the node's
+// arcs, whereas adding the job's nodes one by one records a change per arc.
+TEST_F(FlowGraphManagerTest, AddOrUpdateJobNodesInBulkChanges) {
+  // There are no resources the tasks could prefer.
+  uint64_t num_pref_arcs_task_to_res = FLAGS_num_pref_arcs_task_to_res;
+  FLAGS_num_pref_arcs_task_to_res = 0;
+  FLAGS_incremental_flow = true;
+  FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
+  FlowGraphManager* bulk_graph_manager = CreateGraphManagerUsingTrivialCost();
+  JobDescriptor test_job;
+  TaskDescriptor* root_td_ptr = CreateTask(&test_job, 42);
+  root_td_ptr->set_state(TaskDescriptor::RUNNABLE);
+  InsertIfNotPresent(task_map_.get(), root_td_ptr->uid(), root_td_ptr);
+  for (uint32_t task_index = 0; task_index < 20; ++task_index) {
+    TaskDescriptor* td_ptr = root_td_ptr->add_spawned();
+    td_ptr->set_uid(GenerateTaskID(*root_td_ptr));
+    td_ptr->set_job_id(test_job.uuid());
+    td_ptr->set_state(TaskDescriptor::RUNNABLE);
+    InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr);
+  }
+  FlowGraphChangeManager* change_manager =
+    graph_manager->graph_change_manager_;
+  FlowGraphChangeManager* bulk_change_manager =
+    bulk_graph_manager->graph_change_manager_;
+  change_manager->ResetChanges();
+  bulk_change_manager->ResetChanges();
+  uint64_t num_nodes = bulk_change_manager->flow_graph().NumNodes();
+  uint64_t num_arcs = bulk_change_manager->flow_graph().NumArcs();
+  // The job is in the batch twice, but its nodes are only added once.
+  vector<JobDescriptor*> jd_ptr_vect(2, &test_job);
+  graph_manager->AddOrUpdateJobNodes(jd_ptr_vect);
+  bulk_graph_manager->AddOrUpdateJobNodesInBulk(jd_ptr_vect);
+  EXPECT_EQ(ArcsByEndpoints(bulk_change_manager->flow_graph()),
+            ArcsByEndpoints(change_manager->flow_graph()));
+  // 21 task nodes, the unscheduled aggregator and the two equivalence classes.
+  uint64_t num_new_nodes =
+    bulk_change_manager->flow_graph().NumNodes() - num_nodes;
+  EXPECT_EQ(num_new_nodes, 24);
+  uint64_t num_new_arcs =
+    bulk_change_manager->flow_graph().NumArcs() - num_arcs;
+  // Every change adds a node, and every new arc is added together with one of
+  // its nodes.
+  const vector<DIMACSChange*>& bulk_changes =
+    bulk_change_manager->GetGraphChanges();
+  EXPECT_EQ(bulk_changes.size(), num_new_nodes);
+  uint64_t num_arc_additions = 0;
+  for (auto& change : bulk_changes) {
+    ASSERT_EQ(change->kind(), DIMACSChange::ADD_NODE);
+    num_arc_additions +=
+      static_cast<DIMACSAddNode*>(change)->arc_additions_.size();
+  }
+  EXPECT_EQ(num_arc_additions, num_new_arcs);
+  // Adding the nodes one by one also changes the capacity of the unscheduled
+  // aggregator's arc to the sink once per task.
+  EXPECT_EQ(change_manager->GetGraphChanges().size(),
+            num_new_nodes + num_new_arcs + 20);
+  FLAGS_incremental_flow = false;
+  FLAGS_num_pref_arcs_task_to_res = num_pref_arcs_task_to_res;
+  delete graph_manager;
+  delete bulk_graph_manager;
+}
+
 TEST_F(FlowGraphManagerTest, AddEquivClassNode) {
   FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
   uint64_t num_nodes =
@@ -293,6 +453,221 @@ TEST_F(FlowGraphManagerTest, AddResourceTopologyDFS) {
             1);
 }
 
+// The costs of the arcs from an EC to the resources are only recomputed once
+// the resource or all costs have been updated.
+// The arc costs of cost models that do not support the cache are recomputed
+// every time, even if --cache_equiv_class_arc_costs is set.
+TEST_F(FlowGraphManagerTest, ArcCostCacheUnsupported) {
+  FLAGS_cache_equiv_class_arc_costs = true;
+  MockCostModel mock_cost_model;
+  FlowGraphManager* graph_manager =
+    new FlowGraphManager(&mock_cost_model, leaf_res_ids_, &wall_time_, tg_,
+                         &dimacs_stats_);
+  FlowGraphNode* ec_node = graph_manager->AddEquivClassNode(42);
+  ResourceTopologyNodeDescriptor machine_rtnd;
+  ResourceDescriptor* machine_rd_ptr = CreateMachine(&machine_rtnd, "machine");
+  FlowGraphNode* machine_res_node =
+    graph_manager->AddResourceNode(machine_rd_ptr);
+  ResourceID_t machine_res_id = machine_res_node->resource_id_;
+  queue<TDOrNodeWrapper*> node_queue;
+  unordered_set<uint64_t> marked_nodes;
+  ON_CALL(mock_cost_model, GetOutgoingEquivClassPrefArcs(_))
+    .WillByDefault(testing::Invoke([machine_res_id](EquivClass_t ec) {
+          return new vector<ResourceID_t>(1, machine_res_id);
+        }));
+  ON_CALL(mock_cost_model, EquivClassToResourceNode(_, _))
+    .WillByDefault(testing::Return(ArcDescriptor(42LL, 1ULL, 0ULL)));
+  ON_CALL(mock_cost_model, SupportsArcCostCache())
+    .WillByDefault(testing::Return(false));
+  EXPECT_CALL(mock_cost_model, GetOutgoingEquivClassPrefArcs(_))
+    .Times(2);
+  EXPECT_CALL(mock_cost_model, EquivClassToResourceNode(_, _))
+    .Times(2);
+  graph_manager->UpdateEquivToResArcs(ec_node, &node_queue, &marked_nodes);
+  graph_manager->UpdateEquivToResArcs(ec_node, &node_queue, &marked_nodes);
+  FLAGS_cache_equiv_class_arc_costs = false;
+  delete graph_manager;
+}
+
+TEST_F(FlowGraphManagerTest, BatchedArcCostComputation) {
+  FLAGS_flow_graph_update_threads = 4;
+  MockCostModel mock_cost_model;
+  FlowGraphManager* graph_manager =
+    new FlowGraphManager(&mock_cost_model, leaf_res_ids_, &wall_time_, tg_,
+                         &dimacs_stats_);
+  const FlowGraph& flow_graph =
+    graph_manager->graph_change_manager_->flow_graph();
+  // Many EC nodes with too few preferences each for their costs to be
+  // computed in parallel on their own.
+  queue<TDOrNodeWrapper*> node_queue;
+  unordered_set<uint64_t> marked_nodes;
+  vector<FlowGraphNode*> ec_nodes;
+  for (EquivClass_t ec = 1; ec <= 64; ++ec) {
+    FlowGraphNode* ec_node = graph_manager->AddEquivClassNode(ec);
+    ec_nodes.push_back(ec_node);
+    marked_nodes.insert(ec_node->id_);
+    node_queue.push(new TDOrNodeWrapper(ec_node, NULL));
+  }
+  vector<EquivClass_t> pref_ecs;
+  for (EquivClass_t pref_ec = 1000; pref_ec < 1064; ++pref_ec) {
+    pref_ecs.push_back(pref_ec);
+  }
+  uint64_t num_arcs_before = flow_graph.NumArcs();
+  ON_CALL(mock_cost_model, IsThreadSafe())
+    .WillByDefault(testing::Return(true));
+  ON_CALL(mock_cost_model, GetEquivClassToEquivClassesArcs(_))
+    .WillByDefault(testing::Invoke([&pref_ecs](EquivClass_t ec) {
+          return ec < 1000 ? new vector<EquivClass_t>(pref_ecs) : NULL;
+        }));
+  // All the costs of the frontier are computed before any arc is added.
+  ON_CALL(mock_cost_model, EquivClassToEquivClass(_, _))
+    .WillByDefault(testing::Invoke(
+        [&flow_graph, num_arcs_before](EquivClass_t ec1, EquivClass_t ec2) {
+          EXPECT_EQ(flow_graph.NumArcs(), num_arcs_before);
+          return ArcDescriptor(static_cast<Cost_t>(ec1 * ec2), 1ULL, 0ULL);
+        }));
+  EXPECT_CALL(mock_cost_model, EquivClassToEquivClass(_, _))
+    .Times(ec_nodes.size() * pref_ecs.size());
+  graph_manager->UpdateFlowGraph(&node_queue, &marked_nodes);
+  EXPECT_TRUE(node_queue.empty());
+  for (auto& ec_node : ec_nodes) {
+    EXPECT_EQ(ec_node->outgoing_arc_map_.size(), pref_ecs.size());
+    for (auto& pref_ec : pref_ecs) {
+      FlowGraphNode* pref_ec_node = graph_manager->NodeForEquivClass(pref_ec);
+      CHECK_NOTNULL(pref_ec_node);
+      FlowGraphArc* arc = graph_manager->graph_change_manager_->
+        mutable_flow_graph()->GetArc(ec_node, pref_ec_node);
+      CHECK_NOTNULL(arc);
+      EXPECT_EQ(arc->cost_, static_cast<int64_t>(ec_node->ec_id_ * pref_ec));
+    }
+  }
+  FLAGS_flow_graph_update_threads = 0;
+  delete graph_manager;
+}
+
+TEST_F(FlowGraphManagerTest, CacheEquivClassArcCosts) {
+  FLAGS_cache_equiv_class_arc_costs = true;
+  MockCostModel mock_cost_model;
+  FlowGraphManager* graph_manager =
+    new FlowGraphManager(&mock_cost_model, leaf_res_ids_, &wall_time_, tg_,
+                         &dimacs_stats_);
+  FlowGraphNode* ec_node = graph_manager->AddEquivClassNode(42);
+  ResourceTopologyNodeDescriptor machine_rtnd;
+  ResourceDescriptor* machine_rd_ptr = CreateMachine(&machine_rtnd, "machine");
+  FlowGraphNode* machine_res_node =
+    graph_manager->AddResourceNode(machine_rd_ptr);
+  ResourceID_t machine_res_id = machine_res_node->resource_id_;
+  queue<TDOrNodeWrapper*> node_queue;
+  unordered_set<uint64_t> marked_nodes;
+  ON_CALL(mock_cost_model, GetOutgoingEquivClassPrefArcs(_))
+    .WillByDefault(testing::Invoke([machine_res_id](EquivClass_t ec) {
+          return new vector<ResourceID_t>(1, machine_res_id);
+        }));
+  ON_CALL(mock_cost_model, EquivClassToResourceNode(_, _))
+    .WillByDefault(testing::Return(ArcDescriptor(42LL, 1ULL, 0ULL)));
+  ON_CALL(mock_cost_model, SupportsArcCostCache())
+    .WillByDefault(testing::Return(true));
+  EXPECT_CALL(mock_cost_model, GetOutgoingEquivClassPrefArcs(_))
+    .Times(4);
+  EXPECT_CALL(mock_cost_model, EquivClassToResourceNode(_, _))
+    .Times(3);
+  graph_manager->UpdateEquivToResArcs(ec_node, &node_queue, &marked_nodes);
+  // The arc's cost is current.
+  graph_manager->UpdateEquivToResArcs(ec_node, &node_queue, &marked_nodes);
+  graph_manager->MarkResourceNodeUpdated(machine_res_node);
+  graph_manager->UpdateEquivToResArcs(ec_node, &node_queue, &marked_nodes);
+  graph_manager->InvalidateArcCosts();
+  graph_manager->UpdateEquivToResArcs(ec_node, &node_queue, &marked_nodes);
+  FLAGS_cache_equiv_class_arc_costs = false;
+  delete graph_manager;
+}
+
+// Only the resource descriptor changes that can change costs mark the
+// resource as updated in the statistics traversal.
+TEST_F(FlowGraphManagerTest, ResourceCostDigest) {
+  FLAGS_cache_equiv_class_arc_costs = true;
+  MockCostModel mock_cost_model;
+  FlowGraphManager* graph_manager =
+    new FlowGraphManager(&mock_cost_model, leaf_res_ids_, &wall_time_, tg_,
+                         &dimacs_stats_);
+  ResourceTopologyNodeDescriptor machine_rtnd;
+  ResourceDescriptor* machine_rd_ptr = CreateMachine(&machine_rtnd, "machine");
+  FlowGraphNode* machine_res_node =
+    graph_manager->AddResourceNode(machine_rd_ptr);
+  boost::function<FlowGraphNode*(FlowGraphNode*, FlowGraphNode*)> gather =
+    [](FlowGraphNode* acc, FlowGraphNode* other) { return acc; };
+  graph_manager->ComputeTopologyStatistics(machine_res_node, NULL, gather,
+                                           gather);
+  uint64_t cost_version = machine_res_node->cost_version_;
+  // Heartbeats do not change costs.
+  machine_rd_ptr->set_last_heartbeat(1234);
+  graph_manager->ComputeTopologyStatistics(machine_res_node, NULL, gather,
+                                           gather);
+  EXPECT_EQ(machine_res_node->cost_version_, cost_version);
+  // Label and resource changes do.
+  Label* label = machine_rd_ptr->add_labels();
+  label->set_key("zone");
+  label->set_value("a");
+  graph_manager->ComputeTopologyStatistics(machine_res_node, NULL, gather,
+                                           gather);
+  EXPECT_GT(machine_res_node->cost_version_, cost_version);
+  cost_version = machine_res_node->cost_version_;
+  machine_rd_ptr->mutable_available_resources()->set_cpu_cores(2.0);
+  graph_manager->ComputeTopologyStatistics(machine_res_node, NULL, gather,
+                                           gather);
+  EXPECT_GT(machine_res_node->cost_version_, cost_version);
+  FLAGS_cache_equiv_class_arc_costs = false;
+  delete graph_manager;
+}
+
+TEST_F(FlowGraphManagerTest, ParallelArcCostComputation) {
+  FLAGS_flow_graph_update_threads = 4;
+  MockCostModel mock_cost_model;
+  FlowGraphManager* graph_manager =
+    new FlowGraphManager(&mock_cost_model, leaf_res_ids_, &wall_time_, tg_,
+                         &dimacs_stats_);
+  FlowGraphNode* ec_node = graph_manager->AddEquivClassNode(1);
+  queue<TDOrNodeWrapper*> node_queue;
+  unordered_set<uint64_t> marked_nodes;
+  // Enough preferences for the costs to be computed by all threads.
+  vector<EquivClass_t> pref_ecs;
+  for (EquivClass_t pref_ec = 2; pref_ec < 4098; ++pref_ec) {
+    pref_ecs.push_back(pref_ec);
+  }
+  ON_CALL(mock_cost_model, IsThreadSafe())
+    .WillByDefault(testing::Return(true));
+  ON_CALL(mock_cost_model, GetEquivClassToEquivClassesArcs(_))
+    .WillByDefault(testing::Invoke([&pref_ecs](EquivClass_t ec) {
+          return new vector<EquivClass_t>(pref_ecs);
+        }));
+  ON_CALL(mock_cost_model, EquivClassToEquivClass(_, _))
+    .WillByDefault(testing::Invoke([](EquivClass_t ec1, EquivClass_t ec2) {
+          return ArcDescriptor(static_cast<Cost_t>(ec2), 1ULL, 0ULL);
+        }));
+  EXPECT_CALL(mock_cost_model, IsThreadSafe()).Times(1);
+  EXPECT_CALL(mock_cost_model, GetEquivClassToEquivClassesArcs(_)).Times(1);
+  EXPECT_CALL(mock_cost_model, EquivClassToEquivClass(_, _))
+    .Times(pref_ecs.size());
+  graph_manager->UpdateEquivToEquivArcs(ec_node, &node_queue, &marked_nodes);
+  // Every arc gets the cost that was computed for its preference.
+  EXPECT_EQ(ec_node->outgoing_arc_map_.size(), pref_ecs.size());
+  for (auto& pref_ec : pref_ecs) {
+    FlowGraphNode* pref_ec_node = graph_manager->NodeForEquivClass(pref_ec);
+    CHECK_NOTNULL(pref_ec_node);
+    FlowGraphArc* arc = graph_manager->graph_change_manager_->
+      mutable_flow_graph()->GetArc(ec_node, pref_ec_node);
+    CHECK_NOTNULL(arc);
+    EXPECT_EQ(arc->cost_, static_cast<int64_t>(pref_ec));
+  }
+  EXPECT_EQ(node_queue.size(), pref_ecs.size());
+  while (!node_queue.empty()) {
+    delete node_queue.front();
+    node_queue.pop();
+  }
+  FLAGS_flow_graph_update_threads = 0;
+  delete graph_manager;
+}
+
 TEST_F(FlowGraphManagerTest, PinTaskToNode) {
   MockCostModel mock_cost_model;
   FlowGraphManager* graph_manager =
@@ -402,7 +777,10 @@ TEST_F(FlowGraphManagerTest, PurgeUnconnectedEquivClassNodes) {
 }
 
 TEST_F(FlowGraphManagerTest, RemoveEquivClassNode) {
-  FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
+  MockCostModel mock_cost_model;
+  FlowGraphManager* graph_manager =
+    new FlowGraphManager(&mock_cost_model, leaf_res_ids_, &wall_time_, tg_,
+                         &dimacs_stats_);
   EquivClass_t ec = 42;
   FlowGraphNode* ec_node = graph_manager->AddEquivClassNode(ec);
   const FlowGraph& flow_graph =
@@ -410,11 +788,13 @@ TEST_F(FlowGraphManagerTest, RemoveEquivClassNode) {
   uint64_t num_arcs = flow_graph.NumArcs();
   EXPECT_EQ(graph_manager->tec_to_node_map_.size(), 1);
   EXPECT_EQ(0, flow_graph.unused_ids_.size());
+  EXPECT_CALL(mock_cost_model, RemoveEquivClass(ec)).Times(1);
   graph_manager->RemoveEquivClassNode(ec_node);
   EXPECT_EQ(graph_manager->tec_to_node_map_.size(), 0);
   EXPECT_EQ(1, flow_graph.unused_ids_.size());
   EXPECT_EQ(num_arcs, flow_graph.NumArcs());
   EXPECT_DEATH(graph_manager->RemoveEquivClassNode(NULL), "");
+  delete graph_manager;
 }
 
 TEST_F(FlowGraphManagerTest, RemoveInvalidECPrefArcs) {
@@ -805,6 +1185,100 @@ TEST_F(FlowGraphManagerTest, UpdateArcsForScheduledTask) {
   CHECK_EQ(arc_task_to_unsched->cost_, 43);
 }
 
+TEST_F(FlowGraphManagerTest, UpdateBucketedCostsToUnscheduledAggs) {
+  FLAGS_unsched_agg_cost_update_interval = 100;
+  MockCostModel mock_cost_model;
+  sim::SimulatedWallTime test_time;
+  test_time.UpdateCurrentTimestamp(1000);
+  FlowGraphManager* graph_manager = new FlowGraphManager(
+      &mock_cost_model, leaf_res_ids_, &test_time, tg_, &dimacs_stats_);
+  JobDescriptor test_job;
+  TaskDescriptor* td_ptr1 = CreateTask(&test_job, 42);
+  TaskDescriptor* td_ptr2 = td_ptr1->add_spawned();
+  td_ptr2->set_uid(GenerateTaskID(*td_ptr1));
+  td_ptr2->set_job_id(td_ptr1->job_id());
+  JobID_t job_id = JobIDFromString(td_ptr1->job_id());
+  EXPECT_CALL(mock_cost_model, AddTask(_)).Times(2);
+  FlowGraphNode* task_node1 = graph_manager->AddTaskNode(job_id, td_ptr1);
+  FlowGraphNode* task_node2 = graph_manager->AddTaskNode(job_id, td_ptr2);
+  FlowGraphNode* unsched_agg_node =
+    graph_manager->AddUnscheduledAggNode(job_id);
+  graph_manager->graph_change_manager_->AddArc(
+      task_node1, unsched_agg_node, 0, 1, 1, FlowGraphArcType::OTHER,
+      ADD_ARC_TO_UNSCHED, "test");
+  graph_manager->graph_change_manager_->AddArc(
+      task_node2, unsched_agg_node, 0, 1, 1, FlowGraphArcType::OTHER,
+      ADD_ARC_TO_UNSCHED, "test");
+  ON_CALL(mock_cost_model, TaskToUnscheduledAgg(_))
+    .WillByDefault(testing::Return(ArcDescriptor(45LL, 1ULL, 0ULL)));
+  // The tasks' costs are not updated before their first bucket ends.
+  EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(0);
+  test_time.UpdateCurrentTimestamp(1050);
+  graph_manager->UpdateAllCostsToUnscheduledAggs();
+  testing::Mock::VerifyAndClearExpectations(&mock_cost_model);
+  EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(2);
+  test_time.UpdateCurrentTimestamp(1100);
+  graph_manager->UpdateAllCostsToUnscheduledAggs();
+  testing::Mock::VerifyAndClearExpectations(&mock_cost_model);
+  EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(0);
+  test_time.UpdateCurrentTimestamp(1150);
+  graph_manager->UpdateAllCostsToUnscheduledAggs();
+  testing::Mock::VerifyAndClearExpectations(&mock_cost_model);
+  // Removed tasks are not updated, and several buckets that end between two
+  // updates only cause one update.
+  graph_manager->RemoveTaskNode(task_node2);
+  EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(1);
+  test_time.UpdateCurrentTimestamp(1350);
+  graph_manager->UpdateAllCostsToUnscheduledAggs();
+  testing::Mock::VerifyAndClearExpectations(&mock_cost_model);
+  EXPECT_EQ(graph_manager->unsched_agg_cost_updates_.top().first, 1400);
+  FLAGS_unsched_agg_cost_update_interval = 0;
+  delete graph_manager;
+}
+
+TEST_F(FlowGraphManagerTest, UpdateBucketedCostsInAddOrUpdateJobNodes) {
+  FLAGS_unsched_agg_cost_update_interval = 100;
+  MockCostModel mock_cost_model;
+  sim::SimulatedWallTime test_time;
+  test_time.UpdateCurrentTimestamp(1000);
+  FlowGraphManager* graph_manager = new FlowGraphManager(
+      &mock_cost_model, leaf_res_ids_, &test_time, tg_, &dimacs_stats_);
+  JobDescriptor test_job;
+  TaskDescriptor* td_ptr1 = CreateTask(&test_job, 42);
+  td_ptr1->set_state(TaskDescriptor::RUNNABLE);
+  TaskDescriptor* td_ptr2 = td_ptr1->add_spawned();
+  td_ptr2->set_uid(GenerateTaskID(*td_ptr1));
+  td_ptr2->set_job_id(td_ptr1->job_id());
+  td_ptr2->set_state(TaskDescriptor::RUNNABLE);
+  vector<JobDescriptor*> jd_ptr_vect(1, &test_job);
+  ON_CALL(mock_cost_model, TaskToUnscheduledAgg(_))
+    .WillByDefault(testing::Return(ArcDescriptor(45LL, 1ULL, 0ULL)));
+  ON_CALL(mock_cost_model, UnscheduledAggToSink(_))
+    .WillByDefault(testing::Return(ArcDescriptor(0LL, 1ULL, 0ULL)));
+  // The arcs of new tasks are added right away.
+  EXPECT_CALL(mock_cost_model, AddTask(_)).Times(2);
+  EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(2);
+  graph_manager->AddOrUpdateJobNodes(jd_ptr_vect);
+  testing::Mock::VerifyAndClearExpectations(&mock_cost_model);
+  // The existing arcs are not updated before their first bucket ends.
+  EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(0);
+  test_time.UpdateCurrentTimestamp(1050);
+  graph_manager->AddOrUpdateJobNodes(jd_ptr_vect);
+  testing::Mock::VerifyAndClearExpectations(&mock_cost_model);
+  EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(2);
+  test_time.UpdateCurrentTimestamp(1100);
+  graph_manager->AddOrUpdateJobNodes(jd_ptr_vect);
+  testing::Mock::VerifyAndClearExpectations(&mock_cost_model);
+  // The arcs updated by AddOrUpdateJobNodes are not updated again before
+  // the solver runs.
+  EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(0);
+  graph_manager->UpdateAllCostsToUnscheduledAggs();
+  graph_manager->AddOrUpdateJobNodes(jd_ptr_vect);
+  testing::Mock::VerifyAndClearExpectations(&mock_cost_model);
+  FLAGS_unsched_agg_cost_update_interval = 0;
+  delete graph_manager;
+}
+
 TEST_F(FlowGraphManagerTest, UpdateChildrenTasks) {
   FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
   const FlowGraph& flow_graph =
@@ -840,6 +1314,54 @@ TEST_F(FlowGraphManagerTest, UpdateChildrenTasks) {
   CHECK_EQ(marked_nodes.size(), 1);
 }
 
+TEST_F(FlowGraphManagerTest, UpdateDirtyResourceTopology) {
+  bool preemption = FLAGS_preemption;
+  FLAGS_preemption = false;
+  FLAGS_max_tasks_per_pu = 2;
+  FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
+  ResourceTopologyNodeDescriptor machine_rtnd;
+  ResourceDescriptor* machine_rd_ptr = CreateMachine(&machine_rtnd, "machine");
+  machine_rd_ptr->set_num_slots_below(4);
+  FlowGraphNode* machine_node = graph_manager->AddResourceNode(machine_rd_ptr);
+  vector<FlowGraphNode*> pu_nodes;
+  vector<FlowGraphArc*> pu_arcs;
+  for (uint32_t pu_index = 0; pu_index < 2; ++pu_index) {
+    ResourceTopologyNodeDescriptor* pu_rtnd_ptr =
+      machine_rtnd.add_children();
+    ResourceDescriptor* pu_rd_ptr =
+      CreateMachine(pu_rtnd_ptr, "pu" + to_string(pu_index));
+    pu_rd_ptr->set_type(ResourceDescriptor::RESOURCE_PU);
+    pu_rd_ptr->set_num_slots_below(2);
+    pu_rtnd_ptr->set_parent_id(machine_rd_ptr->uuid());
+    FlowGraphNode* pu_node = graph_manager->AddResourceNode(pu_rd_ptr);
+    pu_arcs.push_back(graph_manager->graph_change_manager_->AddArc(
+        machine_node, pu_node, 0, 2, 0, FlowGraphArcType::OTHER,
+        ADD_ARC_BETWEEN_RES, "test"));
+    CHECK(InsertIfNotPresent(&graph_manager->node_to_parent_node_map_,
+                             pu_node, machine_node));
+    pu_nodes.push_back(pu_node);
+  }
+  // Only the PU whose running tasks changed is refreshed.
+  pu_nodes[0]->rd_ptr_->add_current_running_tasks(42);
+  graph_manager->MarkResourceStatsDirty(*pu_nodes[0]);
+  graph_manager->UpdateDirtyResourceTopology();
+  EXPECT_EQ(pu_nodes[0]->rd_ptr_->num_running_tasks_below(), 1);
+  EXPECT_EQ(pu_arcs[0]->cap_upper_bound_, 1);
+  EXPECT_EQ(pu_arcs[1]->cap_upper_bound_, 2);
+  EXPECT_EQ(machine_rd_ptr->num_slots_below(), 4);
+  EXPECT_EQ(machine_rd_ptr->num_running_tasks_below(), 1);
+  EXPECT_TRUE(graph_manager->dirty_res_node_ids_.empty());
+  // The counts match the ones a full traversal of the topology computes.
+  graph_manager->UpdateResourceTopology(&machine_rtnd);
+  EXPECT_EQ(machine_rd_ptr->num_slots_below(), 4);
+  EXPECT_EQ(machine_rd_ptr->num_running_tasks_below(), 1);
+  EXPECT_EQ(pu_arcs[0]->cap_upper_bound_, 1);
+  EXPECT_EQ(pu_arcs[1]->cap_upper_bound_, 2);
+  FLAGS_max_tasks_per_pu = 1;
+  FLAGS_preemption = preemption;
+  delete graph_manager;
+}
+
 TEST_F(FlowGraphManagerTest, UpdateEquivClassNode) {
   MockCostModel mock_cost_model;
   FlowGraphManager* graph_manager =
@@ -28,13 +28,15 @@ namespace firmament {
   FlowGraphNode::FlowGraphNode(uint64_t id)
       : id_(id), excess_(0), job_id_(boost::uuids::nil_uuid()),
         resource_id_(boost::uuids::nil_uuid()), rd_ptr_(NULL), td_ptr_(NULL),
-        ec_id_(0), visited_(0) {
+        ec_id_(0), visited_(0), graph_index_(0), cost_version_(0),
+        rd_digest_(0) {
   }
 
   FlowGraphNode::FlowGraphNode(uint64_t id, int64_t excess)
       : id_(id), excess_(excess), job_id_(boost::uuids::nil_uuid()),
         resource_id_(boost::uuids::nil_uuid()), rd_ptr_(NULL), td_ptr_(NULL),
-        ec_id_(0), visited_(0) {
+        ec_id_(0), visited_(0), graph_index_(0), cost_version_(0),
+        rd_digest_(0) {
   }
 
   void FlowGraphNode::AddArc(FlowGraphArc* arc) {
@@ -32,6 +32,7 @@
 #include "base/resource_desc.pb.h"
 #include "base/task_desc.pb.h"
 #include "scheduling/flow/flow_graph_arc.h"
+#include "scheduling/flow/flow_graph_arc_map.h"
 
 namespace firmament {
 
@@ -97,11 +98,19 @@ struct FlowGraphNode {
   // Free-form comment for debugging purposes (used to label special nodes)
   string comment_;
   // Outgoing arcs from this node, keyed by destination node
-  unordered_map<uint64_t, FlowGraphArc*> outgoing_arc_map_;
+  FlowGraphArcMap outgoing_arc_map_;
   // Incoming arcs to this node, keyed by source node
-  unordered_map<uint64_t, FlowGraphArc*> incoming_arc_map_;
+  FlowGraphArcMap incoming_arc_map_;
   // Field use to mark if the node has been visited in a graph traversal.
   uint32_t visited_;
+  // Position of the node in the flow graph's node list.
+  uint64_t graph_index_;
+  // Cost version at which the node was last updated in a way that may change
+  // the costs of its arcs (see FlowGraphManager::ArcCostIsCurrent).
+  uint64_t cost_version_;
+  // Hash of the resource descriptor when the node's cost version was last
+  // checked against it (resource nodes only).
+  uint64_t rd_digest_;
 };
 
 }  // namespace firmament
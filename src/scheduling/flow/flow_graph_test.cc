@@ -21,7 +21,9 @@
 // Tests for flow graph.
 
 #include <gtest/gtest.h>
+#include <malloc.h>
 
+#include <unordered_map>
 #include <vector>
 
 #include "base/common.h"
@@ -69,7 +71,7 @@ TEST_F(FlowGraphTest, AddArcToNode) {
   FlowGraphArc* arc = graph.AddArc(n0->id_, n1->id_);
   CHECK_EQ(graph.NumNodes(), init_node_count + 2);
   CHECK_EQ(graph.NumArcs(), 1);
-  CHECK_EQ(n0->outgoing_arc_map_[n1->id_], arc);
+  CHECK_EQ(n0->outgoing_arc_map_.find(n1->id_)->second, arc);
 }
 
 // Change an arc and check it gets added to changes.
@@ -133,6 +135,113 @@ TEST_F(FlowGraphTest, GetArc) {
   fgraph.DeleteNode(node1);
 }
 
+// Tests that arcs can be found and deleted on nodes that have enough arcs to
+// have their adjacency lists indexed.
+TEST_F(FlowGraphTest, ManyArcsPerNode) {
+  FlowGraph fgraph;
+  FlowGraphNode* sink = fgraph.AddNode();
+  vector<FlowGraphNode*> nodes;
+  for (uint64_t i = 0; i < 100; ++i) {
+    FlowGraphNode* node = fgraph.AddNode();
+    fgraph.AddArc(node, sink);
+    nodes.push_back(node);
+  }
+  CHECK_EQ(sink->incoming_arc_map_.size(), 100);
+  for (uint64_t i = 0; i < nodes.size(); i += 2) {
+    fgraph.DeleteArc(fgraph.GetArc(nodes[i], sink));
+  }
+  CHECK_EQ(sink->incoming_arc_map_.size(), 50);
+  for (uint64_t i = 0; i < nodes.size(); ++i) {
+    FlowGraphArc* arc = fgraph.GetArc(nodes[i], sink);
+    if (i % 2 == 0) {
+      CHECK(arc == NULL);
+      CHECK(sink->incoming_arc_map_.find(nodes[i]->id_) ==
+            sink->incoming_arc_map_.end());
+    } else {
+      CHECK_NOTNULL(arc);
+      CHECK_EQ(sink->incoming_arc_map_.find(nodes[i]->id_)->second, arc);
+    }
+  }
+  fgraph.DeleteNode(sink);
+  CHECK_EQ(fgraph.NumArcs(), 0);
+  for (auto& node : nodes) {
+    CHECK(node->outgoing_arc_map_.empty());
+  }
+}
+
+// Returns the number of bytes currently allocated with malloc.
+static int64_t AllocatedBytes() {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  return static_cast<int64_t>(mallinfo2().uordblks);
+#else
+  return mallinfo().uordblks;
+#endif
+}
+
+// Compares the memory used by the adjacency lists of a graph with 100k tasks
+// to the memory the same adjacency lists use when stored in hash maps.
+TEST_F(FlowGraphTest, AdjacencyMemoryFootprint) {
+  const uint64_t kNumTasks = 100000;
+  const uint64_t kNumPUs = 1000;
+  const uint64_t kNumECs = 100;
+  int64_t start_bytes = AllocatedBytes();
+  FlowGraph fgraph;
+  FlowGraphNode* sink = fgraph.AddNode();
+  FlowGraphNode* unsched_agg = fgraph.AddNode();
+  fgraph.AddArc(unsched_agg, sink);
+  vector<FlowGraphNode*> pus;
+  for (uint64_t i = 0; i < kNumPUs; ++i) {
+    pus.push_back(fgraph.AddNode());
+    fgraph.AddArc(pus.back(), sink);
+  }
+  vector<FlowGraphNode*> ecs;
+  for (uint64_t i = 0; i < kNumECs; ++i) {
+    ecs.push_back(fgraph.AddNode());
+    for (uint64_t j = 0; j < kNumPUs / kNumECs; ++j) {
+      fgraph.AddArc(ecs.back(), pus[i * kNumPUs / kNumECs + j]);
+    }
+  }
+  for (uint64_t i = 0; i < kNumTasks; ++i) {
+    // Every task has an arc to the unscheduled aggregator, to an equivalence
+    // class and to a preferred PU.
+    FlowGraphNode* task = fgraph.AddNode();
+    fgraph.AddArc(task, unsched_agg);
+    fgraph.AddArc(task, ecs[i % kNumECs]);
+    fgraph.AddArc(task, pus[(i * 7) % kNumPUs]);
+  }
+  int64_t graph_bytes = AllocatedBytes() - start_bytes;
+  // Copy the adjacency lists into both representations.
+  uint64_t num_nodes = fgraph.Nodes().size();
+  start_bytes = AllocatedBytes();
+  vector<FlowGraphArcMap> flat_adjacency(2 * num_nodes);
+  for (uint64_t i = 0; i < num_nodes; ++i) {
+    const FlowGraphNode* node = fgraph.Nodes()[i];
+    for (auto& dst_arc : node->outgoing_arc_map_) {
+      flat_adjacency[2 * i].insert(dst_arc);
+    }
+    for (auto& src_arc : node->incoming_arc_map_) {
+      flat_adjacency[2 * i + 1].insert(src_arc);
+    }
+  }
+  int64_t flat_bytes = AllocatedBytes() - start_bytes;
+  start_bytes = AllocatedBytes();
+  vector<unordered_map<uint64_t, FlowGraphArc*>> hash_adjacency(2 * num_nodes);
+  for (uint64_t i = 0; i < num_nodes; ++i) {
+    const FlowGraphNode* node = fgraph.Nodes()[i];
+    hash_adjacency[2 * i].insert(node->outgoing_arc_map_.begin(),
+                                 node->outgoing_arc_map_.end());
+    hash_adjacency[2 * i + 1].insert(node->incoming_arc_map_.begin(),
+                                     node->incoming_arc_map_.end());
+  }
+  int64_t hash_bytes = AllocatedBytes() - start_bytes;
+  LOG(INFO) << "Graph with " << kNumTasks << " tasks: " << graph_bytes
+            << " bytes in total, " << graph_bytes / num_nodes
+            << " bytes per node";
+  LOG(INFO) << "Adjacency lists: " << flat_bytes << " bytes flat, "
+            << hash_bytes << " bytes in hash maps";
+  EXPECT_LT(flat_bytes, hash_bytes);
+}
+
 }  // namespace firmament
 
 int main(int argc, char** argv) {
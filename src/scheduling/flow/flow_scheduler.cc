@@ -61,6 +61,10 @@ DEFINE_uint64(purge_unconnected_ec_frequency, 10, "Frequency in solver runs "
 DEFINE_bool(update_resource_topology_capacities, false,
             "True if the arc capacities of the resource topology should be "
             "updated after every scheduling round");
+DEFINE_uint64(bulk_job_ingestion_min_tasks, 10000,
+              "Minimum number of runnable tasks without flow graph nodes "
+              "(i.e., newly submitted tasks) in a scheduling round from "
+              "which the jobs' nodes are added to the flow graph in bulk");
 DEFINE_uint64(max_tasks_per_pu, 1,
               "The maximum number of tasks we can schedule per PU");
 DEFINE_string(solver_runtime_accounting_mode, "algorithm",
@@ -68,9 +72,17 @@ DEFINE_string(solver_runtime_accounting_mode, "algorithm",
               "scheduling duration in simulations");
 DEFINE_bool(reschedule_tasks_upon_node_failure, true, "True if tasks that were "
             "running on failed nodes should be rescheduled");
+DEFINE_bool(pipelined_scheduling, false, "True if the solver should run "
+            "between scheduling rounds rather than within them. A round "
+            "applies the placements of the solver run started by the "
+            "previous round and then starts the next run, so that events "
+            "can update the graph while the solver runs. Only applies to "
+            "a single external solver.");
 
+DECLARE_bool(cache_equiv_class_arc_costs);
 DECLARE_string(flow_scheduling_solver);
 DECLARE_bool(flowlessly_flip_algorithms);
+DECLARE_uint64(flow_solver_deadline);
 DEFINE_bool(resource_stats_update_based_on_resource_reservation, true,
             "Set this false when you have external machine stats server");
 DEFINE_bool(pod_affinity_antiaffinity_symmetry, false, "Enable pod affinity/anti-affinity symmetry");
@@ -156,8 +168,7 @@ FlowScheduler::FlowScheduler(
       VLOG(1) << "Using the net cost model";
       break;
     case CostModelType::COST_MODEL_CPU:
-      cost_model_ = 
-          new CpuCostModel(resource_map, task_map, knowledge_base, labels_map);
+      cost_model_ = new CpuCostModel(resource_map, task_map, knowledge_base);
       VLOG(1) << "Using the cpu cost model";
       break;
     case CostModelType::COST_MODEL_QUINCY_INTERFERENCE:
@@ -171,6 +182,12 @@ FlowScheduler::FlowScheduler(
       LOG(FATAL) << "Unknown flow scheduling cost model specificed "
                  << "(" << FLAGS_flow_scheduling_cost_model << ")";
   }
+  if (FLAGS_cache_equiv_class_arc_costs &&
+      !cost_model_->SupportsArcCostCache()) {
+    LOG(WARNING) << "The cost model does not support "
+                 << "--cache_equiv_class_arc_costs; its arc costs are "
+                 << "recomputed in every scheduling round";
+  }
 
   flow_graph_manager_.reset(
       new FlowGraphManager(cost_model_, leaf_res_ids_, time_manager_,
@@ -399,8 +416,7 @@ void FlowScheduler::HandleTaskCompletion(TaskDescriptor* td_ptr,
   }
   if (!td_ptr->scheduled_to_resource().empty()) {
     ResourceID_t res_id = ResourceIDFromString(td_ptr->scheduled_to_resource());
-    cost_model_->UpdateResourceToNamespacesMap(res_id,
-                                           td_ptr->task_namespace(), false);
+    cost_model_->UpdateTopologyDomainCounts(res_id, *td_ptr, false);
   }
   // We first call into the superclass handler because it populates
   // the task report. The report might be used by the cost models.
@@ -418,26 +434,29 @@ void FlowScheduler::HandleTaskEviction(TaskDescriptor* td_ptr,
                                        ResourceDescriptor* rd_ptr) {
   boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
   ResourceID_t res_id = ResourceIDFromString(rd_ptr->uuid());
-  flow_graph_manager_->TaskEvicted(td_ptr->uid(), res_id);
+  uint64_t task_node_id =
+    flow_graph_manager_->TaskEvicted(td_ptr->uid(), res_id);
+  tasks_moved_during_solver_run_.insert(task_node_id);
   if (FLAGS_pod_affinity_antiaffinity_symmetry) {
     cost_model_->RemoveTaskFromTaskSymmetryMap(td_ptr);
   }
-  cost_model_->UpdateResourceToNamespacesMap(res_id,
-                                           td_ptr->task_namespace(), false);
+  cost_model_->UpdateTopologyDomainCounts(res_id, *td_ptr, false);
   EventDrivenScheduler::HandleTaskEviction(td_ptr, rd_ptr);
 }
 
 void FlowScheduler::HandleTaskFailure(TaskDescriptor* td_ptr) {
   boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
-  flow_graph_manager_->TaskFailed(td_ptr->uid());
+  uint64_t task_node_id = flow_graph_manager_->TaskFailed(td_ptr->uid());
+  if (task_node_id != 0) {
+    tasks_completed_during_solver_run_.insert(task_node_id);
+  }
   // pod affinity/anti-affinity symmetry
   if (FLAGS_pod_affinity_antiaffinity_symmetry) {
     cost_model_->RemoveTaskFromTaskSymmetryMap(td_ptr);
   }
   if (!td_ptr->scheduled_to_resource().empty()) {
     ResourceID_t res_id = ResourceIDFromString(td_ptr->scheduled_to_resource());
-    cost_model_->UpdateResourceToNamespacesMap(res_id,
-                                           td_ptr->task_namespace(), false);
+    cost_model_->UpdateTopologyDomainCounts(res_id, *td_ptr, false);
   }
   EventDrivenScheduler::HandleTaskFailure(td_ptr);
 }
@@ -473,8 +492,13 @@ void FlowScheduler::HandleTaskMigration(TaskDescriptor* td_ptr,
   // TaskSchedule requires scheduled_to_resource to be up to date.
   // Hence, we have to set it before we call the method.
   td_ptr->set_scheduled_to_resource(rd_ptr->uuid());
-  flow_graph_manager_->TaskMigrated(task_id, old_res_id,
-                                    ResourceIDFromString(rd_ptr->uuid()));
+  ResourceID_t new_res_id = ResourceIDFromString(rd_ptr->uuid());
+  uint64_t task_node_id =
+    flow_graph_manager_->TaskMigrated(task_id, old_res_id, new_res_id);
+  tasks_moved_during_solver_run_.insert(task_node_id);
+  // The task now counts towards the topology domains of its new machine.
+  cost_model_->UpdateTopologyDomainCounts(old_res_id, *td_ptr, false);
+  cost_model_->UpdateTopologyDomainCounts(new_res_id, *td_ptr, true);
   EventDrivenScheduler::HandleTaskMigration(td_ptr, rd_ptr);
 }
 
@@ -507,22 +531,23 @@ void FlowScheduler::HandleTaskPlacement(TaskDescriptor* td_ptr,
       }
     }
   }
-  cost_model_->UpdateResourceToNamespacesMap(res_id,
-                                             td_ptr->task_namespace(), true);
+  cost_model_->UpdateTopologyDomainCounts(res_id, *td_ptr, true);
   EventDrivenScheduler::HandleTaskPlacement(td_ptr, rd_ptr);
 }
 
 void FlowScheduler::HandleTaskRemoval(TaskDescriptor* td_ptr) {
   boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
-  flow_graph_manager_->TaskRemoved(td_ptr->uid());
+  uint64_t task_node_id = flow_graph_manager_->TaskRemoved(td_ptr->uid());
+  if (task_node_id != 0) {
+    tasks_completed_during_solver_run_.insert(task_node_id);
+  }
   // pod affinity/anti-affinity symmetry
   if (FLAGS_pod_affinity_antiaffinity_symmetry) {
     cost_model_->RemoveTaskFromTaskSymmetryMap(td_ptr);
   }
   if (!td_ptr->scheduled_to_resource().empty()) {
     ResourceID_t res_id = ResourceIDFromString(td_ptr->scheduled_to_resource());
-    cost_model_->UpdateResourceToNamespacesMap(res_id,
-                                           td_ptr->task_namespace(), false);
+    cost_model_->UpdateTopologyDomainCounts(res_id, *td_ptr, false);
   }
   EventDrivenScheduler::HandleTaskRemoval(td_ptr);
 }
@@ -530,7 +555,10 @@ void FlowScheduler::HandleTaskRemoval(TaskDescriptor* td_ptr) {
 void FlowScheduler::KillRunningTask(TaskID_t task_id,
                                     TaskKillMessage::TaskKillReason reason) {
   boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
-  flow_graph_manager_->TaskKilled(task_id);
+  uint64_t task_node_id = flow_graph_manager_->TaskKilled(task_id);
+  if (task_node_id != 0) {
+    tasks_completed_during_solver_run_.insert(task_node_id);
+  }
   EventDrivenScheduler::KillRunningTask(task_id, reason);
 }
 
@@ -742,19 +770,27 @@ uint64_t FlowScheduler::ScheduleJobs(const vector<JobDescriptor*>& jd_ptr_vect,
   uint64_t num_scheduled_tasks = 0;
   boost::timer::cpu_timer total_scheduler_timer;
   vector<JobDescriptor*> jds_with_runnables;
+  uint64_t num_new_runnable_tasks = 0;
   for (auto& jd_ptr : jd_ptr_vect) {
     // Check if we have any runnable tasks in this job
     const unordered_set<TaskID_t> runnable_tasks =
       ComputeRunnableTasksForJob(jd_ptr);
     if (runnable_tasks.size() > 0) {
       jds_with_runnables.push_back(jd_ptr);
+      for (auto& task_id : runnable_tasks) {
+        if (!flow_graph_manager_->HasNodeForTaskID(task_id)) {
+          num_new_runnable_tasks++;
+        }
+      }
     }
   }
   // XXX(ionel): HACK! We should only run the scheduler when we have
   // runnable jobs. However, we also run the scheduler when we've
   // set the flowlessly_flip_algorithms flag in order to speed up
   // simulators and make sure different simulations are synchronous.
-  if (jds_with_runnables.size() > 0 ||
+  // In pipelined mode, we also run when a solver run is in flight, so that
+  // its placements are applied.
+  if (jds_with_runnables.size() > 0 || solver_dispatcher_->run_in_flight() ||
       (FLAGS_flowlessly_flip_algorithms &&
        time_manager_->GetCurrentTimestamp() >= SIMULATION_START_TIME)) {
     // First, we update the cost model's resource topology statistics
@@ -766,7 +802,11 @@ uint64_t FlowScheduler::ScheduleJobs(const vector<JobDescriptor*>& jd_ptr_vect,
       // Clear unscheduled tasks related maps and sets.
       cost_model_->ClearUnscheduledTasksData();
     }
-    flow_graph_manager_->AddOrUpdateJobNodes(jds_with_runnables);
+    if (num_new_runnable_tasks >= FLAGS_bulk_job_ingestion_min_tasks) {
+      flow_graph_manager_->AddOrUpdateJobNodesInBulk(jds_with_runnables);
+    } else {
+      flow_graph_manager_->AddOrUpdateJobNodes(jds_with_runnables);
+    }
     num_scheduled_tasks += RunSchedulingIteration(scheduler_stats, deltas, &jds_with_runnables);
     VLOG(1) << "STOP SCHEDULING, placed " << num_scheduled_tasks << " tasks";
     // If we have cost model debug logging turned on, write some debugging
@@ -852,12 +892,32 @@ uint64_t FlowScheduler::RunSchedulingIteration(
     // Periodically remove EC nodes without incoming arcs.
     flow_graph_manager_->PurgeUnconnectedEquivClassNodes();
   }
-  pus_removed_during_solver_run_.clear();
-  tasks_completed_during_solver_run_.clear();
+  // The affinity rounds need the placements of their own solver run.
+  bool pipelined = FLAGS_pipelined_scheduling && !queue_based_schedule &&
+    !affinity_batch_schedule && solver_dispatcher_->SupportsPipelining();
+  if (pipelined && !solver_dispatcher_->run_in_flight()) {
+    // There are no placements to apply in the first pipelined round.
+    StartPipelinedSolverRun();
+    return 0;
+  }
+  if (!pipelined) {
+    if (solver_dispatcher_->run_in_flight()) {
+      // The run below considers the current graph, which supersedes the
+      // graph of the pipelined run in flight.
+      delete solver_dispatcher_->FinishRun(NULL);
+    }
+    pus_removed_during_solver_run_.clear();
+    tasks_completed_during_solver_run_.clear();
+    tasks_moved_during_solver_run_.clear();
+  }
   uint64_t scheduler_start_timestamp = time_manager_->GetCurrentTimestamp();
   // Run the flow solver! This is where all the juicy goodness happens :)
   multimap<uint64_t, uint64_t>* task_mappings;
-  if (!queue_based_schedule) {
+  if (pipelined) {
+    // The run was started at the end of the previous round, and the events
+    // since then are reconciled with its placements below.
+    task_mappings = solver_dispatcher_->FinishRun(scheduler_stats);
+  } else if (!queue_based_schedule) {
     task_mappings = solver_dispatcher_->Run(scheduler_stats);
   } else {
       string id = ((*job_vector)[0])->uuid();
@@ -872,9 +932,17 @@ uint64_t FlowScheduler::RunSchedulingIteration(
                                                                  single_delta);
   }
   solver_run_cnt_++;
-  CHECK_LE(scheduler_stats->scheduler_runtime_, FLAGS_max_solver_runtime)
-    << "Solver took longer than limit of "
-    << scheduler_stats->scheduler_runtime_;
+  if (FLAGS_flow_solver_deadline == 0) {
+    CHECK_LE(scheduler_stats->scheduler_runtime_, FLAGS_max_solver_runtime)
+      << "Solver took longer than limit of "
+      << scheduler_stats->scheduler_runtime_;
+  } else if (scheduler_stats->scheduler_runtime_ > FLAGS_max_solver_runtime) {
+    // With a solver deadline, a slow run falls back to worse scheduling
+    // decisions rather than aborting.
+    LOG(WARNING) << "Solver took " << scheduler_stats->scheduler_runtime_
+                 << " us, longer than the limit of "
+                 << FLAGS_max_solver_runtime << " us";
+  }
   // Play all the simulation events that happened while the solver was running.
   if (event_notifier_) {
     if (solver_run_cnt_ == 1) {
@@ -909,6 +977,28 @@ uint64_t FlowScheduler::RunSchedulingIteration(
   // Solver's done, let's post-process the results.
   multimap<uint64_t, uint64_t>::iterator it;
   vector<SchedulingDelta*> deltas;
+  // The solver's placements of the tasks that were evicted or migrated while
+  // it was running are stale. Evicted tasks are reconsidered in the next
+  // solver run, and migrated tasks stay on the PUs they were moved to.
+  for (auto& task_node_id : tasks_moved_during_solver_run_) {
+    if (tasks_completed_during_solver_run_.find(task_node_id) !=
+        tasks_completed_during_solver_run_.end()) {
+      // The node may have been reused by another task.
+      continue;
+    }
+    VLOG(1) << "Task with node id: " << task_node_id
+            << " was evicted or migrated while the solver was running";
+    task_mappings->erase(task_node_id);
+    const FlowGraphNode& task_node =
+        flow_graph_manager_->node_for_node_id(task_node_id);
+    CHECK_NOTNULL(task_node.td_ptr_);
+    uint64_t pu_node_id =
+      flow_graph_manager_->PUNodeIDForRunningTask(task_node.td_ptr_->uid());
+    if (pu_node_id != 0) {
+      task_mappings->insert(pair<uint64_t, uint64_t>(task_node_id,
+                                                     pu_node_id));
+    }
+  }
   // We first generate the deltas for the preempted tasks in a separate step.
   // Otherwise, we would have to maintain for every ResourceDescriptor the
   // current_running_tasks field which would be expensive because
@@ -996,13 +1086,25 @@ uint64_t FlowScheduler::RunSchedulingIteration(
   deltas.clear();
   time_manager_->UpdateCurrentTimestamp(scheduler_start_timestamp);
   if (FLAGS_update_resource_topology_capacities) {
-    for (auto& rtnd_ptr : resource_roots_) {
-      flow_graph_manager_->UpdateResourceTopology(rtnd_ptr);
-    }
+    flow_graph_manager_->UpdateDirtyResourceTopology();
+  }
+  if (pipelined && !job_vector->empty()) {
+    // Solve the graph including the placements just made while the next
+    // events are handled.
+    StartPipelinedSolverRun();
   }
   return num_scheduled;
 }
 
+void FlowScheduler::StartPipelinedSolverRun() {
+  // The sets collect the tasks and PUs that are removed while the run is
+  // in flight, so that its placements are not applied to them.
+  pus_removed_during_solver_run_.clear();
+  tasks_completed_during_solver_run_.clear();
+  tasks_moved_during_solver_run_.clear();
+  solver_dispatcher_->StartRun();
+}
+
 void FlowScheduler::UpdateCostModelResourceStats() {
   VLOG(2) << "Updating resource statistics in flow graph";
   flow_graph_manager_->ComputeTopologyStatistics(
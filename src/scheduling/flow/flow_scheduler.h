@@ -146,6 +146,7 @@ class FlowScheduler : public EventDrivenScheduler {
   void RegisterRemoteResource(ResourceID_t res_id);
   uint64_t RunSchedulingIteration(SchedulerStats* scheduler_stats,
     vector<SchedulingDelta>* deltas_output, vector<JobDescriptor*>* job_vector);
+  void StartPipelinedSolverRun();
   void UpdateCostModelResourceStats();
   void AddKnowledgeBaseResourceStats(TaskDescriptor* td_ptr,
                                                  ResourceStatus* rs);
@@ -170,10 +171,13 @@ class FlowScheduler : public EventDrivenScheduler {
   // while the solver was running. This set is used to make sure we don't
   // place tasks on PUs that have been removed.
   set<uint64_t> pus_removed_during_solver_run_;
-  // Set of task node ids that have completed while the solver was running.
-  // We use this set to make sure we don't try to place again the completed
-  // tasks.
+  // Set of task node ids that have completed, failed or been removed while
+  // the solver was running. We use this set to make sure we don't try to
+  // place again these tasks, or new tasks that reuse their node ids.
   set<uint64_t> tasks_completed_during_solver_run_;
+  // Set of task node ids that have been evicted or migrated while the solver
+  // was running. The solver's placements of these tasks are stale.
+  set<uint64_t> tasks_moved_during_solver_run_;
   DIMACSChangeStats* dimacs_stats_;
   uint64_t solver_run_cnt_;
   unordered_set<ResourceTopologyNodeDescriptor*> resource_roots_;
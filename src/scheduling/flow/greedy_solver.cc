@@ -0,0 +1,171 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+
+#include "scheduling/flow/greedy_solver.h"
+
+#include <algorithm>
+
+namespace firmament {
+
+// Orders arcs by cost, breaking ties by destination to be deterministic.
+inline bool CheaperArc(const FlowGraphArc* arc1, const FlowGraphArc* arc2) {
+  return arc1->cost_ < arc2->cost_ ||
+    (arc1->cost_ == arc2->cost_ && arc1->dst_ < arc2->dst_);
+}
+
+GreedySolver::GreedySolver() : sink_id_(0) {
+}
+
+bool GreedySolver::FindPath(const FlowGraphNode& task_node,
+                            uint64_t max_path_length) {
+  path_.clear();
+  const FlowGraphNode* node = &task_node;
+  while (true) {
+    if (is_leaf_[node->graph_index_]) {
+      FlowGraphArcMap::const_iterator it =
+        node->outgoing_arc_map_.find(sink_id_);
+      if (it != node->outgoing_arc_map_.end() &&
+          HasSpareCapacity(*it->second)) {
+        path_.push_back(it->second);
+        return true;
+      }
+      is_dead_[node->graph_index_] = true;
+    } else if (path_.size() < max_path_length) {
+      FlowGraphArc* arc = NextArc(*node);
+      if (arc != NULL) {
+        path_.push_back(arc);
+        node = arc->dst_node_;
+        continue;
+      }
+      is_dead_[node->graph_index_] = true;
+    }
+    // Backtrack. The arc the path took into the node is skipped from now
+    // on if the node is dead.
+    if (path_.empty()) {
+      return false;
+    }
+    node = path_.back()->src_node_;
+    path_.pop_back();
+  }
+}
+
+FlowGraphArc* GreedySolver::NextArc(const FlowGraphNode& node) {
+  uint64_t index = node.graph_index_;
+  if (!arcs_sorted_[index]) {
+    SortOutgoingArcs(node);
+  }
+  for (; next_arc_[index] < arc_offsets_[index + 1]; ++next_arc_[index]) {
+    FlowGraphArc* arc = sorted_arcs_[next_arc_[index]];
+    if (HasSpareCapacity(*arc) && !is_dead_[arc->dst_node_->graph_index_]) {
+      return arc;
+    }
+  }
+  return NULL;
+}
+
+void GreedySolver::PlaceTasks(const FlowGraph& graph,
+                              const unordered_set<uint64_t>& leaves,
+                              uint64_t sink_id,
+                              multimap<uint64_t, uint64_t>* task_mappings) {
+  CHECK_NOTNULL(task_mappings);
+  const vector<FlowGraphNode*>& nodes = graph.Nodes();
+  sink_id_ = sink_id;
+  arc_flow_.assign(graph.Arcs().size(), 0);
+  is_leaf_.assign(nodes.size(), false);
+  is_dead_.assign(nodes.size(), false);
+  arcs_sorted_.assign(nodes.size(), false);
+  arc_offsets_.assign(nodes.size() + 1, 0);
+  for (auto& node : nodes) {
+    uint64_t index = node->graph_index_;
+    arc_offsets_[index + 1] = arc_offsets_[index] +
+      node->outgoing_arc_map_.size();
+    if (leaves.find(node->id_) != leaves.end()) {
+      is_leaf_[index] = true;
+    } else if (node->id_ == sink_id ||
+               node->type_ == FlowNodeType::JOB_AGGREGATOR) {
+      // Paths only reach the sink through a leaf, and routing a task to its
+      // unscheduled aggregator would leave it unscheduled anyway.
+      is_dead_[index] = true;
+    }
+  }
+  next_arc_.assign(arc_offsets_.begin(), arc_offsets_.end() - 1);
+  sorted_arcs_.resize(arc_offsets_[nodes.size()]);
+  // Place the running tasks first, so that they are not displaced by tasks
+  // that are waiting to be scheduled.
+  for (uint32_t pass = 0; pass < 2; ++pass) {
+    for (auto& node : nodes) {
+      if (!node->IsTaskNode() || node->td_ptr_ == NULL ||
+          (node->td_ptr_->state() == TaskDescriptor::RUNNING) != (pass == 0)) {
+        continue;
+      }
+      if (pass == 0 && PlaceOnRunningArc(*node)) {
+        task_mappings->insert(
+            pair<uint64_t, uint64_t>(node->id_, path_.back()->src_));
+        continue;
+      }
+      // A path visits every node at most once unless the graph has cycles.
+      if (!is_dead_[node->graph_index_] && FindPath(*node, nodes.size())) {
+        for (auto& arc : path_) {
+          arc_flow_[arc->graph_index_]++;
+        }
+        task_mappings->insert(
+            pair<uint64_t, uint64_t>(node->id_, path_.back()->src_));
+      }
+    }
+  }
+}
+
+bool GreedySolver::PlaceOnRunningArc(const FlowGraphNode& task_node) {
+  for (auto& dst_arc : task_node.outgoing_arc_map_) {
+    FlowGraphArc* arc = dst_arc.second;
+    if (arc->type_ != FlowGraphArcType::RUNNING ||
+        !is_leaf_[arc->dst_node_->graph_index_] || !HasSpareCapacity(*arc)) {
+      continue;
+    }
+    FlowGraphArcMap::const_iterator it =
+      arc->dst_node_->outgoing_arc_map_.find(sink_id_);
+    if (it == arc->dst_node_->outgoing_arc_map_.end() ||
+        !HasSpareCapacity(*it->second)) {
+      continue;
+    }
+    arc_flow_[arc->graph_index_]++;
+    arc_flow_[it->second->graph_index_]++;
+    path_.clear();
+    path_.push_back(arc);
+    path_.push_back(it->second);
+    return true;
+  }
+  return false;
+}
+
+void GreedySolver::SortOutgoingArcs(const FlowGraphNode& node) {
+  uint64_t index = node.graph_index_;
+  vector<FlowGraphArc*>::iterator begin =
+    sorted_arcs_.begin() + arc_offsets_[index];
+  vector<FlowGraphArc*>::iterator it = begin;
+  for (auto& dst_arc : node.outgoing_arc_map_) {
+    *it++ = dst_arc.second;
+  }
+  sort(begin, it, CheaperArc);
+  arcs_sorted_[index] = true;
+}
+
+}  // namespace firmament
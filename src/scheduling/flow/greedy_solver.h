@@ -0,0 +1,87 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+
+// Greedy placement of tasks on the flow graph. It is used instead of the
+// min-cost flow when the solver does not finish by its deadline: every task
+// is routed along the cheapest arcs that still have spare capacity until it
+// reaches a leaf resource. The placement respects the arc capacities, but
+// is not optimal.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_GREEDY_SOLVER_H
+#define FIRMAMENT_SCHEDULING_FLOW_GREEDY_SOLVER_H
+
+#include <map>
+#include <vector>
+
+#include "base/common.h"
+#include "base/types.h"
+#include "scheduling/flow/flow_graph.h"
+
+namespace firmament {
+
+class GreedySolver {
+ public:
+  GreedySolver();
+
+  /**
+   * Places the tasks of the flow graph on leaf resources. Running tasks are
+   * placed first and keep their resource if their running arc still has
+   * capacity. Tasks that cannot reach a leaf stay unscheduled.
+   * @param graph the flow graph
+   * @param leaves the node ids of the leaf resources
+   * @param sink_id the node id of the sink
+   * @param task_mappings the (task node id, leaf node id) pairs are added
+   * to it
+   */
+  void PlaceTasks(const FlowGraph& graph, const unordered_set<uint64_t>& leaves,
+                  uint64_t sink_id, multimap<uint64_t, uint64_t>* task_mappings);
+
+ private:
+  bool FindPath(const FlowGraphNode& task_node, uint64_t max_path_length);
+  bool HasSpareCapacity(const FlowGraphArc& arc) const {
+    return arc_flow_[arc.graph_index_] < arc.cap_upper_bound_;
+  }
+  FlowGraphArc* NextArc(const FlowGraphNode& node);
+  bool PlaceOnRunningArc(const FlowGraphNode& task_node);
+  void SortOutgoingArcs(const FlowGraphNode& node);
+
+  uint64_t sink_id_;
+  // Flow routed along every arc so far; indexed by the arc's graph index.
+  vector<uint64_t> arc_flow_;
+  // The following are indexed by the nodes' graph indices. A node is dead
+  // once no path with spare capacity leads from it to the sink. Since
+  // capacity is only ever used up, a dead node stays dead.
+  vector<uint8_t> is_leaf_;
+  vector<uint8_t> is_dead_;
+  // The outgoing arcs of node n, sorted by cost once n is first visited,
+  // are at positions [arc_offsets_[n], arc_offsets_[n + 1]) of sorted_arcs_.
+  // The arcs before next_arc_[n] are full or lead to dead nodes.
+  vector<uint64_t> arc_offsets_;
+  vector<uint64_t> next_arc_;
+  vector<uint8_t> arcs_sorted_;
+  vector<FlowGraphArc*> sorted_arcs_;
+  // Arcs of the path currently being explored.
+  vector<FlowGraphArc*> path_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_GREEDY_SOLVER_H
@@ -0,0 +1,139 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the greedy task placement used when the solver misses its
+// deadline.
+
+#include <gtest/gtest.h>
+
+#include <map>
+
+#include "base/common.h"
+#include "base/task_desc.pb.h"
+#include "scheduling/flow/flow_graph.h"
+#include "scheduling/flow/greedy_solver.h"
+
+namespace firmament {
+
+// The fixture for testing the GreedySolver class.
+class GreedySolverTest : public ::testing::Test {
+ protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  GreedySolverTest() {
+    // You can do set-up work for each test here.
+  }
+
+  virtual ~GreedySolverTest() {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  virtual void SetUp() {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+  }
+
+  virtual void TearDown() {
+    // Code here will be called immediately after the test (right
+    // before the destructor).
+  }
+
+  FlowGraphArc* AddArc(FlowGraph* graph, FlowGraphNode* src,
+                       FlowGraphNode* dst, uint64_t cap_upper_bound,
+                       int64_t cost) {
+    FlowGraphArc* arc = graph->AddArc(src, dst);
+    graph->ChangeArc(arc, 0, cap_upper_bound, cost);
+    return arc;
+  }
+
+  FlowGraphNode* AddNode(FlowGraph* graph, FlowNodeType type) {
+    FlowGraphNode* node = graph->AddNode();
+    node->type_ = type;
+    return node;
+  }
+
+  FlowGraphNode* AddTaskNode(FlowGraph* graph, TaskDescriptor* td_ptr,
+                             TaskDescriptor::TaskState state) {
+    td_ptr->set_state(state);
+    FlowGraphNode* node = AddNode(graph, FlowNodeType::UNSCHEDULED_TASK);
+    node->td_ptr_ = td_ptr;
+    node->excess_ = 1;
+    return node;
+  }
+
+  // Objects declared here can be used by all tests in the test case for
+  // GreedySolver.
+};
+
+TEST_F(GreedySolverTest, PlaceTasks) {
+  FlowGraph graph;
+  TaskDescriptor running_td;
+  TaskDescriptor td1;
+  TaskDescriptor td2;
+  FlowGraphNode* sink = AddNode(&graph, FlowNodeType::SINK);
+  FlowGraphNode* unsched_agg = AddNode(&graph, FlowNodeType::JOB_AGGREGATOR);
+  FlowGraphNode* ec = AddNode(&graph, FlowNodeType::EQUIVALENCE_CLASS);
+  FlowGraphNode* machine = AddNode(&graph, FlowNodeType::MACHINE);
+  FlowGraphNode* pu1 = AddNode(&graph, FlowNodeType::PU);
+  FlowGraphNode* pu2 = AddNode(&graph, FlowNodeType::PU);
+  // The running task is added last, but it is placed first.
+  FlowGraphNode* task1 = AddTaskNode(&graph, &td1, TaskDescriptor::RUNNABLE);
+  FlowGraphNode* task2 = AddTaskNode(&graph, &td2, TaskDescriptor::RUNNABLE);
+  FlowGraphNode* running_task =
+    AddTaskNode(&graph, &running_td, TaskDescriptor::RUNNING);
+  AddArc(&graph, unsched_agg, sink, 3, 0);
+  AddArc(&graph, ec, machine, 2, 1);
+  AddArc(&graph, machine, pu1, 1, 5);
+  AddArc(&graph, machine, pu2, 1, 0);
+  AddArc(&graph, pu1, sink, 1, 0);
+  AddArc(&graph, pu2, sink, 1, 0);
+  AddArc(&graph, task1, ec, 1, 1);
+  AddArc(&graph, task2, ec, 1, 1);
+  // The unscheduled aggregators are cheaper, but the tasks must not be
+  // routed through them.
+  AddArc(&graph, task1, unsched_agg, 1, 0);
+  AddArc(&graph, task2, unsched_agg, 1, 0);
+  AddArc(&graph, running_task, unsched_agg, 1, 0);
+  FlowGraphArc* running_arc = AddArc(&graph, running_task, pu2, 1, 10);
+  running_arc->type_ = FlowGraphArcType::RUNNING;
+  unordered_set<uint64_t> leaves;
+  leaves.insert(pu1->id_);
+  leaves.insert(pu2->id_);
+  GreedySolver solver;
+  multimap<uint64_t, uint64_t> task_mappings;
+  solver.PlaceTasks(graph, leaves, sink->id_, &task_mappings);
+  // The running task keeps its PU, task1 gets the other PU, and there is no
+  // capacity left for task2.
+  ASSERT_EQ(task_mappings.size(), 2);
+  EXPECT_EQ(task_mappings.find(running_task->id_)->second, pu2->id_);
+  EXPECT_EQ(task_mappings.find(task1->id_)->second, pu1->id_);
+  EXPECT_TRUE(task_mappings.find(task2->id_) == task_mappings.end());
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
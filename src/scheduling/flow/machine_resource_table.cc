@@ -0,0 +1,217 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/flow/machine_resource_table.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define FIRMAMENT_HAVE_AVX2_KERNEL
+#endif
+
+#include "misc/map-util.h"
+
+namespace firmament {
+
+void MachineResourceTable::AddOrUpdateMachine(ResourceID_t res_id,
+                                              const ResourceDescriptor& rd) {
+  size_t* row_ptr = FindOrNull(machine_to_row_, res_id);
+  if (row_ptr) {
+    SetRow(*row_ptr, rd);
+    return;
+  }
+  size_t row = row_to_machine_.size();
+  InsertIfNotPresent(&machine_to_row_, res_id, row);
+  row_to_machine_.push_back(res_id);
+  cpu_capacity_.push_back(0.0);
+  cpu_available_.push_back(0.0);
+  ram_capacity_.push_back(0);
+  ram_available_.push_back(0);
+  ephemeral_storage_capacity_.push_back(0);
+  ephemeral_storage_available_.push_back(0);
+  SetRow(row, rd);
+}
+
+int64_t MachineResourceTable::FindRow(ResourceID_t res_id) const {
+  const size_t* row_ptr = FindOrNull(machine_to_row_, res_id);
+  if (!row_ptr) {
+    return -1;
+  }
+  return static_cast<int64_t>(*row_ptr);
+}
+
+void MachineResourceTable::RemoveMachine(ResourceID_t res_id) {
+  size_t* row_ptr = FindOrNull(machine_to_row_, res_id);
+  if (!row_ptr) {
+    return;
+  }
+  size_t row = *row_ptr;
+  size_t last_row = row_to_machine_.size() - 1;
+  if (row != last_row) {
+    ResourceID_t last_res_id = row_to_machine_[last_row];
+    row_to_machine_[row] = last_res_id;
+    cpu_capacity_[row] = cpu_capacity_[last_row];
+    cpu_available_[row] = cpu_available_[last_row];
+    ram_capacity_[row] = ram_capacity_[last_row];
+    ram_available_[row] = ram_available_[last_row];
+    ephemeral_storage_capacity_[row] = ephemeral_storage_capacity_[last_row];
+    ephemeral_storage_available_[row] =
+      ephemeral_storage_available_[last_row];
+    machine_to_row_[last_res_id] = row;
+  }
+  machine_to_row_.erase(res_id);
+  row_to_machine_.pop_back();
+  cpu_capacity_.pop_back();
+  cpu_available_.pop_back();
+  ram_capacity_.pop_back();
+  ram_available_.pop_back();
+  ephemeral_storage_capacity_.pop_back();
+  ephemeral_storage_available_.pop_back();
+}
+
+void MachineResourceTable::SetRow(size_t row, const ResourceDescriptor& rd) {
+  cpu_capacity_[row] = rd.resource_capacity().cpu_cores();
+  cpu_available_[row] = rd.available_resources().cpu_cores();
+  ram_capacity_[row] = rd.resource_capacity().ram_cap();
+  ram_available_[row] = rd.available_resources().ram_cap();
+  ephemeral_storage_capacity_[row] =
+    rd.resource_capacity().ephemeral_storage();
+  ephemeral_storage_available_[row] =
+    rd.available_resources().ephemeral_storage();
+}
+
+void MachineResourceTable::UpdateMachine(ResourceID_t res_id,
+                                         const ResourceDescriptor& rd) {
+  size_t* row_ptr = FindOrNull(machine_to_row_, res_id);
+  if (row_ptr) {
+    SetRow(*row_ptr, rd);
+  }
+}
+
+size_t ResourceCostBatch::AddArc(const MachineResourceTable& table,
+                                 size_t row, uint64_t cpu_request,
+                                 uint64_t ram_request, uint64_t num_tasks) {
+  // The resources left are truncated to whole units before the fractions are
+  // taken, as the per-arc cost computation has always done.
+  uint64_t cpu_left = table.cpu_available(row) - num_tasks * cpu_request;
+  uint64_t ram_left = table.ram_available(row) - num_tasks * ram_request;
+  cpu_used_.push_back(table.cpu_capacity(row) - cpu_left);
+  cpu_capacity_.push_back(table.cpu_capacity(row));
+  ram_used_.push_back(table.ram_capacity(row) - ram_left);
+  ram_capacity_.push_back(table.ram_capacity(row));
+  return cpu_used_.size() - 1;
+}
+
+void ResourceCostBatch::Clear() {
+  cpu_used_.clear();
+  cpu_capacity_.clear();
+  ram_used_.clear();
+  ram_capacity_.clear();
+}
+
+void ResourceCostBatch::Compute(float omega) {
+  size_t num_arcs = NumArcs();
+  cpu_costs_.resize(num_arcs);
+  ram_costs_.resize(num_arcs);
+  balanced_costs_.resize(num_arcs);
+  if (num_arcs == 0) {
+    return;
+  }
+  ComputeResourceCosts(&cpu_used_[0], &cpu_capacity_[0], &ram_used_[0],
+                       &ram_capacity_[0], num_arcs, omega, &cpu_costs_[0],
+                       &ram_costs_[0], &balanced_costs_[0]);
+}
+
+void ComputeResourceCostsScalar(const float* cpu_used,
+                                const float* cpu_capacity,
+                                const float* ram_used,
+                                const float* ram_capacity, size_t num_arcs,
+                                float omega, float* cpu_costs,
+                                float* ram_costs, float* balanced_costs) {
+  for (size_t i = 0; i < num_arcs; ++i) {
+    float cpu_fraction = cpu_used[i] / cpu_capacity[i];
+    float ram_fraction = ram_used[i] / ram_capacity[i];
+    cpu_costs[i] = cpu_fraction * omega;
+    ram_costs[i] = ram_fraction * omega;
+    float mean = (cpu_fraction + ram_fraction) / 2.0f;
+    float cpu_deviation = cpu_fraction - mean;
+    float ram_deviation = ram_fraction - mean;
+    float variance = (cpu_deviation * cpu_deviation +
+                      ram_deviation * ram_deviation) / 2.0f;
+    balanced_costs[i] = variance * omega;
+  }
+}
+
+#ifdef FIRMAMENT_HAVE_AVX2_KERNEL
+// Performs the same IEEE operations as ComputeResourceCostsScalar, in the same
+// order and without fused multiply-adds, eight arcs at a time.
+__attribute__((target("avx2")))
+static void ComputeResourceCostsAVX2(const float* cpu_used,
+                                     const float* cpu_capacity,
+                                     const float* ram_used,
+                                     const float* ram_capacity,
+                                     size_t num_arcs, float omega,
+                                     float* cpu_costs, float* ram_costs,
+                                     float* balanced_costs) {
+  const __m256 omega_vec = _mm256_set1_ps(omega);
+  const __m256 two = _mm256_set1_ps(2.0f);
+  size_t i = 0;
+  for (; i + 8 <= num_arcs; i += 8) {
+    __m256 cpu_fraction = _mm256_div_ps(_mm256_loadu_ps(cpu_used + i),
+                                        _mm256_loadu_ps(cpu_capacity + i));
+    __m256 ram_fraction = _mm256_div_ps(_mm256_loadu_ps(ram_used + i),
+                                        _mm256_loadu_ps(ram_capacity + i));
+    _mm256_storeu_ps(cpu_costs + i, _mm256_mul_ps(cpu_fraction, omega_vec));
+    _mm256_storeu_ps(ram_costs + i, _mm256_mul_ps(ram_fraction, omega_vec));
+    __m256 mean = _mm256_div_ps(_mm256_add_ps(cpu_fraction, ram_fraction),
+                                two);
+    __m256 cpu_deviation = _mm256_sub_ps(cpu_fraction, mean);
+    __m256 ram_deviation = _mm256_sub_ps(ram_fraction, mean);
+    __m256 variance = _mm256_div_ps(
+        _mm256_add_ps(_mm256_mul_ps(cpu_deviation, cpu_deviation),
+                      _mm256_mul_ps(ram_deviation, ram_deviation)),
+        two);
+    _mm256_storeu_ps(balanced_costs + i, _mm256_mul_ps(variance, omega_vec));
+  }
+  ComputeResourceCostsScalar(cpu_used + i, cpu_capacity + i, ram_used + i,
+                             ram_capacity + i, num_arcs - i, omega,
+                             cpu_costs + i, ram_costs + i,
+                             balanced_costs + i);
+}
+#endif
+
+void ComputeResourceCosts(const float* cpu_used, const float* cpu_capacity,
+                          const float* ram_used, const float* ram_capacity,
+                          size_t num_arcs, float omega, float* cpu_costs,
+                          float* ram_costs, float* balanced_costs) {
+#ifdef FIRMAMENT_HAVE_AVX2_KERNEL
+  static const bool kHaveAVX2 = __builtin_cpu_supports("avx2");
+  if (kHaveAVX2) {
+    ComputeResourceCostsAVX2(cpu_used, cpu_capacity, ram_used, ram_capacity,
+                             num_arcs, omega, cpu_costs, ram_costs,
+                             balanced_costs);
+    return;
+  }
+#endif
+  ComputeResourceCostsScalar(cpu_used, cpu_capacity, ram_used, ram_capacity,
+                             num_arcs, omega, cpu_costs, ram_costs,
+                             balanced_costs);
+}
+
+}  // namespace firmament
@@ -0,0 +1,143 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Structure-of-arrays table of the machines' resource capacity and
+// availability, and a vectorized kernel that computes the least requested
+// and balanced resource allocation costs of many arcs at once.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_MACHINE_RESOURCE_TABLE_H
+#define FIRMAMENT_SCHEDULING_FLOW_MACHINE_RESOURCE_TABLE_H
+
+#include <vector>
+
+#include "base/common.h"
+#include "base/resource_desc.pb.h"
+#include "base/types.h"
+
+namespace firmament {
+
+class MachineResourceTable {
+ public:
+  /**
+   * Adds a row for the machine, or refreshes its row if it already has one.
+   */
+  void AddOrUpdateMachine(ResourceID_t res_id, const ResourceDescriptor& rd);
+  /**
+   * Returns the machine's row, or -1 if the machine is not in the table.
+   */
+  int64_t FindRow(ResourceID_t res_id) const;
+  /**
+   * Removes the machine's row. The last row takes its place.
+   */
+  void RemoveMachine(ResourceID_t res_id);
+  /**
+   * Refreshes the machine's row if the machine is in the table.
+   */
+  void UpdateMachine(ResourceID_t res_id, const ResourceDescriptor& rd);
+  inline size_t NumRows() const {
+    return row_to_machine_.size();
+  }
+  inline float cpu_capacity(size_t row) const {
+    return cpu_capacity_[row];
+  }
+  inline float cpu_available(size_t row) const {
+    return cpu_available_[row];
+  }
+  inline uint64_t ram_capacity(size_t row) const {
+    return ram_capacity_[row];
+  }
+  inline uint64_t ram_available(size_t row) const {
+    return ram_available_[row];
+  }
+  inline uint64_t ephemeral_storage_capacity(size_t row) const {
+    return ephemeral_storage_capacity_[row];
+  }
+  inline uint64_t ephemeral_storage_available(size_t row) const {
+    return ephemeral_storage_available_[row];
+  }
+
+ private:
+  void SetRow(size_t row, const ResourceDescriptor& rd);
+
+  unordered_map<ResourceID_t, size_t, boost::hash<ResourceID_t>>
+    machine_to_row_;
+  vector<ResourceID_t> row_to_machine_;
+  vector<float> cpu_capacity_;
+  vector<float> cpu_available_;
+  vector<uint64_t> ram_capacity_;
+  vector<uint64_t> ram_available_;
+  vector<uint64_t> ephemeral_storage_capacity_;
+  vector<uint64_t> ephemeral_storage_available_;
+};
+
+// The inputs and outputs of ComputeResourceCosts for a batch of arcs from a
+// task EC to machines.
+struct ResourceCostBatch {
+  /**
+   * Adds an arc that places num_tasks tasks, each with the given CPU and RAM
+   * request, on the machine in the table row. Returns the arc's position in
+   * the batch.
+   */
+  size_t AddArc(const MachineResourceTable& table, size_t row,
+                uint64_t cpu_request, uint64_t ram_request,
+                uint64_t num_tasks);
+  void Clear();
+  /**
+   * Fills in the costs of all the arcs in the batch.
+   */
+  void Compute(float omega);
+  inline size_t NumArcs() const {
+    return cpu_used_.size();
+  }
+
+  vector<float> cpu_used_;
+  vector<float> cpu_capacity_;
+  vector<float> ram_used_;
+  vector<float> ram_capacity_;
+  vector<float> cpu_costs_;
+  vector<float> ram_costs_;
+  vector<float> balanced_costs_;
+};
+
+/**
+ * Computes the least requested and balanced resource allocation costs of
+ * num_arcs arcs, before they are truncated to integers. The CPU and RAM
+ * fractions of arc i are cpu_used[i] / cpu_capacity[i] and
+ * ram_used[i] / ram_capacity[i]. Uses AVX2 if the CPU supports it; the
+ * results are identical to those of ComputeResourceCostsScalar.
+ * @param omega the cost of a fully used resource
+ * @param cpu_costs set to the CPU fraction times omega
+ * @param ram_costs set to the RAM fraction times omega
+ * @param balanced_costs set to the variance of the fractions times omega
+ */
+void ComputeResourceCosts(const float* cpu_used, const float* cpu_capacity,
+                          const float* ram_used, const float* ram_capacity,
+                          size_t num_arcs, float omega, float* cpu_costs,
+                          float* ram_costs, float* balanced_costs);
+void ComputeResourceCostsScalar(const float* cpu_used,
+                                const float* cpu_capacity,
+                                const float* ram_used,
+                                const float* ram_capacity, size_t num_arcs,
+                                float omega, float* cpu_costs,
+                                float* ram_costs, float* balanced_costs);
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_MACHINE_RESOURCE_TABLE_H
@@ -0,0 +1,89 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "misc/utils.h"
+#include "scheduling/flow/machine_resource_table.h"
+
+namespace firmament {
+
+class MachineResourceTableTest : public ::testing::Test {
+ protected:
+  ResourceID_t AddMachine(const string& machine_name, float cpu_available,
+                          uint64_t ram_available) {
+    ResourceID_t res_id = GenerateResourceID(machine_name);
+    ResourceDescriptor rd;
+    rd.mutable_resource_capacity()->set_cpu_cores(1000.0);
+    rd.mutable_resource_capacity()->set_ram_cap(32000);
+    rd.mutable_available_resources()->set_cpu_cores(cpu_available);
+    rd.mutable_available_resources()->set_ram_cap(ram_available);
+    table_.AddOrUpdateMachine(res_id, rd);
+    return res_id;
+  }
+
+  MachineResourceTable table_;
+};
+
+TEST_F(MachineResourceTableTest, RemoveMachine) {
+  ResourceID_t machine1 = AddMachine("Machine1", 100.0, 1000);
+  ResourceID_t machine2 = AddMachine("Machine2", 200.0, 2000);
+  ResourceID_t machine3 = AddMachine("Machine3", 300.0, 3000);
+  EXPECT_EQ(3U, table_.NumRows());
+  // The last row takes the place of the removed one.
+  table_.RemoveMachine(machine1);
+  EXPECT_EQ(2U, table_.NumRows());
+  EXPECT_EQ(-1, table_.FindRow(machine1));
+  EXPECT_EQ(0, table_.FindRow(machine3));
+  EXPECT_FLOAT_EQ(300.0, table_.cpu_available(0));
+  EXPECT_EQ(3000U, table_.ram_available(0));
+  EXPECT_EQ(2000U, table_.ram_available(table_.FindRow(machine2)));
+}
+
+TEST_F(MachineResourceTableTest, BatchMatchesScalarCosts) {
+  // Use a number of arcs that is not a multiple of the vector width.
+  ResourceCostBatch batch;
+  for (uint64_t index = 0; index < 37; ++index) {
+    AddMachine("Machine" + to_string(index), 1000.0 - index * 13.7,
+               32000 - index * 731);
+    batch.AddArc(table_, index, 10, 100, index % 5);
+  }
+  batch.Compute(1000.0);
+  size_t num_arcs = batch.NumArcs();
+  vector<float> cpu_costs(num_arcs);
+  vector<float> ram_costs(num_arcs);
+  vector<float> balanced_costs(num_arcs);
+  ComputeResourceCostsScalar(&batch.cpu_used_[0], &batch.cpu_capacity_[0],
+                             &batch.ram_used_[0], &batch.ram_capacity_[0],
+                             num_arcs, 1000.0, &cpu_costs[0], &ram_costs[0],
+                             &balanced_costs[0]);
+  for (size_t arc = 0; arc < num_arcs; ++arc) {
+    EXPECT_EQ(cpu_costs[arc], batch.cpu_costs_[arc]);
+    EXPECT_EQ(ram_costs[arc], batch.ram_costs_[arc]);
+    EXPECT_EQ(balanced_costs[arc], batch.balanced_costs_[arc]);
+  }
+}
+
+}  // namespace firmament
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -55,11 +55,14 @@ class MockCostModel : public CostModelInterface {
   MOCK_METHOD1(AddTask, void(TaskID_t task_id));
   MOCK_METHOD1(RemoveMachine, void(ResourceID_t res_id));
   MOCK_METHOD1(RemoveTask, void(TaskID_t task_id));
+  MOCK_METHOD1(RemoveEquivClass, void(EquivClass_t ec));
   MOCK_METHOD2(GatherStats,
                FlowGraphNode*(FlowGraphNode* acc, FlowGraphNode* other));
   MOCK_METHOD1(PrepareStats, void(FlowGraphNode* acc));
   MOCK_METHOD2(UpdateStats,
                FlowGraphNode*(FlowGraphNode* acc, FlowGraphNode* other));
+  MOCK_CONST_METHOD0(IsThreadSafe, bool());
+  MOCK_CONST_METHOD0(SupportsArcCostCache, bool());
 };
 
 }  // namespace firmament
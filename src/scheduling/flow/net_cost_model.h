@@ -69,6 +69,12 @@ class NetCostModel : public CostModelInterface {
   FlowGraphNode* GatherStats(FlowGraphNode* accumulator, FlowGraphNode* other);
   void PrepareStats(FlowGraphNode* accumulator);
   FlowGraphNode* UpdateStats(FlowGraphNode* accumulator, FlowGraphNode* other);
+  bool IsThreadSafe() const {
+    return true;
+  }
+  bool SupportsArcCostCache() const {
+    return true;
+  }
 
  private:
   EquivClass_t GetMachineEC(const string& machine_name, uint64_t ec_index);
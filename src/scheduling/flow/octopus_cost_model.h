@@ -63,6 +63,12 @@ class OctopusCostModel : public CostModelInterface {
   FlowGraphNode* GatherStats(FlowGraphNode* accumulator, FlowGraphNode* other);
   void PrepareStats(FlowGraphNode* accumulator);
   FlowGraphNode* UpdateStats(FlowGraphNode* accumulator, FlowGraphNode* other);
+  bool IsThreadSafe() const {
+    return true;
+  }
+  bool SupportsArcCostCache() const {
+    return true;
+  }
 
  private:
   // Cost to cluster aggregator EC
@@ -20,24 +20,30 @@
 
 #include "scheduling/flow/solver_dispatcher.h"
 
+#include <errno.h>
 #include <sys/stat.h>
 #include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
 #include <utility>
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread/thread_time.hpp>
 #include <boost/timer/timer.hpp>
 
 #include "base/common.h"
 #include "base/units.h"
 #include "misc/string_utils.h"
 #include "misc/utils.h"
+#include "scheduling/flow/dimacs_binary_format.h"
 
 DEFINE_bool(debug_flow_graph, false, "Write out a debug copy of the scheduling"
             " flow graph to the debug directory.");
 DEFINE_string(flow_scheduling_solver, "cs2",
               "Solver to use for flow network optimization. Possible values:"
               "\"cs2\": Goldberg solver, \"flowlessly\": local Flowlessly "
-              "solver reimplementation; \"custom\": specify custom solver. "
+              "solver reimplementation; \"inproc\": in-process cost scaling "
+              "solver; \"custom\": specify custom solver. "
               "with -flow_scheduling_binary and -flow_scheduling_args.");
 DEFINE_string(flow_scheduling_binary, "", "Path to flow solving executable. "
               "If specified, overrides default path. "
@@ -69,6 +75,29 @@ DEFINE_bool(flowlessly_run_cost_scaling_and_relax, false, "True if Flowlessly "
             "should run both algorithms");
 DEFINE_int64(flowlessly_alpha_factor, 9, "Alpha factor to be used by "
              "Flowlessly's cost scaling");
+DEFINE_bool(flow_solver_dense_node_ids, true, "Renumber the nodes to the "
+            "dense range [1, number of live nodes] when the full flow graph "
+            "is sent to a solver, and map the results back. Only applies if "
+            "the graph is not updated incrementally.");
+DEFINE_string(flow_solver_portfolio, "", "Comma-separated list of solvers "
+              "to race against each other on every run, e.g. "
+              "\"cs2,flowlessly:relax,flowlessly:fast_cost_scaling\". An "
+              "entry is a solver name, optionally followed by the Flowlessly "
+              "algorithm to use. The result of the first solver to finish is "
+              "used and the other solvers are killed. Overrides "
+              "-flow_scheduling_solver; requires -incremental_flow=false.");
+DEFINE_uint64(flow_solver_deadline, 0, "Maximum time in microseconds a "
+              "solver run may take; 0 means no limit. The in-process solver "
+              "stops with the best feasible flow found by the deadline, if "
+              "it has found one. External solvers are killed when they miss "
+              "the deadline. Without a flow, the tasks are placed greedily.");
+DEFINE_bool(flowlessly_binary_protocol, false, "True if graphs and flows "
+            "should be exchanged with Flowlessly in the compact binary format "
+            "instead of DIMACS text. Requires a Flowlessly binary that "
+            "accepts --binary_protocol=true and implements the format in "
+            "dimacs_binary_format.h; the bundled builds are not known to, "
+            "and the scheduler refuses to start if the binary does not "
+            "accept the flag.");
 
 namespace firmament {
 namespace scheduler {
@@ -80,9 +109,14 @@ using boost::token_compress_on;
 SolverDispatcher::SolverDispatcher(
     shared_ptr<FlowGraphManager> flow_graph_manager,
     bool solver_ran_once)
-  : flow_graph_manager_(flow_graph_manager),
+  : flow_graph_manager_(flow_graph_manager), exported_num_nodes_(0),
+    exported_sink_(0), solver_task_mappings_(NULL),
     solver_ran_once_(solver_ran_once),
-    debug_seq_num_(0), to_solver_(NULL), from_solver_(NULL),
+    debug_seq_num_(0), num_missed_deadlines_(0), num_infeasible_runs_(0),
+    solver_finished_(false),
+    solver_missed_deadline_(false), solver_pid_(0), run_in_flight_(false),
+    solver_output_complete_(false), algorithm_runtime_(0),
+    solver_runtime_(0), to_solver_(NULL), from_solver_(NULL),
     from_solver_stderr_(NULL) {
   // Set up debug directory if it doesn't exist
   struct stat st;
@@ -96,13 +130,25 @@ SolverDispatcher::SolverDispatcher(
     int64_t ret = system(cmd.c_str());
     CHECK(WIFEXITED(ret));
   }
+  if (!FLAGS_flow_solver_portfolio.empty()) {
+    SetUpPortfolio();
+  } else if (FLAGS_flowlessly_binary_protocol) {
+    CheckBinaryProtocolSupport();
+  }
 }
 
 SolverDispatcher::~SolverDispatcher() {
+  if (run_in_flight_) {
+    delete FinishRun(NULL);
+  }
   if (to_solver_ != NULL) {
     // Print EOS to Make sure the solver closes gracefully when running
     // in daemon mode.
-    fprintf(to_solver_, "c EOS\n");
+    if (FLAGS_flowlessly_binary_protocol) {
+      fputc(BINARY_RECORD_END_OF_STREAM, to_solver_);
+    } else {
+      fprintf(to_solver_, "c EOS\n");
+    }
     fflush(to_solver_);
     CHECK_EQ(fclose(to_solver_), 0);
   }
@@ -114,27 +160,102 @@ SolverDispatcher::~SolverDispatcher() {
   }
 }
 
+// Rejects -flowlessly_binary_protocol at startup, rather than on the first
+// solver run, unless the solver binary accepts --binary_protocol=true.
+// Flowlessly parses its flags with gflags, which exits with an error on an
+// unknown flag before it handles --version.
+void SolverDispatcher::CheckBinaryProtocolSupport() {
+  if (FLAGS_flow_scheduling_solver != "flowlessly") {
+    LOG(FATAL) << "-flowlessly_binary_protocol requires "
+               << "-flow_scheduling_solver=flowlessly";
+  }
+  string binary;
+  vector<string> args;
+  SolverConfiguration(FLAGS_flow_scheduling_solver, FLAGS_flowlessly_algorithm,
+                      &binary, &args);
+  string cmd;
+  spf(&cmd, "%s --binary_protocol=true --version > /dev/null 2>&1",
+      binary.c_str());
+  int64_t ret = system(cmd.c_str());
+  if (!WIFEXITED(ret) || WEXITSTATUS(ret) != 0) {
+    LOG(FATAL) << "-flowlessly_binary_protocol is set, but the solver binary "
+               << binary << " does not accept --binary_protocol=true. Set "
+               << "-flowlessly_binary to a Flowlessly build that implements "
+               << "dimacs_binary_format.h, or unset the flag.";
+  }
+}
+
 void SolverDispatcher::ExportJSON(string* output) const {
   return json_exporter_.Export(
       flow_graph_manager_->flow_graph_change_manager()->flow_graph(), output);
 }
 
+// Makes writes to a pipe whose reader has gone away fail with EPIPE in the
+// calling thread, rather than raise SIGPIPE, which would terminate the
+// scheduler. Solvers that miss their deadline or lose a portfolio race are
+// killed, possibly before they have read their whole input.
+void BlockSigpipe() {
+  sigset_t sigpipe_set;
+  sigemptyset(&sigpipe_set);
+  sigaddset(&sigpipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe_set, NULL);
+}
+
 void *ExportToSolver(void *x) {
   SolverDispatcher* solver_dispatcher = reinterpret_cast<SolverDispatcher*>(x);
+  BlockSigpipe();
   solver_dispatcher->ExportGraph(solver_dispatcher->to_solver_);
   solver_dispatcher->flow_graph_manager_->
     flow_graph_change_manager()->ResetChanges();
-  if (fflush(solver_dispatcher->to_solver_)) {
-    PLOG(FATAL) << "Error while flushing";
+  // A solver that has crashed cannot be written to. Its output is then
+  // incomplete, and the run falls back to placing the tasks greedily.
+  if (fflush(solver_dispatcher->to_solver_) &&
+      !solver_dispatcher->SolverMissedDeadline()) {
+    PLOG(ERROR) << "Error while flushing";
   }
   if (!FLAGS_incremental_flow) {
     // We need to close the stream because that's what cs expects.
-    CHECK_EQ(fclose(solver_dispatcher->to_solver_), 0);
+    if (fclose(solver_dispatcher->to_solver_) &&
+        !solver_dispatcher->SolverMissedDeadline()) {
+      PLOG(ERROR) << "Error while closing the solver's input";
+    }
     solver_dispatcher->to_solver_ = NULL;
   }
   return NULL;
 }
 
+void *EnforceSolverDeadline(void *x) {
+  SolverDispatcher* solver_dispatcher = reinterpret_cast<SolverDispatcher*>(x);
+  boost::system_time deadline = boost::get_system_time() +
+    boost::posix_time::microseconds(FLAGS_flow_solver_deadline);
+  boost::unique_lock<boost::mutex> lock(solver_dispatcher->deadline_lock_);
+  while (!solver_dispatcher->solver_finished_) {
+    if (!solver_dispatcher->deadline_cond_.timed_wait(lock, deadline)) {
+      if (!solver_dispatcher->solver_finished_) {
+        // Killing the solver closes its output, which ends the read.
+        solver_dispatcher->solver_missed_deadline_ = true;
+        kill(solver_dispatcher->solver_pid_, SIGKILL);
+        // The killed solver's output is incomplete and is not used.
+        solver_dispatcher->solver_output_parser_.Stop();
+      }
+      break;
+    }
+  }
+  return NULL;
+}
+
+void *ReadSolverOutput(void *x) {
+  SolverDispatcher* solver_dispatcher = reinterpret_cast<SolverDispatcher*>(x);
+  solver_dispatcher->ReadOutput(&solver_dispatcher->algorithm_runtime_);
+  boost::lock_guard<boost::mutex> lock(solver_dispatcher->deadline_lock_);
+  solver_dispatcher->solver_runtime_ =
+    static_cast<uint64_t>(solver_dispatcher->solver_timer_.elapsed().wall) /
+    NANOSECONDS_IN_MICROSECOND;
+  solver_dispatcher->solver_finished_ = true;
+  solver_dispatcher->deadline_cond_.notify_all();
+  return NULL;
+}
+
 void *ProcessStderrJustlog(void *x) {
   char line[1024];
   FILE *stderr = reinterpret_cast<FILE*>(x);
@@ -146,6 +267,45 @@ void *ProcessStderrJustlog(void *x) {
   return NULL;
 }
 
+void *WriteGraphToPortfolioSolver(void *x) {
+  PortfolioSolver* solver = reinterpret_cast<PortfolioSolver*>(x);
+  BlockSigpipe();
+  const char* graph = solver->to_solver_graph_;
+  size_t remaining = solver->to_solver_graph_size_;
+  while (remaining > 0) {
+    ssize_t num_written = write(solver->infd_[1], graph, remaining);
+    if (num_written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      VLOG(1) << "Stopped writing the graph to solver " << solver->name_;
+      break;
+    }
+    graph += num_written;
+    remaining -= static_cast<size_t>(num_written);
+  }
+  // The solvers only start once their input has been closed.
+  CHECK_EQ(close(solver->infd_[1]), 0);
+  return NULL;
+}
+
+void *ReadPortfolioSolverOutput(void *x) {
+  PortfolioSolver* solver = reinterpret_cast<PortfolioSolver*>(x);
+  bool succeeded;
+  if (FLAGS_only_read_assignment_changes) {
+    succeeded = solver->output_parser_.ReadTaskMappings(
+        &solver->task_mappings_, &solver->algorithm_runtime_);
+  } else {
+    succeeded = solver->output_parser_.ReadFlow(
+        &solver->extracted_flow_, &solver->algorithm_runtime_, NULL);
+  }
+  boost::lock_guard<boost::mutex> lock(*solver->lock_);
+  solver->finished_ = true;
+  solver->succeeded_ = succeeded;
+  solver->finished_cond_->notify_all();
+  return NULL;
+}
+
 void SolverDispatcher::ExportGraph(FILE* stream) {
   // Note dimacs_exporter_ is the full graph iff solver is running for the first
   // time, or is non-incremental. Otherwise, dimacs_exporter_ is the incremental
@@ -153,22 +313,111 @@ void SolverDispatcher::ExportGraph(FILE* stream) {
   FlowGraphChangeManager* change_manager =
     flow_graph_manager_->flow_graph_change_manager();
   if (solver_ran_once_ && FLAGS_incremental_flow) {
-    dimacs_exporter_.ExportIncremental(
-        change_manager->GetOptimizedGraphChanges(), stream);
+    if (FLAGS_flowlessly_binary_protocol) {
+      dimacs_exporter_.ExportIncrementalBinary(
+          change_manager->GetOptimizedGraphChanges(), stream);
+    } else {
+      dimacs_exporter_.ExportIncremental(
+          change_manager->GetOptimizedGraphChanges(), stream);
+    }
   }
   if (!solver_ran_once_ || !FLAGS_incremental_flow) {
     // Always export full flow graph when running first time. If algorithm
     // is non-incremental, must do it for subsequent iterations too.
-    dimacs_exporter_.Export(change_manager->flow_graph(), stream);
+    if (FLAGS_flowlessly_binary_protocol) {
+      dimacs_exporter_.ExportBinary(change_manager->flow_graph(), stream);
+    } else {
+      dimacs_exporter_.Export(change_manager->flow_graph(), stream);
+    }
   }
 }
 
-multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
+multimap<uint64_t, uint64_t>* SolverDispatcher::FinishRun(
     SchedulerStats* scheduler_stats) {
+  CHECK(run_in_flight_) << "No solver run has been started";
+  if (pthread_join(reader_thread_, NULL)) {
+    PLOG(FATAL) << "Error joining thread";
+  }
+  bool missed_deadline = false;
+  if (FLAGS_flow_solver_deadline > 0) {
+    if (pthread_join(deadline_thread_, NULL)) {
+      PLOG(FATAL) << "Error joining thread";
+    }
+    missed_deadline = SolverMissedDeadline();
+  }
+  run_in_flight_ = false;
+
+  // The output of a solver that missed its deadline, crashed or printed
+  // something malformed is discarded, and the tasks are placed greedily.
+  bool use_output = !missed_deadline && solver_output_complete_;
+  if (!missed_deadline && !solver_output_complete_) {
+    LOG(ERROR) << "Solver output is incomplete or malformed in run "
+               << debug_seq_num_ << "; placing tasks greedily";
+    if (FLAGS_incremental_flow) {
+      // The solver cannot be updated incrementally from here on.
+      kill(solver_pid_, SIGKILL);
+    }
+  }
+  if (!use_output && to_solver_ != NULL) {
+    // An incremental solver's input stays open across runs. Writing out
+    // what is left in the stream fails, since the solver is gone.
+    fclose(to_solver_);
+    to_solver_ = NULL;
+  }
+
+  if (!FLAGS_incremental_flow || !use_output) {
+    // We're done with the solver and can let it terminate here.
+    int status = WaitForFinish(solver_pid_);
+
+    CHECK_EQ(fclose(from_solver_), 0);
+    from_solver_ = NULL;
+    CHECK_EQ(fclose(from_solver_stderr_), 0);
+    from_solver_stderr_ = NULL;
+    // N.B.: we DON'T close to_solver_ here, as the export thread already does
+    // this (cs2 expects stdin to be closed before it terminates, so we can't do
+    // it here)
+
+    // wait for logger thread
+    if (pthread_join(logger_thread_, NULL)) {
+      PLOG(FATAL) << "Error joining thread";
+    }
+
+    if (use_output && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+      LOG(ERROR) << "Solver terminated abnormally in run " << debug_seq_num_
+                 << "; placing tasks greedily";
+      use_output = false;
+    }
+  }
+
+  multimap<uint64_t, uint64_t>* task_mappings;
+  if (use_output) {
+    task_mappings = MapOutput();
+  } else {
+    delete solver_task_mappings_;
+    solver_task_mappings_ = NULL;
+    task_mappings = PlaceTasksGreedily();
+    if (missed_deadline) {
+      RecordMissedDeadline(scheduler_stats);
+    }
+  }
+  // A solver whose output was discarded is restarted with the full graph
+  // next time.
+  solver_ran_once_ = use_output;
+
+  if (scheduler_stats != NULL) {
+    scheduler_stats->scheduler_runtime_ = solver_runtime_;
+    scheduler_stats->algorithm_runtime_ = algorithm_runtime_;
+  }
+  debug_seq_num_++;
+  return task_mappings;
+}
+
+void SolverDispatcher::PrepareRun() {
   // Adjusts the costs on the arcs from tasks to unsched aggs.
   if (solver_ran_once_) {
     flow_graph_manager_->UpdateAllCostsToUnscheduledAggs();
   }
+  dimacs_exporter_.set_dense_node_ids(UseDenseNodeIds());
 
   // Write debugging copy, of whatever we send to flow solver
   if (FLAGS_debug_flow_graph) {
@@ -197,11 +446,270 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
       fclose(incremental_file);
     }
   }
+}
+
+multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
+    SchedulerStats* scheduler_stats) {
+  if (!portfolio_.empty()) {
+    PrepareRun();
+    multimap<uint64_t, uint64_t>* task_mappings =
+      RunPortfolio(scheduler_stats);
+    debug_seq_num_++;
+    return task_mappings;
+  }
+  if (FLAGS_flow_scheduling_solver == "inproc") {
+    PrepareRun();
+    multimap<uint64_t, uint64_t>* task_mappings =
+      RunInProcessSolver(scheduler_stats);
+    debug_seq_num_++;
+    return task_mappings;
+  }
+  StartRun();
+  return FinishRun(scheduler_stats);
+}
+
+multimap<uint64_t, uint64_t>* SolverDispatcher::RunInProcessSolver(
+    SchedulerStats* scheduler_stats) {
+  FlowGraphChangeManager* change_manager =
+    flow_graph_manager_->flow_graph_change_manager();
+  const FlowGraph& flow_graph = change_manager->flow_graph();
+  boost::timer::cpu_timer flowsolver_timer;
+  inproc_solver_.set_deadline(
+      FLAGS_flow_solver_deadline > 0 ?
+      wall_time_.GetCurrentTimestamp() + FLAGS_flow_solver_deadline : 0);
+  bool feasible;
+  if (solver_ran_once_ && FLAGS_incremental_flow) {
+    // Warm start from the previous flow and re-optimize around the changes.
+    feasible = inproc_solver_.SolveIncremental(
+        flow_graph, change_manager->GetOptimizedGraphChanges(),
+        *flow_graph_manager_->sink_node());
+  } else {
+    feasible = inproc_solver_.Solve(flow_graph);
+  }
+  if (!feasible) {
+    // The solver starts from scratch next time, so the changes are dropped.
+    change_manager->ResetChanges();
+    if (inproc_solver_.deadline_reached()) {
+      LOG(ERROR) << "In-process solver did not find a feasible flow by its "
+                 << "deadline in run " << debug_seq_num_
+                 << "; placing tasks greedily";
+      RecordMissedDeadline(scheduler_stats);
+    } else {
+      num_infeasible_runs_++;
+      LOG(ERROR) << "In-process solver found that the flow in run "
+                 << debug_seq_num_ << " is infeasible ("
+                 << num_infeasible_runs_ << " infeasible runs in total); "
+                 << "placing tasks greedily";
+    }
+    multimap<uint64_t, uint64_t>* task_mappings = PlaceTasksGreedily();
+    if (scheduler_stats != NULL) {
+      scheduler_stats->scheduler_runtime_ =
+        static_cast<uint64_t>(flowsolver_timer.elapsed().wall) /
+        NANOSECONDS_IN_MICROSECOND;
+    }
+    return task_mappings;
+  }
+  uint64_t algorithm_runtime =
+    static_cast<uint64_t>(flowsolver_timer.elapsed().wall) /
+    NANOSECONDS_IN_MICROSECOND;
+  change_manager->ResetChanges();
+  SnapshotExportedNodes(false);
+  inproc_solver_.ExtractFlow(&extracted_flow_, exported_num_nodes_ + 1);
+  multimap<uint64_t, uint64_t>* task_mappings =
+    GetMappings(&extracted_flow_, false);
+  solver_ran_once_ = true;
+  if (!inproc_solver_.optimal()) {
+    // The flow found by the deadline is feasible, so it is used as is.
+    RecordMissedDeadline(scheduler_stats);
+  }
+  if (scheduler_stats != NULL) {
+    scheduler_stats->scheduler_runtime_ =
+      static_cast<uint64_t>(flowsolver_timer.elapsed().wall) /
+      NANOSECONDS_IN_MICROSECOND;
+    scheduler_stats->algorithm_runtime_ = algorithm_runtime;
+  }
+  return task_mappings;
+}
+
+multimap<uint64_t, uint64_t>* SolverDispatcher::RunPortfolio(
+    SchedulerStats* scheduler_stats) {
+  FlowGraphChangeManager* change_manager =
+    flow_graph_manager_->flow_graph_change_manager();
+  const FlowGraph& flow_graph = change_manager->flow_graph();
+  boost::timer::cpu_timer flowsolver_timer;
+  // Export the graph once and send the same copy to all the solvers.
+  char* graph = NULL;
+  size_t graph_size = 0;
+  FILE* graph_stream = open_memstream(&graph, &graph_size);
+  CHECK_NOTNULL(graph_stream);
+  dimacs_exporter_.Export(flow_graph, graph_stream);
+  CHECK_EQ(fclose(graph_stream), 0);
+  change_manager->ResetChanges();
+  bool dense_node_ids = UseDenseNodeIds();
+  SnapshotExportedNodes(dense_node_ids);
+  for (auto& solver : portfolio_) {
+    solver->to_solver_graph_ = graph;
+    solver->to_solver_graph_size_ = graph_size;
+    solver->extracted_flow_.Reset(exported_num_nodes_ + 1);
+    solver->task_mappings_.clear();
+    solver->algorithm_runtime_ = numeric_limits<uint64_t>::max();
+    solver->finished_ = false;
+    solver->succeeded_ = false;
+    solver->pid_ = ExecCommandSync(solver->binary_, solver->args_,
+                                   solver->infd_, solver->outfd_,
+                                   solver->errfd_);
+    VLOG(2) << "Portfolio solver " << solver->name_ << " running (PID: "
+            << solver->pid_ << ")";
+    if ((solver->from_solver_stderr_ = fdopen(solver->errfd_[0], "r")) ==
+        NULL) {
+      LOG(ERROR) << "Failed to open FD for reading solver's output. FD "
+                 << solver->errfd_[0];
+    }
+    solver->output_parser_.Reset(solver->outfd_[0]);
+    if (pthread_create(&solver->logger_thread_, NULL, ProcessStderrJustlog,
+                       solver->from_solver_stderr_) ||
+        pthread_create(&solver->reader_thread_, NULL,
+                       ReadPortfolioSolverOutput, solver.get()) ||
+        pthread_create(&solver->writer_thread_, NULL,
+                       WriteGraphToPortfolioSolver, solver.get())) {
+      PLOG(FATAL) << "Error creating thread";
+    }
+  }
+  // Wait for the first solver that produces a complete result. Solvers that
+  // fail are ignored as long as there are others still running.
+  PortfolioSolver* winner = NULL;
+  bool missed_deadline = false;
+  boost::system_time deadline = boost::get_system_time() +
+    boost::posix_time::microseconds(FLAGS_flow_solver_deadline);
+  {
+    boost::unique_lock<boost::mutex> lock(portfolio_lock_);
+    while (winner == NULL && !missed_deadline) {
+      uint64_t num_finished = 0;
+      for (auto& solver : portfolio_) {
+        if (solver->finished_) {
+          num_finished++;
+          if (solver->succeeded_ && winner == NULL) {
+            winner = solver.get();
+          }
+        }
+      }
+      if (winner != NULL || num_finished == portfolio_.size()) {
+        break;
+      }
+      if (FLAGS_flow_solver_deadline == 0) {
+        portfolio_finished_cond_.wait(lock);
+      } else if (!portfolio_finished_cond_.timed_wait(lock, deadline)) {
+        missed_deadline = true;
+      }
+    }
+  }
+  if (winner == NULL && !missed_deadline) {
+    LOG(ERROR) << "No solver in the portfolio produced a result in run "
+               << debug_seq_num_ << "; placing tasks greedily";
+  }
+  // Kill the other solvers. Their output readers and graph writers then see
+  // the pipes close and terminate.
+  for (auto& solver : portfolio_) {
+    if (solver.get() != winner) {
+      kill(solver->pid_, SIGKILL);
+    }
+  }
+  for (auto& solver : portfolio_) {
+    if (pthread_join(solver->writer_thread_, NULL) ||
+        pthread_join(solver->reader_thread_, NULL) ||
+        pthread_join(solver->logger_thread_, NULL)) {
+      PLOG(FATAL) << "Error joining thread";
+    }
+    int status = WaitForFinish(solver->pid_);
+    CHECK_EQ(close(solver->outfd_[0]), 0);
+    CHECK_EQ(fclose(solver->from_solver_stderr_), 0);
+    solver->from_solver_stderr_ = NULL;
+    if (solver.get() == winner &&
+        !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+      LOG(ERROR) << "Portfolio solver " << winner->name_ << " terminated "
+                 << "abnormally in run " << debug_seq_num_ << "; placing "
+                 << "tasks greedily";
+      winner = NULL;
+    }
+  }
+  free(graph);
+  // The solvers are started afresh in every run.
+  solver_ran_once_ = true;
+  if (winner == NULL) {
+    multimap<uint64_t, uint64_t>* task_mappings = PlaceTasksGreedily();
+    if (missed_deadline) {
+      RecordMissedDeadline(scheduler_stats);
+    }
+    if (scheduler_stats != NULL) {
+      scheduler_stats->scheduler_runtime_ =
+        static_cast<uint64_t>(flowsolver_timer.elapsed().wall) /
+        NANOSECONDS_IN_MICROSECOND;
+    }
+    return task_mappings;
+  }
+  winner->num_wins_++;
+  LOG(INFO) << "Portfolio solver " << winner->name_ << " finished first in "
+            << "run " << debug_seq_num_ << " (" << winner->num_wins_
+            << " wins in total)";
+  multimap<uint64_t, uint64_t>* task_mappings;
+  if (FLAGS_only_read_assignment_changes) {
+    task_mappings = new multimap<uint64_t, uint64_t>();
+    task_mappings->swap(winner->task_mappings_);
+    if (!ValidTaskMappings(*task_mappings)) {
+      delete task_mappings;
+      task_mappings = PlaceTasksGreedily();
+    } else if (dense_node_ids) {
+      task_mappings = DenseToNodeIdMappings(task_mappings);
+    }
+  } else {
+    task_mappings = GetMappings(&winner->extracted_flow_, dense_node_ids);
+  }
+  if (scheduler_stats != NULL) {
+    scheduler_stats->scheduler_runtime_ =
+      static_cast<uint64_t>(flowsolver_timer.elapsed().wall) /
+      NANOSECONDS_IN_MICROSECOND;
+    scheduler_stats->algorithm_runtime_ = winner->algorithm_runtime_;
+    scheduler_stats->solver_ = winner->name_;
+  }
+  return task_mappings;
+}
+
+multimap<uint64_t, uint64_t>* SolverDispatcher::PlaceTasksGreedily() {
+  multimap<uint64_t, uint64_t>* task_mappings =
+    new multimap<uint64_t, uint64_t>();
+  greedy_solver_.PlaceTasks(
+      flow_graph_manager_->flow_graph_change_manager()->flow_graph(),
+      flow_graph_manager_->leaf_node_ids(),
+      flow_graph_manager_->sink_node()->id_, task_mappings);
+  return task_mappings;
+}
+
+void SolverDispatcher::RecordMissedDeadline(SchedulerStats* scheduler_stats) {
+  num_missed_deadlines_++;
+  LOG(WARNING) << "Solver missed its deadline of "
+               << FLAGS_flow_solver_deadline << " us in run "
+               << debug_seq_num_ << " (" << num_missed_deadlines_
+               << " missed deadlines in total)";
+  if (scheduler_stats != NULL) {
+    scheduler_stats->solver_missed_deadline_ = true;
+  }
+}
+
+pair<TaskID_t, ResourceID_t> SolverDispatcher::RunSimpleSolverForSingleTask(
+    SchedulerStats* scheduler_stats, TaskID_t single_task_id) {
+  pair<TaskID_t, ResourceID_t> delta =
+    flow_graph_manager_->cost_model()->GetTaskMappingForSingleTask(single_task_id);
+  return delta;
+}
+
+void SolverDispatcher::StartRun() {
+  CHECK(SupportsPipelining());
+  CHECK(!run_in_flight_) << "The previous solver run has not finished";
+  PrepareRun();
+  SnapshotExportedNodes(UseDenseNodeIds());
 
   // Now run the solver
   vector<string> args;
-  pid_t solver_pid = 0;
-  pthread_t logger_thread = static_cast<pthread_t>(-1);
   // If the solver hasn't executed or if we're not running in incremental mode.
   if (!solver_ran_once_ || !FLAGS_incremental_flow) {
     // Pipe setup
@@ -212,9 +720,10 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
     // infd[0] == CHILD_READ
     // infd[1] == PARENT_WRITE
     string binary;
-    SolverConfiguration(FLAGS_flow_scheduling_solver, &binary, &args);
-    solver_pid = ExecCommandSync(binary, args, infd_, outfd_, errfd_);
-    VLOG(2) << "Solver running " << "(PID: " << solver_pid << ")"
+    SolverConfiguration(FLAGS_flow_scheduling_solver,
+                        FLAGS_flowlessly_algorithm, &binary, &args);
+    solver_pid_ = ExecCommandSync(binary, args, infd_, outfd_, errfd_);
+    VLOG(2) << "Solver running " << "(PID: " << solver_pid_ << ")"
             << ", CHILD_READ: " << infd_[0]
             << ", CHILD_WRITE_STD: " << outfd_[1]
             << ", CHILD_WRITE_ERR: " << errfd_[1]
@@ -230,18 +739,20 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
       LOG(ERROR) << "Failed to open FD for reading solver's output. FD "
                  << outfd_[0];
     }
+    // The output is read from the pipe directly, bypassing from_solver_.
+    solver_output_parser_.Reset(outfd_[0]);
     if ((to_solver_ = fdopen(infd_[1], "w")) == NULL) {
       LOG(ERROR) << "Failed to open FD to solver for writing. FD: "
                  << infd_[1];
     }
 
-    if (pthread_create(&logger_thread, NULL,
+    if (pthread_create(&logger_thread_, NULL,
                        ProcessStderrJustlog, from_solver_stderr_)) {
       PLOG(FATAL) << "Error creating thread";
     }
   }
 
-  boost::timer::cpu_timer flowsolver_timer;
+  solver_timer_.start();
 
   // We must export graph and read from STDOUT/STDERR in parallel
   // Otherwise, the solver might block if STDOUT/STDERR buffer gets full.
@@ -249,62 +760,138 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
 
   // Create thread to write the DIMACS
   pthread_t exporter_thread;
+  solver_finished_ = false;
+  solver_missed_deadline_ = false;
+  solver_output_complete_ = false;
+  algorithm_runtime_ = numeric_limits<uint64_t>::max();
   if (pthread_create(&exporter_thread, NULL, ExportToSolver, this)) {
     PLOG(FATAL) << "Error creating thread";
   }
+  if (FLAGS_flow_solver_deadline > 0 &&
+      pthread_create(&deadline_thread_, NULL, EnforceSolverDeadline, this)) {
+    PLOG(FATAL) << "Error creating thread";
+  }
+  if (pthread_create(&reader_thread_, NULL, ReadSolverOutput, this)) {
+    PLOG(FATAL) << "Error creating thread";
+  }
+  run_in_flight_ = true;
 
-  uint64_t algorithm_runtime = numeric_limits<uint64_t>::max();
-  multimap<uint64_t, uint64_t>* task_mappings =
-    ReadOutput(&algorithm_runtime);
-
-  // Wait for exporter to complete. (Should already have happened when we
-  // get here, given we've finished reading the output.)
+  // The exporter reads the graph, so it must be done before the caller is
+  // allowed to change the graph again. The solvers read all of their input
+  // before they print any output, and the output is read by the reader
+  // thread, so waiting here cannot block the solver.
   if (pthread_join(exporter_thread, NULL)) {
     PLOG(FATAL) << "Error joining thread";
   }
+}
 
-  solver_ran_once_ = true;
+bool SolverDispatcher::SolverMissedDeadline() {
+  boost::lock_guard<boost::mutex> lock(deadline_lock_);
+  return solver_missed_deadline_;
+}
 
-  if (scheduler_stats != NULL) {
-    scheduler_stats->scheduler_runtime_ =
-      static_cast<uint64_t>(flowsolver_timer.elapsed().wall) /
-      NANOSECONDS_IN_MICROSECOND;
-    scheduler_stats->algorithm_runtime_ = algorithm_runtime;
-  }
+bool SolverDispatcher::SupportsPipelining() const {
+  return portfolio_.empty() && FLAGS_flow_scheduling_solver != "inproc";
+}
 
-  if (!FLAGS_incremental_flow) {
-    // We're done with the solver and can let it terminate here.
-    int status = WaitForFinish(solver_pid);
+// Returns true if the task assignments a solver printed map task nodes to
+// leaves of the graph as it was exported.
+bool SolverDispatcher::ValidTaskMappings(
+    const multimap<uint64_t, uint64_t>& task_mappings) const {
+  for (auto& task_pu : task_mappings) {
+    if (task_pu.first >= node_kinds_.size() ||
+        task_pu.second >= node_kinds_.size() ||
+        node_kinds_[task_pu.first] != ExtractedFlow::TASK_NODE ||
+        node_kinds_[task_pu.second] != ExtractedFlow::LEAF_NODE) {
+      LOG(ERROR) << "Solver assigned node " << task_pu.first << " to node "
+                 << task_pu.second << ", which are not a task and a PU, in "
+                 << "run " << debug_seq_num_ << "; placing tasks greedily";
+      return false;
+    }
+  }
+  return true;
+}
 
-    CHECK_EQ(fclose(from_solver_), 0);
-    from_solver_ = NULL;
-    CHECK_EQ(fclose(from_solver_stderr_), 0);
-    from_solver_stderr_ = NULL;
-    // N.B.: we DON'T close to_solver_ here, as the export thread already does
-    // this (cs2 expects stdin to be closed before it terminates, so we can't do
-    // it here)
+bool SolverDispatcher::UseDenseNodeIds() const {
+  // Incrementally updated solvers keep referring to the nodes by the ids
+  // they were first exported with, so their node ids must not change.
+  return FLAGS_flow_solver_dense_node_ids && !FLAGS_incremental_flow;
+}
 
-    // wait for logger thread
-    if (pthread_join(logger_thread, NULL)) {
-      PLOG(FATAL) << "Error joining thread";
+void SolverDispatcher::SetUpPortfolio() {
+  if (FLAGS_incremental_flow) {
+    LOG(FATAL) << "Portfolio mode requires -incremental_flow=false, since "
+               << "the solvers that lose a run are killed";
+  }
+  if (FLAGS_flowlessly_binary_protocol) {
+    LOG(FATAL) << "Portfolio mode does not support the binary protocol";
+  }
+  vector<string> entries;
+  boost::split(entries, FLAGS_flow_solver_portfolio, is_any_of(","),
+               token_compress_on);
+  for (auto& entry : entries) {
+    if (entry.empty()) {
+      continue;
     }
-
-    if (!(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
-      LOG(FATAL) << "Solver terminated abnormally";
+    vector<string> solver_algorithm;
+    boost::split(solver_algorithm, entry, is_any_of(":"));
+    if (solver_algorithm.size() > 2 || solver_algorithm[0] == "inproc") {
+      LOG(FATAL) << "Invalid portfolio solver: " << entry;
     }
+    unique_ptr<PortfolioSolver> solver(new PortfolioSolver());
+    solver->name_ = entry;
+    SolverConfiguration(solver_algorithm[0],
+                        solver_algorithm.size() == 2 ?
+                        solver_algorithm[1] : FLAGS_flowlessly_algorithm,
+                        &solver->binary_, &solver->args_);
+    solver->lock_ = &portfolio_lock_;
+    solver->finished_cond_ = &portfolio_finished_cond_;
+    portfolio_.push_back(std::move(solver));
   }
-  debug_seq_num_++;
-  return task_mappings;
+  CHECK(!portfolio_.empty()) << "Empty solver portfolio";
 }
 
-pair<TaskID_t, ResourceID_t> SolverDispatcher::RunSimpleSolverForSingleTask(
-    SchedulerStats* scheduler_stats, TaskID_t single_task_id) {
-  pair<TaskID_t, ResourceID_t> delta =
-    flow_graph_manager_->cost_model()->GetTaskMappingForSingleTask(single_task_id);
-  return delta;
+// Records the nodes by the ids the solver refers to them with, so that the
+// solver's output can still be mapped once the graph has changed.
+void SolverDispatcher::SnapshotExportedNodes(bool dense_node_ids) {
+  const FlowGraph& flow_graph =
+    flow_graph_manager_->flow_graph_change_manager()->flow_graph();
+  exported_num_nodes_ =
+    dense_node_ids ? flow_graph.Nodes().size() : flow_graph.NumNodes();
+  // Classify the nodes once, so that tracing the flow does not have to look
+  // the nodes up.
+  node_kinds_.assign(exported_num_nodes_ + 1, ExtractedFlow::OTHER_NODE);
+  exported_node_ids_.clear();
+  if (dense_node_ids) {
+    exported_node_ids_.resize(exported_num_nodes_ + 1, 0);
+  }
+  for (auto& node : flow_graph.Nodes()) {
+    uint64_t node_id = node->id_;
+    if (dense_node_ids) {
+      node_id = flow_graph.DenseNodeId(*node);
+      exported_node_ids_[node_id] = node->id_;
+    }
+    if (node->IsTaskNode()) {
+      node_kinds_[node_id] = ExtractedFlow::TASK_NODE;
+    } else if (node->type_ == FlowNodeType::JOB_AGGREGATOR) {
+      node_kinds_[node_id] = ExtractedFlow::UNSCHEDULED_NODE;
+    }
+  }
+  for (auto& leaf_node_id : flow_graph_manager_->leaf_node_ids()) {
+    uint64_t leaf_node = leaf_node_id;
+    if (dense_node_ids) {
+      leaf_node = flow_graph.DenseNodeId(flow_graph.Node(leaf_node_id));
+    }
+    node_kinds_[leaf_node] = ExtractedFlow::LEAF_NODE;
+  }
+  exported_sink_ = flow_graph_manager_->sink_node()->id_;
+  if (dense_node_ids) {
+    exported_sink_ = flow_graph.DenseNodeId(*flow_graph_manager_->sink_node());
+  }
 }
 
 void SolverDispatcher::SolverConfiguration(const string& solver,
+                                           const string& algorithm,
                                            string* binary,
                                            vector<string> *args) {
   // New solvers need to have their binary registered here.
@@ -318,6 +905,9 @@ void SolverDispatcher::SolverConfiguration(const string& solver,
   } else {
     LOG(FATAL) << "Non-existed flow network solver specified: " << solver;
   }
+  if (FLAGS_flowlessly_binary_protocol && solver != "flowlessly") {
+    LOG(FATAL) << "The binary protocol is only supported by Flowlessly";
+  }
 
   if (!FLAGS_flow_scheduling_binary.empty()) {
     *binary = FLAGS_flow_scheduling_binary;
@@ -339,7 +929,7 @@ void SolverDispatcher::SolverConfiguration(const string& solver,
 
     if (solver == "flowlessly") {
       args->push_back("--graph_has_node_types=true");
-      args->push_back("--algorithm=" + FLAGS_flowlessly_algorithm);
+      args->push_back("--algorithm=" + algorithm);
       if (FLAGS_only_read_assignment_changes) {
         args->push_back("--print_assignments=true");
       } else {
@@ -365,6 +955,9 @@ void SolverDispatcher::SolverConfiguration(const string& solver,
       }
       args->push_back("--alpha_scaling_factor=" +
                       FLAGS_flowlessly_alpha_factor);
+      if (FLAGS_flowlessly_binary_protocol) {
+        args->push_back("--binary_protocol=true");
+      }
     } else if (solver == "cs2") {
       // Nothing to do
     } else {
@@ -373,110 +966,92 @@ void SolverDispatcher::SolverConfiguration(const string& solver,
   }
 }
 
-// Maps worker|root tasks to leaves. It expects a extracted_flow containing
-// only the arcs with positive flow (i.e. what ReadFlowGraph returns).
+// Maps the dense node ids of the task assignments a solver printed back to
+// node ids. Takes ownership of dense_task_mappings.
+multimap<uint64_t, uint64_t>* SolverDispatcher::DenseToNodeIdMappings(
+    multimap<uint64_t, uint64_t>* dense_task_mappings) {
+  multimap<uint64_t, uint64_t>* task_mappings =
+    new multimap<uint64_t, uint64_t>();
+  for (auto& task_pu : *dense_task_mappings) {
+    CHECK_LT(task_pu.first, exported_node_ids_.size());
+    CHECK_LT(task_pu.second, exported_node_ids_.size());
+    task_mappings->insert(
+        pair<uint64_t, uint64_t>(exported_node_ids_[task_pu.first],
+                                 exported_node_ids_[task_pu.second]));
+  }
+  delete dense_task_mappings;
+  return task_mappings;
+}
+
+// Maps worker|root tasks to leaves. It expects an extracted_flow containing
+// only the arcs with positive flow (i.e. what ReadFlowGraph returns), for the
+// nodes recorded by SnapshotExportedNodes. If dense_node_ids is set, the
+// extracted flow refers to the nodes by their dense node ids. The returned
+// mappings always use the node ids. If the flow cannot be traced back to the
+// tasks, the tasks are placed greedily instead.
 multimap<uint64_t, uint64_t>* SolverDispatcher::GetMappings(
-    vector<unordered_map<uint64_t, uint64_t>>* extracted_flow,
-    unordered_set<uint64_t> leaves, uint64_t sink) {
+    ExtractedFlow* extracted_flow, bool dense_node_ids) {
   CHECK_NOTNULL(extracted_flow);
+  if (!extracted_flow->MapTasksToLeaves(node_kinds_, exported_sink_,
+                                        &task_leaf_pairs_)) {
+    LOG(ERROR) << "Solver's flow does not place all the tasks it carries in "
+               << "run " << debug_seq_num_ << "; placing tasks greedily";
+    return PlaceTasksGreedily();
+  }
   multimap<uint64_t, uint64_t>* task_to_pu =
     new multimap<uint64_t, uint64_t>();
-  const FlowGraph& flow_graph =
-    flow_graph_manager_->flow_graph_change_manager()->flow_graph();
-  vector<vector<uint64_t>> pu_ids(flow_graph.NumNodes() + 1);
-  vector<bool> visited(flow_graph.NumNodes() + 1, false);
-  queue<uint64_t> to_visit;
-  for (auto& leaf_node : leaves) {
-    visited[leaf_node]= true;
-    uint64_t* flow = FindOrNull((*extracted_flow)[sink], leaf_node);
-    if (flow != NULL) {
-      // Exists flow from node to sink.
-      for (uint64_t index = 0; index < *flow; ++index) {
-        pu_ids[leaf_node].push_back(leaf_node);
-      }
-      to_visit.push(leaf_node);
-    }
-  }
-  while (!to_visit.empty()) {
-    uint64_t node_id = to_visit.front();
-    to_visit.pop();
-    visited[node_id] = true;
-    if (flow_graph_manager_->flow_graph_change_manager()->CheckNodeType(
-            node_id, FlowNodeType::ROOT_TASK) ||
-        flow_graph_manager_->flow_graph_change_manager()->CheckNodeType(
-            node_id, FlowNodeType::UNSCHEDULED_TASK) ||
-        flow_graph_manager_->flow_graph_change_manager()->CheckNodeType(
-            node_id, FlowNodeType::SCHEDULED_TASK)) {
-      // It's a task node.
-      for (auto& pu_node_id : pu_ids[node_id]) {
-        task_to_pu->insert(pair<uint64_t, uint64_t>(node_id, pu_node_id));
-      }
+  for (auto& task_leaf : task_leaf_pairs_) {
+    if (dense_node_ids) {
+      task_to_pu->insert(
+          pair<uint64_t, uint64_t>(exported_node_ids_[task_leaf.first],
+                                   exported_node_ids_[task_leaf.second]));
     } else {
-      vector<uint64_t>::iterator pu_it = pu_ids[node_id].begin();
-      for (auto& src_flow : (*extracted_flow)[node_id]) {
-        bool assigned_all_pus = false;
-        // Populate the PUs vector at the source of the arc with as many PU
-        // entries from the incoming set of PU IDs as there's flow on the arc.
-        while (src_flow.second > 0) {
-          // It's an incoming arc with flow on it.
-          if (pu_it == pu_ids[node_id].end()) {
-            assigned_all_pus = true;
-            // No more PUs left to assign
-            break;
-          }
-          // Add the PU to the PUs vector of the source node.
-          pu_ids[src_flow.first].push_back(*pu_it);
-          pu_it++;
-          src_flow.second--;
-        }
-        if (!visited[src_flow.first]) {
-          to_visit.push(src_flow.first);
-          visited[src_flow.first] = true;
-        }
-        if (assigned_all_pus) {
-          break;
-        }
-      }
+      task_to_pu->insert(task_leaf);
     }
   }
   return task_to_pu;
 }
 
-// Returns a vector containing a nodes arcs with flow > 0.
-// In the returned graph the arcs are the inverse of the arcs in the file.
-// If there is (i,j) with flow 1 then in the graph we will have (j,i).
-multimap<uint64_t, uint64_t>* SolverDispatcher::ReadOutput(
-    uint64_t* algorithm_runtime) {
-  multimap<uint64_t, uint64_t>* task_mappings;
+// Maps the output read by ReadOutput to task placements.
+multimap<uint64_t, uint64_t>* SolverDispatcher::MapOutput() {
+  bool dense_node_ids = UseDenseNodeIds();
+  if (FLAGS_only_read_assignment_changes) {
+    multimap<uint64_t, uint64_t>* task_mappings = solver_task_mappings_;
+    solver_task_mappings_ = NULL;
+    if (!ValidTaskMappings(*task_mappings)) {
+      delete task_mappings;
+      return PlaceTasksGreedily();
+    }
+    if (dense_node_ids) {
+      task_mappings = DenseToNodeIdMappings(task_mappings);
+    }
+    return task_mappings;
+  }
+  return GetMappings(&extracted_flow_, dense_node_ids);
+}
+
+// Reads the solver's output for the nodes recorded by SnapshotExportedNodes.
+// The flow is read into extracted_flow_, and task assignment changes into
+// solver_task_mappings_. Runs on the reader thread.
+void SolverDispatcher::ReadOutput(uint64_t* algorithm_runtime) {
   // If we read from stdout and stderr, then we must process both
   // in parallel. Otherwise, the buffer on one could get full, and the solver
   // would block. This could result in a situation of deadlock.
-
-  // Process stdout in main thread
   if (FLAGS_only_read_assignment_changes) {
-    task_mappings = ReadTaskMappingChanges(from_solver_, algorithm_runtime);
+    solver_task_mappings_ = new multimap<uint64_t, uint64_t>();
+    solver_output_complete_ =
+      ReadTaskMappingChanges(algorithm_runtime, solver_task_mappings_);
   } else {
     // Parse and process the result
-    uint64_t num_nodes =
-      flow_graph_manager_->flow_graph_change_manager()->flow_graph().NumNodes();
-    vector<unordered_map<uint64_t, uint64_t> >* extracted_flow =
-      ReadFlowGraph(from_solver_, algorithm_runtime, num_nodes);
-    task_mappings = GetMappings(extracted_flow,
-                                flow_graph_manager_->leaf_node_ids(),
-                                flow_graph_manager_->sink_node()->id_);
-    delete extracted_flow;
+    solver_output_complete_ =
+      ReadFlowGraph(algorithm_runtime, exported_num_nodes_, &extracted_flow_);
   }
-  return task_mappings;
 }
 
-vector<unordered_map<uint64_t, uint64_t>>* SolverDispatcher::ReadFlowGraph(
-    FILE* fptr, uint64_t* algorithm_runtime, uint64_t num_vertices) {
-  vector<unordered_map<uint64_t, uint64_t>>* adj_list =
-    new vector<unordered_map<uint64_t, uint64_t> >(num_vertices + 1);
-  // The cost is not returned.
-  int64_t cost;
-  char line[100];
-  vector<string> vals;
+bool SolverDispatcher::ReadFlowGraph(uint64_t* algorithm_runtime,
+                                     uint64_t num_vertices,
+                                     ExtractedFlow* extracted_flow) {
+  extracted_flow->Reset(num_vertices + 1);
   FILE* dbg_fptr = NULL;
   if (FLAGS_debug_flow_graph) {
     // Somewhat ugly hack to generate unique output file name.
@@ -485,64 +1060,28 @@ vector<unordered_map<uint64_t, uint64_t>>* SolverDispatcher::ReadFlowGraph(
         FLAGS_debug_output_dir.c_str(), debug_seq_num_);
     CHECK((dbg_fptr = fopen(out_file_name.c_str(), "w")) != NULL);
   }
-  while (fgets(line, sizeof(line), fptr) != NULL) {
-    if (FLAGS_debug_flow_graph) {
-      fputs(line, dbg_fptr);
-      fputc('\n', dbg_fptr);
-    }
-    if (line[0] == 'f') {
-      uint64_t src;
-      uint64_t dst;
-      uint64_t flow;
-      CHECK_EQ(sscanf(line, "%*c %ju %ju %ju", &src, &dst, &flow), 3);
-      // Only add it to the adjacency list if flow > 0
-      if (flow > 0) {
-        (*adj_list)[dst].insert(make_pair(src, flow));
-      }
-    } else if (line[0] == 'c') {
-      if (!strcmp(line, "c EOI\n")) {
-        break;
-      } else if (!strncmp(line, "c ALGORITHM TIME", 16)) {
-        sscanf(line, "%*c %*s %*s %ju", algorithm_runtime);
-      }
-    } else if (line[0] == 's') {
-      sscanf(line, "%*c %ju", &cost);
-    } else {
-      LOG(ERROR) << "Unexpected line in flow graph: " << line;
-    }
+  bool complete;
+  if (FLAGS_flowlessly_binary_protocol) {
+    complete = solver_output_parser_.ReadBinaryFlow(extracted_flow,
+                                                    algorithm_runtime,
+                                                    dbg_fptr);
+  } else {
+    complete = solver_output_parser_.ReadFlow(extracted_flow,
+                                              algorithm_runtime, dbg_fptr);
   }
   if (FLAGS_debug_flow_graph)
     CHECK_EQ(fclose(dbg_fptr), 0);
-  return adj_list;
+  return complete;
 }
 
-multimap<uint64_t, uint64_t>* SolverDispatcher::ReadTaskMappingChanges(
-    FILE* fptr, uint64_t* algorithm_runtime) {
-  multimap<uint64_t, uint64_t>* task_node =
-    new multimap<uint64_t, uint64_t>();
-  char line[100];
-  bool end_of_iteration = false;
-  while (!end_of_iteration) {
-    if (fgets(line, 100, fptr) != NULL) {
-      if (line[0] == 'm') {
-        uint64_t task_id;
-        uint64_t core_id;
-        CHECK_EQ(sscanf(line, "%*c %ju %ju", &task_id, &core_id), 2);
-        VLOG(2) << "Assigning task node " << task_id << " to PU node "
-                << core_id;
-        task_node->insert(pair<uint64_t, uint64_t>(task_id, core_id));
-      } else if (line[0] == 'c') {
-        if (!strcmp(line, "c EOI\n")) {
-          end_of_iteration = true;
-        } else if (!strncmp(line, "c ALGORITHM TIME", 16)) {
-          sscanf(line, "%*c %*s %*s %ju", algorithm_runtime);
-        }
-      } else {
-        LOG(ERROR) << "Unknown type of row in flow graph.";
-      }
-    }
+bool SolverDispatcher::ReadTaskMappingChanges(
+    uint64_t* algorithm_runtime, multimap<uint64_t, uint64_t>* task_node) {
+  if (FLAGS_flowlessly_binary_protocol) {
+    return solver_output_parser_.ReadBinaryTaskMappings(task_node,
+                                                        algorithm_runtime);
   }
-  return task_node;
+  return solver_output_parser_.ReadTaskMappings(task_node, algorithm_runtime);
 }
+
 } // namespace scheduler
 } // namespace firmament
@@ -21,19 +21,70 @@
 #ifndef FIRMAMENT_SCHEDULING_FLOW_SOLVER_DISPATCHER_H
 #define FIRMAMENT_SCHEDULING_FLOW_SOLVER_DISPATCHER_H
 
+#include <pthread.h>
+#include <sys/types.h>
+
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/timer/timer.hpp>
+
 #include "base/common.h"
+#include "misc/wall_time.h"
 #include "scheduling/scheduler_interface.h"
+#include "scheduling/flow/cost_scaling_solver.h"
 #include "scheduling/flow/dimacs_exporter.h"
+#include "scheduling/flow/extracted_flow.h"
 #include "scheduling/flow/json_exporter.h"
 #include "scheduling/flow/flow_graph_manager.h"
+#include "scheduling/flow/greedy_solver.h"
+#include "scheduling/flow/solver_output_parser.h"
 
 namespace firmament {
 namespace scheduler {
 
+// One of the solvers that are raced against each other in portfolio mode,
+// together with the state of its current run.
+struct PortfolioSolver {
+  PortfolioSolver() : pid_(0), to_solver_graph_(NULL),
+    to_solver_graph_size_(0), from_solver_stderr_(NULL), finished_(false),
+    succeeded_(false), algorithm_runtime_(0), num_wins_(0), lock_(NULL),
+    finished_cond_(NULL) {
+  }
+  // Name of the portfolio entry, e.g. "flowlessly:relax".
+  string name_;
+  string binary_;
+  vector<string> args_;
+  pid_t pid_;
+  int errfd_[2];
+  int outfd_[2];
+  int infd_[2];
+  // The exported graph, which is shared by all the solvers.
+  const char* to_solver_graph_;
+  size_t to_solver_graph_size_;
+  FILE* from_solver_stderr_;
+  pthread_t writer_thread_;
+  pthread_t reader_thread_;
+  pthread_t logger_thread_;
+  SolverOutputParser output_parser_;
+  // The solver's result; only one of them is read, depending on whether
+  // the solver prints the flow or the task assignments.
+  ExtractedFlow extracted_flow_;
+  multimap<uint64_t, uint64_t> task_mappings_;
+  // Set once the solver's output has been read. Protected by lock_.
+  bool finished_;
+  bool succeeded_;
+  uint64_t algorithm_runtime_;
+  // Number of runs in which this solver was the first to finish.
+  uint64_t num_wins_;
+  boost::mutex* lock_;
+  boost::condition_variable* finished_cond_;
+};
+
 class SolverDispatcher {
  public:
   SolverDispatcher(shared_ptr<FlowGraphManager> flow_graph_manager,
@@ -41,42 +92,135 @@ class SolverDispatcher {
   ~SolverDispatcher();
 
   void ExportJSON(string* output) const;
+  /**
+   * Waits for the solver run started by StartRun() and returns the task
+   * mappings it computed. The mappings refer to the nodes as they were when
+   * the run was started, even if the graph has changed since.
+   * @param scheduler_stats if not NULL, set to the statistics of the run
+   * @return the (task node id, PU node id) pairs; the caller owns them
+   */
+  multimap<uint64_t, uint64_t>* FinishRun(SchedulerStats* scheduler_stats);
   multimap<uint64_t, uint64_t>* Run(SchedulerStats* scheduler_stats);
 
   pair<TaskID_t, ResourceID_t> RunSimpleSolverForSingleTask(
      SchedulerStats* scheduler_stats,
      TaskID_t single_task_id);
+  /**
+   * Exports the graph to an external solver and returns without waiting for
+   * the solver to finish, so that the graph can be changed while the solver
+   * runs. FinishRun() must be called before the next run is started.
+   */
+  void StartRun();
+  /**
+   * Returns true if runs can be split into StartRun() and FinishRun(), i.e.
+   * if a single external solver is used.
+   */
+  bool SupportsPipelining() const;
+  bool run_in_flight() const {
+    return run_in_flight_;
+  }
   uint64_t seq_num() const {
     return debug_seq_num_;
   }
+  uint64_t num_missed_deadlines() const {
+    return num_missed_deadlines_;
+  }
+  uint64_t num_infeasible_runs() const {
+    return num_infeasible_runs_;
+  }
 
  private:
+  void CheckBinaryProtocolSupport();
   void ExportGraph(FILE* stream);
-  multimap<uint64_t, uint64_t>* GetMappings(
-      vector<unordered_map<uint64_t, uint64_t>>* extracted_flow,
-      unordered_set<uint64_t> leaves, uint64_t sink);
-  multimap<uint64_t, uint64_t>* ReadOutput(uint64_t* algorithm_runtime);
-  vector<unordered_map<uint64_t, uint64_t>>* ReadFlowGraph(
-      FILE* fptr,
-      uint64_t* algorithm_runtime,
-      uint64_t num_vertices);
-  multimap<uint64_t, uint64_t>* ReadTaskMappingChanges(
-      FILE* fptr,
-      uint64_t* algorithm_runtime);
-  void SolverConfiguration(const string& solver, string* binary,
-                           vector<string> *args);
+  multimap<uint64_t, uint64_t>* DenseToNodeIdMappings(
+      multimap<uint64_t, uint64_t>* dense_task_mappings);
+  multimap<uint64_t, uint64_t>* GetMappings(ExtractedFlow* extracted_flow,
+                                            bool dense_node_ids);
+  multimap<uint64_t, uint64_t>* MapOutput();
+  multimap<uint64_t, uint64_t>* PlaceTasksGreedily();
+  void PrepareRun();
+  void ReadOutput(uint64_t* algorithm_runtime);
+  bool ReadFlowGraph(uint64_t* algorithm_runtime, uint64_t num_vertices,
+                     ExtractedFlow* extracted_flow);
+  bool ReadTaskMappingChanges(uint64_t* algorithm_runtime,
+                              multimap<uint64_t, uint64_t>* task_node);
+  void RecordMissedDeadline(SchedulerStats* scheduler_stats);
+  multimap<uint64_t, uint64_t>* RunInProcessSolver(
+      SchedulerStats* scheduler_stats);
+  multimap<uint64_t, uint64_t>* RunPortfolio(SchedulerStats* scheduler_stats);
+  void SetUpPortfolio();
+  void SnapshotExportedNodes(bool dense_node_ids);
+  void SolverConfiguration(const string& solver, const string& algorithm,
+                           string* binary, vector<string> *args);
+  bool SolverMissedDeadline();
+  bool UseDenseNodeIds() const;
+  bool ValidTaskMappings(
+      const multimap<uint64_t, uint64_t>& task_mappings) const;
+  friend void *EnforceSolverDeadline(void *x);
   friend void *ExportToSolver(void *x);
+  friend void *ReadSolverOutput(void *x);
 
   shared_ptr<FlowGraphManager> flow_graph_manager_;
   // DIMACS exporter for interfacing to the solver
   DIMACSExporter dimacs_exporter_;
+  // Solver used when the flow network is optimized in-process
+  CostScalingSolver inproc_solver_;
+  // Places the tasks when a solver misses its deadline
+  GreedySolver greedy_solver_;
   // JSON exporter for debug and visualisation
   JSONExporter json_exporter_;
+  // Flow read from the solver and the scratch space used to map it to task
+  // placements; reused across runs.
+  ExtractedFlow extracted_flow_;
+  vector<pair<uint64_t, uint64_t>> task_leaf_pairs_;
+  // The nodes as they were exported to the solver, indexed by the ids the
+  // solver refers to them with: their kinds and, with dense node ids, their
+  // node ids. The solver's output is mapped using them, since the graph may
+  // have changed by the time the output is read.
+  vector<uint8_t> node_kinds_;
+  vector<uint64_t> exported_node_ids_;
+  uint64_t exported_num_nodes_;
+  uint64_t exported_sink_;
+  // Task assignments read from a solver that only prints the changes.
+  multimap<uint64_t, uint64_t>* solver_task_mappings_;
+  // Parser for the solver's output; its read buffer is reused across runs.
+  SolverOutputParser solver_output_parser_;
+  // Solvers raced against each other in portfolio mode; empty otherwise.
+  vector<unique_ptr<PortfolioSolver>> portfolio_;
+  boost::mutex portfolio_lock_;
+  boost::condition_variable portfolio_finished_cond_;
   // Boolean that indicates if the solver has knowledge of the flow graph (i.e.
   // it is set after the initial from scratch run of the solver).
   bool solver_ran_once_;
   // Debug sequence number (for solver input/output files written to /tmp)
   uint64_t debug_seq_num_;
+  // Number of runs in which the solver missed its deadline.
+  uint64_t num_missed_deadlines_;
+  // Number of runs in which the in-process solver found the flow infeasible
+  // before its deadline.
+  uint64_t num_infeasible_runs_;
+  // State shared with the thread that kills the solver when it misses its
+  // deadline. Protected by deadline_lock_.
+  boost::mutex deadline_lock_;
+  boost::condition_variable deadline_cond_;
+  bool solver_finished_;
+  bool solver_missed_deadline_;
+  WallTime wall_time_;
+
+  // The solver process, which outlives a run if the solver is incremental,
+  // and the thread that logs its stderr.
+  pid_t solver_pid_;
+  pthread_t logger_thread_;
+  // State of the external solver run between StartRun() and FinishRun().
+  bool run_in_flight_;
+  pthread_t reader_thread_;
+  pthread_t deadline_thread_;
+  boost::timer::cpu_timer solver_timer_;
+  // Set by the reader thread once it has read the solver's output; the
+  // output is only used if it was read up to the end of the iteration.
+  bool solver_output_complete_;
+  uint64_t algorithm_runtime_;
+  uint64_t solver_runtime_;
 
   // FDs used to communicate with the solver.
   int errfd_[2];
@@ -0,0 +1,323 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/flow/solver_output_parser.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "scheduling/flow/dimacs_binary_format.h"
+
+namespace firmament {
+
+const char kEndOfIteration[] = "c EOI";
+const char kAlgorithmTime[] = "c ALGORITHM TIME";
+
+// Returns true if the line [line, line_end) starts with the prefix.
+inline bool LineStartsWith(const char* line, const char* line_end,
+                           const char* prefix, size_t prefix_length) {
+  return static_cast<size_t>(line_end - line) >= prefix_length &&
+    memcmp(line, prefix, prefix_length) == 0;
+}
+
+SolverOutputParser::SolverOutputParser(size_t buffer_size)
+  : fd_(-1), buffer_(buffer_size), begin_(0), end_(0),
+    end_of_output_(false), stopped_(false) {
+}
+
+bool SolverOutputParser::NextBinaryRecord(char* type, const char** fields) {
+  while (true) {
+    if (stopped_) {
+      begin_ = end_;
+      return false;
+    }
+    if (begin_ != end_) {
+      *type = buffer_[begin_];
+      int64_t size = BinaryResultRecordSize(*type);
+      if (size < 0) {
+        LOG(ERROR) << "Unexpected binary record type: "
+                   << static_cast<int>(*type);
+        begin_ = end_;
+        return false;
+      }
+      if (end_ - begin_ > static_cast<size_t>(size)) {
+        *fields = buffer_.data() + begin_ + 1;
+        begin_ += 1 + static_cast<size_t>(size);
+        return true;
+      }
+    }
+    if (!ReadMore()) {
+      if (begin_ != end_) {
+        LOG(WARNING) << "Dropping truncated last record of solver output "
+                     << "of type " << buffer_[begin_];
+        begin_ = end_;
+      }
+      return false;
+    }
+  }
+}
+
+bool SolverOutputParser::NextLine(const char** line, const char** line_end) {
+  while (true) {
+    if (stopped_) {
+      begin_ = end_;
+      return false;
+    }
+    const char* newline = static_cast<const char*>(
+        memchr(buffer_.data() + begin_, '\n', end_ - begin_));
+    if (newline != NULL) {
+      *line = buffer_.data() + begin_;
+      *line_end = newline;
+      begin_ = newline + 1 - buffer_.data();
+      return true;
+    }
+    if (!ReadMore()) {
+      if (begin_ != end_) {
+        // The last line is not terminated, e.g., because the solver was
+        // killed while it printed the line. It is dropped, since it may be
+        // incomplete.
+        LOG(WARNING) << "Dropping unterminated last line of solver output: "
+                     << string(buffer_.data() + begin_, end_ - begin_);
+        begin_ = end_;
+      }
+      return false;
+    }
+  }
+}
+
+bool SolverOutputParser::ParseAlgorithmTime(const char* line,
+                                            const char* line_end,
+                                            uint64_t* algorithm_runtime) {
+  const char* pos = line + sizeof(kAlgorithmTime) - 1;
+  // Skip the rest of the "TIME" token (e.g., a colon) like sscanf's %s does.
+  while (pos < line_end && *pos != ' ') {
+    ++pos;
+  }
+  return ParseUInt64(&pos, line_end, algorithm_runtime);
+}
+
+bool SolverOutputParser::ParseUInt64(const char** pos, const char* end,
+                                     uint64_t* value) {
+  const char* cur = *pos;
+  while (cur < end && *cur == ' ') {
+    ++cur;
+  }
+  if (cur == end || *cur < '0' || *cur > '9') {
+    return false;
+  }
+  uint64_t result = 0;
+  for (; cur < end && *cur >= '0' && *cur <= '9'; ++cur) {
+    uint64_t digit = static_cast<uint64_t>(*cur - '0');
+    if (result > (UINT64_MAX - digit) / 10) {
+      // The number does not fit into 64 bits.
+      return false;
+    }
+    result = result * 10 + digit;
+  }
+  *value = result;
+  *pos = cur;
+  return true;
+}
+
+bool SolverOutputParser::ReadBinaryFlow(ExtractedFlow* extracted_flow,
+                                        uint64_t* algorithm_runtime,
+                                        FILE* debug_file) {
+  CHECK_NOTNULL(extracted_flow);
+  char type;
+  const char* fields;
+  bool end_of_iteration = false;
+  while (!end_of_iteration && NextBinaryRecord(&type, &fields)) {
+    if (type == BINARY_RECORD_FLOW) {
+      uint64_t src = ParseBinaryUInt64(fields);
+      uint64_t dst = ParseBinaryUInt64(fields + 8);
+      uint64_t flow = ParseBinaryUInt64(fields + 16);
+      if (debug_file != NULL) {
+        fprintf(debug_file, "f %ju %ju %ju\n", src, dst, flow);
+      }
+      // Only add it to the extracted flow if flow > 0
+      if (flow > 0) {
+        extracted_flow->AddArcFlow(src, dst, flow);
+      }
+    } else if (type == BINARY_RECORD_ALGORITHM_TIME) {
+      *algorithm_runtime = ParseBinaryUInt64(fields);
+    } else if (type == BINARY_RECORD_END_OF_ITERATION) {
+      end_of_iteration = true;
+    } else if (type != BINARY_RECORD_COST) {
+      // The solution cost is not used.
+      LOG(ERROR) << "Unexpected binary record in flow graph: " << type;
+    }
+  }
+  return extracted_flow->Finalize() && end_of_iteration;
+}
+
+bool SolverOutputParser::ReadBinaryTaskMappings(
+    multimap<uint64_t, uint64_t>* task_mappings,
+    uint64_t* algorithm_runtime) {
+  CHECK_NOTNULL(task_mappings);
+  char type;
+  const char* fields;
+  while (NextBinaryRecord(&type, &fields)) {
+    if (type == BINARY_RECORD_ASSIGNMENT) {
+      uint64_t task_id = ParseBinaryUInt64(fields);
+      uint64_t core_id = ParseBinaryUInt64(fields + 8);
+      VLOG(2) << "Assigning task node " << task_id << " to PU node "
+              << core_id;
+      task_mappings->insert(pair<uint64_t, uint64_t>(task_id, core_id));
+    } else if (type == BINARY_RECORD_ALGORITHM_TIME) {
+      *algorithm_runtime = ParseBinaryUInt64(fields);
+    } else if (type == BINARY_RECORD_END_OF_ITERATION) {
+      return true;
+    } else if (type != BINARY_RECORD_COST) {
+      LOG(ERROR) << "Unexpected binary record in task mappings: " << type;
+    }
+  }
+  return false;
+}
+
+bool SolverOutputParser::ReadFlow(ExtractedFlow* extracted_flow,
+                                  uint64_t* algorithm_runtime,
+                                  FILE* debug_file) {
+  CHECK_NOTNULL(extracted_flow);
+  const char* line;
+  const char* line_end;
+  bool end_of_iteration = false;
+  while (!end_of_iteration && NextLine(&line, &line_end)) {
+    if (debug_file != NULL) {
+      fwrite(line, 1, line_end - line, debug_file);
+      fputc('\n', debug_file);
+    }
+    if (line == line_end) {
+      continue;
+    }
+    if (line[0] == 'f') {
+      const char* pos = line + 1;
+      uint64_t src;
+      uint64_t dst;
+      uint64_t flow;
+      if (!ParseUInt64(&pos, line_end, &src) ||
+          !ParseUInt64(&pos, line_end, &dst) ||
+          !ParseUInt64(&pos, line_end, &flow)) {
+        LOG(ERROR) << "Malformed flow line: " << string(line, line_end);
+        break;
+      }
+      // Only add it to the extracted flow if flow > 0
+      if (flow > 0) {
+        extracted_flow->AddArcFlow(src, dst, flow);
+      }
+    } else if (line[0] == 'c') {
+      if (LineStartsWith(line, line_end, kEndOfIteration,
+                         sizeof(kEndOfIteration) - 1)) {
+        end_of_iteration = true;
+      } else if (LineStartsWith(line, line_end, kAlgorithmTime,
+                                sizeof(kAlgorithmTime) - 1)) {
+        ParseAlgorithmTime(line, line_end, algorithm_runtime);
+      }
+    } else if (line[0] != 's') {
+      // The solution cost ('s' line) is not used.
+      LOG(ERROR) << "Unexpected line in flow graph: "
+                 << string(line, line_end);
+    }
+  }
+  return extracted_flow->Finalize() && end_of_iteration;
+}
+
+bool SolverOutputParser::ReadMore() {
+  while (!end_of_output_) {
+    // Move the unparsed output to the front of the buffer and read more
+    // output after it.
+    if (begin_ > 0) {
+      memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+      end_ -= begin_;
+      begin_ = 0;
+    }
+    if (end_ == buffer_.size()) {
+      // A line or record does not fit into the buffer.
+      buffer_.resize(2 * buffer_.size());
+    }
+    ssize_t num_read = read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+    if (num_read < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      PLOG(ERROR) << "Failed to read solver output";
+      end_of_output_ = true;
+    } else if (num_read == 0) {
+      end_of_output_ = true;
+    } else {
+      end_ += static_cast<size_t>(num_read);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SolverOutputParser::ReadTaskMappings(
+    multimap<uint64_t, uint64_t>* task_mappings,
+    uint64_t* algorithm_runtime) {
+  CHECK_NOTNULL(task_mappings);
+  const char* line;
+  const char* line_end;
+  while (NextLine(&line, &line_end)) {
+    if (line == line_end) {
+      continue;
+    }
+    if (line[0] == 'm') {
+      const char* pos = line + 1;
+      uint64_t task_id;
+      uint64_t core_id;
+      if (!ParseUInt64(&pos, line_end, &task_id) ||
+          !ParseUInt64(&pos, line_end, &core_id)) {
+        LOG(ERROR) << "Malformed assignment line: "
+                   << string(line, line_end);
+        return false;
+      }
+      VLOG(2) << "Assigning task node " << task_id << " to PU node "
+              << core_id;
+      task_mappings->insert(pair<uint64_t, uint64_t>(task_id, core_id));
+    } else if (line[0] == 'c') {
+      if (LineStartsWith(line, line_end, kEndOfIteration,
+                         sizeof(kEndOfIteration) - 1)) {
+        return true;
+      } else if (LineStartsWith(line, line_end, kAlgorithmTime,
+                                sizeof(kAlgorithmTime) - 1)) {
+        ParseAlgorithmTime(line, line_end, algorithm_runtime);
+      }
+    } else {
+      LOG(ERROR) << "Unknown type of row in flow graph.";
+    }
+  }
+  return false;
+}
+
+void SolverOutputParser::Reset(int fd) {
+  fd_ = fd;
+  begin_ = 0;
+  end_ = 0;
+  end_of_output_ = false;
+  stopped_ = false;
+}
+
+void SolverOutputParser::Stop() {
+  stopped_ = true;
+}
+
+}  // namespace firmament
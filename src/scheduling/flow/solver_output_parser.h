@@ -0,0 +1,115 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Streaming parser for the output of the flow solvers, in either the text
+// or the binary format (see dimacs_binary_format.h). The output is read from
+// the solver's pipe in large chunks as the solver produces it, and the lines
+// or records are parsed in place, without copying them or allocating memory
+// per line.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_SOLVER_OUTPUT_PARSER_H
+#define FIRMAMENT_SCHEDULING_FLOW_SOLVER_OUTPUT_PARSER_H
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include "base/common.h"
+#include "base/types.h"
+#include "scheduling/flow/extracted_flow.h"
+
+namespace firmament {
+
+class SolverOutputParser {
+ public:
+  explicit SolverOutputParser(size_t buffer_size = 1 << 20);
+
+  /**
+   * Like ReadFlow(), but for output in the binary format.
+   * @return false if the output ended before the end of the iteration, a
+   * record was malformed, or an arc refers to an unknown node
+   */
+  bool ReadBinaryFlow(ExtractedFlow* extracted_flow,
+                      uint64_t* algorithm_runtime, FILE* debug_file);
+  /**
+   * Like ReadTaskMappings(), but for output in the binary format.
+   * @return false if the output ended before the end of the iteration, or
+   * a record was malformed
+   */
+  bool ReadBinaryTaskMappings(multimap<uint64_t, uint64_t>* task_mappings,
+                              uint64_t* algorithm_runtime);
+
+  /**
+   * Reads the flow of one solver iteration, i.e. up to the end of iteration
+   * comment or the end of the output, and adds the arcs that carry flow to
+   * the extracted flow.
+   * @param extracted_flow the flow to add the arcs to; it is finalized once
+   * the iteration has been read
+   * @param algorithm_runtime set to the runtime the solver reports, if any
+   * @param debug_file if not NULL, the lines read are copied to the file
+   * @return false if the output ended before the end of the iteration, a
+   * line was malformed, or an arc refers to an unknown node
+   */
+  bool ReadFlow(ExtractedFlow* extracted_flow, uint64_t* algorithm_runtime,
+                FILE* debug_file);
+  /**
+   * Reads the task assignment changes of one solver iteration.
+   * @param task_mappings the (task node id, PU node id) pairs are added to it
+   * @param algorithm_runtime set to the runtime the solver reports, if any
+   * @return false if the output ended before the end of the iteration, or
+   * a line was malformed
+   */
+  bool ReadTaskMappings(multimap<uint64_t, uint64_t>* task_mappings,
+                        uint64_t* algorithm_runtime);
+  /**
+   * Starts parsing the output of a new solver process. Any buffered output
+   * of the previous solver is discarded.
+   * @param fd the descriptor of the pipe the solver writes its output to
+   */
+  void Reset(int fd);
+  /**
+   * Makes the parser discard the rest of the output, as if it had ended.
+   * Can be called from another thread, e.g., once the solver has been
+   * killed and its output is no longer needed.
+   */
+  void Stop();
+
+ private:
+  bool NextBinaryRecord(char* type, const char** fields);
+  bool NextLine(const char** line, const char** line_end);
+  bool ParseAlgorithmTime(const char* line, const char* line_end,
+                          uint64_t* algorithm_runtime);
+  static bool ParseUInt64(const char** pos, const char* end,
+                          uint64_t* value);
+  bool ReadMore();
+
+  int fd_;
+  vector<char> buffer_;
+  // The unparsed output is at [begin_, end_) of buffer_.
+  size_t begin_;
+  size_t end_;
+  bool end_of_output_;
+  std::atomic<bool> stopped_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_SOLVER_OUTPUT_PARSER_H
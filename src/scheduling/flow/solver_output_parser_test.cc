@@ -0,0 +1,370 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+
+// Tests for the streaming parser of the solvers' text and binary output.
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include "base/common.h"
+#include "misc/wall_time.h"
+#include "scheduling/flow/dimacs_binary_format.h"
+#include "scheduling/flow/extracted_flow.h"
+#include "scheduling/flow/solver_output_parser.h"
+
+namespace firmament {
+
+// The fixture for testing class SolverOutputParser.
+class SolverOutputParserTest : public ::testing::Test {
+ protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  SolverOutputParserTest() {
+    // You can do set-up work for each test here.
+  }
+
+  virtual ~SolverOutputParserTest() {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  virtual void SetUp() {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    output_file_ = tmpfile();
+    CHECK_NOTNULL(output_file_);
+  }
+
+  virtual void TearDown() {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    CHECK_EQ(fclose(output_file_), 0);
+  }
+
+  // Writes the solver output to the file and rewinds it.
+  void WriteOutput(const string& output) {
+    CHECK_EQ(fwrite(output.data(), 1, output.size(), output_file_),
+             output.size());
+    CHECK_EQ(fflush(output_file_), 0);
+    rewind(output_file_);
+  }
+
+  // Objects declared here can be used by all tests in the test case for
+  // SolverOutputParser.
+  FILE* output_file_;
+};
+
+// Parses the flow of two iterations with a buffer that is smaller than
+// some of the lines, so that lines span several reads.
+TEST_F(SolverOutputParserTest, ReadFlow) {
+  WriteOutput("c ALGORITHM TIME: 1234\n"
+              "f 1 2 3\n"
+              "f 2 3 0\n"
+              "s 42\n"
+              "f 1234567 3 1\n"
+              "c EOI\n"
+              "f 3 1 2\n"
+              "c EOI\n");
+  SolverOutputParser parser(8);
+  parser.Reset(fileno(output_file_));
+  ExtractedFlow flow;
+  flow.Reset(1234568);
+  uint64_t algorithm_runtime = 0;
+  EXPECT_TRUE(parser.ReadFlow(&flow, &algorithm_runtime, NULL));
+  EXPECT_EQ(algorithm_runtime, 1234);
+  EXPECT_EQ(flow.Flow(1, 2), 3);
+  // Arcs without flow are not added.
+  EXPECT_EQ(flow.IncomingEnd(3) - flow.IncomingBegin(3), 1);
+  EXPECT_EQ(flow.Flow(1234567, 3), 1);
+  // The second iteration continues after the first one's end.
+  flow.Reset(4);
+  EXPECT_TRUE(parser.ReadFlow(&flow, &algorithm_runtime, NULL));
+  EXPECT_EQ(flow.Flow(3, 1), 2);
+  EXPECT_EQ(flow.Flow(1, 2), 0);
+  // The output ends without another iteration.
+  flow.Reset(4);
+  EXPECT_FALSE(parser.ReadFlow(&flow, &algorithm_runtime, NULL));
+}
+
+TEST_F(SolverOutputParserTest, ReadTaskMappings) {
+  WriteOutput("m 5 7\n"
+              "m 6 8\n"
+              "c ALGORITHM TIME 99\n"
+              "c EOI\n"
+              "m 5 8");
+  SolverOutputParser parser;
+  parser.Reset(fileno(output_file_));
+  multimap<uint64_t, uint64_t> task_mappings;
+  uint64_t algorithm_runtime = 0;
+  EXPECT_TRUE(parser.ReadTaskMappings(&task_mappings, &algorithm_runtime));
+  EXPECT_EQ(algorithm_runtime, 99);
+  ASSERT_EQ(task_mappings.size(), 2);
+  EXPECT_EQ(task_mappings.find(5)->second, 7);
+  EXPECT_EQ(task_mappings.find(6)->second, 8);
+  // The last line is not terminated, so it is dropped, and the output ends
+  // before the end of the iteration.
+  task_mappings.clear();
+  EXPECT_FALSE(parser.ReadTaskMappings(&task_mappings, &algorithm_runtime));
+  EXPECT_EQ(task_mappings.size(), 0);
+}
+
+// The output of a solver that is killed while it prints a line ends with a
+// truncated line, which must not be parsed.
+TEST_F(SolverOutputParserTest, TruncatedLastFlowLine) {
+  WriteOutput("f 1 2 3\n"
+              "f 2 3");
+  SolverOutputParser parser;
+  parser.Reset(fileno(output_file_));
+  ExtractedFlow flow;
+  flow.Reset(4);
+  uint64_t algorithm_runtime = 0;
+  EXPECT_FALSE(parser.ReadFlow(&flow, &algorithm_runtime, NULL));
+  EXPECT_EQ(flow.Flow(1, 2), 3);
+  EXPECT_EQ(flow.Flow(2, 3), 0);
+}
+
+// A line that is cut off before all of its fields is dropped, too.
+TEST_F(SolverOutputParserTest, TruncatedLastAssignmentLine) {
+  WriteOutput("m 5 7\n"
+              "m 6");
+  SolverOutputParser parser;
+  parser.Reset(fileno(output_file_));
+  multimap<uint64_t, uint64_t> task_mappings;
+  uint64_t algorithm_runtime = 0;
+  EXPECT_FALSE(parser.ReadTaskMappings(&task_mappings, &algorithm_runtime));
+  ASSERT_EQ(task_mappings.size(), 1);
+  EXPECT_EQ(task_mappings.find(5)->second, 7);
+}
+
+// Malformed lines end the parsing of the iteration.
+TEST_F(SolverOutputParserTest, MalformedLine) {
+  WriteOutput("f 1 2 3\n"
+              "f 2 x 1\n"
+              "f 3 1 1\n"
+              "c EOI\n");
+  SolverOutputParser parser;
+  parser.Reset(fileno(output_file_));
+  ExtractedFlow flow;
+  flow.Reset(4);
+  uint64_t algorithm_runtime = 0;
+  EXPECT_FALSE(parser.ReadFlow(&flow, &algorithm_runtime, NULL));
+  EXPECT_EQ(flow.Flow(1, 2), 3);
+  EXPECT_EQ(flow.Flow(3, 1), 0);
+}
+
+// A number that does not fit into 64 bits makes the line malformed, rather
+// than wrapping around to a small flow.
+TEST_F(SolverOutputParserTest, NumberOverflow) {
+  WriteOutput("f 1 2 18446744073709551615\n"
+              "f 2 3 18446744073709551616\n"
+              "c EOI\n");
+  SolverOutputParser parser;
+  parser.Reset(fileno(output_file_));
+  ExtractedFlow flow;
+  flow.Reset(4);
+  uint64_t algorithm_runtime = 0;
+  EXPECT_FALSE(parser.ReadFlow(&flow, &algorithm_runtime, NULL));
+  EXPECT_EQ(flow.Flow(1, 2), UINT64_MAX);
+  EXPECT_EQ(flow.Flow(2, 3), 0);
+}
+
+// A flow that refers to a node the graph does not have is rejected, even if
+// the iteration is complete.
+TEST_F(SolverOutputParserTest, UnknownNode) {
+  WriteOutput("f 1 2 3\n"
+              "f 2 7 1\n"
+              "c EOI\n");
+  SolverOutputParser parser;
+  parser.Reset(fileno(output_file_));
+  ExtractedFlow flow;
+  flow.Reset(4);
+  uint64_t algorithm_runtime = 0;
+  EXPECT_FALSE(parser.ReadFlow(&flow, &algorithm_runtime, NULL));
+  EXPECT_EQ(flow.Flow(1, 2), 0);
+}
+
+// A stopped parser discards the output, until it is reset.
+TEST_F(SolverOutputParserTest, Stop) {
+  WriteOutput("f 1 2 3\n"
+              "c EOI\n");
+  SolverOutputParser parser;
+  parser.Reset(fileno(output_file_));
+  parser.Stop();
+  ExtractedFlow flow;
+  flow.Reset(4);
+  uint64_t algorithm_runtime = 0;
+  EXPECT_FALSE(parser.ReadFlow(&flow, &algorithm_runtime, NULL));
+  EXPECT_EQ(flow.Flow(1, 2), 0);
+  CHECK_EQ(lseek(fileno(output_file_), 0, SEEK_SET), 0);
+  parser.Reset(fileno(output_file_));
+  flow.Reset(4);
+  EXPECT_TRUE(parser.ReadFlow(&flow, &algorithm_runtime, NULL));
+  EXPECT_EQ(flow.Flow(1, 2), 3);
+}
+
+// Parses the flow of two iterations in the binary format with a buffer that
+// is smaller than a record.
+TEST_F(SolverOutputParserTest, ReadBinaryFlow) {
+  string output;
+  AppendBinaryRecordType(BINARY_RECORD_ALGORITHM_TIME, &output);
+  AppendBinaryUInt64(1234, &output);
+  AppendBinaryRecordType(BINARY_RECORD_FLOW, &output);
+  AppendBinaryUInt64(1, &output);
+  AppendBinaryUInt64(2, &output);
+  AppendBinaryUInt64(3, &output);
+  AppendBinaryRecordType(BINARY_RECORD_COST, &output);
+  AppendBinaryInt64(42, &output);
+  AppendBinaryRecordType(BINARY_RECORD_END_OF_ITERATION, &output);
+  AppendBinaryRecordType(BINARY_RECORD_FLOW, &output);
+  AppendBinaryUInt64(3, &output);
+  AppendBinaryUInt64(1, &output);
+  AppendBinaryUInt64(2, &output);
+  AppendBinaryRecordType(BINARY_RECORD_END_OF_ITERATION, &output);
+  WriteOutput(output);
+  SolverOutputParser parser(8);
+  parser.Reset(fileno(output_file_));
+  ExtractedFlow flow;
+  flow.Reset(4);
+  uint64_t algorithm_runtime = 0;
+  EXPECT_TRUE(parser.ReadBinaryFlow(&flow, &algorithm_runtime, NULL));
+  EXPECT_EQ(algorithm_runtime, 1234);
+  EXPECT_EQ(flow.Flow(1, 2), 3);
+  flow.Reset(4);
+  EXPECT_TRUE(parser.ReadBinaryFlow(&flow, &algorithm_runtime, NULL));
+  EXPECT_EQ(flow.Flow(3, 1), 2);
+  flow.Reset(4);
+  EXPECT_FALSE(parser.ReadBinaryFlow(&flow, &algorithm_runtime, NULL));
+}
+
+// Binary output that ends with a truncated record or contains a record of
+// an unknown type is incomplete.
+TEST_F(SolverOutputParserTest, MalformedBinaryRecords) {
+  string output;
+  AppendBinaryRecordType(BINARY_RECORD_ASSIGNMENT, &output);
+  AppendBinaryUInt64(5, &output);
+  AppendBinaryUInt64(7, &output);
+  AppendBinaryRecordType(BINARY_RECORD_ASSIGNMENT, &output);
+  AppendBinaryUInt64(6, &output);
+  WriteOutput(output);
+  SolverOutputParser parser;
+  parser.Reset(fileno(output_file_));
+  multimap<uint64_t, uint64_t> task_mappings;
+  uint64_t algorithm_runtime = 0;
+  EXPECT_FALSE(parser.ReadBinaryTaskMappings(&task_mappings,
+                                             &algorithm_runtime));
+  ASSERT_EQ(task_mappings.size(), 1);
+  EXPECT_EQ(task_mappings.find(5)->second, 7);
+  output.clear();
+  output.push_back('?');
+  AppendBinaryRecordType(BINARY_RECORD_END_OF_ITERATION, &output);
+  CHECK_EQ(ftruncate(fileno(output_file_), 0), 0);
+  WriteOutput(output);
+  parser.Reset(fileno(output_file_));
+  task_mappings.clear();
+  EXPECT_FALSE(parser.ReadBinaryTaskMappings(&task_mappings,
+                                             &algorithm_runtime));
+}
+
+// A stopped parser discards binary output, too.
+TEST_F(SolverOutputParserTest, StopBinary) {
+  string output;
+  AppendBinaryRecordType(BINARY_RECORD_FLOW, &output);
+  AppendBinaryUInt64(1, &output);
+  AppendBinaryUInt64(2, &output);
+  AppendBinaryUInt64(3, &output);
+  AppendBinaryRecordType(BINARY_RECORD_END_OF_ITERATION, &output);
+  WriteOutput(output);
+  SolverOutputParser parser;
+  parser.Reset(fileno(output_file_));
+  parser.Stop();
+  ExtractedFlow flow;
+  flow.Reset(4);
+  uint64_t algorithm_runtime = 0;
+  EXPECT_FALSE(parser.ReadBinaryFlow(&flow, &algorithm_runtime, NULL));
+  EXPECT_EQ(flow.Flow(1, 2), 0);
+}
+
+// Parses 1M flow lines and compares the time it takes to reading them with
+// fgets and sscanf.
+TEST_F(SolverOutputParserTest, ReadFlowBenchmark) {
+  const uint64_t kNumArcs = 1000000;
+  const uint64_t kNumNodes = 100000;
+  string output;
+  for (uint64_t arc = 0; arc < kNumArcs; ++arc) {
+    output += "f " + to_string(arc % kNumNodes) + " " +
+      to_string((arc * 7 + 1) % kNumNodes) + " " + to_string(arc % 3) +
+      "\n";
+  }
+  output += "c EOI\n";
+  WriteOutput(output);
+  WallTime wall_time;
+  uint64_t start_time = wall_time.GetCurrentTimestamp();
+  ExtractedFlow sscanf_flow;
+  sscanf_flow.Reset(kNumNodes);
+  char line[100];
+  while (fgets(line, sizeof(line), output_file_) != NULL) {
+    if (line[0] == 'f') {
+      uint64_t src;
+      uint64_t dst;
+      uint64_t flow;
+      CHECK_EQ(sscanf(line, "%*c %ju %ju %ju", &src, &dst, &flow), 3);
+      if (flow > 0) {
+        sscanf_flow.AddArcFlow(src, dst, flow);
+      }
+    } else if (!strcmp(line, "c EOI\n")) {
+      break;
+    }
+  }
+  sscanf_flow.Finalize();
+  uint64_t sscanf_time = wall_time.GetCurrentTimestamp() - start_time;
+  CHECK_EQ(lseek(fileno(output_file_), 0, SEEK_SET), 0);
+  start_time = wall_time.GetCurrentTimestamp();
+  SolverOutputParser parser;
+  parser.Reset(fileno(output_file_));
+  ExtractedFlow flow;
+  flow.Reset(kNumNodes);
+  uint64_t algorithm_runtime = 0;
+  EXPECT_TRUE(parser.ReadFlow(&flow, &algorithm_runtime, NULL));
+  uint64_t parser_time = wall_time.GetCurrentTimestamp() - start_time;
+  LOG(INFO) << "Parsed " << kNumArcs << " flow lines in " << sscanf_time
+            << " us with fgets and sscanf and in " << parser_time
+            << " us with the streaming parser";
+  for (uint64_t node_id = 0; node_id < kNumNodes; ++node_id) {
+    ASSERT_EQ(flow.IncomingEnd(node_id) - flow.IncomingBegin(node_id),
+              sscanf_flow.IncomingEnd(node_id) -
+              sscanf_flow.IncomingBegin(node_id));
+  }
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
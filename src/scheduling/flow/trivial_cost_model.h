@@ -70,6 +70,12 @@ class TrivialCostModel : public CostModelInterface {
   FlowGraphNode* GatherStats(FlowGraphNode* accumulator, FlowGraphNode* other);
   void PrepareStats(FlowGraphNode* accumulator);
   FlowGraphNode* UpdateStats(FlowGraphNode* accumulator, FlowGraphNode* other);
+  bool IsThreadSafe() const {
+    return true;
+  }
+  bool SupportsArcCostCache() const {
+    return true;
+  }
 
  private:
   shared_ptr<ResourceMap_t> resource_map_;
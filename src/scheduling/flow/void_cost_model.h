@@ -67,6 +67,12 @@ class VoidCostModel : public CostModelInterface {
   FlowGraphNode* GatherStats(FlowGraphNode* accumulator, FlowGraphNode* other);
   void PrepareStats(FlowGraphNode* accumulator);
   FlowGraphNode* UpdateStats(FlowGraphNode* accumulator, FlowGraphNode* other);
+  bool IsThreadSafe() const {
+    return true;
+  }
+  bool SupportsArcCostCache() const {
+    return true;
+  }
 
  private:
   Cost_t TaskToClusterAggCost(TaskID_t task_id);
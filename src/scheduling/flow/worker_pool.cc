@@ -0,0 +1,99 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+
+#include "scheduling/flow/worker_pool.h"
+
+#include <boost/bind.hpp>
+
+namespace firmament {
+
+WorkerPool::WorkerPool()
+  : num_threads_(0), next_task_(0), num_unfinished_tasks_(0),
+    shutting_down_(false) {
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    shutting_down_ = true;
+  }
+  tasks_started_.notify_all();
+  threads_.join_all();
+}
+
+void WorkerPool::Run(vector<boost::function<void()>>* tasks,
+                     uint64_t num_threads) {
+  // The calling thread is one of the threads the tasks run on.
+  Start(tasks, num_threads > 0 ? num_threads - 1 : 0);
+  Wait();
+}
+
+bool WorkerPool::RunNextTask(boost::unique_lock<boost::mutex>* lock) {
+  if (next_task_ >= tasks_.size()) {
+    return false;
+  }
+  boost::function<void()>& task = tasks_[next_task_++];
+  lock->unlock();
+  task();
+  lock->lock();
+  if (--num_unfinished_tasks_ == 0) {
+    tasks_finished_.notify_all();
+  }
+  return true;
+}
+
+void WorkerPool::Start(vector<boost::function<void()>>* tasks,
+                       uint64_t num_threads) {
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    CHECK_EQ(num_unfinished_tasks_, 0);
+    // The tasks are swapped in rather than copied. The caller gets back the
+    // (empty) vector of the previous tasks, so that its storage is reused.
+    tasks_.swap(*tasks);
+    next_task_ = 0;
+    num_unfinished_tasks_ = tasks_.size();
+  }
+  for (; num_threads_ < num_threads; ++num_threads_) {
+    threads_.create_thread(boost::bind(&WorkerPool::WorkerLoop, this));
+  }
+  tasks_started_.notify_all();
+}
+
+void WorkerPool::Wait() {
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  while (RunNextTask(&lock)) {
+  }
+  while (num_unfinished_tasks_ > 0) {
+    tasks_finished_.wait(lock);
+  }
+  tasks_.clear();
+}
+
+void WorkerPool::WorkerLoop() {
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  while (!shutting_down_) {
+    if (!RunNextTask(&lock)) {
+      tasks_started_.wait(lock);
+    }
+  }
+}
+
+}  // namespace firmament
@@ -0,0 +1,82 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+
+// A pool of threads that is kept across scheduling rounds, so that work
+// split into many small tasks does not pay for starting and joining threads
+// every time it runs.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_WORKER_POOL_H
+#define FIRMAMENT_SCHEDULING_FLOW_WORKER_POOL_H
+
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include "base/common.h"
+
+namespace firmament {
+
+class WorkerPool {
+ public:
+  WorkerPool();
+  ~WorkerPool();
+  /**
+   * Starts running the tasks on the pool's threads, and returns without
+   * waiting for them. The tasks are moved out of the vector. The pool grows
+   * to num_threads threads if it is smaller. No other tasks may be started
+   * before Wait has returned.
+   */
+  void Start(vector<boost::function<void()>>* tasks, uint64_t num_threads);
+  /**
+   * Helps running the started tasks on the calling thread, and returns once
+   * all of them have finished.
+   */
+  void Wait();
+  /**
+   * Runs the tasks on up to num_threads threads, including the calling one.
+   */
+  void Run(vector<boost::function<void()>>* tasks, uint64_t num_threads);
+
+ private:
+  // Runs the next task that has not been started yet, if any. Expects the
+  // lock to be held, and releases it while the task runs.
+  bool RunNextTask(boost::unique_lock<boost::mutex>* lock);
+  void WorkerLoop();
+
+  boost::mutex mutex_;
+  // Signalled when tasks are started or the pool is shutting down.
+  boost::condition_variable tasks_started_;
+  // Signalled when the last started task has finished.
+  boost::condition_variable tasks_finished_;
+  boost::thread_group threads_;
+  uint64_t num_threads_;
+  vector<boost::function<void()>> tasks_;
+  // Index of the next task to run.
+  size_t next_task_;
+  // Number of tasks that have not finished yet.
+  size_t num_unfinished_tasks_;
+  bool shutting_down_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_WORKER_POOL_H
@@ -0,0 +1,74 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <boost/bind.hpp>
+
+#include "scheduling/flow/worker_pool.h"
+
+namespace firmament {
+
+void SetValue(uint64_t value, uint64_t* slot) {
+  *slot = value;
+}
+
+// The same pool runs several batches of tasks, with growing numbers of
+// threads.
+TEST(WorkerPoolTest, RunsAllTasksOfEveryBatch) {
+  WorkerPool pool;
+  vector<boost::function<void()>> tasks;
+  for (uint64_t num_threads = 1; num_threads <= 4; ++num_threads) {
+    vector<uint64_t> values(100, 0);
+    for (uint64_t i = 0; i < values.size(); ++i) {
+      tasks.push_back(boost::bind(&SetValue, num_threads * i, &values[i]));
+    }
+    pool.Run(&tasks, num_threads);
+    EXPECT_TRUE(tasks.empty());
+    for (uint64_t i = 0; i < values.size(); ++i) {
+      EXPECT_EQ(num_threads * i, values[i]);
+    }
+  }
+}
+
+// The calling thread can work while the tasks run.
+TEST(WorkerPoolTest, StartAndWait) {
+  WorkerPool pool;
+  vector<boost::function<void()>> tasks;
+  vector<uint64_t> values(10, 0);
+  for (uint64_t i = 0; i < values.size(); ++i) {
+    tasks.push_back(boost::bind(&SetValue, i + 1, &values[i]));
+  }
+  pool.Start(&tasks, 2);
+  uint64_t caller_value = 0;
+  SetValue(42, &caller_value);
+  pool.Wait();
+  EXPECT_EQ(42U, caller_value);
+  for (uint64_t i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(i + 1, values[i]);
+  }
+}
+
+}  // namespace firmament
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
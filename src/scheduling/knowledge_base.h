@@ -41,6 +41,8 @@
 #include "base/task_final_report.pb.h"
 #include "base/task_stats.pb.h"
 #include "scheduling/data_layer_manager_interface.h"
+#include "scheduling/label_index.h"
+#include "scheduling/topology_domain_counts.h"
 
 namespace firmament {
 
@@ -75,6 +77,18 @@ class KnowledgeBase {
     CHECK_NOTNULL(data_layer_manager_);
     return data_layer_manager_;
   }
+  inline const LabelIndex& label_index() {
+    return label_index_;
+  }
+  inline LabelIndex* mutable_label_index() {
+    return &label_index_;
+  }
+  inline const TopologyDomainCounts& topology_domain_counts() {
+    return topology_domain_counts_;
+  }
+  inline TopologyDomainCounts* mutable_topology_domain_counts() {
+    return &topology_domain_counts_;
+  }
 
  protected:
   unordered_map<ResourceID_t, deque<ResourceStats>,
@@ -86,6 +100,12 @@ class KnowledgeBase {
   boost::upgrade_mutex kb_lock_;
   unordered_map<ResourceID_t, uint64_t,
       boost::hash<boost::uuids::uuid>> resource_tasks_count_;
+  // Index of the machines' labels, used to filter machines by node selector
+  // and node affinity.
+  LabelIndex label_index_;
+  // Counts of the pods in every topology domain, used to evaluate pod
+  // affinity and anti-affinity.
+  TopologyDomainCounts topology_domain_counts_;
 
  private:
   fstream serial_machine_samples_;
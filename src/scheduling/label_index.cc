@@ -0,0 +1,353 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/label_index.h"
+
+#include <algorithm>
+
+#include "misc/map-util.h"
+
+namespace firmament {
+
+LabelIndex::LabelIndex() : taint_set_size_(0) {
+}
+
+void LabelIndex::AddOrUpdateMachine(ResourceID_t res_id,
+                                    const ResourceDescriptor& rd) {
+  size_t* slot_ptr = FindOrNull(machine_to_slot_, res_id);
+  size_t slot;
+  if (slot_ptr) {
+    slot = *slot_ptr;
+    UnindexSlot(slot);
+  } else if (!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+    CHECK(InsertIfNotPresent(&machine_to_slot_, res_id, slot));
+  } else {
+    slot = slot_attributes_.size();
+    if (slot == machines_.size()) {
+      // Grow the bitsets geometrically so that adding machines one by one
+      // does not resize every bitset each time.
+      Resize(max(static_cast<size_t>(64), 2 * machines_.size()));
+    }
+    slot_attributes_.push_back(scheduler::InternedNodeAttributes());
+    slot_taint_groups_.push_back(0);
+    CHECK(InsertIfNotPresent(&machine_to_slot_, res_id, slot));
+  }
+  machines_.set(slot);
+  scheduler::InternNodeAttributes(rd, &strings_, &slot_attributes_[slot]);
+  for (const auto& label : slot_attributes_[slot].labels_) {
+    MachineSet_t& key_machines = key_index_[label.first];
+    key_machines.resize(machines_.size());
+    key_machines.set(slot);
+    MachineSet_t& value_machines = value_index_[label.first][label.second];
+    value_machines.resize(machines_.size());
+    value_machines.set(slot);
+  }
+  vector<uint32_t> taint_ids;
+  for (const auto& taint : slot_attributes_[slot].taints_) {
+    taint_ids.push_back(InternTaint(taint));
+  }
+  sort(taint_ids.begin(), taint_ids.end());
+  taint_ids.erase(unique(taint_ids.begin(), taint_ids.end()),
+                  taint_ids.end());
+  map<vector<uint32_t>, uint32_t>::iterator group_it =
+      taint_groups_.find(taint_ids);
+  if (group_it == taint_groups_.end()) {
+    uint32_t group = static_cast<uint32_t>(taint_group_signatures_.size());
+    TaintSet_t signature(taint_set_size_);
+    for (uint32_t taint_id : taint_ids) {
+      signature.set(taint_id);
+    }
+    taint_group_signatures_.push_back(signature);
+    group_it = taint_groups_.insert(make_pair(taint_ids, group)).first;
+  }
+  slot_taint_groups_[slot] = group_it->second;
+}
+
+bool LabelIndex::Contains(const MachineSet_t& machines,
+                          ResourceID_t res_id) const {
+  const size_t* slot = FindOrNull(machine_to_slot_, res_id);
+  return slot && *slot < machines.size() && machines.test(*slot);
+}
+
+const scheduler::InternedNodeAttributes* LabelIndex::FindMachine(
+    ResourceID_t res_id) const {
+  const size_t* slot = FindOrNull(machine_to_slot_, res_id);
+  if (!slot) {
+    return NULL;
+  }
+  return &slot_attributes_[*slot];
+}
+
+bool LabelIndex::HasMachine(ResourceID_t res_id) const {
+  return ContainsKey(machine_to_slot_, res_id);
+}
+
+uint32_t LabelIndex::InternTaint(const scheduler::InternedTaint& taint) {
+  tuple<uint32_t, uint32_t, uint32_t> taint_key(
+      taint.key_, taint.value_, static_cast<uint32_t>(taint.effect_));
+  map<tuple<uint32_t, uint32_t, uint32_t>, uint32_t>::iterator it =
+      taint_ids_.find(taint_key);
+  if (it != taint_ids_.end()) {
+    return it->second;
+  }
+  uint32_t taint_id = static_cast<uint32_t>(taints_.size());
+  taints_.push_back(taint);
+  taint_ids_.insert(make_pair(taint_key, taint_id));
+  if (taints_.size() > taint_set_size_) {
+    ResizeTaintSets(max(static_cast<size_t>(64), 2 * taint_set_size_));
+  }
+  return taint_id;
+}
+
+void LabelIndex::IntolerableTaintCounts(const TolerationMasks& masks,
+                                        vector<int64_t>* group_counts) const {
+  CHECK_NOTNULL(group_counts);
+  CHECK_EQ(masks.num_taints_, taints_.size())
+    << "Toleration masks are out of date";
+  group_counts->resize(taint_group_signatures_.size());
+  for (size_t group = 0; group < taint_group_signatures_.size(); ++group) {
+    const TaintSet_t& signature = taint_group_signatures_[group];
+    if (signature.intersects(masks.hard_intolerable_)) {
+      (*group_counts)[group] = -1;
+      continue;
+    }
+    int64_t num_intolerable = 0;
+    for (size_t taint_id = signature.find_first();
+         taint_id != TaintSet_t::npos;
+         taint_id = signature.find_next(taint_id)) {
+      if (masks.soft_intolerable_.test(taint_id)) {
+        num_intolerable++;
+      }
+    }
+    (*group_counts)[group] = num_intolerable;
+  }
+}
+
+void LabelIndex::MachinesSatisfyingLabelSelectors(
+    const scheduler::CompiledLabelSelectors_t& selectors,
+    MachineSet_t* machines) const {
+  CHECK_NOTNULL(machines);
+  *machines = machines_;
+  MachineSet_t selected(machines_.size());
+  for (const auto& selector : selectors) {
+    switch (selector.type_) {
+      case LabelSelector::IN_SET: {
+        MachinesWithValues(selector.key_, selector.values_, &selected);
+        *machines &= selected;
+        break;
+      }
+      case LabelSelector::NOT_IN_SET: {
+        MachinesWithValues(selector.key_, selector.values_, &selected);
+        *machines -= selected;
+        break;
+      }
+      case LabelSelector::EXISTS_KEY: {
+        const MachineSet_t* key_machines =
+            FindOrNull(key_index_, selector.key_);
+        if (key_machines) {
+          *machines &= *key_machines;
+        } else {
+          machines->reset();
+        }
+        break;
+      }
+      case LabelSelector::NOT_EXISTS_KEY: {
+        const MachineSet_t* key_machines =
+            FindOrNull(key_index_, selector.key_);
+        if (key_machines) {
+          *machines -= *key_machines;
+        }
+        break;
+      }
+      case LabelSelector::GREATER_THAN: {
+        int64_t threshold = selector.threshold_;
+        MachinesWithValuesMatching(
+            selector.key_,
+            [threshold](const string& value) {
+              // Values that are not numbers do not match.
+              int64_t number;
+              return scheduler::ParseLabelNumber(value, &number) &&
+                number > threshold;
+            },
+            &selected);
+        *machines &= selected;
+        break;
+      }
+      case LabelSelector::LESSER_THAN: {
+        int64_t threshold = selector.threshold_;
+        MachinesWithValuesMatching(
+            selector.key_,
+            [threshold](const string& value) {
+              // Values that are not numbers do not match.
+              int64_t number;
+              return scheduler::ParseLabelNumber(value, &number) &&
+                number < threshold;
+            },
+            &selected);
+        *machines &= selected;
+        break;
+      }
+      default:
+        LOG(FATAL) << "Unsupported selector type: " << selector.type_;
+    }
+    if (machines->none()) {
+      break;
+    }
+  }
+}
+
+void LabelIndex::MachinesSatisfyingNodeSelectorAndNodeAffinity(
+    const scheduler::LabelPredicateProgram& program,
+    MachineSet_t* machines) const {
+  MachinesSatisfyingLabelSelectors(program.node_selector_, machines);
+  if (!program.has_required_terms_) {
+    return;
+  }
+  // A machine must match at least one of the terms; terms without match
+  // expressions match no machine.
+  MachineSet_t term_machines(machines_.size());
+  MachineSet_t any_term_machines(machines_.size());
+  for (const auto& term : program.required_terms_) {
+    if (term.empty()) {
+      continue;
+    }
+    MachinesSatisfyingLabelSelectors(term, &term_machines);
+    any_term_machines |= term_machines;
+  }
+  *machines &= any_term_machines;
+}
+
+void LabelIndex::MachinesWithValues(uint32_t key,
+                                    const vector<uint32_t>& values,
+                                    MachineSet_t* machines) const {
+  machines->reset();
+  const unordered_map<uint32_t, MachineSet_t>* value_machines =
+      FindOrNull(value_index_, key);
+  if (!value_machines) {
+    return;
+  }
+  for (uint32_t value : values) {
+    const MachineSet_t* machines_with_value =
+        FindOrNull(*value_machines, value);
+    if (machines_with_value) {
+      *machines |= *machines_with_value;
+    }
+  }
+}
+
+template<typename Predicate>
+void LabelIndex::MachinesWithValuesMatching(uint32_t key,
+                                            Predicate predicate,
+                                            MachineSet_t* machines) const {
+  machines->reset();
+  const unordered_map<uint32_t, MachineSet_t>* value_machines =
+      FindOrNull(value_index_, key);
+  if (!value_machines) {
+    return;
+  }
+  for (const auto& value_and_machines : *value_machines) {
+    if (predicate(strings_.String(value_and_machines.first))) {
+      *machines |= value_and_machines.second;
+    }
+  }
+}
+
+void LabelIndex::RemoveMachine(ResourceID_t res_id) {
+  size_t* slot = FindOrNull(machine_to_slot_, res_id);
+  if (!slot) {
+    return;
+  }
+  UnindexSlot(*slot);
+  machines_.reset(*slot);
+  free_slots_.push_back(*slot);
+  machine_to_slot_.erase(res_id);
+}
+
+void LabelIndex::Resize(size_t num_slots) {
+  machines_.resize(num_slots);
+  for (auto& key_machines : key_index_) {
+    key_machines.second.resize(num_slots);
+  }
+  for (auto& key_values : value_index_) {
+    for (auto& value_machines : key_values.second) {
+      value_machines.second.resize(num_slots);
+    }
+  }
+}
+
+void LabelIndex::ResizeTaintSets(size_t num_taints) {
+  taint_set_size_ = num_taints;
+  for (auto& signature : taint_group_signatures_) {
+    signature.resize(num_taints);
+  }
+}
+
+uint32_t LabelIndex::TaintGroup(ResourceID_t res_id) const {
+  const size_t* slot = FindOrNull(machine_to_slot_, res_id);
+  CHECK_NOTNULL(slot);
+  return slot_taint_groups_[*slot];
+}
+
+void LabelIndex::UnindexSlot(size_t slot) {
+  for (const auto& label : slot_attributes_[slot].labels_) {
+    MachineSet_t& key_machines = key_index_[label.first];
+    key_machines.reset(slot);
+    if (key_machines.none()) {
+      key_index_.erase(label.first);
+    }
+    unordered_map<uint32_t, MachineSet_t>& value_machines =
+        value_index_[label.first];
+    MachineSet_t& machines_with_value = value_machines[label.second];
+    machines_with_value.reset(slot);
+    if (machines_with_value.none()) {
+      value_machines.erase(label.second);
+      if (value_machines.empty()) {
+        value_index_.erase(label.first);
+      }
+    }
+  }
+  slot_attributes_[slot].labels_.clear();
+  slot_attributes_[slot].taints_.clear();
+}
+
+void LabelIndex::UpdateTolerationMasks(
+    const scheduler::LabelPredicateProgram& program,
+    TolerationMasks* masks) const {
+  CHECK_NOTNULL(masks);
+  masks->hard_intolerable_.resize(taint_set_size_);
+  masks->soft_intolerable_.resize(taint_set_size_);
+  for (uint32_t taint_id = masks->num_taints_; taint_id < taints_.size();
+       ++taint_id) {
+    const scheduler::InternedTaint& taint = taints_[taint_id];
+    if (taint.effect_ == scheduler::TAINT_NO_SCHEDULE ||
+        taint.effect_ == scheduler::TAINT_NO_EXECUTE) {
+      masks->hard_intolerable_[taint_id] =
+          !scheduler::ToleratesHardTaint(taint, program);
+    } else if (taint.effect_ == scheduler::TAINT_PREFER_NO_SCHEDULE) {
+      masks->soft_intolerable_[taint_id] =
+          !scheduler::ToleratesSoftTaint(taint, program);
+    }
+  }
+  masks->num_taints_ = static_cast<uint32_t>(taints_.size());
+}
+
+}  // namespace firmament
@@ -0,0 +1,172 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Cluster-wide inverted index from machine labels to the set of machines
+// that carry them. Every machine is assigned a slot, and the machines that
+// have a label key or key/value pair are kept as a bitset over the slots, so
+// that node selectors and node affinity terms are evaluated with bitset
+// AND/OR/ANDNOT operations rather than by matching every machine's labels.
+// The index also keeps every machine's labels and taints interned, for the
+// compiled predicates of label_utils.h to be evaluated against. Every
+// distinct taint is assigned a small id, and machines with the same set of
+// taints share a taint group, so that tolerations are evaluated once per
+// group rather than once per machine.
+
+#ifndef FIRMAMENT_SCHEDULING_LABEL_INDEX_H
+#define FIRMAMENT_SCHEDULING_LABEL_INDEX_H
+
+#include <boost/dynamic_bitset.hpp>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "base/common.h"
+#include "base/resource_desc.pb.h"
+#include "base/types.h"
+#include "scheduling/label_utils.h"
+
+namespace firmament {
+
+typedef boost::dynamic_bitset<> MachineSet_t;
+typedef boost::dynamic_bitset<> TaintSet_t;
+
+// The taints a task EC does not tolerate, as bitsets over the taint ids of a
+// LabelIndex. Taint ids are never reused, so the masks only need to be
+// extended as new taints appear.
+struct TolerationMasks {
+  TolerationMasks() : num_taints_(0) {
+  }
+  TaintSet_t hard_intolerable_;
+  TaintSet_t soft_intolerable_;
+  // The number of taint ids the masks have been computed for.
+  uint32_t num_taints_;
+};
+
+class LabelIndex {
+ public:
+  LabelIndex();
+  /**
+   * Indexes the labels and taints of a machine, replacing the ones
+   * previously indexed for it.
+   */
+  void AddOrUpdateMachine(ResourceID_t res_id, const ResourceDescriptor& rd);
+  /**
+   * Returns true if the machine is in the set. Machines that are not indexed
+   * are in no set.
+   */
+  bool Contains(const MachineSet_t& machines, ResourceID_t res_id) const;
+  /**
+   * Returns the interned labels and taints of the machine, or NULL if the
+   * machine is not indexed.
+   */
+  const scheduler::InternedNodeAttributes* FindMachine(
+      ResourceID_t res_id) const;
+  /**
+   * Returns true if the machine's labels are indexed.
+   */
+  bool HasMachine(ResourceID_t res_id) const;
+  /**
+   * Computes, for every taint group, the number of PreferNoSchedule taints
+   * that the masks do not tolerate, or -1 if they do not tolerate one of the
+   * group's NoSchedule or NoExecute taints.
+   * @param masks masks that are up to date, see UpdateTolerationMasks
+   * @param group_counts set to the counts, indexed by taint group
+   */
+  void IntolerableTaintCounts(const TolerationMasks& masks,
+                              vector<int64_t>* group_counts) const;
+  /**
+   * Computes the machines that satisfy all the label selectors.
+   */
+  void MachinesSatisfyingLabelSelectors(
+      const scheduler::CompiledLabelSelectors_t& selectors,
+      MachineSet_t* machines) const;
+  /**
+   * Computes the machines that satisfy the program's node selector and
+   * required node affinity terms, i.e., the machines for which
+   * scheduler::SatisfiesNodeSelectorAndNodeAffinity returns true.
+   */
+  void MachinesSatisfyingNodeSelectorAndNodeAffinity(
+      const scheduler::LabelPredicateProgram& program,
+      MachineSet_t* machines) const;
+  void RemoveMachine(ResourceID_t res_id);
+  /**
+   * Returns the taint group of an indexed machine.
+   */
+  uint32_t TaintGroup(ResourceID_t res_id) const;
+  /**
+   * Extends the masks with the taints that have been indexed since they were
+   * last updated.
+   */
+  void UpdateTolerationMasks(const scheduler::LabelPredicateProgram& program,
+                             TolerationMasks* masks) const;
+  inline const scheduler::LabelStringTable& strings() const {
+    return strings_;
+  }
+  inline scheduler::LabelStringTable* mutable_strings() {
+    return &strings_;
+  }
+
+ private:
+  // Returns the machines that carry the label key with one of the values.
+  void MachinesWithValues(uint32_t key, const vector<uint32_t>& values,
+                          MachineSet_t* machines) const;
+  // Returns the machines that carry the label key with a value the predicate
+  // holds for.
+  template<typename Predicate>
+  void MachinesWithValuesMatching(uint32_t key, Predicate predicate,
+                                  MachineSet_t* machines) const;
+  uint32_t InternTaint(const scheduler::InternedTaint& taint);
+  void Resize(size_t num_slots);
+  void ResizeTaintSets(size_t num_taints);
+  void UnindexSlot(size_t slot);
+
+  // The label and taint strings of the machines and of the programs that
+  // are evaluated against them.
+  scheduler::LabelStringTable strings_;
+  unordered_map<ResourceID_t, size_t, boost::hash<ResourceID_t>>
+    machine_to_slot_;
+  // Slots of removed machines that can be reused.
+  vector<size_t> free_slots_;
+  // The slots that hold a machine.
+  MachineSet_t machines_;
+  // The labels and taints indexed for the machine in every slot.
+  vector<scheduler::InternedNodeAttributes> slot_attributes_;
+  // Label key -> machines that carry the key.
+  unordered_map<uint32_t, MachineSet_t> key_index_;
+  // Label key -> label value -> machines that carry the key/value pair.
+  unordered_map<uint32_t, unordered_map<uint32_t, MachineSet_t>> value_index_;
+  // Taint id -> taint, and (key, value, effect) -> taint id.
+  vector<scheduler::InternedTaint> taints_;
+  map<tuple<uint32_t, uint32_t, uint32_t>, uint32_t> taint_ids_;
+  // The size of all taint sets, which grows geometrically.
+  size_t taint_set_size_;
+  // Taint group -> the ids of the group's taints. Groups are not removed when
+  // their last machine is, as the number of distinct groups is small.
+  vector<TaintSet_t> taint_group_signatures_;
+  // Sorted taint ids -> taint group.
+  map<vector<uint32_t>, uint32_t> taint_groups_;
+  // The taint group of the machine in every slot.
+  vector<uint32_t> slot_taint_groups_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_LABEL_INDEX_H
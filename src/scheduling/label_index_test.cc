@@ -0,0 +1,237 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "misc/utils.h"
+#include "scheduling/label_index.h"
+#include "scheduling/label_utils.h"
+
+namespace firmament {
+
+class LabelIndexTest : public ::testing::Test {
+ protected:
+  LabelIndexTest() {
+    // You can do initial set-up work for each test here.
+  }
+
+  virtual ~LabelIndexTest() {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  ResourceID_t AddMachine(const string& machine_name, const string& zone,
+                          const string& disk) {
+    ResourceID_t res_id = GenerateResourceID(machine_name);
+    ResourceDescriptor* rd_ptr = &machines_[res_id];
+    rd_ptr->set_uuid(to_string(res_id));
+    rd_ptr->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    Label* zone_label = rd_ptr->add_labels();
+    zone_label->set_key("zone");
+    zone_label->set_value(zone);
+    if (!disk.empty()) {
+      Label* disk_label = rd_ptr->add_labels();
+      disk_label->set_key("disk");
+      disk_label->set_value(disk);
+    }
+    label_index_.AddOrUpdateMachine(res_id, *rd_ptr);
+    return res_id;
+  }
+
+  // Checks that the index selects the same machines as
+  // scheduler::SatisfiesNodeSelectorAndNodeAffinity.
+  void ExpectSameAsLabelUtils(const TaskDescriptor& td) {
+    scheduler::LabelPredicateProgram program;
+    scheduler::CompileLabelPredicates(td, label_index_.mutable_strings(),
+                                      &program);
+    MachineSet_t selected;
+    label_index_.MachinesSatisfyingNodeSelectorAndNodeAffinity(program,
+                                                               &selected);
+    for (auto& machine : machines_) {
+      EXPECT_EQ(scheduler::SatisfiesNodeSelectorAndNodeAffinity(
+                    machine.second, td),
+                label_index_.Contains(selected, machine.first));
+    }
+  }
+
+  void MachinesSatisfyingLabelSelectors(const TaskDescriptor& td,
+                                        MachineSet_t* machines) {
+    scheduler::CompiledLabelSelectors_t selectors;
+    scheduler::CompileLabelSelectors(td.label_selectors(),
+                                     label_index_.mutable_strings(),
+                                     &selectors);
+    label_index_.MachinesSatisfyingLabelSelectors(selectors, machines);
+  }
+
+  LabelIndex label_index_;
+  unordered_map<ResourceID_t, ResourceDescriptor,
+                boost::hash<ResourceID_t>> machines_;
+};
+
+TEST_F(LabelIndexTest, LabelSelectors) {
+  ResourceID_t machine1 = AddMachine("Machine1", "a", "ssd");
+  ResourceID_t machine2 = AddMachine("Machine2", "b", "hdd");
+  ResourceID_t machine3 = AddMachine("Machine3", "c", "");
+  TaskDescriptor td;
+  LabelSelector* in_set = td.add_label_selectors();
+  in_set->set_type(LabelSelector::IN_SET);
+  in_set->set_key("zone");
+  in_set->add_values("a");
+  in_set->add_values("c");
+  MachineSet_t selected;
+  MachinesSatisfyingLabelSelectors(td, &selected);
+  EXPECT_TRUE(label_index_.Contains(selected, machine1));
+  EXPECT_FALSE(label_index_.Contains(selected, machine2));
+  EXPECT_TRUE(label_index_.Contains(selected, machine3));
+  ExpectSameAsLabelUtils(td);
+  LabelSelector* exists = td.add_label_selectors();
+  exists->set_type(LabelSelector::EXISTS_KEY);
+  exists->set_key("disk");
+  MachinesSatisfyingLabelSelectors(td, &selected);
+  EXPECT_TRUE(label_index_.Contains(selected, machine1));
+  EXPECT_FALSE(label_index_.Contains(selected, machine3));
+  ExpectSameAsLabelUtils(td);
+  exists->set_type(LabelSelector::NOT_EXISTS_KEY);
+  ExpectSameAsLabelUtils(td);
+  in_set->set_type(LabelSelector::NOT_IN_SET);
+  ExpectSameAsLabelUtils(td);
+}
+
+// Machines whose value for the key is not a number match neither bound.
+TEST_F(LabelIndexTest, NumericSelectorsWithNonNumericValues) {
+  ResourceID_t machine1 = AddMachine("Machine1", "a", "10");
+  ResourceID_t machine2 = AddMachine("Machine2", "b", "large");
+  ResourceID_t machine3 = AddMachine("Machine3", "c", "30");
+  TaskDescriptor td;
+  LabelSelector* greater_than = td.add_label_selectors();
+  greater_than->set_type(LabelSelector::GREATER_THAN);
+  greater_than->set_key("disk");
+  greater_than->add_values("20");
+  MachineSet_t selected;
+  MachinesSatisfyingLabelSelectors(td, &selected);
+  EXPECT_FALSE(label_index_.Contains(selected, machine1));
+  EXPECT_FALSE(label_index_.Contains(selected, machine2));
+  EXPECT_TRUE(label_index_.Contains(selected, machine3));
+  greater_than->set_type(LabelSelector::LESSER_THAN);
+  MachinesSatisfyingLabelSelectors(td, &selected);
+  EXPECT_TRUE(label_index_.Contains(selected, machine1));
+  EXPECT_FALSE(label_index_.Contains(selected, machine2));
+  EXPECT_FALSE(label_index_.Contains(selected, machine3));
+}
+
+TEST_F(LabelIndexTest, NodeAffinity) {
+  AddMachine("Machine1", "a", "ssd");
+  AddMachine("Machine2", "b", "hdd");
+  AddMachine("Machine3", "c", "");
+  TaskDescriptor td;
+  NodeSelector* required = td.mutable_affinity()->mutable_node_affinity()
+      ->mutable_requiredduringschedulingignoredduringexecution();
+  NodeSelectorRequirement* zone_requirement =
+      required->add_nodeselectorterms()->add_matchexpressions();
+  zone_requirement->set_key("zone");
+  zone_requirement->set_operator_("In");
+  zone_requirement->add_values("a");
+  ExpectSameAsLabelUtils(td);
+  NodeSelectorRequirement* disk_requirement =
+      required->add_nodeselectorterms()->add_matchexpressions();
+  disk_requirement->set_key("disk");
+  disk_requirement->set_operator_("DoesNotExist");
+  ExpectSameAsLabelUtils(td);
+  LabelSelector* node_selector = td.add_label_selectors();
+  node_selector->set_type(LabelSelector::NOT_IN_SET);
+  node_selector->set_key("zone");
+  node_selector->add_values("a");
+  ExpectSameAsLabelUtils(td);
+}
+
+TEST_F(LabelIndexTest, UpdateAndRemoveMachine) {
+  ResourceID_t machine1 = AddMachine("Machine1", "a", "ssd");
+  ResourceID_t machine2 = AddMachine("Machine2", "a", "");
+  TaskDescriptor td;
+  LabelSelector* in_set = td.add_label_selectors();
+  in_set->set_type(LabelSelector::IN_SET);
+  in_set->set_key("zone");
+  in_set->add_values("a");
+  MachineSet_t selected;
+  MachinesSatisfyingLabelSelectors(td, &selected);
+  EXPECT_TRUE(label_index_.Contains(selected, machine1));
+  EXPECT_TRUE(label_index_.Contains(selected, machine2));
+  // Move machine1 to another zone.
+  machines_[machine1].mutable_labels(0)->set_value("b");
+  label_index_.AddOrUpdateMachine(machine1, machines_[machine1]);
+  MachinesSatisfyingLabelSelectors(td, &selected);
+  EXPECT_FALSE(label_index_.Contains(selected, machine1));
+  EXPECT_TRUE(label_index_.Contains(selected, machine2));
+  // A removed machine is in no set, and its slot is reused.
+  label_index_.RemoveMachine(machine2);
+  machines_.erase(machine2);
+  EXPECT_FALSE(label_index_.HasMachine(machine2));
+  MachinesSatisfyingLabelSelectors(td, &selected);
+  EXPECT_TRUE(selected.none());
+  ResourceID_t machine3 = AddMachine("Machine3", "a", "");
+  MachinesSatisfyingLabelSelectors(td, &selected);
+  EXPECT_EQ(1U, selected.count());
+  EXPECT_TRUE(label_index_.Contains(selected, machine3));
+}
+
+TEST_F(LabelIndexTest, TaintGroups) {
+  ResourceID_t machine1 = AddMachine("Machine1", "a", "");
+  ResourceID_t machine2 = AddMachine("Machine2", "a", "");
+  ResourceID_t machine3 = AddMachine("Machine3", "a", "");
+  // Machine1 and Machine2 have the same taints, Machine3 has none.
+  for (ResourceID_t res_id : {machine1, machine2}) {
+    Taint* taint = machines_[res_id].add_taints();
+    taint->set_key("gpu");
+    taint->set_value("true");
+    taint->set_effect("PreferNoSchedule");
+    label_index_.AddOrUpdateMachine(res_id, machines_[res_id]);
+  }
+  EXPECT_EQ(label_index_.TaintGroup(machine1),
+            label_index_.TaintGroup(machine2));
+  EXPECT_NE(label_index_.TaintGroup(machine1),
+            label_index_.TaintGroup(machine3));
+  TaskDescriptor td;
+  scheduler::LabelPredicateProgram program;
+  scheduler::CompileLabelPredicates(td, label_index_.mutable_strings(),
+                                    &program);
+  TolerationMasks masks;
+  label_index_.UpdateTolerationMasks(program, &masks);
+  vector<int64_t> group_counts;
+  label_index_.IntolerableTaintCounts(masks, &group_counts);
+  EXPECT_EQ(1, group_counts[label_index_.TaintGroup(machine1)]);
+  EXPECT_EQ(0, group_counts[label_index_.TaintGroup(machine3)]);
+  // A hard taint added later is picked up when the masks are updated.
+  Taint* taint = machines_[machine3].add_taints();
+  taint->set_key("dedicated");
+  taint->set_value("db");
+  taint->set_effect("NoSchedule");
+  label_index_.AddOrUpdateMachine(machine3, machines_[machine3]);
+  label_index_.UpdateTolerationMasks(program, &masks);
+  label_index_.IntolerableTaintCounts(masks, &group_counts);
+  EXPECT_EQ(-1, group_counts[label_index_.TaintGroup(machine3)]);
+  EXPECT_FALSE(scheduler::HasMatchingTolerationforNodeTaints(
+      machines_[machine3], td));
+}
+
+}  // namespace firmament
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -18,7 +18,11 @@
  * permissions and limitations under the License.
  */
 
+#include <errno.h>
+#include <stdlib.h>
+
 #include <boost/functional/hash.hpp>
+#include <algorithm>
 #include "misc/map-util.h"
 #include "misc/utils.h"
 #include "scheduling/label_utils.h"
@@ -295,5 +299,377 @@ bool HasMatchingTolerationforNodeTaints(const ResourceDescriptor& rd,
   return IsPodScheduleOnNode;
 }
 
+uint32_t LabelStringTable::Intern(const string& str) {
+  unordered_map<string, uint32_t>::const_iterator it = ids_.find(str);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  uint32_t id = static_cast<uint32_t>(strings_.size());
+  strings_.push_back(str);
+  CHECK(InsertIfNotPresent(&ids_, str, id));
+  return id;
+}
+
+namespace {
+
+TaintEffect TaintEffectFromString(const string& effect) {
+  if (effect == "NoSchedule") {
+    return TAINT_NO_SCHEDULE;
+  } else if (effect == "PreferNoSchedule") {
+    return TAINT_PREFER_NO_SCHEDULE;
+  } else if (effect == "NoExecute") {
+    return TAINT_NO_EXECUTE;
+  }
+  return TAINT_OTHER_EFFECT;
+}
+
+void AddCompiledToleration(uint32_t key, uint32_t value, TaintEffect effect,
+                           bool exists,
+                           vector<CompiledToleration>* tolerations) {
+  CompiledToleration toleration = {key, value, effect, exists};
+  tolerations->push_back(toleration);
+}
+
+// Returns the id of the machine's value for the label key, or NULL if the
+// machine does not carry the key.
+const uint32_t* FindLabelValue(const InternedNodeAttributes& node,
+                               uint32_t key) {
+  vector<pair<uint32_t, uint32_t>>::const_iterator it =
+      lower_bound(node.labels_.begin(), node.labels_.end(),
+                  make_pair(key, static_cast<uint32_t>(0)));
+  if (it == node.labels_.end() || it->first != key) {
+    return NULL;
+  }
+  return &it->second;
+}
+
+bool SatisfiesLabelSelector(const InternedNodeAttributes& node,
+                            const CompiledLabelSelector& selector,
+                            const LabelStringTable& strings) {
+  const uint32_t* value = FindLabelValue(node, selector.key_);
+  switch (selector.type_) {
+    case LabelSelector::IN_SET:
+      return value != NULL && binary_search(selector.values_.begin(),
+                                            selector.values_.end(), *value);
+    case LabelSelector::NOT_IN_SET:
+      return value == NULL || !binary_search(selector.values_.begin(),
+                                             selector.values_.end(), *value);
+    case LabelSelector::EXISTS_KEY:
+      return value != NULL;
+    case LabelSelector::NOT_EXISTS_KEY:
+      return value == NULL;
+    case LabelSelector::GREATER_THAN:
+    case LabelSelector::LESSER_THAN: {
+      // Values that are not numbers do not match.
+      int64_t number;
+      if (value == NULL ||
+          !ParseLabelNumber(strings.String(*value), &number)) {
+        return false;
+      }
+      return selector.type_ == LabelSelector::GREATER_THAN ?
+        number > selector.threshold_ : number < selector.threshold_;
+    }
+    default:
+      LOG(FATAL) << "Unsupported selector type: " << selector.type_;
+  }
+  return false;
+}
+
+void CompileLabelSelector(const string& key, LabelSelector::SelectorType type,
+                          const RepeatedPtrField<string>& values,
+                          LabelStringTable* strings,
+                          CompiledLabelSelectors_t* compiled_selectors) {
+  CompiledLabelSelector selector;
+  selector.type_ = type;
+  selector.key_ = strings->Intern(key);
+  selector.threshold_ = 0;
+  if (type == LabelSelector::GREATER_THAN ||
+      type == LabelSelector::LESSER_THAN) {
+    if (values.size() == 0 ||
+        !ParseLabelNumber(values.Get(0), &selector.threshold_)) {
+      // The selector comes from the user. It is compiled to an IN_SET
+      // selector without values, which matches no machine.
+      LOG(WARNING) << "Selector on " << key << " has no numeric bound; it "
+                   << "matches no machine";
+      selector.type_ = LabelSelector::IN_SET;
+      compiled_selectors->push_back(selector);
+      return;
+    }
+  }
+  for (const auto& value : values) {
+    selector.values_.push_back(strings->Intern(value));
+  }
+  sort(selector.values_.begin(), selector.values_.end());
+  compiled_selectors->push_back(selector);
+}
+
+}  // namespace
+
+void CompileLabelPredicates(const TaskDescriptor& td,
+                            LabelStringTable* strings,
+                            LabelPredicateProgram* program) {
+  CHECK_NOTNULL(strings);
+  CHECK_NOTNULL(program);
+  program->node_selector_.clear();
+  program->has_required_terms_ = false;
+  program->required_terms_.clear();
+  program->preferred_terms_.clear();
+  program->tolerates_all_hard_taints_ = false;
+  program->hard_tolerations_.clear();
+  program->tolerates_all_soft_taints_ = false;
+  program->soft_tolerations_.clear();
+  CompileLabelSelectors(td.label_selectors(), strings,
+                        &program->node_selector_);
+  if (td.has_affinity() && td.affinity().has_node_affinity()) {
+    const NodeAffinity& node_affinity = td.affinity().node_affinity();
+    if (node_affinity.has_requiredduringschedulingignoredduringexecution() &&
+        node_affinity.requiredduringschedulingignoredduringexecution()
+            .nodeselectorterms_size()) {
+      program->has_required_terms_ = true;
+      for (const auto& term :
+           node_affinity.requiredduringschedulingignoredduringexecution()
+               .nodeselectorterms()) {
+        program->required_terms_.push_back(CompiledLabelSelectors_t());
+        CompileNodeSelectorRequirements(term.matchexpressions(), strings,
+                                        &program->required_terms_.back());
+      }
+    }
+    for (const auto& preferred_term :
+         node_affinity.preferredduringschedulingignoredduringexecution()) {
+      // Terms without weight or match expressions never add to the score.
+      if (!preferred_term.weight() || !preferred_term.has_preference() ||
+          preferred_term.preference().matchexpressions_size() == 0) {
+        continue;
+      }
+      program->preferred_terms_.push_back(
+          make_pair(preferred_term.weight(), CompiledLabelSelectors_t()));
+      CompileNodeSelectorRequirements(
+          preferred_term.preference().matchexpressions(), strings,
+          &program->preferred_terms_.back().second);
+    }
+  }
+  for (const auto& toleration : td.tolerations()) {
+    TaintEffect effect = TaintEffectFromString(toleration.effect());
+    // Only tasks with more than the default tolerations tolerate hard
+    // taints; see HasMatchingTolerationforNodeTaints.
+    bool hard = td.tolerations_size() > DEFAULT_TOLERATIONS &&
+        (toleration.effect() == "" || effect == TAINT_NO_SCHEDULE ||
+         effect == TAINT_NO_EXECUTE);
+    bool soft = toleration.effect() == "" ||
+        effect == TAINT_PREFER_NO_SCHEDULE;
+    if (!hard && !soft) {
+      continue;
+    }
+    bool exists = toleration.operator_() == "Exists";
+    if (!exists && toleration.operator_() != "Equal" &&
+        toleration.operator_() != "") {
+      LOG(FATAL) << "Unsupported operator :" << toleration.operator_();
+    }
+    uint32_t key = strings->Intern(toleration.key());
+    uint32_t value = strings->Intern(toleration.value());
+    if (hard) {
+      if (exists && toleration.key() == "") {
+        program->tolerates_all_hard_taints_ = true;
+      } else if (toleration.effect() == "") {
+        AddCompiledToleration(key, value, TAINT_NO_EXECUTE, exists,
+                              &program->hard_tolerations_);
+        AddCompiledToleration(key, value, TAINT_NO_SCHEDULE, exists,
+                              &program->hard_tolerations_);
+      } else {
+        AddCompiledToleration(key, value, effect, exists,
+                              &program->hard_tolerations_);
+      }
+    }
+    if (soft) {
+      if (exists && toleration.key() == "") {
+        program->tolerates_all_soft_taints_ = true;
+      } else {
+        AddCompiledToleration(key, value, TAINT_PREFER_NO_SCHEDULE, exists,
+                              &program->soft_tolerations_);
+      }
+    }
+  }
+}
+
+void CompileLabelSelectors(const RepeatedPtrField<LabelSelector>& selectors,
+                           LabelStringTable* strings,
+                           CompiledLabelSelectors_t* compiled_selectors) {
+  for (const auto& selector : selectors) {
+    CompileLabelSelector(selector.key(), selector.type(), selector.values(),
+                         strings, compiled_selectors);
+  }
+}
+
+void CompileNodeSelectorRequirements(
+    const RepeatedPtrField<NodeSelectorRequirement>& matchExpressions,
+    LabelStringTable* strings, CompiledLabelSelectors_t* compiled_selectors) {
+  for (const auto& nsm : matchExpressions) {
+    // Unknown operators are treated as In, as in
+    // NodeSelectorRequirementsAsLabelSelectors.
+    LabelSelector::SelectorType type = LabelSelector::IN_SET;
+    const string& operator_type = nsm.operator_();
+    if (operator_type == "NotIn")
+      type = LabelSelector::NOT_IN_SET;
+    else if (operator_type == "Exists")
+      type = LabelSelector::EXISTS_KEY;
+    else if (operator_type == "DoesNotExist")
+      type = LabelSelector::NOT_EXISTS_KEY;
+    else if (operator_type == "Gt")
+      type = LabelSelector::GREATER_THAN;
+    else if (operator_type == "Lt")
+      type = LabelSelector::LESSER_THAN;
+    CompileLabelSelector(nsm.key(), type, nsm.values(), strings,
+                         compiled_selectors);
+  }
+}
+
+int64_t CountIntolerableSoftTaints(const InternedNodeAttributes& node,
+                                   const LabelPredicateProgram& program) {
+  int64_t num_intolerable = 0;
+  for (const auto& taint : node.taints_) {
+    if (taint.effect_ == TAINT_PREFER_NO_SCHEDULE &&
+        !ToleratesSoftTaint(taint, program)) {
+      num_intolerable++;
+    }
+  }
+  return num_intolerable;
+}
+
+bool HasMatchingTolerationforNodeTaints(const InternedNodeAttributes& node,
+                                        const LabelPredicateProgram& program) {
+  for (const auto& taint : node.taints_) {
+    if ((taint.effect_ == TAINT_NO_SCHEDULE ||
+         taint.effect_ == TAINT_NO_EXECUTE) &&
+        !ToleratesHardTaint(taint, program)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void InternNodeAttributes(const ResourceDescriptor& rd,
+                          LabelStringTable* strings,
+                          InternedNodeAttributes* node) {
+  CHECK_NOTNULL(strings);
+  CHECK_NOTNULL(node);
+  node->labels_.clear();
+  node->taints_.clear();
+  for (const auto& label : rd.labels()) {
+    uint32_t key = strings->Intern(label.key());
+    if (FindLabelValue(*node, key)) {
+      // Only the first value of a key counts.
+      continue;
+    }
+    pair<uint32_t, uint32_t> interned_label(key,
+                                            strings->Intern(label.value()));
+    node->labels_.insert(lower_bound(node->labels_.begin(),
+                                     node->labels_.end(), interned_label),
+                         interned_label);
+  }
+  for (const auto& taint : rd.taints()) {
+    InternedTaint interned_taint = {strings->Intern(taint.key()),
+                                    strings->Intern(taint.value()),
+                                    TaintEffectFromString(taint.effect())};
+    node->taints_.push_back(interned_taint);
+  }
+}
+
+bool ParseLabelNumber(const string& str, int64_t* number) {
+  if (str.empty()) {
+    return false;
+  }
+  char* end;
+  errno = 0;
+  long long value = strtoll(str.c_str(), &end, 10);  // NOLINT
+  if (errno != 0 || *end != '\0') {
+    return false;
+  }
+  *number = static_cast<int64_t>(value);
+  return true;
+}
+
+int64_t PreferredNodeAffinityWeight(const InternedNodeAttributes& node,
+                                    const LabelPredicateProgram& program,
+                                    const LabelStringTable& strings) {
+  int64_t sum_of_weights = 0;
+  for (const auto& preferred_term : program.preferred_terms_) {
+    if (SatisfiesLabelSelectors(node, preferred_term.second, strings)) {
+      sum_of_weights += preferred_term.first;
+    }
+  }
+  return sum_of_weights;
+}
+
+bool SatisfiesLabelSelectors(const InternedNodeAttributes& node,
+                             const CompiledLabelSelectors_t& selectors,
+                             const LabelStringTable& strings) {
+  for (const auto& selector : selectors) {
+    if (!SatisfiesLabelSelector(node, selector, strings)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SatisfiesNodeSelectorAndNodeAffinity(const InternedNodeAttributes& node,
+                                          const LabelPredicateProgram& program,
+                                          const LabelStringTable& strings) {
+  if (!SatisfiesLabelSelectors(node, program.node_selector_, strings)) {
+    return false;
+  }
+  if (!program.has_required_terms_) {
+    return true;
+  }
+  for (const auto& term : program.required_terms_) {
+    if (!term.empty() && SatisfiesLabelSelectors(node, term, strings)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ToleratesHardTaint(const InternedTaint& taint,
+                        const LabelPredicateProgram& program) {
+  if (program.tolerates_all_hard_taints_) {
+    return true;
+  }
+  // An Exists toleration for the key and effect tolerates the taint.
+  // Otherwise, the first Equal toleration for them decides.
+  const CompiledToleration* equal_toleration = NULL;
+  for (const auto& toleration : program.hard_tolerations_) {
+    if (toleration.key_ != taint.key_ || toleration.effect_ != taint.effect_) {
+      continue;
+    }
+    if (toleration.exists_) {
+      return true;
+    }
+    if (!equal_toleration) {
+      equal_toleration = &toleration;
+    }
+  }
+  return equal_toleration && equal_toleration->value_ == taint.value_;
+}
+
+bool ToleratesSoftTaint(const InternedTaint& taint,
+                        const LabelPredicateProgram& program) {
+  if (program.tolerates_all_soft_taints_) {
+    return true;
+  }
+  // As for hard taints, but soft tolerations match on the key only.
+  const CompiledToleration* equal_toleration = NULL;
+  for (const auto& toleration : program.soft_tolerations_) {
+    if (toleration.key_ != taint.key_) {
+      continue;
+    }
+    if (toleration.exists_) {
+      return true;
+    }
+    if (!equal_toleration) {
+      equal_toleration = &toleration;
+    }
+  }
+  return equal_toleration && equal_toleration->value_ == taint.value_;
+}
+
 }  // namespace scheduler
 }  // namespace firmament
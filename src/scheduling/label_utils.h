@@ -21,8 +21,11 @@
 #ifndef FIRMAMENT_SCHEDULING_LABEL_UTILS_H
 #define FIRMAMENT_SCHEDULING_LABEL_UTILS_H
 
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "base/affinity.pb.h"
 #include "base/common.h"
@@ -35,6 +38,115 @@
 
 namespace firmament {
 namespace scheduler {
+
+// Interns label and taint strings into small integer ids, so that compiled
+// predicates compare ids rather than strings.
+class LabelStringTable {
+ public:
+  uint32_t Intern(const string& str);
+  inline const string& String(uint32_t id) const {
+    return strings_[id];
+  }
+
+ private:
+  unordered_map<string, uint32_t> ids_;
+  vector<string> strings_;
+};
+
+enum TaintEffect {
+  TAINT_NO_SCHEDULE = 0,
+  TAINT_PREFER_NO_SCHEDULE = 1,
+  TAINT_NO_EXECUTE = 2,
+  TAINT_OTHER_EFFECT = 3,
+};
+
+struct InternedTaint {
+  uint32_t key_;
+  uint32_t value_;
+  TaintEffect effect_;
+};
+
+// A machine's labels and taints with their strings interned. The labels are
+// sorted by key, and only the first value of every key is kept.
+struct InternedNodeAttributes {
+  vector<pair<uint32_t, uint32_t>> labels_;
+  vector<InternedTaint> taints_;
+};
+
+struct CompiledLabelSelector {
+  LabelSelector::SelectorType type_;
+  uint32_t key_;
+  // Sorted value ids.
+  vector<uint32_t> values_;
+  // The bound of GREATER_THAN and LESSER_THAN selectors.
+  int64_t threshold_;
+};
+
+typedef vector<CompiledLabelSelector> CompiledLabelSelectors_t;
+
+struct CompiledToleration {
+  uint32_t key_;
+  uint32_t value_;
+  TaintEffect effect_;
+  // True for the Exists operator, false for Equal.
+  bool exists_;
+};
+
+// A task's node selector, node affinity terms and tolerations compiled into
+// predicates over interned machine attributes. Evaluating the program does
+// not allocate memory.
+struct LabelPredicateProgram {
+  CompiledLabelSelectors_t node_selector_;
+  // True if the task has required node affinity terms; a machine must then
+  // satisfy at least one of required_terms_. Terms without match
+  // expressions are empty and match no machine.
+  bool has_required_terms_;
+  vector<CompiledLabelSelectors_t> required_terms_;
+  // (weight, term) pairs of the preferred node affinity terms that can add
+  // to a machine's score.
+  vector<pair<int32_t, CompiledLabelSelectors_t>> preferred_terms_;
+  // Tolerations of NoSchedule and NoExecute taints.
+  bool tolerates_all_hard_taints_;
+  vector<CompiledToleration> hard_tolerations_;
+  // Tolerations of PreferNoSchedule taints.
+  bool tolerates_all_soft_taints_;
+  vector<CompiledToleration> soft_tolerations_;
+};
+
+void CompileLabelPredicates(const TaskDescriptor& td,
+                            LabelStringTable* strings,
+                            LabelPredicateProgram* program);
+void CompileLabelSelectors(const RepeatedPtrField<LabelSelector>& selectors,
+                           LabelStringTable* strings,
+                           CompiledLabelSelectors_t* compiled_selectors);
+void CompileNodeSelectorRequirements(
+    const RepeatedPtrField<NodeSelectorRequirement>& matchExpressions,
+    LabelStringTable* strings, CompiledLabelSelectors_t* compiled_selectors);
+int64_t CountIntolerableSoftTaints(const InternedNodeAttributes& node,
+                                   const LabelPredicateProgram& program);
+bool HasMatchingTolerationforNodeTaints(const InternedNodeAttributes& node,
+                                        const LabelPredicateProgram& program);
+void InternNodeAttributes(const ResourceDescriptor& rd,
+                          LabelStringTable* strings,
+                          InternedNodeAttributes* node);
+// Parses a label value or selector bound as a base 10 integer. Returns false
+// if the string is not a number in its entirety or does not fit.
+bool ParseLabelNumber(const string& str, int64_t* number);
+int64_t PreferredNodeAffinityWeight(const InternedNodeAttributes& node,
+                                    const LabelPredicateProgram& program,
+                                    const LabelStringTable& strings);
+bool SatisfiesLabelSelectors(const InternedNodeAttributes& node,
+                             const CompiledLabelSelectors_t& selectors,
+                             const LabelStringTable& strings);
+bool SatisfiesNodeSelectorAndNodeAffinity(const InternedNodeAttributes& node,
+                                          const LabelPredicateProgram& program,
+                                          const LabelStringTable& strings);
+// Returns true if the program tolerates the NoSchedule or NoExecute taint.
+bool ToleratesHardTaint(const InternedTaint& taint,
+                        const LabelPredicateProgram& program);
+// Returns true if the program tolerates the PreferNoSchedule taint.
+bool ToleratesSoftTaint(const InternedTaint& taint,
+                        const LabelPredicateProgram& program);
 RepeatedPtrField<LabelSelector> NodeSelectorRequirementsAsLabelSelectors(
     const RepeatedPtrField<NodeSelectorRequirement>& matchExpressions);
 bool SatisfiesMatchExpressions(const ResourceDescriptor& rd,
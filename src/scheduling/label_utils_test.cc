@@ -421,6 +421,103 @@ TEST_F(LabelUtilsTest, SatisfiesLabelSelectors_multiple_resource_labels) {
   CHECK_EQ(ret, true);
 }
 
+TEST_F(LabelUtilsTest, CompiledLabelPredicates) {
+  ResourceTopologyNodeDescriptor rtnd;
+  CreateResourceWithLabels(&rtnd, "Machine1", "zone", "a");
+  ResourceDescriptor* rd_ptr = rtnd.mutable_resource_desc();
+  Taint* hard_taint = rd_ptr->add_taints();
+  hard_taint->set_key("gpu");
+  hard_taint->set_value("true");
+  hard_taint->set_effect("NoSchedule");
+  Taint* soft_taint = rd_ptr->add_taints();
+  soft_taint->set_key("spot");
+  soft_taint->set_value("true");
+  soft_taint->set_effect("PreferNoSchedule");
+  LabelStringTable strings;
+  InternedNodeAttributes node;
+  InternNodeAttributes(*rd_ptr, &strings, &node);
+  JobDescriptor jd;
+  TaskDescriptor* td_ptr = CreateTaskWithLabels(&jd, 46, "app", "web");
+  // Two default tolerations, which do not tolerate the hard taint.
+  for (uint32_t index = 0; index < DEFAULT_TOLERATIONS; ++index) {
+    Toleration* toleration = td_ptr->add_tolerations();
+    toleration->set_key("not-ready");
+    toleration->set_operator_("Exists");
+    toleration->set_effect("NoExecute");
+  }
+  NodeSelectorTerm* preference =
+      td_ptr->mutable_affinity()->mutable_node_affinity()
+          ->add_preferredduringschedulingignoredduringexecution()
+          ->mutable_preference();
+  td_ptr->mutable_affinity()->mutable_node_affinity()
+      ->mutable_preferredduringschedulingignoredduringexecution(0)
+      ->set_weight(5);
+  NodeSelectorRequirement* requirement = preference->add_matchexpressions();
+  requirement->set_key("zone");
+  requirement->set_operator_("In");
+  requirement->add_values("a");
+  LabelPredicateProgram program;
+  CompileLabelPredicates(*td_ptr, &strings, &program);
+  EXPECT_TRUE(SatisfiesNodeSelectorAndNodeAffinity(node, program, strings));
+  EXPECT_EQ(5, PreferredNodeAffinityWeight(node, program, strings));
+  EXPECT_FALSE(HasMatchingTolerationforNodeTaints(*rd_ptr, *td_ptr));
+  EXPECT_FALSE(HasMatchingTolerationforNodeTaints(node, program));
+  EXPECT_EQ(1, CountIntolerableSoftTaints(node, program));
+  // Tolerate the hard taint by value and the soft taint by key.
+  Toleration* gpu_toleration = td_ptr->add_tolerations();
+  gpu_toleration->set_key("gpu");
+  gpu_toleration->set_operator_("Equal");
+  gpu_toleration->set_value("true");
+  Toleration* spot_toleration = td_ptr->add_tolerations();
+  spot_toleration->set_key("spot");
+  spot_toleration->set_operator_("Exists");
+  spot_toleration->set_effect("PreferNoSchedule");
+  CompileLabelPredicates(*td_ptr, &strings, &program);
+  EXPECT_TRUE(HasMatchingTolerationforNodeTaints(*rd_ptr, *td_ptr));
+  EXPECT_TRUE(HasMatchingTolerationforNodeTaints(node, program));
+  EXPECT_EQ(0, CountIntolerableSoftTaints(node, program));
+  // A node selector on another zone excludes the machine.
+  LabelSelector* label_selector = td_ptr->add_label_selectors();
+  label_selector->set_type(LabelSelector::NOT_IN_SET);
+  label_selector->set_key("zone");
+  label_selector->add_values("a");
+  CompileLabelPredicates(*td_ptr, &strings, &program);
+  EXPECT_FALSE(SatisfiesNodeSelectorAndNodeAffinity(node, program, strings));
+  EXPECT_FALSE(SatisfiesNodeSelectorAndNodeAffinity(*rd_ptr, *td_ptr));
+}
+
+// Numeric selectors with a bound that is not a number match no machine, and
+// machine values that are not numbers match neither bound.
+TEST_F(LabelUtilsTest, CompiledNumericLabelSelectors) {
+  ResourceTopologyNodeDescriptor rtnd;
+  CreateResourceWithLabels(&rtnd, "Machine1", "cores", "8");
+  ResourceTopologyNodeDescriptor other_rtnd;
+  CreateResourceWithLabels(&other_rtnd, "Machine2", "cores", "many");
+  LabelStringTable strings;
+  InternedNodeAttributes node;
+  InternNodeAttributes(rtnd.resource_desc(), &strings, &node);
+  InternedNodeAttributes other_node;
+  InternNodeAttributes(other_rtnd.resource_desc(), &strings, &other_node);
+  RepeatedPtrField<LabelSelector> selectors;
+  LabelSelector* selector = selectors.Add();
+  selector->set_type(LabelSelector::GREATER_THAN);
+  selector->set_key("cores");
+  selector->add_values("4");
+  CompiledLabelSelectors_t compiled_selectors;
+  CompileLabelSelectors(selectors, &strings, &compiled_selectors);
+  EXPECT_TRUE(SatisfiesLabelSelectors(node, compiled_selectors, strings));
+  EXPECT_FALSE(SatisfiesLabelSelectors(other_node, compiled_selectors,
+                                       strings));
+  selector->set_values(0, "four");
+  compiled_selectors.clear();
+  CompileLabelSelectors(selectors, &strings, &compiled_selectors);
+  EXPECT_FALSE(SatisfiesLabelSelectors(node, compiled_selectors, strings));
+  selector->clear_values();
+  compiled_selectors.clear();
+  CompileLabelSelectors(selectors, &strings, &compiled_selectors);
+  EXPECT_FALSE(SatisfiesLabelSelectors(node, compiled_selectors, strings));
+}
+
 }  // namespace scheduler
 }  // namespace firmament
 
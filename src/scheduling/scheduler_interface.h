@@ -51,7 +51,8 @@ using store::ObjectStoreInterface;
 
 struct SchedulerStats {
   SchedulerStats() : algorithm_runtime_(numeric_limits<uint64_t>::max()),
-    scheduler_runtime_(0ULL), total_runtime_(0ULL) {
+    scheduler_runtime_(0ULL), total_runtime_(0ULL),
+    solver_missed_deadline_(false) {
   }
   // Accounts only the algorithmic part of the scheduler (in u-sec).
   uint64_t algorithm_runtime_;
@@ -62,6 +63,12 @@ struct SchedulerStats {
   // writing it, running the solver, reading the output and updating again
   // the graph.
   uint64_t total_runtime_;
+  // Name of the solver whose result was used, if several solvers were raced
+  // against each other.
+  string solver_;
+  // True if the solver did not finish by its deadline, in which case the
+  // scheduling decisions are not optimal.
+  bool solver_missed_deadline_;
 };
 
 class SchedulerInterface : public PrintableInterface {
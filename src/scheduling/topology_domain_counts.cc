@@ -0,0 +1,234 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/topology_domain_counts.h"
+
+#include "misc/map-util.h"
+
+namespace firmament {
+
+// Adds delta to the count of the key, and removes the key once its count
+// drops to zero.
+static void AdjustCount(unordered_map<string, uint64_t>* counts,
+                        const string& key, int64_t delta) {
+  uint64_t& count = (*counts)[key];
+  CHECK(delta >= 0 || count >= static_cast<uint64_t>(-delta));
+  count += delta;
+  if (count == 0) {
+    counts->erase(key);
+  }
+}
+
+bool DomainPodCounts::HasLabelKey(const string& key) const {
+  return label_keys_.find(key) != label_keys_.end();
+}
+
+bool DomainPodCounts::HasLabelValue(const string& key,
+                                    const string& value) const {
+  const unordered_map<string, uint64_t>* values =
+    FindOrNull(label_values_, key);
+  return values && values->find(value) != values->end();
+}
+
+bool DomainPodCounts::HasNamespace(const string& task_namespace) const {
+  return namespaces_.find(task_namespace) != namespaces_.end();
+}
+
+void TopologyDomainCounts::AddOrUpdateMachine(ResourceID_t res_id,
+                                              const ResourceDescriptor& rd) {
+  MachineLabels_t labels;
+  unordered_set<string> label_keys;
+  for (const auto& label : rd.labels()) {
+    // Only the first value of a duplicate key counts, like in DomainCounts.
+    if (label_keys.insert(label.key()).second) {
+      labels.push_back(pair<string, string>(label.key(), label.value()));
+    }
+  }
+  DomainPodCounts* counts = FindOrNull(machine_counts_, res_id);
+  if (!counts) {
+    InsertIfNotPresent(&machine_counts_, res_id, DomainPodCounts());
+    InsertIfNotPresent(&machine_labels_, res_id, labels);
+    return;
+  }
+  MachineLabels_t* old_labels = FindOrNull(machine_labels_, res_id);
+  CHECK_NOTNULL(old_labels);
+  if (*old_labels == labels) {
+    return;
+  }
+  // The machine has moved to other domains; move its pods along.
+  UpdateDomains(*counts, *old_labels, -1);
+  UpdateDomains(*counts, labels, 1);
+  *old_labels = labels;
+}
+
+void TopologyDomainCounts::AddPod(ResourceID_t machine_res_id,
+                                  const TaskDescriptor& td) {
+  RemovePod(td.uid());
+  if (!FindOrNull(machine_counts_, machine_res_id)) {
+    // Pods are only counted on the machines that are tracked.
+    return;
+  }
+  CountedPod pod;
+  pod.machine_res_id_ = machine_res_id;
+  pod.namespace_ = td.task_namespace();
+  for (const auto& label : td.labels()) {
+    pod.labels_.push_back(pair<string, string>(label.key(), label.value()));
+  }
+  UpdatePod(pod, 1);
+  InsertIfNotPresent(&counted_pods_, td.uid(), pod);
+  machine_pods_[machine_res_id].insert(td.uid());
+}
+
+const DomainPodCounts* TopologyDomainCounts::DomainCounts(
+    ResourceID_t res_id, const string& topology_key) const {
+  const DomainPodCounts* counts = FindOrNull(machine_counts_, res_id);
+  if (!counts || topology_key.empty()) {
+    return counts;
+  }
+  const MachineLabels_t* labels = FindOrNull(machine_labels_, res_id);
+  CHECK_NOTNULL(labels);
+  for (const auto& label : *labels) {
+    if (label.first != topology_key) {
+      continue;
+    }
+    const unordered_map<string, DomainPodCounts>* domains =
+      FindOrNull(domain_counts_, topology_key);
+    const DomainPodCounts* domain_counts =
+      domains ? FindOrNull(*domains, label.second) : NULL;
+    if (!domain_counts) {
+      // No pods have been placed in the domain.
+      static const DomainPodCounts empty_counts;
+      return &empty_counts;
+    }
+    return domain_counts;
+  }
+  return NULL;
+}
+
+void TopologyDomainCounts::RemoveMachine(ResourceID_t res_id) {
+  DomainPodCounts* counts = FindOrNull(machine_counts_, res_id);
+  if (!counts) {
+    return;
+  }
+  MachineLabels_t* labels = FindOrNull(machine_labels_, res_id);
+  CHECK_NOTNULL(labels);
+  UpdateDomains(*counts, *labels, -1);
+  machine_counts_.erase(res_id);
+  machine_labels_.erase(res_id);
+  unordered_set<TaskID_t>* pods = FindOrNull(machine_pods_, res_id);
+  if (pods) {
+    for (const auto& task_id : *pods) {
+      counted_pods_.erase(task_id);
+    }
+    machine_pods_.erase(res_id);
+  }
+}
+
+void TopologyDomainCounts::RemovePod(TaskID_t task_id) {
+  CountedPod* pod = FindOrNull(counted_pods_, task_id);
+  if (!pod) {
+    return;
+  }
+  UpdatePod(*pod, -1);
+  unordered_set<TaskID_t>* pods = FindOrNull(machine_pods_,
+                                             pod->machine_res_id_);
+  CHECK_NOTNULL(pods);
+  pods->erase(task_id);
+  if (pods->empty()) {
+    machine_pods_.erase(pod->machine_res_id_);
+  }
+  counted_pods_.erase(task_id);
+}
+
+void TopologyDomainCounts::UpdateCounts(const CountedPod& pod, int64_t sign,
+                                        DomainPodCounts* counts) {
+  AdjustCount(&counts->namespaces_, pod.namespace_, sign);
+  for (const auto& label : pod.labels_) {
+    AdjustCount(&counts->label_keys_, label.first, sign);
+    unordered_map<string, uint64_t>* values =
+      &counts->label_values_[label.first];
+    AdjustCount(values, label.second, sign);
+    if (values->empty()) {
+      counts->label_values_.erase(label.first);
+    }
+  }
+}
+
+void TopologyDomainCounts::UpdateDomains(
+    const DomainPodCounts& machine_counts,
+    const MachineLabels_t& machine_labels, int64_t sign) {
+  if (machine_counts.empty()) {
+    return;
+  }
+  for (const auto& label : machine_labels) {
+    unordered_map<string, DomainPodCounts>* domains =
+      &domain_counts_[label.first];
+    DomainPodCounts* counts = &(*domains)[label.second];
+    for (const auto& ns_count : machine_counts.namespaces_) {
+      AdjustCount(&counts->namespaces_, ns_count.first,
+                  sign * static_cast<int64_t>(ns_count.second));
+    }
+    for (const auto& key_count : machine_counts.label_keys_) {
+      AdjustCount(&counts->label_keys_, key_count.first,
+                  sign * static_cast<int64_t>(key_count.second));
+    }
+    for (const auto& key_values : machine_counts.label_values_) {
+      unordered_map<string, uint64_t>* values =
+        &counts->label_values_[key_values.first];
+      for (const auto& value_count : key_values.second) {
+        AdjustCount(values, value_count.first,
+                    sign * static_cast<int64_t>(value_count.second));
+      }
+      if (values->empty()) {
+        counts->label_values_.erase(key_values.first);
+      }
+    }
+    if (counts->empty()) {
+      domains->erase(label.second);
+      if (domains->empty()) {
+        domain_counts_.erase(label.first);
+      }
+    }
+  }
+}
+
+void TopologyDomainCounts::UpdatePod(const CountedPod& pod, int64_t sign) {
+  DomainPodCounts* machine_counts =
+    FindOrNull(machine_counts_, pod.machine_res_id_);
+  CHECK_NOTNULL(machine_counts);
+  UpdateCounts(pod, sign, machine_counts);
+  const MachineLabels_t* labels =
+    FindOrNull(machine_labels_, pod.machine_res_id_);
+  CHECK_NOTNULL(labels);
+  for (const auto& label : *labels) {
+    unordered_map<string, DomainPodCounts>* domains =
+      &domain_counts_[label.first];
+    DomainPodCounts* counts = &(*domains)[label.second];
+    UpdateCounts(pod, sign, counts);
+    if (counts->empty()) {
+      domains->erase(label.second);
+      if (domains->empty()) {
+        domain_counts_.erase(label.first);
+      }
+    }
+  }
+}
+
+}  // namespace firmament
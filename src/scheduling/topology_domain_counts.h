@@ -0,0 +1,126 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Counters of the pods placed in every topology domain, by namespace, label
+// key and label/value pair. The domain of a machine for a topology key is the
+// set of machines that carry the same value for the label key (e.g., all the
+// machines of a zone); the empty topology key stands for the machine itself.
+// The counters are updated as pods are placed and leave their machines, so
+// that pod affinity and anti-affinity terms are evaluated with a few lookups
+// rather than by scanning all the pods with matching labels.
+
+#ifndef FIRMAMENT_SCHEDULING_TOPOLOGY_DOMAIN_COUNTS_H
+#define FIRMAMENT_SCHEDULING_TOPOLOGY_DOMAIN_COUNTS_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+#include "base/resource_desc.pb.h"
+#include "base/task_desc.pb.h"
+#include "base/types.h"
+
+namespace firmament {
+
+// The number of pods in a topology domain with every namespace, label key and
+// label/value pair. Entries are removed when their count drops to zero.
+struct DomainPodCounts {
+  bool HasLabelKey(const string& key) const;
+  bool HasLabelValue(const string& key, const string& value) const;
+  bool HasNamespace(const string& task_namespace) const;
+  inline bool empty() const {
+    return namespaces_.empty() && label_keys_.empty();
+  }
+
+  unordered_map<string, uint64_t> namespaces_;
+  unordered_map<string, uint64_t> label_keys_;
+  unordered_map<string, unordered_map<string, uint64_t>> label_values_;
+};
+
+class TopologyDomainCounts {
+ public:
+  /**
+   * Starts tracking the domains of a machine, or moves the machine's pods to
+   * its new domains if its labels have changed. If the machine carries a
+   * label key several times, it is only in the domain of the key's first
+   * value.
+   */
+  void AddOrUpdateMachine(ResourceID_t res_id, const ResourceDescriptor& rd);
+  /**
+   * Counts a pod placed on the machine, if the machine is tracked. A pod that
+   * is already counted is moved to the machine.
+   */
+  void AddPod(ResourceID_t machine_res_id, const TaskDescriptor& td);
+  /**
+   * Returns the counts of the machine's domain for the topology key, or of
+   * the machine itself if the key is empty. Returns NULL if the machine is
+   * not tracked or does not carry the topology key.
+   */
+  const DomainPodCounts* DomainCounts(ResourceID_t res_id,
+                                      const string& topology_key) const;
+  /**
+   * Stops tracking the machine. Its pods are no longer counted in any domain.
+   */
+  void RemoveMachine(ResourceID_t res_id);
+  /**
+   * Stops counting the pod, if it is counted.
+   */
+  void RemovePod(TaskID_t task_id);
+
+ private:
+  // A pod as it was counted, so that it is uncounted in the same way even if
+  // its descriptor has changed in the meantime.
+  struct CountedPod {
+    ResourceID_t machine_res_id_;
+    string namespace_;
+    vector<pair<string, string>> labels_;
+  };
+  typedef vector<pair<string, string>> MachineLabels_t;
+
+  // Adds (or, if sign is negative, subtracts) the counts of a pod.
+  void UpdateCounts(const CountedPod& pod, int64_t sign,
+                    DomainPodCounts* counts);
+  // Adds (or subtracts) all the counts of a machine to those of its domains.
+  void UpdateDomains(const DomainPodCounts& machine_counts,
+                     const MachineLabels_t& machine_labels, int64_t sign);
+  // Updates the counts of the machine and of its domains for the pod.
+  void UpdatePod(const CountedPod& pod, int64_t sign);
+
+  // The counts of every machine, i.e., of the empty topology key.
+  unordered_map<ResourceID_t, DomainPodCounts, boost::hash<ResourceID_t>>
+    machine_counts_;
+  // The labels every machine's pods are counted under.
+  unordered_map<ResourceID_t, MachineLabels_t, boost::hash<ResourceID_t>>
+    machine_labels_;
+  // Topology key -> label value -> counts of the domain.
+  unordered_map<string, unordered_map<string, DomainPodCounts>>
+    domain_counts_;
+  unordered_map<TaskID_t, CountedPod> counted_pods_;
+  // The counted pods on every machine.
+  unordered_map<ResourceID_t, unordered_set<TaskID_t>,
+                boost::hash<ResourceID_t>> machine_pods_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_TOPOLOGY_DOMAIN_COUNTS_H
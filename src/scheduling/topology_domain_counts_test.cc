@@ -0,0 +1,147 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "misc/utils.h"
+#include "scheduling/topology_domain_counts.h"
+
+namespace firmament {
+
+class TopologyDomainCountsTest : public ::testing::Test {
+ protected:
+  ResourceID_t AddMachine(const string& machine_name, const string& zone) {
+    ResourceID_t res_id = GenerateResourceID(machine_name);
+    ResourceDescriptor* rd_ptr = &machines_[res_id];
+    Label* zone_label = rd_ptr->add_labels();
+    zone_label->set_key("zone");
+    zone_label->set_value(zone);
+    counts_.AddOrUpdateMachine(res_id, *rd_ptr);
+    return res_id;
+  }
+
+  void AddPod(TaskID_t task_id, ResourceID_t res_id, const string& app) {
+    TaskDescriptor td;
+    td.set_uid(task_id);
+    td.set_task_namespace("default");
+    Label* app_label = td.add_labels();
+    app_label->set_key("app");
+    app_label->set_value(app);
+    counts_.AddPod(res_id, td);
+  }
+
+  TopologyDomainCounts counts_;
+  unordered_map<ResourceID_t, ResourceDescriptor,
+                boost::hash<ResourceID_t>> machines_;
+};
+
+TEST_F(TopologyDomainCountsTest, MachineAndZoneDomains) {
+  ResourceID_t machine1 = AddMachine("Machine1", "a");
+  ResourceID_t machine2 = AddMachine("Machine2", "a");
+  ResourceID_t machine3 = AddMachine("Machine3", "b");
+  AddPod(1, machine1, "db");
+  // The pod is in machine1's own domain and in the domain of zone a.
+  EXPECT_TRUE(counts_.DomainCounts(machine1, "")->HasLabelValue("app", "db"));
+  EXPECT_TRUE(counts_.DomainCounts(machine2, "")->empty());
+  EXPECT_TRUE(counts_.DomainCounts(machine2, "zone")->HasNamespace("default"));
+  EXPECT_TRUE(counts_.DomainCounts(machine2, "zone")->HasLabelKey("app"));
+  EXPECT_FALSE(counts_.DomainCounts(machine2, "zone")->HasLabelValue("app",
+                                                                    "web"));
+  EXPECT_TRUE(counts_.DomainCounts(machine3, "zone")->empty());
+  EXPECT_EQ(NULL, counts_.DomainCounts(machine3, "rack"));
+  // The pod leaves.
+  counts_.RemovePod(1);
+  counts_.RemovePod(1);
+  EXPECT_TRUE(counts_.DomainCounts(machine1, "")->empty());
+  EXPECT_TRUE(counts_.DomainCounts(machine2, "zone")->empty());
+}
+
+TEST_F(TopologyDomainCountsTest, MachineChangesZone) {
+  ResourceID_t machine1 = AddMachine("Machine1", "a");
+  ResourceID_t machine2 = AddMachine("Machine2", "b");
+  AddPod(1, machine1, "db");
+  AddPod(2, machine1, "web");
+  EXPECT_TRUE(counts_.DomainCounts(machine2, "zone")->empty());
+  // Move machine1 to zone b; its pods move along.
+  machines_[machine1].mutable_labels(0)->set_value("b");
+  counts_.AddOrUpdateMachine(machine1, machines_[machine1]);
+  EXPECT_TRUE(counts_.DomainCounts(machine2, "zone")->HasLabelValue("app",
+                                                                   "web"));
+  counts_.RemovePod(2);
+  EXPECT_FALSE(counts_.DomainCounts(machine2, "zone")->HasLabelValue("app",
+                                                                    "web"));
+  EXPECT_TRUE(counts_.DomainCounts(machine2, "zone")->HasLabelValue("app",
+                                                                   "db"));
+  // Removing the machine uncounts its remaining pods.
+  counts_.RemoveMachine(machine1);
+  EXPECT_EQ(NULL, counts_.DomainCounts(machine1, ""));
+  EXPECT_TRUE(counts_.DomainCounts(machine2, "zone")->empty());
+  counts_.RemovePod(1);
+}
+
+TEST_F(TopologyDomainCountsTest, DuplicateLabelKey) {
+  ResourceID_t machine1 = AddMachine("Machine1", "a");
+  ResourceID_t machine2 = AddMachine("Machine2", "b");
+  // Machine1 also carries zone b, after zone a.
+  Label* zone_label = machines_[machine1].add_labels();
+  zone_label->set_key("zone");
+  zone_label->set_value("b");
+  counts_.AddOrUpdateMachine(machine1, machines_[machine1]);
+  AddPod(1, machine1, "db");
+  // The pod is only counted in the domain of the first value.
+  EXPECT_TRUE(counts_.DomainCounts(machine1, "zone")->HasLabelValue("app",
+                                                                   "db"));
+  EXPECT_TRUE(counts_.DomainCounts(machine2, "zone")->empty());
+  counts_.RemovePod(1);
+  EXPECT_TRUE(counts_.DomainCounts(machine1, "zone")->empty());
+}
+
+TEST_F(TopologyDomainCountsTest, RemoveMachineWithPods) {
+  ResourceID_t machine1 = AddMachine("Machine1", "a");
+  ResourceID_t machine2 = AddMachine("Machine2", "a");
+  AddPod(1, machine1, "db");
+  AddPod(2, machine2, "web");
+  // Pod 3 moves from machine1 to machine2.
+  AddPod(3, machine1, "cache");
+  AddPod(3, machine2, "cache");
+  counts_.RemoveMachine(machine1);
+  EXPECT_FALSE(counts_.DomainCounts(machine2, "zone")->HasLabelValue("app",
+                                                                    "db"));
+  EXPECT_TRUE(counts_.DomainCounts(machine2, "zone")->HasLabelValue("app",
+                                                                   "web"));
+  EXPECT_TRUE(counts_.DomainCounts(machine2, "zone")->HasLabelValue("app",
+                                                                   "cache"));
+  // The pods of the removed machine are no longer counted, while those of
+  // the remaining machine still are.
+  counts_.RemovePod(1);
+  counts_.RemovePod(2);
+  counts_.RemovePod(3);
+  EXPECT_TRUE(counts_.DomainCounts(machine2, "zone")->empty());
+  // A machine that is added again starts without pods.
+  machine1 = AddMachine("Machine1", "a");
+  EXPECT_TRUE(counts_.DomainCounts(machine1, "")->empty());
+}
+
+}  // namespace firmament
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -178,6 +178,7 @@ class SimulatorBridge : public scheduler::SchedulingEventNotifierInterface {
   FRIEND_TEST(SimulatorBridgeTest, OnTaskCompletion);
   FRIEND_TEST(SimulatorBridgeTest, OnTaskEviction);
   FRIEND_TEST(SimulatorBridgeTest, OnTaskPlacement);
+  FRIEND_TEST(SimulatorBridgeTest, PipelinedEvictionDuringSolverRun);
   FRIEND_TEST(SimulatorBridgeTest, RemoveMachine);
 
   /**
@@ -21,6 +21,10 @@
 // Tests for the simulator bridge.
 
 #include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
 
 #include "misc/utils.h"
 #include "sim/google_trace_loader.h"
@@ -29,6 +33,11 @@
 #include "sim/trace_utils.h"
 
 DECLARE_string(machine_tmpl_file);
+DECLARE_string(flow_scheduling_binary);
+DECLARE_string(flow_scheduling_solver);
+DECLARE_bool(only_read_assignment_changes);
+DECLARE_bool(pipelined_scheduling);
+DECLARE_string(solver_runtime_accounting_mode);
 DEFINE_string(scheduler, "flow", "The scheduler to use for tests.");
 
 namespace firmament {
@@ -247,6 +256,71 @@ TEST_F(SimulatorBridgeTest, OnTaskPlacement) {
   CHECK_EQ(td_ptr->start_time(), 0);
 }
 
+TEST_F(SimulatorBridgeTest, PipelinedEvictionDuringSolverRun) {
+  // A solver that always places the first task node on the first PU node.
+  string solver_path = "/tmp/firmament_pipelined_test_solver.sh";
+  std::ofstream solver(solver_path.c_str());
+  solver << "#!/bin/sh\n"
+         << "awk '$1 == \"n\" && $4 == 1 && !task { task = $2 } "
+         << "$1 == \"n\" && $4 == 2 && !pu { pu = $2 } "
+         << "$1 == \"c\" && $2 == \"EOI\" { exit } "
+         << "END { print \"m \" task \" \" pu; print \"c EOI\" }'\n";
+  solver.close();
+  CHECK_EQ(chmod(solver_path.c_str(), 0755), 0);
+  FLAGS_pipelined_scheduling = true;
+  FLAGS_flow_scheduling_solver = "custom";
+  FLAGS_flow_scheduling_binary = solver_path;
+  FLAGS_only_read_assignment_changes = true;
+  // The solver does not report its algorithm runtime.
+  FLAGS_solver_runtime_accounting_mode = "solver";
+  TraceTaskIdentifier trace_task_id;
+  trace_task_id.job_id = 1;
+  trace_task_id.task_index = 1;
+  EventDescriptor event_desc;
+  event_desc.set_type(EventDescriptor::TASK_SUBMIT);
+  event_desc.set_requested_ram(1024);
+  event_desc.set_requested_cpu_cores(1000);
+  bridge_->AddMachine(1);
+  bridge_->AddTask(trace_task_id, event_desc);
+  TaskDescriptor* td_ptr =
+    FindPtrOrNull(bridge_->trace_task_id_to_td_, trace_task_id);
+  CHECK_NOTNULL(td_ptr);
+  CHECK(InsertIfNotPresent(&bridge_->task_runtime_,
+                           GenerateTaskIDFromTraceIdentifier(trace_task_id),
+                           UINT64_MAX / 2));
+  SchedulerStats scheduler_stats;
+  // The first round only starts a solver run, and the second round applies
+  // its placement and starts the next run.
+  bridge_->ScheduleJobs(&scheduler_stats);
+  CHECK_EQ(td_ptr->state(), TaskDescriptor::RUNNABLE);
+  bridge_->ScheduleJobs(&scheduler_stats);
+  CHECK_EQ(td_ptr->state(), TaskDescriptor::RUNNING);
+  ResourceID_t pu_res_id =
+    ResourceIDFromString(td_ptr->scheduled_to_resource());
+  ResourceStatus* pu_rs = FindPtrOrNull(*bridge_->resource_map_, pu_res_id);
+  CHECK_NOTNULL(pu_rs);
+  // Evict the task while the run that still sees it running is in flight.
+  bridge_->scheduler_->HandleTaskEviction(td_ptr,
+                                          pu_rs->mutable_descriptor());
+  CHECK_EQ(td_ptr->state(), TaskDescriptor::RUNNABLE);
+  // The in-flight run's placement of the evicted task is stale and must not
+  // be applied.
+  bridge_->ScheduleJobs(&scheduler_stats);
+  CHECK_EQ(td_ptr->state(), TaskDescriptor::RUNNABLE);
+  CHECK(bridge_->scheduler_->BoundTasksForResource(pu_res_id).empty());
+  // The next run considers the task again.
+  bridge_->ScheduleJobs(&scheduler_stats);
+  CHECK_EQ(td_ptr->state(), TaskDescriptor::RUNNING);
+  delete bridge_;
+  bridge_ = NULL;
+  FLAGS_pipelined_scheduling = false;
+  FLAGS_flow_scheduling_solver = "cs2";
+  FLAGS_flow_scheduling_binary = "";
+  FLAGS_only_read_assignment_changes = false;
+  FLAGS_solver_runtime_accounting_mode = "algorithm";
+  unlink(solver_path.c_str());
+}
+
 TEST_F(SimulatorBridgeTest, RemoveMachine) {
   CHECK_EQ(bridge_->resource_map_->size(), 1);
   CHECK_EQ(bridge_->trace_machine_id_to_rtnd_.size(), 0);